@@ -0,0 +1,228 @@
+#pragma once
+
+#include "Mapping/MappingRule.h"
+#include "Mapping/MacroProgram.h"
+#include "Mapping/AxisTransform.h"
+#include "Mapping/MouseStick.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiled profiles.
+//
+// A profile's JSON is compiled once into a flat binary image that is memory-mapped on
+// startup and read in place: the header, rule table, action pool, macro and axis tables and
+// string table are all addressed by offsets from the start of the file, so nothing has to be parsed or fixed up
+// after mapping. The image remembers the size, modification time and content hash of the
+// JSON it was compiled from; ProfileManager recompiles it when those no longer match. The
+// hash catches an edit that keeps the size within the clock's resolution.
+//
+// Layout (little-endian, every section 8-byte aligned):
+//   BinaryProfileHeader
+//   BinaryRule[ruleCount]      in profile order
+//   BinaryAction[actionCount]  each rule's actions are a contiguous run
+//   BinaryMacro[macroCount]    in profile order
+//   MacroStep[stepCount]       each macro's steps are a contiguous run
+//   BinaryAxisTransform[transformCount]
+//   float[pointCount]          custom curve points; each transform's are a contiguous run
+//   BinaryMouseStick[mouseStickCount]  0 or 1
+//   char[stringBytes]          NUL-terminated strings; offset 0 is the empty string
+//
+// Version 2 added the macro tables, version 3 the axis transforms, version 4 the mouse stick,
+// version 5 gestures and chords to the rules, version 6 layers, version 7 toggle and turbo
+// buttons, version 8 the controller slot of each action, version 9 the device model of each
+// rule, version 10 the source's content hash.
+
+struct BinaryProfileHeader {
+    static constexpr uint32_t Magic = 0x46505752; // "RWPF"
+    static constexpr uint16_t CurrentVersion = 10;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t checksum;     // FNV-1a over everything after the header
+    uint32_t nameOffset;   // Into the string table
+    uint64_t sourceSize;   // Size of the JSON this was compiled from
+    int64_t sourceTime;    // Its last write time, in std::filesystem clock ticks
+    uint32_t ruleOffset;
+    uint32_t ruleCount;
+    uint32_t actionOffset;
+    uint32_t actionCount;
+    uint32_t stringOffset;
+    uint32_t stringBytes;
+    uint32_t macroOffset;
+    uint32_t macroCount;
+    uint32_t stepOffset;
+    uint32_t stepCount;
+    uint32_t transformOffset;
+    uint32_t transformCount;
+    uint32_t pointOffset;
+    uint32_t pointCount;
+    uint32_t mouseStickOffset;
+    uint32_t mouseStickCount;
+    uint32_t skippedBindings; // Game-action bindings the compiler could not turn into rules
+    uint32_t sourceHash;      // HashProfileSource of the JSON this was compiled from
+};
+static_assert(sizeof(BinaryProfileHeader) == 104, "binary profile header layout");
+
+struct BinaryChordInput {
+    uint8_t inputType;   // InputType; Unknown = unused
+    uint8_t reserved;
+    uint16_t id;         // ButtonID
+};
+
+struct BinaryRule {
+    uint8_t inputType;   // InputType
+    uint8_t idType;      // InputCondition::IdType
+    uint16_t id;         // ButtonID or AxisID
+    uint32_t firstAction;
+    uint32_t actionCount;
+    uint8_t gesture;     // Gesture
+    uint8_t layer;
+    uint16_t timeMs;
+    BinaryChordInput chord[InputCondition::MaxChordInputs];
+    uint16_t vendorId;   // DeviceModel; 0/0 = any device
+    uint16_t productId;
+};
+static_assert(sizeof(BinaryRule) == 32, "binary rule layout");
+
+struct BinaryAction {
+    enum Kind : uint8_t { Button, Axis, Macro, Layer };
+
+    uint8_t kind;
+    uint8_t mode;        // Button: VirtualButtonAction::Mode
+    uint16_t target;     // VirtualButtonType, VirtualAxisType or layer
+    int32_t value;       // Button: bit 0 = press, bits 16-31 = turbo rate. Axis: the value, -1 = use
+                         // the source value. Layer: LayerAction::Mode
+    uint32_t nameOffset; // Macro name, into the string table
+    uint8_t slot;        // OutputAction::slot
+    uint8_t reserved[3];
+};
+static_assert(sizeof(BinaryAction) == 16, "binary action layout");
+
+struct BinaryMacro {
+    enum Flags : uint32_t { RepeatWhileHeld = 1, CancelOnRelease = 2 };
+
+    uint32_t nameOffset; // Into the string table
+    uint32_t firstStep;
+    uint32_t stepCount;
+    uint32_t flags;
+};
+static_assert(sizeof(BinaryMacro) == 16, "binary macro layout");
+
+struct BinaryAxisTransform {
+    uint16_t axis;  // VirtualAxisType
+    uint8_t curve;  // AxisTransform::Curve
+    uint8_t invert;
+    float radialDeadzone;
+    float deadzone;
+    float antiDeadzone;
+    float exponent;
+    float sensitivity;
+    uint32_t firstPoint;
+    uint32_t pointCount;
+};
+static_assert(sizeof(BinaryAxisTransform) == 32, "binary axis transform layout");
+
+struct BinaryMouseStick {
+    uint8_t enabled;
+    uint8_t stick;     // MouseStickSettings::Stick
+    uint8_t smoothing; // MouseStickSettings::Smoothing
+    uint8_t reserved;
+    float rateHz;
+    float sensitivity;
+    float acceleration;
+    float windowMs;
+    float decayMs;
+    float smoothingMs;
+    float minCutoffHz;
+    float beta;
+    float derivativeCutoffHz;
+};
+static_assert(sizeof(BinaryMouseStick) == 40, "binary mouse stick layout");
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const uint8_t* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// A mapped, validated compiled profile. Accessors read straight from the mapping.
+class BinaryProfile {
+public:
+    // Maps the file and checks its magic, version, bounds and checksum.
+    // Returns false (with a message on std::cerr) if any of them is wrong.
+    bool Open(const std::string& path);
+
+    // Reads just the header and the profile's name, if the file is a current image compiled
+    // from a source of this size and write time. Nothing else is read or checked, so this is
+    // for indexing only; Open still checks the whole image before it is used. False, quietly,
+    // for a missing, foreign or stale image.
+    static bool ReadName(const std::string& path, uint64_t sourceSize, int64_t sourceTime, std::string& name);
+
+    // True if the image was compiled from a source of this size, write time and contents.
+    bool IsCompiledFrom(uint64_t sourceSize, int64_t sourceTime, uint32_t sourceHash) const {
+        return header->sourceSize == sourceSize && header->sourceTime == sourceTime && header->sourceHash == sourceHash;
+    }
+
+    const char* GetName() const { return GetString(header->nameOffset); }
+    uint32_t GetRuleCount() const { return header->ruleCount; }
+    uint32_t GetSkippedBindingCount() const { return header->skippedBindings; }
+    uint32_t GetMacroCount() const { return header->macroCount; }
+    uint32_t GetAxisTransformCount() const { return header->transformCount; }
+    const BinaryRule& GetRule(uint32_t index) const { return rules[index]; }
+    const BinaryAction* GetActions(const BinaryRule& rule) const { return actions + rule.firstAction; }
+    const char* GetString(uint32_t offset) const { return strings + offset; }
+
+    // Builds the engine's rule objects from the image.
+    std::vector<MappingRule> ToRules() const;
+    std::vector<MacroDefinition> ToMacros() const;
+    std::vector<AxisTransform> ToAxisTransforms() const;
+    MouseStickSettings ToMouseStick() const; // Disabled settings if the image has none
+
+private:
+    MappedFile file;
+    const BinaryProfileHeader* header = nullptr;
+    const BinaryRule* rules = nullptr;
+    const BinaryAction* actions = nullptr;
+    const BinaryMacro* macros = nullptr;
+    const MacroStep* steps = nullptr;
+    const BinaryAxisTransform* transforms = nullptr;
+    const float* points = nullptr;
+    const BinaryMouseStick* mouseStick = nullptr;
+    const char* strings = nullptr;
+};
+
+// Serializes a profile into a binary image. `sourceSize`/`sourceTime`/`sourceHash` identify
+// the JSON it came from, and `skippedBindings` is recorded for diagnostics.
+std::vector<uint8_t> CompileBinaryProfile(const std::string& name, const std::vector<MappingRule>& rules,
+                                          const std::vector<MacroDefinition>& macros,
+                                          const std::vector<AxisTransform>& axisTransforms,
+                                          const MouseStickSettings& mouseStick, uint64_t sourceSize, int64_t sourceTime,
+                                          uint32_t sourceHash, uint32_t skippedBindings);
+
+// The content hash an image records for its source JSON (FNV-1a over the file's bytes).
+uint32_t HashProfileSource(const std::string& text);
+
+// Writes an image to disk through a temporary file, so a reader never maps a half-written one.
+bool WriteBinaryProfile(const std::string& path, const std::vector<uint8_t>& image);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// Monotonic, high-resolution time in nanoseconds since an arbitrary fixed point.
+// QueryPerformanceCounter on Windows, std::chrono::steady_clock elsewhere. Every latency
+// measurement and InputEvent::timestamp uses this clock.
+uint64_t MonotonicNanoseconds();
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Mapping/InputEvent.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Hands out the DeviceIndex that InputEvents carry in place of the device handle: the lowest
+// index no present device has, so indices stay small and dense and anything kept per device
+// can be a plain array. An index is the device's until it is removed, and is then handed to
+// the next new device.
+//
+// Handles are looked up in a small open-addressing table (linear probing, at most half full,
+// no tombstones) that never allocates. A lookup is a hash and usually one probe, so there is
+// no cache of the last handle in front of it: with input from several devices interleaved,
+// its mispredicted check and the store on every lookup cost more than they saved.
+//
+// Registration, lookup and removal happen on the capture thread only. Each index also holds
+// the device's model (vendor and product ID), which the mapping thread reads to match rules
+// bound to a model; it is stored before the device's first event is queued.
+class DeviceRegistry {
+public:
+    static_assert(MaxDevices <= 64, "the used indices are kept in one 64-bit mask");
+
+    // The index of `device`, registering it if it is new. NoDeviceIndex for nullptr (input
+    // injected with SendInput) and while MaxDevices devices are present.
+    DeviceIndex GetIndex(PhysicalDeviceID device) {
+        const DeviceIndex index = Find(device);
+        return index == NoDeviceIndex && device != nullptr ? Add(device) : index;
+    }
+
+    // The index of `device` if it is registered, NoDeviceIndex otherwise.
+    DeviceIndex Find(PhysicalDeviceID device) const {
+        for (size_t slot = Home(device);; slot = (slot + 1) & (TableSize - 1)) {
+            const Entry& entry = table[slot];
+            if (entry.handle == device) {
+                return entry.index;
+            }
+            if (entry.handle == nullptr) {
+                return NoDeviceIndex;
+            }
+        }
+    }
+
+    // Forgets `device` and frees its index, which is returned (NoDeviceIndex if the device
+    // was not registered). Its model is cleared.
+    DeviceIndex Remove(PhysicalDeviceID device);
+
+    // Records the model of a registered device; see ParseModel.
+    void SetModel(DeviceIndex index, DeviceModel model);
+
+    // Whether SetModel was called for the device now at `index`, even with an unknown model.
+    bool IsIdentified(DeviceIndex index) const { return index < MaxDevices && ((identified >> index) & 1) != 0; }
+
+    // The model of the device at `index`; unknown for NoDeviceIndex. Any thread.
+    DeviceModel GetModel(DeviceIndex index) const {
+        if (index >= MaxDevices) {
+            return {};
+        }
+        const uint32_t packed = models[index].load(std::memory_order_relaxed);
+        return { static_cast<uint16_t>(packed >> 16), static_cast<uint16_t>(packed) };
+    }
+
+    // The handle of a registered device, nullptr for any other index.
+    PhysicalDeviceID GetHandle(DeviceIndex index) const { return index < MaxDevices ? handles[index] : nullptr; }
+
+    size_t GetCount() const;
+
+    // Reads the vendor and product ID out of a hardware ID or device interface name, e.g.
+    // "HID\VID_045E&PID_028E&REV_0110" or "\\?\HID#VID_046D&PID_C52B&MI_01#...", in either
+    // case. Either part is 0 if it is missing or malformed.
+    static DeviceModel ParseModel(const wchar_t* text, size_t length);
+
+private:
+    static constexpr size_t TableSize = 2 * MaxDevices;
+    static_assert((TableSize & (TableSize - 1)) == 0, "table size must be a power of two");
+
+    struct Entry {
+        PhysicalDeviceID handle = nullptr;
+        DeviceIndex index = NoDeviceIndex;
+    };
+
+    static size_t Home(PhysicalDeviceID device) {
+        // Handles are small integers or aligned pointers; a multiplicative hash spreads
+        // both over the table.
+        const uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(device));
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (TableSize - 1);
+    }
+
+    DeviceIndex Add(PhysicalDeviceID device);
+
+    std::array<Entry, TableSize> table{};
+    std::array<PhysicalDeviceID, MaxDevices> handles{};
+    std::array<std::atomic<uint32_t>, MaxDevices> models{}; // vendorId << 16 | productId
+    uint64_t used = 0;       // Bit N: index N belongs to a present device
+    uint64_t identified = 0; // Bit N: SetModel was called for it
+};
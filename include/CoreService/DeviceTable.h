@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Mapping/InputEvent.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One HID device as the system lists it.
+struct InputDevice {
+    std::wstring name;
+    std::wstring instanceId; // e.g. "HID\VID_045E&PID_028E\7&1A2B3C4D&0&0000"; kept in upper case
+    DeviceModel model;       // From the hardware ID; unknown if it has no VID_/PID_ part
+};
+
+// The HID devices that are present, kept current from arrival and removal notifications
+// instead of by sweeping SetupAPI again on every change.
+//
+// A full sweep is slow (hundreds of milliseconds on some machines), so it runs in the
+// background: BeginSync before starting it, Sync with its result. Notifications that come
+// in between are applied at once and again on top of the sweep, which may have listed the
+// devices before or after they changed. Devices are keyed by instance ID, which Windows
+// compares without regard to case.
+//
+// Any thread; everything takes the table's lock, and nothing here is on the input path.
+class DeviceTable {
+public:
+    struct Change {
+        enum Kind : uint8_t { Added, Removed, Updated };
+        Kind kind;
+        InputDevice device; // As it is now; as it was for Removed
+    };
+
+    // Starts a sweep: from here until Sync, notifications are also kept to be replayed on
+    // top of the sweep.
+    void BeginSync();
+
+    // Replaces the table with a full sweep and the notifications since BeginSync, and
+    // returns how that differs from what the table held, in instance ID order.
+    std::vector<Change> Sync(std::vector<InputDevice> sweep);
+
+    // A device arrived, or its details changed. Returns false if it was already there as is.
+    bool Add(InputDevice device);
+
+    // A device went away. Returns false if it was not there.
+    bool Remove(const std::wstring& instanceId);
+
+    // Copies the device with `instanceId` to `device`; false if there is none.
+    bool Find(const std::wstring& instanceId, InputDevice& device) const;
+
+    // A copy of every device, in instance ID order.
+    std::vector<InputDevice> GetDevices() const;
+    size_t GetCount() const;
+
+    // Whether a full sweep has been applied, i.e. whether devices that are not raw input
+    // devices (which announce themselves) are listed too.
+    bool IsSynced() const;
+
+    // The instance ID in a device interface path, as raw input and device notifications
+    // name devices: "\\?\HID#VID_045E&PID_028E#7&1a2b3c4d&0&0000#{4d1e55b2-...}" is
+    // "HID\VID_045E&PID_028E\7&1A2B3C4D&0&0000". Empty if `path` is not of that form.
+    static std::wstring InstanceIdFromInterface(const wchar_t* path, size_t length);
+
+private:
+    struct Notification {
+        bool added;
+        InputDevice device; // Only the instance ID for a removal
+    };
+
+    // The position of `instanceId` in `list`, or where it would go.
+    static size_t LowerBound(const std::vector<InputDevice>& list, const std::wstring& instanceId);
+
+    // Applies one arrival or removal to `list`; returns whether it changed anything.
+    static bool Apply(std::vector<InputDevice>& list, const Notification& notification);
+
+    static void Normalize(std::wstring& instanceId);
+
+    mutable std::mutex mutex;
+    std::vector<InputDevice> devices; // Sorted by instance ID
+    std::vector<Notification> pending; // Since BeginSync
+    bool syncing = false;
+    bool synced = false;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for objects that readers use without taking locks.
+//
+// A writer publishes a replacement through an atomic pointer and hands the old object to
+// Retire. Readers bracket their use of the pointer with Enter/Exit, which costs two stores
+// and takes no lock. An object retired at epoch E is freed once every reader is either
+// outside its critical section or entered at E or later, because such a reader started
+// after the replacement was published and cannot be holding the old pointer.
+//
+// Readers register once and must each use their own slot from a single thread. Writers may
+// retire from any thread; they are serialized by a mutex, which is fine because swaps are rare.
+class EpochDomain {
+public:
+    static constexpr size_t MaxReaders = 8;
+    static constexpr size_t NoReader = MaxReaders;
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // No reader may be inside a critical section when the domain is destroyed.
+    ~EpochDomain() {
+        for (const auto& retired : retiredObjects) {
+            retired.destroy(retired.object);
+        }
+    }
+
+    // Claims a reader slot. Returns NoReader if all slots are taken.
+    size_t RegisterReader() {
+        const size_t slot = readerCount.fetch_add(1);
+        return slot < MaxReaders ? slot : NoReader;
+    }
+
+    void Enter(size_t reader) {
+        // seq_cst so the slot is visible before the reader loads the protected pointer.
+        readers[reader].epoch.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+
+    void Exit(size_t reader) {
+        readers[reader].epoch.store(Offline, std::memory_order_release);
+    }
+
+    // Schedules `object` for deletion once no reader can still see it. Call after the
+    // pointer readers load has been replaced.
+    template <typename T>
+    void Retire(const T* object) {
+        if (object == nullptr) {
+            return;
+        }
+        const uint64_t epoch = globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        std::lock_guard<std::mutex> lock(retireMutex);
+        retiredObjects.push_back({ object, epoch, [](const void* p) { delete static_cast<const T*>(p); } });
+    }
+
+    // Frees every retired object no reader can still hold. Never blocks on readers.
+    // Returns how many objects are still waiting.
+    size_t Reclaim() {
+        const uint64_t oldestActive = OldestActiveEpoch();
+        std::lock_guard<std::mutex> lock(retireMutex);
+        size_t kept = 0;
+        for (const auto& retired : retiredObjects) {
+            if (retired.epoch <= oldestActive) {
+                retired.destroy(retired.object);
+            } else {
+                retiredObjects[kept++] = retired;
+            }
+        }
+        retiredObjects.resize(kept);
+        return kept;
+    }
+
+private:
+    static constexpr uint64_t Offline = UINT64_MAX;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{ Offline };
+    };
+
+    struct RetiredObject {
+        const void* object;
+        uint64_t epoch;
+        void (*destroy)(const void*);
+    };
+
+    // The smallest epoch any reader entered at, or Offline if no reader is inside.
+    uint64_t OldestActiveEpoch() const {
+        uint64_t oldest = Offline;
+        const size_t count = readerCount.load() < MaxReaders ? readerCount.load() : MaxReaders;
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t epoch = readers[i].epoch.load(std::memory_order_seq_cst);
+            oldest = epoch < oldest ? epoch : oldest;
+        }
+        return oldest;
+    }
+
+    std::atomic<uint64_t> globalEpoch{ 1 };
+    std::atomic<size_t> readerCount{ 0 };
+    ReaderSlot readers[MaxReaders];
+
+    std::mutex retireMutex;
+    std::vector<RetiredObject> retiredObjects;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Mapping/InputEvent.h"
+#include "Mapping/InputEventBatch.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary recordings of the event stream the mapping engine sees, for replaying it
+// deterministically without a window or hardware (see src/Tools/CoreServiceBench.cpp).
+//
+// File layout, little-endian:
+//   header  : magic "IECP", uint16 version, uint16 reserved, uint64 record count
+//   records : 16 bytes each
+//       uint64 timestamp   nanoseconds since the first record
+//       uint8  type        InputType; Unknown marks the end of a frame (one input report)
+//       uint8  device      DeviceIndex of the device, 0xFF for none
+//       uint16 id          ButtonID or AxisID
+//       int32  value       1/0 for buttons, keys and mouse buttons, the value for axes and hats
+//
+// A record holds the same fields in the same order as an InputEvent. Events already carry
+// the small DeviceIndex the registry handed out instead of a handle, which would mean
+// nothing outside the session that recorded it, so devices are stored and loaded as is.
+struct InputCaptureRecord {
+    static constexpr uint32_t Magic = 0x50434549; // "IECP"
+    static constexpr uint16_t Version = 1;
+    static constexpr uint8_t NoDevice = NoDeviceIndex;
+
+    uint64_t timestamp;
+    uint8_t type;
+    uint8_t device;
+    uint16_t id;
+    int32_t value;
+};
+static_assert(sizeof(InputCaptureRecord) == 16, "capture records are 16 bytes on disk");
+
+// Streams events to a capture file as they arrive. Records are buffered and written in
+// blocks; the header's record count is filled in by Close.
+class InputCaptureWriter {
+public:
+    ~InputCaptureWriter();
+
+    bool Open(const std::string& path);
+    bool Close();
+    bool IsOpen() const { return file.is_open(); }
+
+    void Append(const InputEvent& event);
+    void EndFrame(uint64_t timestamp);
+
+    // Appends a batch as the mapping worker dispatches it. Its frame markers are recorded
+    // with the timestamp of the last event before them.
+    void Append(const InputEventBatch& batch);
+
+private:
+    static constexpr size_t BufferedRecords = 4096;
+
+    void Push(InputCaptureRecord record);
+    void FlushBuffer();
+
+    std::ofstream file;
+    std::vector<InputCaptureRecord> buffer;
+    uint64_t recordCount = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    bool haveFirstTimestamp = false;
+    uint64_t lastEventTimestamp = 0; // Of the last event appended, for the frame markers of batches
+};
+
+// Reads a whole capture. Frame markers come back as InputType::Unknown events.
+bool LoadInputCapture(const std::string& path, std::vector<InputEvent>& events);
+
+// Writes a whole capture, e.g. a synthetic stream generated by a tool.
+bool SaveInputCapture(const std::string& path, const std::vector<InputEvent>& events);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A lock-free latency histogram with HDR-style log-linear buckets.
+//
+// Values below 32 ns get a bucket each; above that every power of two is split into 16
+// buckets, so any recorded value is known to within about 6%. Values up to ~68 s are
+// tracked; anything larger lands in the last bucket, although GetMax stays exact.
+// Recording is a couple of relaxed atomic increments, so any thread may record while
+// another one reads percentiles.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SubBucketBits = 5;
+    static constexpr uint64_t LinearLimit = uint64_t{ 1 } << SubBucketBits;        // 32
+    static constexpr uint64_t SubBucketsPerOctave = LinearLimit / 2;                // 16
+    static constexpr unsigned MaxShift = 32;                                        // values < 2^36 ns
+    static constexpr size_t BucketCount = (MaxShift + 1) * SubBucketsPerOctave + SubBucketsPerOctave;
+
+    void Record(uint64_t nanoseconds) {
+        buckets[IndexFor(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        uint64_t currentMax = max.load(std::memory_order_relaxed);
+        while (nanoseconds > currentMax && !max.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t GetCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t GetMax() const { return max.load(std::memory_order_relaxed); }
+
+    // Returns the upper edge of the bucket holding the given percentile (0-100), or 0 if
+    // nothing was recorded. Never more than GetMax().
+    uint64_t GetPercentile(double percentile) const {
+        const uint64_t total = GetCount();
+        if (total == 0) {
+            return 0;
+        }
+        const auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                const uint64_t upper = i + 1 < BucketCount ? LowerBound(i + 1) - 1 : GetMax();
+                return upper < GetMax() ? upper : GetMax();
+            }
+        }
+        return GetMax();
+    }
+
+    static size_t IndexFor(uint64_t value) {
+        if (value < LinearLimit) {
+            return static_cast<size_t>(value);
+        }
+        unsigned shift = HighestBit(value) - (SubBucketBits - 1);
+        if (shift > MaxShift) {
+            return BucketCount - 1;
+        }
+        return shift * SubBucketsPerOctave + static_cast<size_t>(value >> shift);
+    }
+
+    static uint64_t LowerBound(size_t index) {
+        if (index < LinearLimit) {
+            return index;
+        }
+        const size_t shift = index / SubBucketsPerOctave - 1;
+        return (index % SubBucketsPerOctave + SubBucketsPerOctave) << shift;
+    }
+
+private:
+    static unsigned HighestBit(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<unsigned>(index);
+#else
+        return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    }
+
+    std::atomic<uint64_t> buckets[BucketCount] = {};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> max{ 0 };
+};
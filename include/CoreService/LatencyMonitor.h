@@ -0,0 +1,39 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "Mapping/InputEvent.h"
+#include <iosfwd>
+
+// The points along the input path where latency is measured. Each one is timed from the
+// moment the report was captured (InputEvent::timestamp).
+enum class LatencyStage : uint8_t {
+    Decode,   // Report decoded and diffed on the capture thread
+    Dispatch, // Event reached MappingEngine::ProcessInput
+    Action,   // A matching rule's actions were applied to the virtual controller
+    Flush,    // The resulting report was handed to the virtual gamepad
+    Count
+};
+
+// Collects latency histograms per stage, both overall and per physical device.
+// Recording is lock-free, so the capture and mapping threads record into it directly and
+// the histograms can be dumped from any thread while input keeps flowing.
+class LatencyMonitor {
+public:
+    // Devices with an index past this get only the overall histograms.
+    static constexpr size_t MaxTrackedDevices = 16;
+
+    void Record(LatencyStage stage, DeviceIndex device, uint64_t captureTimestamp, uint64_t now);
+
+    const LatencyHistogram& GetHistogram(LatencyStage stage) const {
+        return totals[static_cast<size_t>(stage)];
+    }
+
+    // Writes count, p50, p99, p99.9 and max per stage, overall and for each device seen.
+    void Dump(std::ostream& out) const;
+
+private:
+    static constexpr size_t StageCount = static_cast<size_t>(LatencyStage::Count);
+
+    LatencyHistogram totals[StageCount];
+    LatencyHistogram perDevice[MaxTrackedDevices][StageCount]; // By DeviceIndex
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Asynchronous logging for the input path.
+//
+// A log statement copies its format string pointer and arguments into a fixed-size binary
+// record in a ring buffer owned by the calling thread. It never formats, allocates (apart
+// from the thread's first record, which creates its ring), locks or flushes. A background
+// thread drains all rings, formats the records, each prefixed with the time it was logged,
+// and writes them to the console. If a ring is full the record is dropped and counted
+// instead of waiting. When a thread exits, its ring is drained one last time and freed.
+//
+// Format strings use "{}" placeholders and must be string literals, since only the pointer
+// is stored. String arguments must be literals for the same reason. Anything built at
+// runtime should keep using std::cout/std::cerr outside the hot path.
+//
+// The level is fixed at compile time with CORESERVICE_LOG_LEVEL (see CMakeLists.txt).
+// Statements below it expand to nothing, arguments included.
+
+#define CORESERVICE_LOG_LEVEL_TRACE 0
+#define CORESERVICE_LOG_LEVEL_DEBUG 1
+#define CORESERVICE_LOG_LEVEL_INFO 2
+#define CORESERVICE_LOG_LEVEL_WARNING 3
+#define CORESERVICE_LOG_LEVEL_ERROR 4
+#define CORESERVICE_LOG_LEVEL_OFF 5
+
+#ifndef CORESERVICE_LOG_LEVEL
+#define CORESERVICE_LOG_LEVEL CORESERVICE_LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel : uint8_t { Trace, Debug, Info, Warning, Error };
+
+// One log statement, as stored in a thread's ring.
+struct LogRecord {
+    static constexpr size_t MaxArguments = 4;
+
+    enum ArgumentType : uint8_t { Int, UInt, Double, Bool, Pointer, CString };
+
+    const char* format;
+    uint64_t timestamp; // MonotonicNanoseconds()
+    uint64_t values[MaxArguments];
+    uint8_t types[MaxArguments];
+    uint8_t argumentCount;
+    LogLevel level;
+};
+
+class Logger {
+public:
+    // Starts/stops the background formatting thread. Stop drains everything still queued.
+    static void Start();
+    static void Stop();
+
+    // Records dropped because a thread's ring was full.
+    static uint64_t GetDroppedCount();
+    // Rings still registered: one per thread that has logged, until it exits and its ring
+    // is drained.
+    static size_t GetRingCount();
+
+    template <typename... Args>
+    static void Write(LogLevel level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= LogRecord::MaxArguments, "Too many log arguments");
+        LogRecord record;
+        record.format = format;
+        record.level = level;
+        record.argumentCount = 0;
+        (Encode(record, args), ...);
+        Submit(record);
+    }
+
+private:
+    static void Submit(LogRecord& record);
+
+    template <typename T>
+    static void Encode(LogRecord& record, const T& value) {
+        const uint8_t i = record.argumentCount++;
+        if constexpr (std::is_same<T, bool>::value) {
+            record.types[i] = LogRecord::Bool;
+            record.values[i] = value ? 1 : 0;
+        } else if constexpr (std::is_enum<T>::value) {
+            record.types[i] = LogRecord::Int;
+            record.values[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+        } else if constexpr (std::is_floating_point<T>::value) {
+            record.types[i] = LogRecord::Double;
+            const double d = static_cast<double>(value);
+            static_assert(sizeof(d) == sizeof(record.values[i]), "double must be 64-bit");
+            std::memcpy(&record.values[i], &d, sizeof(d));
+        } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+            record.types[i] = LogRecord::Int;
+            record.values[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral<T>::value) {
+            record.types[i] = LogRecord::UInt;
+            record.values[i] = static_cast<uint64_t>(value);
+        } else if constexpr (std::is_same<typename std::decay<T>::type, const char*>::value ||
+                             std::is_same<typename std::decay<T>::type, char*>::value) {
+            record.types[i] = LogRecord::CString;
+            record.values[i] = reinterpret_cast<uintptr_t>(static_cast<const char*>(value));
+        } else {
+            static_assert(std::is_pointer<T>::value, "Unsupported log argument type");
+            record.types[i] = LogRecord::Pointer;
+            record.values[i] = reinterpret_cast<uintptr_t>(value);
+        }
+    }
+};
+
+#define CORESERVICE_LOG_AT(level, ...) Logger::Write(level, __VA_ARGS__)
+
+#if CORESERVICE_LOG_LEVEL <= CORESERVICE_LOG_LEVEL_TRACE
+#define LOG_TRACE(...) CORESERVICE_LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if CORESERVICE_LOG_LEVEL <= CORESERVICE_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) CORESERVICE_LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if CORESERVICE_LOG_LEVEL <= CORESERVICE_LOG_LEVEL_INFO
+#define LOG_INFO(...) CORESERVICE_LOG_AT(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if CORESERVICE_LOG_LEVEL <= CORESERVICE_LOG_LEVEL_WARNING
+#define LOG_WARNING(...) CORESERVICE_LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#if CORESERVICE_LOG_LEVEL <= CORESERVICE_LOG_LEVEL_ERROR
+#define LOG_ERROR(...) CORESERVICE_LOG_AT(LogLevel::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
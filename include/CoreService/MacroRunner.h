@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Mapping/MacroProgram.h"
+#include "LatencyHistogram.h"
+#include "TimerWheel.h"
+#include <cstddef>
+#include <cstdint>
+
+// Where running macros send their press, release and axis steps.
+class MacroOutput {
+public:
+    virtual ~MacroOutput() = default;
+
+    // One step that is due now. Never a Delay.
+    virtual void PostStep(const MacroStep& step) = 0;
+
+    // Called once after the steps that became due together, so the receiver can send them
+    // as a single update.
+    virtual void EndSteps() = 0;
+
+    // A fixed-rate tick (see MacroScheduler::SetTickInterval), stamped with the time it was
+    // due rather than when it ran. Receivers without periodic work can ignore it.
+    virtual void PostTick(uint64_t /*tickNs*/) {}
+
+    // The one-shot alarm set with MacroScheduler::SetAlarm has gone off; `alarmNs` is the
+    // time it was set for.
+    virtual void PostAlarm(uint64_t /*alarmNs*/) {}
+};
+
+// Runs macros against a clock it is handed, without any threads of its own.
+//
+// Each running macro is an instance from a fixed pool, and each instance owns the timer
+// with the same index in a TimerWheel. An instance executes steps until it reaches a
+// Delay, arms its timer for the end of the delay and goes idle; Advance resumes every
+// instance whose timer is due. Delays are measured from when the previous wait was due
+// rather than from when it actually ended, so scheduling noise does not accumulate over a
+// long or repeating macro. Nothing allocates once the runner is constructed.
+//
+// The same code runs on MacroScheduler's thread against the real clock and, for testing,
+// against any virtual clock a caller cares to advance.
+class MacroRunner {
+public:
+    static constexpr size_t MaxInstances = 256;
+    static constexpr uint64_t DefaultTickNs = 20'000; // 20 us
+
+    explicit MacroRunner(uint64_t startNs, uint64_t tickNs = DefaultTickNs);
+    ~MacroRunner();
+
+    MacroRunner(const MacroRunner&) = delete;
+    MacroRunner& operator=(const MacroRunner&) = delete;
+
+    // Starts macro `macroId` of `program` for the button identified by `trigger`, as of
+    // `startNs`, driving virtual controller `slot`. Steps up to the first Delay are posted
+    // immediately. A macro still running for the same trigger is stopped first. Takes over
+    // one reference to `program` whether or not it starts; returns false if the id is
+    // invalid or every instance is busy.
+    bool Start(const MacroProgram* program, uint32_t macroId, uint64_t trigger, uint64_t startNs, MacroOutput& output,
+               uint8_t slot = 0);
+
+    // The triggering button was released. Repeating macros finish their current pass;
+    // cancel-on-release macros stop at once.
+    void Release(uint64_t trigger, MacroOutput& output);
+
+    // Resumes every macro due at or before `nowNs`.
+    void Advance(uint64_t nowNs, MacroOutput& output);
+
+    // Stops every running macro.
+    void StopAll(MacroOutput& output);
+
+    // When Advance next has something to do; UINT64_MAX if no macro is waiting.
+    uint64_t GetNextWakeNs() const { return timers.GetNextWakeNs(); }
+
+    size_t GetRunningCount() const { return runningCount; }
+
+    // How late each resumed step ran relative to the end of its delay.
+    const LatencyHistogram& GetJitter() const { return jitter; }
+
+private:
+    struct Instance {
+        const MacroProgram* program = nullptr; // nullptr while the instance is free
+        const MacroStep* steps = nullptr;
+        uint32_t stepCount = 0;
+        uint32_t nextStep = 0;
+        uint64_t trigger = 0;
+        uint64_t dueNs = 0;       // When the current wait ends (or ended)
+        uint32_t heldButtons = 0; // Buttons this instance has pressed and not released, by VirtualButtonType
+        bool repeatWhileHeld = false;
+        bool cancelOnRelease = false;
+        bool triggerHeld = false;
+        uint8_t slot = 0;
+        uint32_t nextFree = 0;
+    };
+
+    // Executes steps until the instance waits or finishes.
+    void Run(uint32_t index, MacroOutput& output);
+
+    // Releases whatever the instance still holds and returns it to the pool.
+    void Finish(uint32_t index, MacroOutput& output);
+
+    void Post(const MacroStep& step, uint8_t slot, MacroOutput& output) {
+        MacroStep routed = step;
+        routed.slot = slot;
+        output.PostStep(routed);
+        posted = true;
+    }
+
+    // Calls EndSteps if anything was posted since the last call.
+    void EndSteps(MacroOutput& output);
+
+    TimerWheel timers;
+    Instance instances[MaxInstances];
+    uint32_t firstFree = 0;
+    size_t runningCount = 0;
+    bool posted = false;
+    LatencyHistogram jitter;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "MacroRunner.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+// Runs macros on a dedicated high-resolution scheduler thread.
+//
+// The mapping thread only posts commands (start a macro, trigger released) into a lock-free
+// queue and never waits. The scheduler thread owns a MacroRunner: it applies the commands,
+// resumes macros whose delays have ended, and hands their steps to a MacroOutput. Between
+// steps it sleeps until shortly before the next one is due and spins the rest of the way,
+// because an OS sleep alone overshoots by far more than the sub-millisecond precision
+// macros need. On Windows the sleep uses a high-resolution waitable timer.
+//
+// The thread can also deliver a fixed-rate tick to the same output, for work that has to
+// happen on a steady clock rather than when input arrives (mouse-to-stick output). Ticks are
+// not spun for: being a little late only delays a tick, since it carries the time it was due.
+// Likewise it keeps one alarm, which the mapping side sets to its next gesture deadline so
+// those are timed by this thread instead of by polling.
+//
+// Without Start, nothing runs on its own: the owner calls Poll with whatever clock it likes,
+// which is how macros are exercised under a virtual clock.
+class MacroScheduler {
+public:
+    static constexpr size_t CommandCapacity = 1024;
+
+    // How long before a step is due the thread stops sleeping and starts spinning.
+    static constexpr uint64_t SpinWindowNs = 200'000;
+
+    // `startNs` is the clock's current time; MonotonicNanoseconds() when the thread is used.
+    MacroScheduler(MacroOutput& output, uint64_t startNs, uint64_t tickNs = MacroRunner::DefaultTickNs);
+    ~MacroScheduler();
+
+    MacroScheduler(const MacroScheduler&) = delete;
+    MacroScheduler& operator=(const MacroScheduler&) = delete;
+
+    // Starts the scheduler thread, optionally pinned to `cpuCore` (-1 = not pinned).
+    bool Start(int cpuCore = -1);
+
+    // Stops every running macro (releasing the buttons they hold) and joins the thread.
+    void Stop();
+
+    // Mapping side. Only one thread may call these. `timestampNs` is when the triggering
+    // input was captured; the macro is timed from then (0 = from when the command is seen).
+    // `slot` is the virtual controller the macro drives. A command that does not fit in the
+    // queue is dropped and counted.
+    void StartMacro(const MacroProgram& program, uint32_t macroId, uint64_t trigger, uint64_t timestampNs, uint8_t slot = 0);
+    void ReleaseTrigger(uint64_t trigger);
+
+    // Posts a tick to the output every `intervalNs` (0 = no ticks). Any thread may call this.
+    void SetTickInterval(uint64_t intervalNs);
+
+    // Posts an alarm to the output once `deadlineNs` has passed, replacing any alarm not yet
+    // delivered (UINT64_MAX = none). Any thread may call this.
+    void SetAlarm(uint64_t deadlineNs);
+
+    // Applies queued commands and runs everything due at `nowNs`. This is the scheduler
+    // thread's loop body; call it directly only when the thread is not started.
+    void Poll(uint64_t nowNs);
+
+    // When Poll next has timed work; UINT64_MAX if nothing is waiting.
+    uint64_t GetNextWakeNs() const;
+
+    uint64_t GetDroppedCount() const { return commands.GetOverflowCount(); }
+
+    // How late macro steps ran relative to when they were due.
+    const LatencyHistogram& GetJitter() const { return runner.GetJitter(); }
+    void DumpStats(std::ostream& out) const;
+
+private:
+    struct Command {
+        enum Kind : uint8_t { StartMacro, ReleaseTrigger };
+
+        Kind kind;
+        uint8_t slot;
+        uint32_t macroId;
+        const MacroProgram* program; // Holds a reference for the runner to take over
+        uint64_t trigger;
+        uint64_t timestampNs;
+    };
+
+    void Run(int cpuCore);
+    void PollTick(uint64_t nowNs);
+    void PollAlarm(uint64_t nowNs);
+    void WaitUntil(uint64_t wakeNs, bool spin);
+    void Wake();
+
+    // Drops queued commands without running them, releasing the references they hold.
+    void DiscardCommands();
+
+    MacroOutput& output;
+    MacroRunner runner;
+    SpscRing<Command, CommandCapacity> commands;
+    std::atomic<uint64_t> tickInterval{ 0 };
+    uint64_t nextTickNs = 0; // 0 while ticks are off
+    std::atomic<uint64_t> alarmNs{ UINT64_MAX };
+
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<bool> sleeping{ false };
+#ifdef _WIN32
+    void* wakeEvent = nullptr;
+    void* waitTimer = nullptr;
+#else
+    std::mutex wakeMutex;
+    std::condition_variable wakeSignal;
+#endif
+};
+
+// Identifies the button that triggered a macro, so its release can be routed to it.
+// `device` is the event's DeviceIndex.
+inline uint64_t MacroTrigger(uint8_t device, uint16_t buttonId) {
+    return static_cast<uint64_t>(device) * 0x10000 + buttonId;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "OutputAction.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct GamepadReport;
+
+// How one virtual axis is shaped before it reaches the gamepad, as written in a profile.
+//
+// Stages run in this order, on the value normalized to -1..1 (0..1 for triggers):
+//   radial deadzone  the stick's length is rescaled so the deadzone edge becomes 0; both
+//                    axes of the stick move together, so diagonals keep their direction
+//   deadzone         the same on this axis alone
+//   curve            response curve on the magnitude
+//   anti-deadzone    the smallest magnitude sent once the axis is outside its deadzone,
+//                    to cancel out a deadzone the game applies itself
+//   sensitivity      scales the magnitude, saturating at full deflection
+//   invert           flips the axis (for a trigger, pressed becomes released)
+struct AxisTransform {
+    enum class Curve : uint8_t {
+        Linear,      // out = in
+        Exponential, // out = in ^ exponent
+        Custom       // piecewise linear through `points`
+    };
+
+    VirtualAxisType axis = VirtualAxisType::XBOX_LEFT_STICK_X;
+    float radialDeadzone = 0.0f; // Sticks only. If both axes of a stick set it, the larger wins.
+    float deadzone = 0.0f;
+    float antiDeadzone = 0.0f;
+    Curve curve = Curve::Linear;
+    float exponent = 1.0f;
+    std::vector<float> points; // Custom: outputs at evenly spaced inputs from 0 to 1
+    float sensitivity = 1.0f;
+    bool invert = false;
+};
+
+// The axis transforms of one profile, compiled for the whole report at once.
+//
+// The six gamepad axes are lanes of a structure of arrays: every parameter is an 8-float
+// array indexed by lane (two lanes are padding), so each stage is one operation across all
+// axes. With SSE2 the lanes are processed as two 4-wide vectors; elsewhere the same steps
+// run one lane at a time. Curves are sampled into lookup tables when the set is built and
+// interpolated per lane in both versions.
+//
+// Both versions perform the same IEEE single-precision operations in the same order, and
+// round with the current rounding mode, so they produce bit-identical reports.
+// ApplyReference is a plain per-axis implementation straight from the AxisTransforms that
+// both are checked against.
+class AxisTransformSet {
+public:
+    enum Lane : uint8_t { LeftX, LeftY, RightX, RightY, LeftTrigger, RightTrigger, UsedLanes };
+    static constexpr size_t LaneCount = 8;
+    static constexpr size_t CurvePoints = 65;
+
+    // The identity: reports pass through untouched.
+    AxisTransformSet();
+    explicit AxisTransformSet(const std::vector<AxisTransform>& transforms);
+
+    // True when no axis has a transform, so Apply would change nothing.
+    bool IsIdentity() const { return activeLanes == 0; }
+
+    // Transforms the axes of `report` in place, with SIMD where available.
+    void Apply(GamepadReport& report) const;
+
+    void ApplyScalar(GamepadReport& report) const;
+    void ApplySimd(GamepadReport& report) const; // Falls back to ApplyScalar without SIMD support
+    static bool HasSimd();
+
+    // Reference implementation for checking the other two.
+    static void ApplyReference(const std::vector<AxisTransform>& transforms, GamepadReport& report);
+
+    // The lane of a virtual axis, or UsedLanes if it is not part of the gamepad report.
+    static size_t LaneOf(VirtualAxisType axis);
+
+private:
+    float Interpolate(size_t lane, float magnitude) const;
+
+    alignas(16) float inputScale[LaneCount];  // 1 / full scale
+    alignas(16) float outputScale[LaneCount]; // Full scale
+    alignas(16) float outputMin[LaneCount];
+    alignas(16) float outputMax[LaneCount];
+    alignas(16) float radialDeadzone[LaneCount];
+    alignas(16) float radialScale[LaneCount]; // 1 / (1 - radialDeadzone)
+    alignas(16) float deadzone[LaneCount];
+    alignas(16) float deadzoneScale[LaneCount]; // 1 / (1 - deadzone)
+    alignas(16) float antiDeadzone[LaneCount];
+    alignas(16) float antiDeadzoneScale[LaneCount]; // 1 - antiDeadzone
+    alignas(16) float sensitivity[LaneCount];
+    alignas(16) float invertScale[LaneCount];  // -1 to invert
+    alignas(16) float invertOffset[LaneCount]; // 1 for inverted triggers: out = 1 - in
+    alignas(16) uint32_t activeMask[LaneCount]; // All ones for lanes with a transform
+    alignas(16) uint32_t radialMask[LaneCount]; // All ones for lanes with a radial deadzone
+    std::array<std::array<float, CurvePoints>, LaneCount> curves;
+    uint32_t activeLanes = 0; // Bit per lane
+    uint32_t curveLanes = 0;  // Bit per lane with a non-linear curve
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "MappingRule.h"
+#include "MacroProgram.h"
+#include "AxisTransform.h"
+#include "MouseStick.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Decides what happens when more than one rule matches the same input event.
+enum class MatchPolicy {
+    FirstMatch, // Only the first matching rule (in profile order) is executed.
+    AllMatches  // Every matching rule is executed, in profile order.
+};
+
+// A dispatch-ready, read-only form of a profile's mapping rules.
+//
+// Rules are bucketed by their lookup key (InputType, kind of ID, ButtonID/AxisID) when the
+// set is built. The 16-bit ID space is covered by a two-level direct-indexed table: the high
+// byte of the ID selects a page of 256 buckets and the low byte selects the bucket, so finding
+// the candidates for an event is two array loads no matter how many rules the profile has.
+// Pages that no rule touches all share one empty page, which keeps the table small.
+//
+// Rules with a gesture or a chord are not dispatched through the buckets. Each becomes a
+// gesture machine (run by GestureRunner), and every button it watches gets a listener entry
+// in that button's bucket, so an event reaches exactly the machines that care about it.
+//
+// Profiles with layers get one such index (a DispatchTable) for every combination of their
+// layers, all built here. In each, an input belongs to the highest layer that is on and uses
+// it, and only that layer's rules are in its bucket; inputs an upper layer leaves alone fall
+// through to the layers below. Switching layers is then only a matter of picking another table.
+//
+// The set also carries the profile's macros, axis transforms and mouse-to-stick settings. MacroActions are resolved to
+// indices into the macro program while the set is built, and the set keeps the program alive
+// for as long as it is itself in use.
+class CompiledRuleSet {
+    // Whether a rule's ID is a button or an axis (see IsButtonType).
+    enum IdKind : uint8_t { ButtonKind = 0, AxisKind = 1, IdKindCount = 2 };
+
+    static constexpr size_t InputTypeCount = static_cast<size_t>(InputType::MouseButton) + 1;
+    static constexpr size_t PageSize = 256;
+
+public:
+    // A contiguous run of candidate rules for a single lookup key.
+    struct Bucket {
+        uint32_t first = 0; // Index of the first candidate (see DispatchTable::GetCandidate).
+        uint32_t count = 0; // Number of candidates, in profile order.
+        uint32_t firstListener = 0; // Index of the first gesture listener (see DispatchTable::GetListener).
+        uint32_t listenerCount = 0;
+    };
+
+    // A rule with a gesture or chord, in the form GestureRunner runs it.
+    struct GestureMachine {
+        uint32_t rule;      // Index into GetRules()
+        Gesture gesture;
+        uint8_t fullMask;   // One bit per watched button (bit 0 = the rule's own); all set = chord held
+        uint64_t timeNs;    // The gesture's time limit, defaults applied
+    };
+
+    // One button a machine watches.
+    struct GestureListener {
+        uint32_t machine;
+        uint8_t bit;
+    };
+
+    // Which layers are on, one bit per layer. Bit 0, the base layer, is always set.
+    using LayerMask = uint8_t;
+    static_assert(InputCondition::MaxLayers <= 8, "Layer masks are 8 bits");
+
+    // The rule index for one combination of layers.
+    class DispatchTable {
+    public:
+        // Returns the candidate bucket for an event. Candidates may still need a device check
+        // (see MappingRule::MatchesDevice) because device-specific rules share a key with
+        // device-agnostic ones.
+        const Bucket& Find(const InputEvent& event) const {
+            return Find(event.type, event.IsButton() ? ButtonKind : AxisKind, event.id);
+        }
+
+        const MappingRule& GetCandidate(uint32_t index) const { return rules[candidates[index]]; }
+        const GestureListener& GetListener(uint32_t index) const { return listeners[index]; }
+
+    private:
+        friend class CompiledRuleSet;
+
+        using Page = std::array<Bucket, PageSize>;
+        using Directory = std::array<uint16_t, PageSize>; // High ID byte -> page index (0 = empty page)
+
+        const Bucket& Find(InputType type, IdKind kind, uint16_t id) const {
+            const Directory& directory = directories[static_cast<size_t>(type)][kind];
+            return pages[directory[id >> 8]][id & 0xFF];
+        }
+
+        const MappingRule* rules = nullptr; // The set's rules
+        std::vector<uint32_t> candidates;  // Rule indices grouped by bucket.
+        std::vector<GestureListener> listeners; // Grouped by bucket, like candidates.
+        std::vector<Page> pages = std::vector<Page>(1); // pages[0] is the shared empty page.
+        std::array<std::array<Directory, IdKindCount>, InputTypeCount> directories{};
+    };
+
+    CompiledRuleSet();
+    // Takes over the caller's reference to `macros`, which may be nullptr. `rules` become the
+    // set's own, moved in when the caller passes a temporary.
+    CompiledRuleSet(std::vector<MappingRule> rules, const MacroProgram* macros = nullptr,
+                    const std::vector<AxisTransform>& axisTransforms = {}, const MouseStickSettings& mouseStick = {});
+    // Shares `rules` with whoever else holds them, such as the profile they were read from,
+    // so only the index is built. Rules that start macros are the exception: the set then
+    // keeps its own copy, with the macro names resolved.
+    CompiledRuleSet(std::shared_ptr<const std::vector<MappingRule>> rules, const MacroProgram* macros = nullptr,
+                    const std::vector<AxisTransform>& axisTransforms = {}, const MouseStickSettings& mouseStick = {});
+    ~CompiledRuleSet();
+
+    CompiledRuleSet(const CompiledRuleSet&) = delete;
+    CompiledRuleSet& operator=(const CompiledRuleSet&) = delete;
+
+    // The index to map input with while `layers` are on. Layers the profile does not use are
+    // ignored.
+    const DispatchTable& GetTable(LayerMask layers) const { return tables[tableIndex[(layers & usedLayers) | 1]]; }
+
+    // The layers that have rules, base layer included.
+    LayerMask GetUsedLayers() const { return usedLayers; }
+    bool HasLayers() const { return usedLayers != 1; }
+
+    const GestureMachine& GetMachine(uint32_t index) const { return machines[index]; }
+    size_t GetMachineCount() const { return machines.size(); }
+
+    // Distinguishes sets for state kept outside them; unlike the address, never reused.
+    uint64_t GetGeneration() const { return generation; }
+
+    const std::vector<MappingRule>& GetRules() const { return *rules; }
+    size_t GetRuleCount() const { return rules->size(); }
+
+    // nullptr if the profile has no macros.
+    const MacroProgram* GetMacros() const { return macros; }
+
+    const AxisTransformSet& GetAxisTransforms() const { return axisTransforms; }
+
+    const MouseStickSettings& GetMouseStick() const { return mouseStick; }
+
+    // Whether any rule has a turbo button, which needs the output tick to run.
+    bool HasTurbo() const { return hasTurbo; }
+
+private:
+    // Which layers use each input, keyed like the buckets. Only needed while building.
+    using LayerUse = std::unordered_map<uint32_t, LayerMask>;
+
+    static uint32_t InputKey(InputType type, IdKind kind, uint16_t id) {
+        return static_cast<uint32_t>(type) << 17 | static_cast<uint32_t>(kind) << 16 | id;
+    }
+
+    // Points MacroActions at their macros, rebuilding the rules that start one.
+    void ResolveMacros(std::vector<MappingRule>& ruleList) const;
+    static bool StartsMacro(const MappingRule& rule);
+
+    // Builds the machines and tables once the rules are in place.
+    void Index();
+    void BuildTable(DispatchTable& table, LayerMask layers, const LayerUse& layerUse, const std::vector<uint8_t>& ruleKinds) const;
+
+    std::shared_ptr<const std::vector<MappingRule>> rules;
+    const MacroProgram* macros = nullptr;
+    AxisTransformSet axisTransforms;
+    MouseStickSettings mouseStick;
+    std::vector<GestureMachine> machines;
+    std::vector<DispatchTable> tables;
+    std::array<uint8_t, 256> tableIndex{}; // Layer mask -> index into tables
+    LayerMask usedLayers = 1;
+    bool hasTurbo = false;
+    uint64_t generation;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "InputEvent.h"
+#include "InputSnapshot.h"
+#include <array>
+#include <cstdlib>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Keeps the current state of every control on every physical device and turns new
+// snapshots into change events.
+//
+// Buttons are compared a 64-bit word at a time (XOR of old and new) and only the set bits
+// of the difference are visited, so an idle pad costs a couple of word compares per report.
+//
+// Axes go through a hysteresis filter. An axis that keeps moving the way it last moved is
+// reported at every step, so a stick coming back to rest always ends up reported where it
+// stopped. Only a reversal has to get past the deadband, which is where sensor noise around
+// a held position shows up. An axis that reaches either end of its range is always reported.
+// The largest error left downstream is therefore a reversal of up to the deadband that the
+// stick then stays at.
+//
+// The stored snapshot always reflects what has been reported, so it can also be queried
+// directly, e.g. to check whether a chord's other buttons are already held.
+//
+// Snapshots are kept in a fixed array indexed by DeviceIndex. Events without a device
+// (NoDeviceIndex) share one scratch snapshot that is never reported as a device's state.
+//
+// Not thread-safe. The store belongs to the thread that commits to it (the capture thread,
+// in the service). Anything on another thread has to mirror it from the event stream with
+// Apply instead of reading it.
+class DeviceStateStore {
+public:
+    // Axis reversals of this size or less are ignored. Roughly 0.2% of the full range.
+    static constexpr int32_t DefaultAxisDeadband = 64;
+
+    explicit DeviceStateStore(int32_t axisDeadband = DefaultAxisDeadband) : axisDeadband(axisDeadband) {}
+
+    // Returns the stored state of `device`, a released/centered one if it is new.
+    // Decoders copy this, decode the next report over the copy and pass it to Commit.
+    const InputSnapshot& Get(DeviceIndex device) const { return snapshots[SlotFor(device)]; }
+
+    // Returns the stored state of `device`, or nullptr if it has never reported.
+    const InputSnapshot* Find(DeviceIndex device) const {
+        return device < MaxDevices && ((reported >> device) & 1) != 0 ? &snapshots[device] : nullptr;
+    }
+
+    bool IsButtonPressed(DeviceIndex device, ButtonID button) const {
+        const InputSnapshot* state = Find(device);
+        return state != nullptr && state->IsButtonPressed(button);
+    }
+
+    int32_t GetAxisValue(DeviceIndex device, AxisID axis) const {
+        const InputSnapshot* state = Find(device);
+        return state != nullptr && axis < InputSnapshot::MaxAxes ? state->axes[axis] : 0;
+    }
+
+    // Compares `next` with the stored state of `device`, calls emit(const InputEvent&) for every
+    // button, axis and hat that changed, and stores the result. Returns the number of events.
+    // The events carry `timestamp`, the time the report was captured.
+    template <typename Emit>
+    size_t Commit(DeviceIndex device, const InputSnapshot& next, uint64_t timestamp, Emit&& emit) {
+        return CommitState(device, next, timestamp, true, emit);
+    }
+
+    // Reports every button of `device` released and every axis and hat centered, with no
+    // deadband, then forgets the device (see Remove). For a device that went away.
+    template <typename Emit>
+    size_t Release(DeviceIndex device, uint64_t timestamp, Emit&& emit) {
+        const size_t emitted = CommitState(device, InputSnapshot{}, timestamp, false, emit);
+        Remove(device);
+        return emitted;
+    }
+
+    // Updates the stored state from an event without diffing. Used to mirror the state on
+    // a consumer that only sees the event stream.
+    void Apply(const InputEvent& event) {
+        InputSnapshot& state = snapshots[SlotFor(event.device)];
+        MarkReported(event.device);
+        if (event.type == InputType::Button && event.id < InputSnapshot::MaxButtons) {
+            const uint64_t bit = uint64_t{ 1 } << (event.id % InputSnapshot::ButtonWordBits);
+            uint64_t& word = state.buttons[event.id / InputSnapshot::ButtonWordBits];
+            word = event.IsPressed() ? (word | bit) : (word & ~bit);
+        } else if (event.type == InputType::Axis && event.id < InputSnapshot::MaxAxes) {
+            state.axes[event.id] = event.value;
+        } else if (event.type == InputType::HatSwitch && event.id < InputSnapshot::MaxHats) {
+            state.hats[event.id] = static_cast<int8_t>(event.value);
+        }
+    }
+
+    // Forgets a device, e.g. after it was unplugged, so the next device given its index
+    // starts out released and centered.
+    void Remove(DeviceIndex device) {
+        if (device < MaxDevices) {
+            snapshots[device] = InputSnapshot{};
+            axisDirections[device] = {};
+            reported &= ~(uint64_t{ 1 } << device);
+        }
+    }
+
+private:
+    static constexpr int32_t AxisMin = -32768;
+    static constexpr int32_t AxisMax = 32767;
+
+    static_assert(MaxDevices <= 64, "the reported devices are kept in one 64-bit mask");
+    static constexpr size_t Scratch = MaxDevices; // The snapshot of events without a device
+
+    static size_t SlotFor(DeviceIndex device) { return device < MaxDevices ? device : Scratch; }
+
+    void MarkReported(DeviceIndex device) {
+        if (device < MaxDevices) {
+            reported |= uint64_t{ 1 } << device;
+        }
+    }
+
+    // Commit, with the axis filter only when `filterAxes` is set.
+    template <typename Emit>
+    size_t CommitState(DeviceIndex device, const InputSnapshot& next, uint64_t timestamp, bool filterAxes, Emit& emit) {
+        InputSnapshot& stored = snapshots[SlotFor(device)];
+        MarkReported(device);
+        size_t emitted = 0;
+
+        for (size_t word = 0; word < InputSnapshot::ButtonWords; ++word) {
+            uint64_t changed = stored.buttons[word] ^ next.buttons[word];
+            while (changed != 0) {
+                const uint32_t bit = CountTrailingZeros(changed);
+                const auto button = static_cast<ButtonID>(word * InputSnapshot::ButtonWordBits + bit);
+                emit(InputEvent::Button(device, InputType::Button, button, ((next.buttons[word] >> bit) & 1) != 0, timestamp));
+                ++emitted;
+                changed &= changed - 1;
+            }
+            stored.buttons[word] = next.buttons[word];
+        }
+
+        int8_t* directions = axisDirections[SlotFor(device)].data();
+        for (size_t axis = 0; axis < InputSnapshot::MaxAxes; ++axis) {
+            const int32_t delta = next.axes[axis] - stored.axes[axis];
+            if (delta == 0) {
+                continue;
+            }
+            const int8_t direction = delta > 0 ? 1 : -1;
+            const bool atEnd = next.axes[axis] <= AxisMin || next.axes[axis] >= AxisMax;
+            if (filterAxes && direction != directions[axis] && std::abs(delta) <= axisDeadband && !atEnd) {
+                continue;
+            }
+            directions[axis] = direction;
+            stored.axes[axis] = next.axes[axis];
+            emit(InputEvent::Axis(device, InputType::Axis, static_cast<AxisID>(axis), next.axes[axis], timestamp));
+            ++emitted;
+        }
+
+        for (size_t hat = 0; hat < InputSnapshot::MaxHats; ++hat) {
+            if (next.hats[hat] != stored.hats[hat]) {
+                stored.hats[hat] = next.hats[hat];
+                emit(InputEvent::Axis(device, InputType::HatSwitch, static_cast<AxisID>(hat), next.hats[hat], timestamp));
+                ++emitted;
+            }
+        }
+
+        return emitted;
+    }
+
+    static uint32_t CountTrailingZeros(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return static_cast<uint32_t>(index);
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+    }
+
+    int32_t axisDeadband;
+    std::array<InputSnapshot, MaxDevices + 1> snapshots{};
+    // The way each axis last moved when it was reported: 1 up, -1 down, 0 not yet.
+    std::array<std::array<int8_t, InputSnapshot::MaxAxes>, MaxDevices + 1> axisDirections{};
+    uint64_t reported = 0; // Bit N: device N has reported since it was added
+};
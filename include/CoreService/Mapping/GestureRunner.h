@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CompiledRuleSet.h"
+#include "../TimerWheel.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Runs the gesture machines of a CompiledRuleSet: chords, tap vs. long press, double tap and
+// release-only bindings.
+//
+// Every machine is the same small finite-state machine, driven by a constant transition
+// table indexed by (gesture, state, symbol). The symbols are:
+//   Down     the machine's buttons have all become held (for a plain gesture, its one button)
+//   Up       they no longer all are
+//   Timeout  the gesture's time limit has run out
+// A button event only touches the machines listening to that button, which the rule set
+// lists next to the button's plain rules, so an event costs the same however many chords and
+// gestures the profile has. Time limits are timers on one wheel shared by all machines; the
+// runner is advanced to each event's capture time and, between events, when the wheel's next
+// deadline passes. Nothing polls.
+//
+// The runner does not act on anything itself. Each Press or Release a machine produces is
+// appended to the firings, for the mapping engine to run the rule's actions with.
+class GestureRunner {
+public:
+    // Timer resolution; gesture limits are set in milliseconds.
+    static constexpr uint64_t TickNs = 1'000'000;
+
+    struct Firing {
+        uint32_t machine;
+        bool press;
+        DeviceIndex device; // Whose button completed the gesture
+        uint64_t timeNs;
+    };
+
+    // Switches to `set`'s machines if they are not the ones being run, with every machine
+    // idle. `nowNs` is the current time.
+    void Bind(const CompiledRuleSet& set, uint64_t nowNs);
+
+    // Feeds a button event to the machines in `bucket`, the event's bucket in `table` (one of
+    // the bound set's tables). `model` is that of the event's device.
+    void OnButton(const CompiledRuleSet& set, const CompiledRuleSet::DispatchTable& table, const CompiledRuleSet::Bucket& bucket,
+                  DeviceIndex device, DeviceModel model, bool pressed, uint64_t timeNs);
+
+    // Runs the timeouts due at or before `nowNs`.
+    void Advance(const CompiledRuleSet& set, uint64_t nowNs);
+
+    // When Advance next has work to do; UINT64_MAX if no timer is running.
+    uint64_t GetNextWakeNs() const { return timers ? timers->GetNextWakeNs() : UINT64_MAX; }
+
+    const std::vector<Firing>& GetFirings() const { return firings; }
+    void ClearFirings() { firings.clear(); }
+
+private:
+    struct MachineState {
+        uint8_t held = 0;  // Watched buttons currently down, one bit each
+        uint8_t state = 0; // Idle
+        DeviceIndex device = NoDeviceIndex;
+    };
+
+    void Step(const CompiledRuleSet& set, uint32_t machine, uint8_t symbol, uint64_t timeNs);
+
+    // Timers 2m and 2m+1 are machine m's time limit and the end of its pulse.
+    uint32_t GestureTimer(uint32_t machine) const { return machine * 2; }
+    uint32_t PulseTimer(uint32_t machine) const { return machine * 2 + 1; }
+
+    uint64_t generation = 0;
+    std::vector<MachineState> machines;
+    std::unique_ptr<TimerWheel> timers;
+    std::vector<Firing> firings;
+};
+
+// How long a Release or Tap gesture holds its output down. Long enough for any game to see
+// the press at its own polling rate.
+constexpr uint64_t GesturePulseNs = 40'000'000;
+
+// The time limit of a gesture whose condition leaves timeMs at 0.
+constexpr uint64_t GestureDefaultTimeNs(Gesture gesture) {
+    switch (gesture) {
+        case Gesture::Tap:
+            return 200'000'000;
+        case Gesture::LongPress:
+            return 500'000'000;
+        case Gesture::DoubleTap:
+            return 250'000'000;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "InputSnapshot.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// HID report decoding.
+//
+// A device's report descriptor is parsed once, when the device is first seen, and compiled
+// into an HidExtractionPlan: flat arrays of bit offsets, sizes and scaling factors for every
+// button, axis and hat the device reports. Decoding a report is then a straight walk over
+// those arrays that writes into an InputSnapshot. It does not allocate and has almost no
+// branches. Nothing in here depends on Windows, so the parser and the plans can be exercised
+// against captured descriptor/report bytes on any platform.
+//
+// Control IDs are assigned from HID usages so they are stable across devices:
+//   - Button page (0x09) usage N          -> ButtonID N - 1
+//   - Generic Desktop X, Y, Z, Rx, Ry, Rz,
+//     Slider, Dial, Wheel (0x30-0x38)     -> AxisID 0-8
+//   - Any other absolute value usage      -> the next free AxisID from 9, in descriptor order
+//   - Generic Desktop Hat switch (0x39)   -> hat 0, 1, ... in order within each report
+
+// Describes one control found in the descriptor. Kept alongside the plan for diagnostics
+// and for binding profiles to specific usages; the decode loop does not read it.
+struct HidControlInfo {
+    enum class Kind : uint8_t { Button, Axis, Hat };
+
+    Kind kind;
+    uint8_t reportId;
+    uint16_t controlId; // ButtonID, AxisID or hat index
+    uint16_t usagePage;
+    uint16_t usage;
+    uint32_t bitOffset; // From the start of the report, including the report ID byte if present
+    uint8_t bitSize;
+    int32_t logicalMin;
+    int32_t logicalMax;
+};
+
+class HidExtractionPlan {
+public:
+    // Reports longer than this are rejected by Decode. Large enough for every common
+    // gamepad, including DualSense over Bluetooth (78 bytes).
+    static constexpr size_t MaxReportBytes = 256;
+
+    // Decodes one input report into `state`, updating only the controls carried by that
+    // report's ID. Returns false if the report is unknown to the plan or shorter than the
+    // descriptor says it should be; `state` is left untouched in that case.
+    bool Decode(const uint8_t* report, size_t size, InputSnapshot& state) const;
+
+    bool IsEmpty() const { return controls.empty(); }
+    bool HasReportIdPrefix() const { return hasReportIdPrefix; }
+    const std::vector<HidControlInfo>& GetControls() const { return controls; }
+
+private:
+    friend class HidPlanBuilder;
+
+    // A run of 1-bit buttons that sit next to each other in the report and in the bitset.
+    // The whole run is moved with one shift and mask.
+    struct ButtonRun {
+        uint32_t bitOffset;
+        uint8_t bitCount;
+        uint8_t word;  // Bitset word the run lands in
+        uint8_t shift; // Bit position of the run within that word
+        uint64_t mask; // Bits of that word owned by the run
+    };
+
+    // A button array slot: the field holds the index of a pressed button, or an
+    // out-of-range value when that slot is empty.
+    struct ButtonSlot {
+        uint32_t bitOffset;
+        uint8_t bitSize;
+        uint8_t firstButton;
+        uint8_t buttonCount;
+        int32_t logicalMin;
+    };
+
+    // An absolute axis. The raw value is sign-extended (signShift is 0 for unsigned fields)
+    // and rescaled from the logical range to -32768..32767 with a 16.16 fixed-point factor.
+    struct AxisField {
+        uint32_t bitOffset;
+        uint8_t bitSize;
+        uint8_t signShift;
+        uint8_t target;
+        int32_t logicalMin;
+        int64_t scale;
+    };
+
+    // A hat switch. Values outside the logical range mean "centered". 4-way hats are
+    // widened to the 8-way numbering with directionShift.
+    struct HatField {
+        uint32_t bitOffset;
+        uint8_t bitSize;
+        uint8_t target;
+        uint8_t directionShift;
+        int32_t logicalMin;
+        uint32_t directionCount;
+    };
+
+    // Everything carried by one report ID, as ranges into the arrays below.
+    struct ReportProgram {
+        uint32_t minimumBytes = 0;
+        uint16_t firstRun = 0, runCount = 0;
+        uint16_t firstSlot = 0, slotCount = 0;
+        uint16_t firstAxis = 0, axisCount = 0;
+        uint16_t firstHat = 0, hatCount = 0;
+        uint64_t slotClear[InputSnapshot::ButtonWords] = {}; // Buttons owned by the slots
+    };
+
+    static constexpr uint8_t NoProgram = 0xFF;
+
+    bool hasReportIdPrefix = false;
+    std::array<uint8_t, 256> programByReportId = MakeEmptyIndex();
+    std::vector<ReportProgram> programs;
+    std::vector<ButtonRun> runs;
+    std::vector<ButtonSlot> slots;
+    std::vector<AxisField> axisFields;
+    std::vector<HatField> hatFields;
+    std::vector<HidControlInfo> controls;
+
+    static std::array<uint8_t, 256> MakeEmptyIndex() {
+        std::array<uint8_t, 256> index{};
+        index.fill(NoProgram);
+        return index;
+    }
+};
+
+// Collects input fields from a descriptor source and compiles them into an HidExtractionPlan.
+// The report descriptor parser below is one source; RawInputHandler feeds it from Windows'
+// preparsed data, which is all user mode gets to see of a descriptor there.
+class HidPlanBuilder {
+public:
+    // `reportIdPrefix` says whether reports start with a report ID byte.
+    explicit HidPlanBuilder(bool reportIdPrefix);
+
+    // A single variable input field. Usages the plan has no use for (vendor pages,
+    // constants, output-only usages) are ignored.
+    void AddVariable(uint8_t reportId, uint32_t bitOffset, uint8_t bitSize,
+                     uint16_t usagePage, uint16_t usage, int32_t logicalMin, int32_t logicalMax);
+
+    // An array input field whose value selects one usage out of [usageMin, usageMax].
+    // Only button arrays are decoded.
+    void AddArray(uint8_t reportId, uint32_t bitOffset, uint8_t bitSize,
+                  uint16_t usagePage, uint16_t usageMin, uint16_t usageMax, int32_t logicalMin);
+
+    // Sets the size of a report, for rejecting truncated reports.
+    void SetReportBits(uint8_t reportId, uint32_t bitLength);
+
+    HidExtractionPlan Build();
+
+private:
+    struct PendingButton { uint8_t reportId; uint32_t bitOffset; uint16_t button; };
+    struct PendingArray { uint8_t reportId; uint32_t bitOffset; uint8_t bitSize; uint16_t firstButton; uint16_t count; int32_t logicalMin; };
+    struct PendingValue { uint8_t reportId; uint32_t bitOffset; uint8_t bitSize; uint8_t target; bool isHat; int32_t logicalMin; int32_t logicalMax; };
+
+    bool reportIdPrefix;
+    std::array<uint32_t, 256> reportBits{};
+    std::vector<PendingButton> buttons;
+    std::vector<PendingArray> arrays;
+    std::vector<PendingValue> values;
+    std::vector<HidControlInfo> controls;
+    uint16_t nextDynamicAxis = 9;
+};
+
+// Parses a raw HID report descriptor and compiles its input reports into `plan`.
+// Returns false if the descriptor is malformed or contains no usable input controls.
+bool ParseHidReportDescriptor(const uint8_t* descriptor, size_t size, HidExtractionPlan& plan);
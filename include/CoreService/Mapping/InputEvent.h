@@ -1,22 +1,47 @@
 #pragma once
 
-#include <string>
+#include <cstddef>
 #include <cstdint> // For uintN_t types
-#include <variant>   // For std::variant
+#include <type_traits>
 
 // Represents the physical device that generated the input.
-// Using a HANDLE for now as that's what RawInput provides.
-// Could be a more abstract ID later if needed.
+// Using a HANDLE for now as that's what RawInput provides. Only the capture side sees
+// handles; events carry the device's DeviceIndex instead (see DeviceRegistry).
 using PhysicalDeviceID = void*; // Corresponds to RAWINPUTHEADER::hDevice
 
-enum class InputType {
+// Small, dense number of a device, handed out by the DeviceRegistry. Anything kept per
+// device can be an array indexed by it.
+using DeviceIndex = uint8_t;
+constexpr DeviceIndex NoDeviceIndex = 0xFF; // Input without a device, e.g. frame markers
+constexpr size_t MaxDevices = 64;           // Devices past this many get NoDeviceIndex
+
+// The USB vendor and product ID of a device, from its hardware ID. Both are 0 when unknown;
+// in a rule's condition, that matches any device.
+struct DeviceModel {
+    uint16_t vendorId = 0;
+    uint16_t productId = 0;
+
+    bool IsKnown() const { return vendorId != 0 || productId != 0; }
+    bool operator==(const DeviceModel& other) const { return vendorId == other.vendorId && productId == other.productId; }
+    bool operator!=(const DeviceModel& other) const { return !(*this == other); }
+};
+
+enum class InputType : uint8_t {
     Unknown,
     Button,
     Axis,
     Trigger, // Could be a special type of axis or handled as an axis
-    HatSwitch // POV Hat
+    HatSwitch, // POV Hat
+    Key,       // Keyboard key, with the KeyCode as ID (see KeyNames.h)
+    MouseButton, // Mouse button or wheel step, with a MouseButtonId as ID
+    DeviceRemoved // Not input: the device was unplugged, and its index may go to the next new one
 };
 
+// Whether events of `type` are buttons (value 1/0 for pressed/released) rather than axes.
+constexpr bool IsButtonType(InputType type) {
+    return type == InputType::Button || type == InputType::Key || type == InputType::MouseButton;
+}
+
 // Specific identifier for a button on a device (e.g., button 0, button 1, etc.)
 // This will be device-specific initially, derived from HID usage pages/usages.
 using ButtonID = uint16_t;
@@ -24,26 +49,29 @@ using ButtonID = uint16_t;
 // Specific identifier for an axis on a device (e.g., X-axis, Y-axis, Z-axis)
 using AxisID = uint16_t;
 
-struct ButtonInput {
-    ButtonID id;
-    bool isPressed;
-};
-
-struct AxisInput {
-    AxisID id;
-    int value; // Raw axis value, typically from -32768 to 32767 or 0 to 255 for triggers
-};
+// One input change, packed into 16 bytes so four share a cache line. It is trivially
+// copyable, so queues and batches move events with plain copies, and the payload is read
+// straight from the fields: `type` says whether `id` and `value` are a button or an axis.
+//
+// The field order matches InputCaptureRecord, which stores the same 16 bytes on disk.
+struct InputEvent {
+    uint64_t timestamp = 0;               // MonotonicNanoseconds() when the report was captured, 0 if unknown
+    InputType type = InputType::Unknown;  // Unknown marks the end of a frame (one input report)
+    DeviceIndex device = NoDeviceIndex;   // Identifies the source physical device
+    uint16_t id = 0;                      // ButtonID or AxisID
+    int32_t value = 0;                    // 1/0 for buttons, keys and mouse buttons; the raw value for axes and hats
 
-// Using std::variant to hold different types of input data.
-// This can be extended with more specific input types (e.g., HatSwitchInput).
-using InputData = std::variant<ButtonInput, AxisInput>;
+    static constexpr InputEvent Button(DeviceIndex device, InputType type, ButtonID id, bool pressed, uint64_t time = 0) {
+        return { time, type, device, id, pressed ? 1 : 0 };
+    }
 
-struct InputEvent {
-    PhysicalDeviceID deviceID; // Identifies the source physical device
-    InputType type;
-    InputData data;
-    uint64_t timestamp; // Optional: for timing, macros, etc.
+    // Raw axis value, typically from -32768 to 32767 or 0 to 255 for triggers.
+    static constexpr InputEvent Axis(DeviceIndex device, InputType type, AxisID id, int32_t value, uint64_t time = 0) {
+        return { time, type, device, id, value };
+    }
 
-    InputEvent(PhysicalDeviceID devId, InputType t, InputData d)
-        : deviceID(devId), type(t), data(d), timestamp(0) {} // Timestamp can be set properly later
+    bool IsButton() const { return IsButtonType(type); }
+    bool IsPressed() const { return value != 0; } // Buttons only
 };
+static_assert(sizeof(InputEvent) == 16, "InputEvent must stay 16 bytes, four to a cache line");
+static_assert(std::is_trivially_copyable_v<InputEvent>, "InputEvent must be copyable as plain bytes");
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The decoded state of every control on one physical device, as of its latest report.
+// It is a fixed-size, trivially-copyable block so decoders can write into it in place
+// without allocating, and it is laid out by control ID:
+//   - buttons: bit N of the bitset is ButtonID N (HID button usage N + 1).
+//   - axes:    axes[N] is AxisID N, normalized to -32768..32767.
+//   - hats:    hats[N] is hat N as a direction 0-7 (clockwise from up), or -1 when centered.
+struct InputSnapshot {
+    static constexpr size_t MaxButtons = 128;
+    static constexpr size_t ButtonWordBits = 64;
+    static constexpr size_t ButtonWords = MaxButtons / ButtonWordBits;
+    static constexpr size_t MaxAxes = 16;
+    static constexpr size_t MaxHats = 4;
+
+    uint64_t buttons[ButtonWords] = {};
+    int32_t axes[MaxAxes] = {};
+    int8_t hats[MaxHats] = { -1, -1, -1, -1 };
+
+    bool IsButtonPressed(size_t id) const {
+        return id < MaxButtons && ((buttons[id / ButtonWordBits] >> (id % ButtonWordBits)) & 1) != 0;
+    }
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Keyboard and mouse inputs as the mapping engine sees them.
+//
+// Keys are identified by their scan code (set 1, what RAWKEYBOARD::MakeCode carries) rather
+// than by virtual key, so a binding follows the physical key whatever the keyboard layout.
+// The low byte is the make code; 0x100 marks keys sent with an E0 prefix (the right-hand
+// modifiers, arrows, the navigation block) and 0x200 the E1 prefix, which only Pause uses.
+//
+// Profiles name keys the way people do ("W", "Spacebar", "LeftShift"). Names are turned into
+// codes when a profile is loaded; the tables below are compile-time data and nothing on the
+// input path ever looks at a string.
+using KeyCode = uint16_t;
+
+constexpr KeyCode NoKey = 0;
+constexpr KeyCode KeyE0 = 0x100;
+constexpr KeyCode KeyE1 = 0x200;
+constexpr size_t KeyCodeCount = 0x300;
+
+// Mouse buttons, including the wheel: every wheel step arrives as a press and a release of
+// one of the wheel buttons, so it can be bound like any other button.
+enum class MouseButtonId : uint16_t {
+    Left,
+    Right,
+    Middle,
+    X1,
+    X2,
+    WheelUp,
+    WheelDown,
+    WheelLeft,
+    WheelRight,
+    Count
+};
+
+struct KeyName {
+    std::string_view name;
+    KeyCode code;
+};
+
+struct MouseButtonName {
+    std::string_view name;
+    MouseButtonId button;
+};
+
+constexpr KeyName KeyNames[] = {
+    { "Esc", 0x01 }, { "Escape", 0x01 },
+    { "1", 0x02 }, { "2", 0x03 }, { "3", 0x04 }, { "4", 0x05 }, { "5", 0x06 },
+    { "6", 0x07 }, { "7", 0x08 }, { "8", 0x09 }, { "9", 0x0A }, { "0", 0x0B },
+    { "Minus", 0x0C }, { "Equals", 0x0D }, { "Backspace", 0x0E }, { "Tab", 0x0F },
+    { "Q", 0x10 }, { "W", 0x11 }, { "E", 0x12 }, { "R", 0x13 }, { "T", 0x14 },
+    { "Y", 0x15 }, { "U", 0x16 }, { "I", 0x17 }, { "O", 0x18 }, { "P", 0x19 },
+    { "LeftBracket", 0x1A }, { "RightBracket", 0x1B }, { "Enter", 0x1C }, { "Return", 0x1C },
+    { "LeftControl", 0x1D }, { "Control_Left", 0x1D },
+    { "A", 0x1E }, { "S", 0x1F }, { "D", 0x20 }, { "F", 0x21 }, { "G", 0x22 },
+    { "H", 0x23 }, { "J", 0x24 }, { "K", 0x25 }, { "L", 0x26 },
+    { "Semicolon", 0x27 }, { "Apostrophe", 0x28 }, { "Grave", 0x29 },
+    { "LeftShift", 0x2A }, { "Shift_Left", 0x2A }, { "Backslash", 0x2B },
+    { "Z", 0x2C }, { "X", 0x2D }, { "C", 0x2E }, { "V", 0x2F }, { "B", 0x30 },
+    { "N", 0x31 }, { "M", 0x32 }, { "Comma", 0x33 }, { "Period", 0x34 }, { "Slash", 0x35 },
+    { "RightShift", 0x36 }, { "Shift_Right", 0x36 }, { "Numpad_Multiply", 0x37 },
+    { "LeftAlt", 0x38 }, { "Alt_Left", 0x38 }, { "Spacebar", 0x39 }, { "Space", 0x39 },
+    { "CapsLock", 0x3A },
+    { "F1", 0x3B }, { "F2", 0x3C }, { "F3", 0x3D }, { "F4", 0x3E }, { "F5", 0x3F },
+    { "F6", 0x40 }, { "F7", 0x41 }, { "F8", 0x42 }, { "F9", 0x43 }, { "F10", 0x44 },
+    { "NumLock", 0x45 }, { "ScrollLock", 0x46 },
+    { "Numpad_7", 0x47 }, { "Numpad_8", 0x48 }, { "Numpad_9", 0x49 }, { "Numpad_Minus", 0x4A },
+    { "Numpad_4", 0x4B }, { "Numpad_5", 0x4C }, { "Numpad_6", 0x4D }, { "Numpad_Plus", 0x4E },
+    { "Numpad_1", 0x4F }, { "Numpad_2", 0x50 }, { "Numpad_3", 0x51 },
+    { "Numpad_0", 0x52 }, { "Numpad_Period", 0x53 },
+    { "F11", 0x57 }, { "F12", 0x58 },
+    { "Numpad_Enter", KeyE0 | 0x1C },
+    { "RightControl", KeyE0 | 0x1D }, { "Control_Right", KeyE0 | 0x1D },
+    { "Numpad_Divide", KeyE0 | 0x35 }, { "PrintScreen", KeyE0 | 0x37 },
+    { "RightAlt", KeyE0 | 0x38 }, { "Alt_Right", KeyE0 | 0x38 },
+    { "Home", KeyE0 | 0x47 }, { "Up", KeyE0 | 0x48 }, { "PageUp", KeyE0 | 0x49 },
+    { "Left", KeyE0 | 0x4B }, { "Right", KeyE0 | 0x4D },
+    { "End", KeyE0 | 0x4F }, { "Down", KeyE0 | 0x50 }, { "PageDown", KeyE0 | 0x51 },
+    { "Insert", KeyE0 | 0x52 }, { "Delete", KeyE0 | 0x53 },
+    { "LeftWindows", KeyE0 | 0x5B }, { "RightWindows", KeyE0 | 0x5C }, { "Menu", KeyE0 | 0x5D },
+    { "Pause", KeyE1 | 0x45 },
+};
+
+constexpr MouseButtonName MouseButtonNames[] = {
+    { "Mouse_LeftClick", MouseButtonId::Left },
+    { "Mouse_RightClick", MouseButtonId::Right },
+    { "Mouse_MiddleClick", MouseButtonId::Middle },
+    { "Mouse_Button4", MouseButtonId::X1 },
+    { "Mouse_Button5", MouseButtonId::X2 },
+    { "Mouse_Wheel_Up", MouseButtonId::WheelUp },
+    { "Mouse_Wheel_Down", MouseButtonId::WheelDown },
+    { "Mouse_Wheel_Left", MouseButtonId::WheelLeft },
+    { "Mouse_Wheel_Right", MouseButtonId::WheelRight },
+};
+
+// NoKey if the name is not a key.
+constexpr KeyCode KeyCodeFromName(std::string_view name) {
+    for (const auto& key : KeyNames) {
+        if (key.name == name) {
+            return key.code;
+        }
+    }
+    return NoKey;
+}
+
+// MouseButtonId::Count if the name is not a mouse button.
+constexpr MouseButtonId MouseButtonFromName(std::string_view name) {
+    for (const auto& button : MouseButtonNames) {
+        if (button.name == name) {
+            return button.button;
+        }
+    }
+    return MouseButtonId::Count;
+}
+
+static_assert(KeyCodeFromName("W") == 0x11, "Scan code table is out of order");
+static_assert(KeyCodeFromName("RightControl") == 0x11D, "E0 keys must carry the E0 bit");
+static_assert(KeyCodeFromName("Pause") < KeyCodeCount, "Key codes must fit the key state tables");
+static_assert(KeyCodeFromName("NotAKey") == NoKey, "Unknown names must not resolve");
+static_assert(MouseButtonFromName("Mouse_Wheel_Down") == MouseButtonId::WheelDown, "Mouse button table is out of order");
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One step of a macro. Steps are plain 8-byte records so a whole macro is a flat array
+// that can be walked without touching the heap.
+struct MacroStep {
+    enum Kind : uint8_t {
+        Press,   // Press virtual button `target` (a VirtualButtonType)
+        Release, // Release virtual button `target`
+        Axis,    // Set virtual axis `target` (a VirtualAxisType) to `value`
+        Delay    // Wait `value` microseconds before the next step
+    };
+
+    Kind kind;
+    uint8_t slot; // The virtual controller; set by the runner from the macro's trigger
+    uint16_t target;
+    int32_t value;
+};
+static_assert(sizeof(MacroStep) == 8, "macro steps are 8 bytes");
+
+// A macro as written in a profile.
+struct MacroDefinition {
+    std::string name;
+    std::vector<MacroStep> steps;
+
+    // Start over from the first step for as long as the triggering button is held.
+    bool repeatWhileHeld = false;
+
+    // Stop as soon as the triggering button is released, releasing any buttons the macro
+    // still holds. Otherwise the current run finishes on its own.
+    bool cancelOnRelease = false;
+};
+
+// All macros of one profile, compiled into a single step pool.
+//
+// A program is shared between the rule set that can start its macros and every macro
+// instance still running from it, which may outlive the rule set after a profile switch.
+// It is reference counted by hand so handing it to the scheduler thread is an atomic
+// increment rather than an allocation.
+class MacroProgram {
+public:
+    static constexpr uint32_t NoMacro = UINT32_MAX;
+
+    struct Macro {
+        uint32_t firstStep;
+        uint32_t stepCount;
+        bool repeatWhileHeld;
+        bool cancelOnRelease;
+    };
+
+    explicit MacroProgram(const std::vector<MacroDefinition>& definitions);
+
+    MacroProgram(const MacroProgram&) = delete;
+    MacroProgram& operator=(const MacroProgram&) = delete;
+
+    // Name lookup, for resolving MacroActions when a rule set is built. Not for the hot path.
+    uint32_t Find(const std::string& name) const;
+
+    size_t GetMacroCount() const { return macros.size(); }
+    const Macro& GetMacro(uint32_t id) const { return macros[id]; }
+    const MacroStep* GetSteps(const Macro& macro) const { return steps.data() + macro.firstStep; }
+
+    // A new program starts with one reference, owned by whoever created it.
+    void AddRef() const { references.fetch_add(1, std::memory_order_relaxed); }
+    void Release() const {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+private:
+    ~MacroProgram() = default;
+
+    std::vector<Macro> macros;
+    std::vector<MacroStep> steps;
+    std::vector<std::string> names;
+    mutable std::atomic<uint32_t> references{ 1 };
+};
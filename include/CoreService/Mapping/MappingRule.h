@@ -2,15 +2,37 @@
 
 #include "InputEvent.h"
 #include "OutputAction.h"
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <functional> // For std::function
 
 // A `MappingRule` defines the relationship between a physical input and a virtual output.
 
+// How a button has to be used for a rule to fire. Anything but Press is run by the gesture
+// machines (see GestureRunner.h); the rule's actions then see a synthesized press and release.
+enum class Gesture : uint8_t {
+    Press,     // Follows the button: pressed while it is held
+    Release,   // A short press (see GesturePulseNs) when the button is let go
+    Tap,       // A short press when the button is let go within timeMs of pressing it
+    LongPress, // Pressed once the button has been held for timeMs, until it is let go
+    DoubleTap, // Pressed when the button goes down again within timeMs of being let go
+    Count
+};
+
+// Another button that has to be held along with the condition's own for it to count.
+struct ChordInput {
+    InputType type = InputType::Unknown; // Unknown marks an unused entry
+    ButtonID id = 0;
+};
+
 // The condition that triggers the mapping.
-// For now, it's a simple equality check on the input event's type and ID.
-// This could be expanded to include more complex conditions (e.g., axis ranges, chords).
+// An equality check on the input event's type and ID, optionally narrowed to a device,
+// widened to a chord of buttons held together and shaped by a gesture.
 struct InputCondition {
+    static constexpr size_t MaxChordInputs = 3;
+    static constexpr size_t MaxLayers = 8;
+
     InputType type;
 
     // Using a union for the ID to save space, since it's one or the other.
@@ -20,7 +42,35 @@ struct InputCondition {
     } id;
 
     // We need to know which member of the union is active.
-    enum { IsButton, IsAxis } idType;
+    enum IdType { IsButton, IsAxis } idType;
+
+    // Restricts the condition to a single physical device. NoDeviceIndex matches any device.
+    DeviceIndex device = NoDeviceIndex;
+
+    // Restricts the condition to devices of one model, whichever index they were given, so a
+    // profile can bind a specific pad. An unknown model (the default) matches any device.
+    DeviceModel model;
+
+    // The layer the rule belongs to (0 = the base layer, up to MaxLayers - 1). A rule only
+    // applies while its layer is on, and then hides the rules of lower layers on the same input.
+    uint8_t layer = 0;
+
+    // Buttons only. The chord's buttons may be pressed in any order and may come from
+    // different devices, e.g. a key and a mouse button.
+    Gesture gesture = Gesture::Press;
+    uint16_t timeMs = 0; // The gesture's time limit; 0 = its default (see GestureRunner.h)
+    ChordInput chord[MaxChordInputs] = {};
+
+    size_t GetChordCount() const {
+        size_t count = 0;
+        while (count < MaxChordInputs && chord[count].type != InputType::Unknown) {
+            ++count;
+        }
+        return count;
+    }
+
+    // True for the common case the rule index dispatches directly: one input, no gesture.
+    bool IsPlain() const { return gesture == Gesture::Press && chord[0].type == InputType::Unknown; }
 
     // Example of how to create conditions easily
     static InputCondition OnButtonPress(ButtonID bId) {
@@ -49,22 +99,23 @@ public:
     MappingRule(const InputCondition& condition, const std::vector<OutputAction>& actions)
         : m_condition(condition), m_actions(actions) {}
 
-    bool IsTriggeredBy(const InputEvent& event) const {
-        if (event.type != m_condition.type) {
+    // `model` is that of the event's device (see DeviceRegistry::GetModel).
+    bool IsTriggeredBy(const InputEvent& event, DeviceModel model = {}) const {
+        if (event.type != m_condition.type || !MatchesDevice(event.device, model)) {
             return false;
         }
-
-        if (m_condition.idType == InputCondition::IsButton && std::holds_alternative<ButtonInput>(event.data)) {
-            const auto& buttonData = std::get<ButtonInput>(event.data);
-            return buttonData.id == m_condition.id.buttonId;
-        }
-
-        if (m_condition.idType == InputCondition::IsAxis && std::holds_alternative<AxisInput>(event.data)) {
-            const auto& axisData = std::get<AxisInput>(event.data);
-            return axisData.id == m_condition.id.axisId;
+        // The event's type says whether its ID is a button or an axis.
+        if (m_condition.idType == InputCondition::IsButton) {
+            return event.IsButton() && event.id == m_condition.id.buttonId;
         }
+        return !event.IsButton() && event.id == m_condition.id.axisId;
+    }
 
-        return false;
+    // Only the device part of the condition; the engine's rule index has already matched
+    // the input type and ID by the time this is asked.
+    bool MatchesDevice(DeviceIndex device, DeviceModel model) const {
+        return (m_condition.device == NoDeviceIndex || m_condition.device == device) &&
+               (!m_condition.model.IsKnown() || m_condition.model == model);
     }
 
     const InputCondition& GetCondition() const { return m_condition; }
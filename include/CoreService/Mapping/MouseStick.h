@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// How a profile turns mouse movement into stick deflection.
+//
+// Mouse reports arrive at the mouse's polling rate (125 Hz to 8 kHz) and carry counts moved
+// since the previous report. Those counts are summed between output ticks and the stick is
+// updated at a fixed rate (`rateHz`), whatever the mouse does, so a faster mouse gives a
+// smoother stick rather than a noisier one.
+//
+// Each tick:
+//   velocity      counts over the last `windowMs`, per second. The window should be at least
+//                 one polling interval, or slow mice show up as gaps between reports.
+//   smoothing     an exponential moving average, or a One Euro filter that smooths slow
+//                 aiming heavily and fast flicks hardly at all
+//   response      deflection = sensitivity * v * (1 + acceleration * v), with v the speed in
+//                 thousands of counts per second, in the direction of movement, capped at 1
+//   decay         deflection never falls faster than e^(-t / decayMs) once movement slows
+//                 or stops; 0 lets the stick snap back to center
+//
+// Mouse Y grows downwards and stick Y upwards, so moving the mouse forward pushes the stick up.
+struct MouseStickSettings {
+    enum class Stick : uint8_t { Left, Right };
+    enum class Smoothing : uint8_t { None, Ema, OneEuro };
+
+    bool enabled = false;
+    Stick stick = Stick::Right;
+    float rateHz = 1000.0f;
+    float sensitivity = 0.25f;  // Deflection per 1000 counts/s
+    float acceleration = 0.0f;  // Extra gain per 1000 counts/s
+    float windowMs = 4.0f;
+    float decayMs = 0.0f;
+    Smoothing smoothing = Smoothing::None;
+    float smoothingMs = 8.0f;   // Ema: time constant
+    float minCutoffHz = 2.0f;   // OneEuro: cutoff when the mouse is still
+    float beta = 0.05f;         // OneEuro: how quickly the cutoff rises with speed
+    float derivativeCutoffHz = 1.0f; // OneEuro: cutoff for the speed estimate itself
+
+    // The output tick period, with the rate kept to something a scheduler can deliver.
+    uint64_t GetTickIntervalNs() const {
+        const float rate = rateHz < 50.0f ? 50.0f : (rateHz > 8000.0f ? 8000.0f : rateHz);
+        return static_cast<uint64_t>(1e9f / rate);
+    }
+
+    bool operator==(const MouseStickSettings& other) const {
+        return enabled == other.enabled && stick == other.stick && rateHz == other.rateHz &&
+               sensitivity == other.sensitivity && acceleration == other.acceleration && windowMs == other.windowMs &&
+               decayMs == other.decayMs && smoothing == other.smoothing && smoothingMs == other.smoothingMs &&
+               minCutoffHz == other.minCutoffHz && beta == other.beta && derivativeCutoffHz == other.derivativeCutoffHz;
+    }
+    bool operator!=(const MouseStickSettings& other) const { return !(*this == other); }
+};
+
+// The mouse-to-stick math, free of any platform or threading concerns: counts go in, one
+// stick position comes out per tick. The caller decides where counts come from and when
+// ticks happen. Nothing allocates.
+class MouseStickFilter {
+public:
+    static constexpr size_t MaxWindowTicks = 64;
+
+    struct Output {
+        int16_t x = 0;
+        int16_t y = 0;
+    };
+
+    MouseStickFilter() = default;
+    explicit MouseStickFilter(const MouseStickSettings& settings) { Configure(settings); }
+
+    // Applies new settings and returns to rest.
+    void Configure(const MouseStickSettings& settings);
+    void Reset();
+
+    // One output tick: `dx`/`dy` are the counts since the previous tick and `dtNs` the time
+    // since it. Returns the stick position in gamepad units.
+    Output Tick(int32_t dx, int32_t dy, uint64_t dtNs);
+
+    // True while the stick is deflected or recent movement is still in the window. Once at
+    // rest, ticks without movement change nothing and can be skipped.
+    bool IsMoving() const { return windowCountsX != 0 || windowCountsY != 0 || deflectionX != 0.0f || deflectionY != 0.0f; }
+
+    const MouseStickSettings& GetSettings() const { return settings; }
+
+private:
+    MouseStickSettings settings;
+    uint64_t windowNs = 4'000'000;
+
+    // Per-tick counts over the velocity window, as a ring.
+    struct Bin {
+        int32_t dx;
+        int32_t dy;
+        uint64_t dtNs;
+    };
+    Bin bins[MaxWindowTicks] = {};
+    size_t binCount = 0;
+    size_t nextBin = 0;
+    int64_t windowCountsX = 0;
+    int64_t windowCountsY = 0;
+    uint64_t windowSpanNs = 0;
+
+    // Smoothed velocity, in thousands of counts per second.
+    float velocityX = 0.0f;
+    float velocityY = 0.0f;
+    float speedDerivative = 0.0f; // OneEuro
+    bool filterPrimed = false;
+
+    // Last output, as a fraction of full deflection.
+    float deflectionX = 0.0f;
+    float deflectionY = 0.0f;
+};
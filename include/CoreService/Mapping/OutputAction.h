@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <string>
 #include <variant>
 #include <vector>
 
 // Define virtual controller elements that can be targeted
-// These would correspond to ViGEmBus (e.g., XUSB_GAMEPAD_...) or other virtual outputs
+// Gamepad targets land in the virtual controller's report, keyboard and mouse targets are
+// injected as input; OutputTargets.h has the table that says where each one goes.
 
 enum class VirtualButtonType {
     // Xbox Controller Buttons
@@ -36,6 +39,9 @@ enum class VirtualButtonType {
     // ... other virtual buttons/keys
 };
 
+// One past the last VirtualButtonType; keep it in step when adding targets.
+constexpr size_t VirtualButtonTypeCount = static_cast<size_t>(VirtualButtonType::MOUSE_RIGHT_BUTTON) + 1;
+
 enum class VirtualAxisType {
     // Xbox Controller Axes
     XBOX_LEFT_STICK_X,
@@ -51,32 +57,64 @@ enum class VirtualAxisType {
     // ... other virtual axes
 };
 
+// One past the last VirtualAxisType; keep it in step when adding targets.
+constexpr size_t VirtualAxisTypeCount = static_cast<size_t>(VirtualAxisType::MOUSE_SCROLL_WHEEL) + 1;
+
 struct VirtualButtonAction {
+    enum class Mode : uint8_t {
+        Hold,   // Down while the input is held
+        Toggle, // Each press of the input latches it down or lets it go
+        Turbo   // Pressed and released over and over at turboHz while the input is held
+    };
+
     VirtualButtonType button;
-    bool press; // true to press, false to release
+    bool press; // true to press, false to release the button (and end its toggle or turbo) on the input's press
+    Mode mode = Mode::Hold;
+    uint16_t turboHz = 0; // Presses per second; 0 = DefaultTurboHz
 };
 
+constexpr uint16_t DefaultTurboHz = 10;
+
 struct VirtualAxisAction {
     VirtualAxisType axis;
     int value; // Value depends on the axis (e.g., -32768 to 32767 for sticks, 0-255 for triggers)
 };
 
-// Placeholder for more complex actions like macros
+// Runs one of the profile's macros (see MacroProgram) while the triggering button is pressed.
 struct MacroAction {
     std::string macroName; // Identifier for a predefined macro
-    // Or perhaps a sequence of actions directly
-    // std::vector<std::variant<VirtualButtonAction, VirtualAxisAction, DelayAction>> sequence;
+
+    // Index of the macro in the active rule set's MacroProgram. Resolved from the name when
+    // the rule set is built, so triggering a macro never looks up a string.
+    uint32_t macroId = UINT32_MAX;
 };
 
+// Switches a layer of the profile on or off (see InputCondition::layer). Layer 0 is the base
+// layer and is always on.
+struct LayerAction {
+    enum class Mode : uint8_t {
+        Momentary, // On while the button is held
+        Toggle,    // Each press flips it
+        OneShot    // On until the next press of another button has been mapped
+    };
+
+    uint8_t layer;
+    Mode mode = Mode::Momentary;
+};
 
 // Using std::variant to hold different types of output actions
 using OutputActionData = std::variant<
     VirtualButtonAction,
     VirtualAxisAction,
-    MacroAction // Example for future extension
+    MacroAction,
+    LayerAction
 >;
 
+// Virtual controllers are numbered by slot, player 1 being slot 0.
+constexpr uint8_t MaxVirtualControllers = 4; // As many as XInput has users
+constexpr uint8_t RouteByDevice = 0xFF;      // The slot of the device the input came from
+
 struct OutputAction {
     OutputActionData action;
-    // Potentially add target virtual device ID if multiple virtual controllers are supported
+    uint8_t slot = RouteByDevice; // The virtual controller the action drives
 };
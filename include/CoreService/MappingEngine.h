@@ -1,32 +1,286 @@
 #pragma once
 
 #include "Mapping/InputEvent.h"
+#include "Mapping/InputEventBatch.h"
+#include "Mapping/InputSnapshot.h"
+#include "Mapping/KeyNames.h"
 #include "Mapping/MappingRule.h"
+#include "Mapping/CompiledRuleSet.h"
+#include "Mapping/MouseStick.h"
+#include "Mapping/GestureRunner.h"
+#include "EpochDomain.h"
+#include <array>
+#include <atomic>
 #include <vector>
 #include <memory> // For std::unique_ptr
 
 // Forward declarations to avoid circular dependencies
 class VirtualController;
+class VirtualControllerPool;
+class VirtualKeyboardMouse;
+struct AxisTarget;
+class LatencyMonitor;
+class DeviceRegistry;
+class MacroScheduler;
 
 class MappingEngine {
 public:
     // The engine needs a way to send output, so it gets a reference to the virtual controller.
     MappingEngine(VirtualController& controller);
+
+    // Drives every controller in `controllers`, which must hold at least one and outlive the
+    // engine. The pool itself is copied.
+    explicit MappingEngine(const VirtualControllerPool& controllers);
     ~MappingEngine();
 
+    // Sends the output of a device's input to virtual controller `slot`, unless a rule's action
+    // names a slot of its own. Devices without a slot drive slot 0, or, with auto-assignment,
+    // wait for one. Must be called on the thread that calls ProcessInput, or before input starts.
+    void SetDeviceSlot(DeviceIndex device, uint8_t slot);
+
+    // With auto-assignment on, a game controller (a device sending InputType::Button or Axis
+    // events) without a slot takes the lowest free one the first time it presses a button, and
+    // its input does nothing until then, much as players join on a console. Keyboards and mice
+    // keep slot 0. Same threading as SetDeviceSlot.
+    void SetAutoAssignSlots(bool enabled) { autoAssignSlots = enabled; }
+
     // The main entry point for the engine.
     // It takes a raw input event, finds the appropriate mapping, and executes the output action.
     void ProcessInput(const InputEvent& event);
 
+    // Called after every event of one input report has gone through ProcessInput.
+    // Actions only change the virtual controller's shadow report; this sends the combined
+    // result as a single update.
+    void EndFrame();
+
+    // Runs a batch of events popped from the input queue: ProcessInput for each, and
+    // EndFrame at each frame marker (an event of InputType::Unknown). Events after the
+    // last marker are processed but their frame is left open for the next batch.
+    void ProcessBatch(const InputEventBatch& batch);
+
     // Loads a set of mapping rules. This will eventually load from a profile.
-    void LoadMappings(const std::vector<MappingRule>& rules);
+    // The rules are compiled into a new indexed rule set on the calling thread and published
+    // with a single pointer swap, so it is safe to call while another thread is processing
+    // input. Each input frame is mapped entirely by the rule set that was active when the
+    // frame started; the replaced set is freed once no frame can still be using it.
+    // `macros` are the profile's macros that MacroActions in `rules` refer to by name,
+    // `axisTransforms` shape the virtual axes on every flush made with this set, and
+    // `mouseStick` says whether and how mouse movement drives a stick.
+    // `rules` is moved into the set when the caller passes a temporary.
+    void LoadMappings(std::vector<MappingRule> rules, const std::vector<MacroDefinition>& macros = {},
+                      const std::vector<AxisTransform>& axisTransforms = {}, const MouseStickSettings& mouseStick = {});
+    // The same, but shares `rules` with their owner, such as a compiled profile, instead of
+    // taking a copy.
+    void LoadSharedMappings(std::shared_ptr<const std::vector<MappingRule>> rules, const std::vector<MacroDefinition>& macros = {},
+                            const std::vector<AxisTransform>& axisTransforms = {}, const MouseStickSettings& mouseStick = {});
+
+    // Whether an event stops at the first matching rule or runs every matching rule.
+    void SetMatchPolicy(MatchPolicy policy) { matchPolicy = policy; }
+    MatchPolicy GetMatchPolicy() const { return matchPolicy; }
+
+    // Optional. When set, the engine records how long after capture each event was
+    // dispatched, had its actions applied, and reached the virtual gamepad.
+    void SetLatencyMonitor(LatencyMonitor* monitor) { latencyMonitor = monitor; }
+
+    // Optional. Where the models of devices are looked up for rules bound to a model (see
+    // InputCondition::model); without it such rules never match. Set before input starts.
+    void SetDeviceRegistry(const DeviceRegistry* registry) { devices = registry; }
+
+    // Optional. Keyboard and mouse targets of actions and macro steps (KEY_*, MOUSE_*) are
+    // injected through this output, flushed along with the controllers; without one they do
+    // nothing. Must be set before input starts.
+    void SetKeyboardMouse(VirtualKeyboardMouse* output) { keyboardMouse = output; }
+
+    // Optional. MacroActions are handed to this scheduler; without one they do nothing. Its
+    // tick is also set to the active profile's mouse-to-stick rate, to TurboTickNs for a
+    // profile with only turbo buttons, or off for one with neither.
+    void SetMacroScheduler(MacroScheduler* scheduler);
+
+    // Applies one step of a running macro to the virtual controller. Must be called on the
+    // thread that calls ProcessInput.
+    void ApplyMacroStep(const MacroStep& step);
+
+    // Sends what ApplyMacroStep changed. While an input frame is being mapped this does
+    // nothing, and the frame's own EndFrame sends both together.
+    void FlushMacroSteps();
+
+    // The output tick's period when the profile has turbo buttons but no mouse stick. With a
+    // mouse stick, turbo runs on the stick's tick instead.
+    static constexpr uint64_t TurboTickNs = 1'000'000;
+
+    // One fixed-rate output tick: `dx`/`dy` are the counts the mouse moved since the previous
+    // tick, `tickNs` when this one was due. Moves the mouse stick on controller 0, if the
+    // active profile enables one, and pulses the turbo buttons. Must be called on the thread that calls
+    // ProcessInput.
+    void Tick(uint64_t tickNs, int32_t dx, int32_t dy);
+
+    // Runs the gesture time limits (tap, long press, double tap) that have run out by
+    // `nowNs` and sends the result. Input events advance them too; this covers the time in
+    // between, when the macro scheduler's alarm goes off. Must be called on the thread that
+    // calls ProcessInput.
+    void AdvanceGestures(uint64_t nowNs);
 
 private:
-    // A reference to the virtual controller to send commands to.
-    VirtualController& virtualController;
+    // The virtual controllers to send commands to, by slot.
+    std::array<VirtualController*, MaxVirtualControllers> controllers{};
+    size_t controllerCount = 0;
+
+    // The slot each device is routed to plus one, 0 for none yet, by DeviceIndex; set by
+    // SetDeviceSlot or by auto-assignment.
+    static constexpr uint8_t NoSlot = 0xFF; // Input that drives no controller
+    std::array<uint8_t, MaxDevices> deviceSlots{};
+    bool autoAssignSlots = false;
+
+    // The currently active set of mapping rules, indexed by input type and ID. Replaced
+    // as a whole by LoadMappings and never modified in place.
+    std::atomic<const CompiledRuleSet*> activeMappings;
+
+    // Protects rule sets the input thread may still be reading after a swap.
+    EpochDomain retiredMappings;
+    size_t inputReader;
+
+    // The rule set the current frame is being mapped with, or nullptr between frames.
+    // Only touched by the thread that calls ProcessInput/EndFrame.
+    const CompiledRuleSet* frameMappings = nullptr;
+
+    MatchPolicy matchPolicy = MatchPolicy::FirstMatch;
+
+    LatencyMonitor* latencyMonitor = nullptr;
+    const DeviceRegistry* devices = nullptr;
+    MacroScheduler* macroScheduler = nullptr;
+    VirtualKeyboardMouse* keyboardMouse = nullptr;
+
+    // Mouse-to-stick state. It outlives rule sets and is reset when the settings change.
+    MouseStickFilter mouseStick;
+    uint64_t lastMouseTickNs = 0;
+
+    // Gesture state, like the mouse-to-stick state, belongs to the engine and starts over
+    // when the rule set changes.
+    GestureRunner gestures;
+    uint64_t postedGestureWakeNs = UINT64_MAX; // The alarm last asked of the scheduler
+
+    // Layer, toggle and turbo state, changed by actions. It also starts over with every rule set.
+    using LayerMask = CompiledRuleSet::LayerMask;
+    uint64_t actionGeneration = 0; // The rule set the state below belongs to
+    std::array<uint8_t, InputCondition::MaxLayers> layerHolds{}; // Momentary buttons holding each layer
+    LayerMask toggledLayers = 0;
+    LayerMask oneShotLayers = 0;
+    LayerMask activeLayers = 1;
+    const CompiledRuleSet::DispatchTable* activeTable = nullptr; // frameMappings' table for activeLayers
+
+    // Buttons that are down, with the layers that were on when they were pressed. A release
+    // is mapped with those same layers, so it lets go of exactly what the press pressed even
+    // if the layers changed in between. Past MaxHeldInputs, releases use the current layers.
+    // Only kept while the rule set has layers.
+    struct HeldInput {
+        DeviceIndex device;
+        InputType type;
+        ButtonID id;
+        LayerMask layers;
+    };
+    static constexpr size_t MaxHeldInputs = 32;
+    std::array<HeldInput, MaxHeldInputs> heldInputs{};
+    size_t heldCount = 0;
+
+    // Every button, key and mouse button that is down, for any rule set, so a new one knows
+    // what is still held (see SyncActionState). One bit per input by device: the Button IDs first, then
+    // the key codes, then the mouse buttons. Setting or clearing one is a single store.
+    static constexpr size_t DownBits = InputSnapshot::MaxButtons + KeyCodeCount + static_cast<size_t>(MouseButtonId::Count);
+    static constexpr size_t DownWords = (DownBits + 63) / 64;
+    std::array<std::array<uint64_t, DownWords>, MaxDevices> downInputs{};
+
+    // The bit of an input in downInputs, or DownBits for one outside the table, and the press
+    // of the input a bit stands for.
+    static size_t DownBit(InputType type, ButtonID id);
+    static InputEvent DownInput(DeviceIndex device, size_t bit);
+
+    // Button sets across all controllers are packed into 64 bits, each slot's 16 gamepad
+    // button bits at 16 * slot (see SlotButtons).
+    uint64_t latchedButtons = 0; // Gamepad buttons toggled down
+
+    // What Hold actions have down, so a new rule set can let go of it: gamepad buttons,
+    // packed as above; keys and mouse buttons, bit N for VirtualButtonType N; and gamepad
+    // axes a button pushes, bit slot * VirtualAxisTypeCount + VirtualAxisType.
+    uint64_t holdButtons = 0;
+    uint32_t holdKeys = 0;
+    uint64_t pushedAxes = 0;
+    static_assert(VirtualButtonTypeCount <= 32, "held keys are kept in one 32-bit mask");
+    static_assert(MaxVirtualControllers * VirtualAxisTypeCount <= 64, "pushed axes are kept in one 64-bit mask");
+
+    // Turbo buttons running at the same rate pulse in step, as one group with one phase, so a
+    // tick costs the same however many buttons are in turbo, on however many controllers.
+    // `originNs` is when the group's first button went down; the buttons are pressed for the
+    // first half of every period from then on.
+    struct TurboGroup {
+        uint64_t halfPeriodNs = 0;
+        uint64_t originNs = 0;
+        uint64_t buttons = 0; // 0 = unused
+    };
+    static constexpr size_t MaxTurboGroups = 4; // Distinct rates running at once
+    std::array<TurboGroup, MaxTurboGroups> turboGroups{};
+    uint64_t turboButtons = 0; // Every group's buttons
+    std::atomic<uint64_t> tickIntervalNs{ 0 }; // What the newest rule set wants, 0 = no ticks
+
+    // The first event of the current frame. Its capture time is what the flush is measured
+    // against, since that is the input that has waited longest for the update.
+    DeviceIndex frameDevice = NoDeviceIndex;
+    uint64_t frameTimestamp = 0;
+
+    // Sends the virtual controllers' reports, shaped by the current rule set's axis
+    // transforms, and the queued keyboard and mouse input, and ends the frame's hold on that set.
+    bool FlushController();
+
+    // Makes `compiled` the active set and retires the one it replaces.
+    void Publish(const CompiledRuleSet* compiled);
+
+    // Starts, retimes or stops the scheduler's tick for the newest rule set.
+    void UpdateTickInterval(const CompiledRuleSet& mappings);
+
+    // If `mappings` is not the set the layer, toggle, turbo and hold state belongs to, resets
+    // that state and lets go of everything the old set had down: toggled and turbo buttons,
+    // and whatever Hold actions hold, unless an input still down holds the same output under
+    // `mappings` (which then lets go of it when that input comes up). Swapping in the same
+    // rules therefore changes nothing, and nothing stays stuck from a different profile.
+    void SyncActionState(const CompiledRuleSet& mappings);
+
+    // Recomputes activeLayers and activeTable after a LayerAction.
+    void UpdateLayers();
+
+    // The layers a button event is mapped with: the current ones for a press (which are
+    // remembered), those of the matching press for a release.
+    LayerMask RouteButton(const InputEvent& event);
+
+    // `mask`, a set of GamepadButton bits, on controller `slot`, as packed button sets are.
+    static uint64_t SlotButtons(uint8_t slot, uint16_t mask) { return static_cast<uint64_t>(mask) << (16 * slot); }
+
+    // Presses or releases a packed set of buttons on every controller it covers.
+    void SetButtons(uint64_t buttons, bool pressed);
+
+    // The slot a device's input drives, NoSlot if it has none yet. A button press from an
+    // unrouted game controller takes a slot if auto-assignment is on.
+    uint8_t RouteDevice(const InputEvent& event);
+
+    // Drops the slot and held inputs of a removed device, whose index may be reused.
+    void ForgetDevice(DeviceIndex device);
+
+    // Adds the packed `buttons` to the turbo group for `turboHz`, starting one at `timeNs` if
+    // none runs at that rate, or takes them out of every group.
+    void StartTurbo(uint64_t buttons, uint16_t turboHz, uint64_t timeNs);
+    void StopTurbo(uint64_t buttons);
+
+    // Whether a group's buttons are down at `nowNs`.
+    static bool IsTurboDown(const TurboGroup& group, uint64_t nowNs) {
+        return nowNs < group.originNs || (nowNs - group.originNs) / group.halfPeriodNs % 2 == 0;
+    }
+
+    // Executes the actions of the gestures that fired and asks for an alarm at the next deadline.
+    void RunGestureFirings(const CompiledRuleSet& mappings);
 
-    // The currently active set of mapping rules.
-    std::vector<MappingRule> activeMappings;
+    // Presses or releases `button`, or sets the axis `target`, wherever it lives: on
+    // `controller` (which may be nullptr) for gamepad targets, on the keyboard/mouse output
+    // otherwise.
+    void ApplyButton(VirtualController* controller, VirtualButtonType button, bool pressed);
+    void ApplyAxis(VirtualController* controller, const AxisTarget& target, int value);
 
     // Executes the actions defined by a mapping rule.
     void ExecuteAction(const OutputAction& action, const InputEvent& sourceEvent);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Mapping/InputEvent.h"
+#include "Mapping/InputEventBatch.h"
+#include "MacroRunner.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+class MappingEngine;
+class InputCaptureWriter;
+
+// Runs the mapping engine on its own thread, fed through a lock-free SPSC queue.
+//
+// The capture thread (the one pumping WM_INPUT) only decodes reports and pushes the
+// resulting events here, so a slow action or console write on the mapping side can no
+// longer hold up raw input intake. The worker drains the queue in batches, copies each into
+// an InputEventBatch and runs it through MappingEngine::ProcessBatch, which calls EndFrame
+// at the same report boundaries the capture side marked. A press and release that arrive in one batch
+// therefore still reach the virtual controller as two updates.
+//
+// Nothing pushed here is ever dropped while the worker runs: the events carry state changes
+// (releases, frame ends, DeviceRemoved) that the capture side has already committed and will
+// not send again. If the mapping side falls behind far enough to fill a queue, the pushing
+// thread waits for room, which the worker always makes since it never waits on either
+// producer. The waits are counted (see GetStallCount). Only what is pushed after Stop is
+// dropped, and counted (see GetDroppedCount).
+//
+// The worker is also where macro steps come back in: as a MacroOutput it takes steps from
+// the macro scheduler thread through a second SPSC queue and applies them between input
+// batches, so the virtual controller is only ever touched from this one thread.
+//
+// Relative mouse movement takes a shorter path than other input: at up to 8000 reports a
+// second it is only summed into two atomic counters, which the worker empties on each of
+// the scheduler's fixed-rate ticks and hands to MappingEngine::Tick.
+class MappingWorker : public MacroOutput {
+public:
+    static constexpr size_t QueueCapacity = 4096;
+    static constexpr size_t MacroQueueCapacity = 1024;
+    static constexpr size_t BatchSize = 64;
+    static_assert(BatchSize <= InputEventBatch::Capacity, "a popped batch must fit an InputEventBatch");
+
+    explicit MappingWorker(MappingEngine& engine);
+    ~MappingWorker();
+
+    // Starts the worker thread, optionally pinned to `cpuCore` (-1 = not pinned).
+    bool Start(int cpuCore = -1);
+
+    // Processes whatever is still queued, then joins the worker thread.
+    void Stop();
+
+    // Capture side. Only one thread may call these.
+    void Push(const InputEvent& event);
+    void EndFrame(); // Marks the end of one input report and wakes the worker.
+    // Queues a batch of events in one go and wakes the worker once. Frame ends are marked
+    // in the batch itself, by InputType::Unknown events.
+    void PushBatch(const InputEvent* events, size_t count);
+    void PushMouseDelta(int32_t dx, int32_t dy); // Counts moved since the previous mouse report
+
+    // Times a producer found a queue full and had to wait for the worker. Any thread.
+    uint64_t GetStallCount() const { return stallCount.load(std::memory_order_relaxed); }
+    // Events and steps pushed while the worker was not running that did not fit. Any thread.
+    uint64_t GetDroppedCount() const { return droppedCount.load(std::memory_order_relaxed); }
+
+    // Macro scheduler side. Only one thread may call these.
+    void PostStep(const MacroStep& step) override;
+    void EndSteps() override; // Wakes the worker to apply the posted steps.
+    void PostTick(uint64_t tickNs) override;
+    void PostAlarm(uint64_t alarmNs) override; // Gesture time limits; see MappingEngine::AdvanceGestures
+
+    // Optional. Every event and frame boundary the worker dispatches is also appended to
+    // `writer`, giving a capture that replays exactly what the engine saw. Set before Start.
+    void SetCaptureWriter(InputCaptureWriter* writer) { captureWriter = writer; }
+
+private:
+    void Run(int cpuCore);
+    void WaitForInput();
+    void Dispatch(const InputEvent* events, size_t count);
+    bool ApplyMacroSteps(); // Returns false if there were none.
+    bool ApplyTick();       // Returns false if no tick was pending.
+    bool ApplyAlarm();      // Returns false if no alarm was pending.
+    void Wake();
+    // Pushes all of `items` into `ring`, waiting for room while the worker runs.
+    template <typename Ring, typename Item>
+    void PushAll(Ring& ring, const Item* items, size_t count);
+
+    MappingEngine& engine;
+    InputCaptureWriter* captureWriter = nullptr;
+    InputEventBatch batch; // Only touched by the worker thread
+    SpscRing<InputEvent, QueueCapacity> queue;
+    SpscRing<MacroStep, MacroQueueCapacity> macroSteps;
+    std::atomic<int32_t> mouseX{ 0 };
+    std::atomic<int32_t> mouseY{ 0 };
+    std::atomic<uint64_t> pendingTick{ 0 }; // Due time of the latest unhandled tick; 0 if none
+    std::atomic<uint64_t> pendingAlarm{ 0 }; // Likewise for the scheduler's alarm
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> stallCount{ 0 };
+    std::atomic<uint64_t> droppedCount{ 0 };
+
+    // Set by the worker just before it blocks, so the other threads only pay for a wake-up
+    // when the worker is actually asleep.
+    std::atomic<bool> sleeping{ false };
+    std::mutex wakeMutex;
+    std::condition_variable wakeSignal;
+};
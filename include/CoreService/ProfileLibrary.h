@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Profile;
+
+// The profiles in a directory, known by their names and file details only.
+//
+// A scan skips a file whose size and write time match what the index already has. For a new
+// or changed one it reads only the name: from the header of the profile's compiled image
+// when that was built from the current file, else from the JSON, whose parse stops at
+// "profileName" (SaveProfile writes it first). A large library therefore costs little more
+// than listing it. The index can be saved next to the profiles, so the next start does not
+// read them at all. A profile's rules are only built when it is asked for, through a small
+// cache of the most recently used ones. The stamp alone is not trusted there: an edit can
+// keep the size within the write time's resolution, so a cached profile is only handed out
+// again while its file's content hash is unchanged.
+//
+// Not thread-safe: one thread owns the library.
+class ProfileLibrary {
+public:
+    struct Entry {
+        std::string name;
+        std::string path;
+        int64_t modifiedTime; // In std::filesystem clock ticks, as compiled images record it
+        uint64_t size;
+    };
+
+    struct ScanResult {
+        size_t read = 0;    // Files that were opened; the rest were unchanged
+        size_t added = 0;
+        size_t updated = 0; // Their size or write time changed
+        size_t removed = 0;
+        size_t failed = 0;  // Could not be read, or have no name
+    };
+
+    static constexpr size_t DefaultCacheCapacity = 4;
+
+    explicit ProfileLibrary(size_t cacheCapacity = DefaultCacheCapacity);
+
+    // Brings the index up to date with the .json files in a directory. Cached profiles whose
+    // files changed or went away are dropped.
+    ScanResult Scan(const std::string& directoryPath);
+
+    // The index as a previous run saved it. Scan still checks every entry against its file,
+    // so a stale or foreign index only costs reads. False (and an empty index) if there is
+    // none or it cannot be used.
+    bool LoadIndex(const std::string& indexPath);
+    bool SaveIndex(const std::string& indexPath) const;
+    // Not a .json name, so the index is never taken for a profile.
+    static std::string GetIndexPath(const std::string& directoryPath) { return directoryPath + "/profiles.index"; }
+
+    // Sorted by path.
+    const std::vector<Entry>& GetEntries() const { return entries; }
+    // Looked up in a name index kept next to the entries. Of several profiles with one name,
+    // the first by path.
+    const Entry* Find(const std::string& name) const;
+
+    // The profile with its rules built, from the cache or its file. Either way the file is
+    // read and hashed, and a cached profile whose file's contents changed is loaded again.
+    // Loading one into a full cache evicts the least recently used; whoever still holds that
+    // one keeps it. Null if the file can no longer be loaded.
+    std::shared_ptr<const Profile> Materialize(const Entry& entry);
+    size_t GetCachedCount() const { return cache.size(); }
+
+    // The "profileName" of a JSON profile, read without building the document: parsing stops
+    // as soon as the name is found, and nothing after it is read from the stream.
+    static bool ReadName(std::istream& stream, std::string& name);
+
+private:
+    struct Cached {
+        std::string path;
+        int64_t modifiedTime;
+        uint64_t size;
+        uint32_t sourceHash; // Of the file as it was before the profile was loaded
+        uint64_t lastUse;
+        std::shared_ptr<const Profile> profile;
+    };
+
+    // Reads the name of a changed or new file into `entry`, which holds its path and stamp.
+    static bool IndexFile(Entry& entry);
+    // Rebuilds byName after the entries changed.
+    void IndexNames();
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> byName; // Indices into entries, sorted by name
+    std::vector<Cached> cache;
+    size_t cacheCapacity;
+    uint64_t useCount = 0;
+};
@@ -1,42 +1,127 @@
 #pragma once
 
 #include "MappingEngine.h"
+#include "ProfileLibrary.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
-#include "nlohmann/json.hpp"
+#include <nlohmann/json.hpp>
 
-// Forward declaration
+// Forward declarations
 class MappingRule;
+class BinaryProfile;
 
 class Profile {
 public:
     Profile(std::string name);
 
+    // A profile backed by a mapped compiled image. Its macros, axis transforms and mouse
+    // stick are read from the image here; its rules only when GetMappings first asks for
+    // them, so loading many profiles costs little more than mapping them. Activating it
+    // hands those same rules to the engine (see GetSharedMappings).
+    explicit Profile(std::shared_ptr<const BinaryProfile> image);
+
+    // The getters are safe to call from several threads at once; the setters are not.
     const std::string& GetName() const;
     const std::vector<MappingRule>& GetMappings() const;
+    // The rules built from the image, shared rather than copied; they outlive the profile
+    // for as long as anyone holds them. Null for a profile that has no image.
+    std::shared_ptr<const std::vector<MappingRule>> GetSharedMappings() const;
     void AddMapping(const MappingRule& rule);
+    const std::vector<MacroDefinition>& GetMacros() const;
+    void AddMacro(const MacroDefinition& macro);
+    const std::vector<AxisTransform>& GetAxisTransforms() const;
+    void AddAxisTransform(const AxisTransform& transform);
+    const MouseStickSettings& GetMouseStick() const;
+    void SetMouseStick(const MouseStickSettings& settings);
+
+    // The compiled image the profile is read from, or null for one built in memory or
+    // changed since it was loaded.
+    const std::shared_ptr<const BinaryProfile>& GetImage() const { return image; }
 
 private:
+    // The rules of an image, built once. Copies of the profile share them.
+    struct ImageRules {
+        std::once_flag built;
+        std::vector<MappingRule> rules;
+    };
+
+    // Makes the profile its own, for the setters.
+    void DetachImage();
+
     std::string profileName;
-    std::vector<MappingRule> mappings;
+    std::vector<MappingRule> mappings; // Unused while imageRules is set
+    std::vector<MacroDefinition> macros;
+    std::vector<AxisTransform> axisTransforms;
+    MouseStickSettings mouseStick;
+    std::shared_ptr<const BinaryProfile> image;
+    std::shared_ptr<ImageRules> imageRules;
 };
 
 class ProfileManager {
 public:
     ProfileManager(MappingEngine& engine);
 
-    void LoadProfilesFromDirectory(const std::string& directoryPath);
+    // Brings the library up to date with a directory: the index saved there last time is
+    // checked against the files, only new and changed ones are read (just for their names),
+    // and the result is saved for next time. No profile is loaded; see ActivateProfile.
+    ProfileLibrary::ScanResult LoadProfilesFromDirectory(const std::string& directoryPath);
+
+    // The JSON profiles in a directory, sorted by path, without reading them.
+    static std::vector<std::string> ListProfileFiles(const std::string& directoryPath);
+
+    // Loads a .json profile, or a compiled one directly. For JSON, the compiled image next
+    // to it (see GetCompiledPath) is used when it was built from the current file, judged by
+    // its stamp and content hash; otherwise the JSON is parsed and the image rebuilt for the
+    // next start.
     bool LoadProfile(const std::string& filepath);
+
+    // What LoadProfile does, without keeping the profile. Null if it cannot be loaded.
+    static std::shared_ptr<Profile> ReadProfile(const std::string& filepath);
+
     bool SaveProfile(const Profile& profile, const std::string& filepath);
     void ActivateProfile(const Profile& profile);
+    // Activates a profile of the library by name, building its rules if they are not cached.
+    bool ActivateProfile(const std::string& name);
     const std::vector<Profile>& GetProfiles() const { return profiles; }
+    const ProfileLibrary& GetLibrary() const { return library; }
 
+    // Compiles a JSON profile into a binary image. This is what the offline profile
+    // compiler runs, and what LoadProfile does when an image is missing or stale.
+    static bool CompileProfile(const std::string& jsonPath, const std::string& binaryPath);
+    static std::string GetCompiledPath(const std::string& jsonPath) { return jsonPath + ".bin"; }
+
+    // The size and last write time a compiled image records for its source.
+    static bool GetSourceStamp(const std::string& filepath, uint64_t& size, int64_t& time);
+    // The content hash it records (see HashProfileSource). Reads the whole file.
+    static bool GetSourceHash(const std::string& filepath, uint32_t& hash);
 
 private:
     MappingEngine& mappingEngine;
-    std::vector<Profile> profiles;
+    std::vector<Profile> profiles; // Loaded one by one with LoadProfile
+    ProfileLibrary library;
 
-    // JSON serialization helpers
-    void to_json(nlohmann::json& j, const MappingRule& rule);
-    void from_json(const nlohmann::json& j, MappingRule& rule);
+    // Parses a JSON profile. `sourceHash` is the content hash of the text that was parsed, and
+    // `skippedBindings` counts game-action bindings that could not be turned into rules.
+    static bool ParseJsonProfile(const std::string& filepath, std::string& name, std::vector<MappingRule>& rules,
+                                 std::vector<MacroDefinition>& macros, std::vector<AxisTransform>& axisTransforms,
+                                 MouseStickSettings& mouseStick, uint32_t& sourceHash, uint32_t& skippedBindings);
 };
+
+// JSON serialization of the rule types, found by nlohmann::json through ADL.
+void to_json(nlohmann::json& j, const InputCondition& cond);
+void from_json(const nlohmann::json& j, InputCondition& cond);
+void to_json(nlohmann::json& j, const OutputAction& action);
+void from_json(const nlohmann::json& j, OutputAction& action);
+void to_json(nlohmann::json& j, const MappingRule& rule);
+void from_json(const nlohmann::json& j, MappingRule& rule);
+void to_json(nlohmann::json& j, const MacroStep& step);
+void from_json(const nlohmann::json& j, MacroStep& step);
+void to_json(nlohmann::json& j, const MacroDefinition& macro);
+void from_json(const nlohmann::json& j, MacroDefinition& macro);
+void to_json(nlohmann::json& j, const AxisTransform& transform);
+void from_json(const nlohmann::json& j, AxisTransform& transform);
+void to_json(nlohmann::json& j, const MouseStickSettings& settings);
+void from_json(const nlohmann::json& j, MouseStickSettings& settings);
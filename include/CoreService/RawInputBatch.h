@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Mapping/InputEvent.h"
+#include "Mapping/KeyNames.h"
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Batched Raw Input intake, without any Windows dependency.
+//
+// GetRawInputBuffer copies every pending input into one caller-supplied buffer as a run of
+// packed RAWINPUT records, each starting at the end of the previous one rounded up to the
+// pointer size (what NEXTRAWINPUTBLOCK computes). The pieces here read that buffer in
+// place: the arena is the buffer, the walker steps through the records without copying
+// them, and the decoder turns keyboard and mouse records into InputEvents appended to one
+// batch, which goes to the mapping worker in a single push.
+//
+// The record structs below mirror the Windows layouts field for field (RawInputHandler.cpp
+// checks this at compile time), so the same code reads real buffers on Windows and synthetic
+// ones anywhere else (see the --raw-input mode of src/Tools/CoreServiceBench.cpp).
+
+// RAWINPUTHEADER. `type` is one of the RawInputType values, `size` the size of the whole
+// record in bytes, header included.
+struct RawInputRecordHeader {
+    uint32_t type;
+    uint32_t size;
+    PhysicalDeviceID device;
+    uintptr_t wParam;
+};
+
+enum RawInputType : uint32_t {
+    RawInputMouse = 0,    // RIM_TYPEMOUSE
+    RawInputKeyboard = 1, // RIM_TYPEKEYBOARD
+    RawInputHid = 2       // RIM_TYPEHID
+};
+
+// RAWMOUSE. The button flags and data share a ULONG union in the Windows header.
+struct RawMouseData {
+    uint16_t flags;
+    uint16_t padding;
+    uint16_t buttonFlags;
+    uint16_t buttonData;
+    uint32_t rawButtons;
+    int32_t lastX;
+    int32_t lastY;
+    uint32_t extraInformation;
+};
+
+// RAWKEYBOARD
+struct RawKeyboardData {
+    uint16_t makeCode;
+    uint16_t flags;
+    uint16_t reserved;
+    uint16_t virtualKey;
+    uint32_t message;
+    uint32_t extraInformation;
+};
+
+// RAWHID. `count` reports of `sizeHid` bytes each follow.
+struct RawHidData {
+    uint32_t sizeHid;
+    uint32_t count;
+    uint8_t rawData[1];
+};
+
+// Flag values from the Windows headers that the decoder needs.
+constexpr uint16_t RawKeyBreak = 0x01;      // RI_KEY_BREAK
+constexpr uint16_t RawKeyE0 = 0x02;         // RI_KEY_E0
+constexpr uint16_t RawKeyE1 = 0x04;         // RI_KEY_E1
+constexpr uint16_t RawMouseAbsolute = 0x01; // MOUSE_MOVE_ABSOLUTE
+constexpr uint16_t RawMouseWheel = 0x0400;  // RI_MOUSE_WHEEL
+constexpr uint16_t RawMouseHWheel = 0x0800; // RI_MOUSE_HWHEEL
+
+// The buffer GetRawInputBuffer and GetRawInputData write into. Allocated once, aligned to a
+// cache line (Windows only asks for pointer alignment), and grown only when a single input
+// does not fit, which in practice means a HID device with unusually large reports.
+class RawInputArena {
+public:
+    static constexpr size_t Alignment = 64;
+    static constexpr size_t DefaultCapacity = 16 * 1024;
+
+    explicit RawInputArena(size_t capacity = DefaultCapacity) { Reserve(capacity); }
+
+    void* GetData() { return blocks.get(); }
+    const void* GetData() const { return blocks.get(); }
+    size_t GetCapacity() const { return blockCount * Alignment; }
+
+    // Makes room for at least `bytes`. Growing discards the contents.
+    void Reserve(size_t bytes);
+
+private:
+    struct alignas(Alignment) Block {
+        unsigned char bytes[Alignment];
+    };
+    std::unique_ptr<Block[]> blocks;
+    size_t blockCount = 0;
+};
+
+// Steps through `count` packed records in the first `bytes` of a buffer. Records are
+// returned in place. A record that is shorter than its header or claims to run past the end
+// of the data ends the walk, so a malformed buffer is never read out of bounds.
+class RawInputWalker {
+public:
+    RawInputWalker(const void* data, size_t bytes, size_t count)
+        : cursor(static_cast<const unsigned char*>(data)), end(cursor + bytes), remaining(count) {}
+
+    // The next record, or nullptr once `count` records have been read or the data ends.
+    const RawInputRecordHeader* Next();
+
+    // The record's payload; the type must match the header's `type`.
+    template <typename T>
+    static const T& GetPayload(const RawInputRecordHeader& record) {
+        return *reinterpret_cast<const T*>(reinterpret_cast<const unsigned char*>(&record) + sizeof(RawInputRecordHeader));
+    }
+
+    // Where a record of `recordSize` bytes at `offset` is followed by the next one.
+    static constexpr size_t NextOffset(size_t offset, size_t recordSize) {
+        return (offset + recordSize + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+    }
+
+private:
+    const unsigned char* cursor;
+    const unsigned char* end;
+    size_t remaining;
+};
+
+// Turns keyboard and mouse records into InputEvents:
+//   keys           InputType::Key events keyed by scan code (see KeyNames.h); autorepeat is
+//                  dropped, so each press and release appears exactly once
+//   mouse buttons  InputType::MouseButton events; a wheel step is a press in one frame and
+//                  a release in the next
+//   mouse motion   summed, and taken once per batch for the mouse-to-stick counters
+// Every decoded report ends with a frame marker (an InputType::Unknown event), as the
+// mapping worker's queue expects. Input without a device, i.e. injected with SendInput, is
+// ignored so the service never reacts to its own output or to other software's macros.
+class RawInputDecoder {
+public:
+    // Appends the record's events to `events`, as coming from `device`, the DeviceIndex of
+    // the record's handle. Returns false, appending nothing, for records that are not
+    // keyboard or mouse input.
+    bool Decode(const RawInputRecordHeader& record, DeviceIndex device, uint64_t captureTime, std::vector<InputEvent>& events);
+
+    // Forgets `device` after it was unplugged, appending a release for every key and mouse
+    // button it still held, as one frame, so nothing stays pressed and its index can go to a new device.
+    void RemoveDevice(DeviceIndex device, uint64_t time, std::vector<InputEvent>& events);
+
+    // Relative mouse movement decoded since the last call.
+    void TakeMouseDelta(int32_t& dx, int32_t& dy) {
+        dx = mouseX;
+        dy = mouseY;
+        mouseX = 0;
+        mouseY = 0;
+    }
+
+private:
+    void DecodeKeyboard(DeviceIndex device, const RawKeyboardData& keyboard, uint64_t captureTime, std::vector<InputEvent>& events);
+    void DecodeMouse(DeviceIndex device, const RawMouseData& mouse, uint64_t captureTime, std::vector<InputEvent>& events);
+
+    // Keys each keyboard holds down. Windows repeats the make code while a key is held;
+    // only the first one is a press. Indexed by DeviceIndex.
+    std::array<std::bitset<KeyCodeCount>, MaxDevices> keysDown{};
+    // Mouse buttons each mouse holds down, bit N for MouseButtonId N. Only kept so that
+    // RemoveDevice can let go of them.
+    std::array<uint8_t, MaxDevices> mouseButtonsDown{};
+    int32_t mouseX = 0;
+    int32_t mouseY = 0;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+// A bounded, lock-free single-producer/single-consumer queue of trivially-copyable items.
+//
+// The producer only ever writes the tail index and the consumer only the head index; each
+// lives on its own cache line, and each side keeps a private copy of the other side's index
+// so it only touches the shared line when the ring looks full (producer) or empty (consumer).
+// A push into a full ring fails instead of blocking. TryPush counts it as an overflow;
+// PushBatch leaves what did not fit to the caller, which can retry it.
+//
+// Nothing here is platform specific, so the ring can be stress-tested on any OS.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing items are copied around as raw memory");
+
+public:
+    static constexpr size_t CacheLineSize = 64;
+
+    SpscRing() : slots(new T[Capacity]) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Returns false (and counts an overflow) if the ring is full.
+    bool TryPush(const T& item) {
+        const size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - cachedHead == Capacity) {
+            cachedHead = headIndex.load(std::memory_order_acquire);
+            if (tail - cachedHead == Capacity) {
+                overflowCount.store(overflowCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots[tail & Mask] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side. Pushes as many of `items` as fit with a single index update and returns
+    // how many that was. The rest are not counted; the caller still has them.
+    size_t PushBatch(const T* items, size_t count) {
+        const size_t tail = tailIndex.load(std::memory_order_relaxed);
+        size_t space = Capacity - (tail - cachedHead);
+        if (space < count) {
+            cachedHead = headIndex.load(std::memory_order_acquire);
+            space = Capacity - (tail - cachedHead);
+        }
+        const size_t pushed = count < space ? count : space;
+        for (size_t i = 0; i < pushed; ++i) {
+            slots[(tail + i) & Mask] = items[i];
+        }
+        if (pushed != 0) {
+            tailIndex.store(tail + pushed, std::memory_order_release);
+        }
+        return pushed;
+    }
+
+    // Consumer side. Copies up to `maxItems` items into `out` and returns how many.
+    size_t PopBatch(T* out, size_t maxItems) {
+        const size_t head = headIndex.load(std::memory_order_relaxed);
+        size_t available = cachedTail - head;
+        if (available == 0) {
+            cachedTail = tailIndex.load(std::memory_order_acquire);
+            available = cachedTail - head;
+            if (available == 0) {
+                return 0;
+            }
+        }
+        const size_t count = available < maxItems ? available : maxItems;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = slots[(head + i) & Mask];
+        }
+        headIndex.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    bool TryPop(T& out) { return PopBatch(&out, 1) == 1; }
+
+    // Exact on either side for its own view; a snapshot when read from anywhere else.
+    bool IsEmpty() const {
+        return tailIndex.load(std::memory_order_acquire) == headIndex.load(std::memory_order_acquire);
+    }
+
+    size_t GetSize() const {
+        return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire);
+    }
+
+    // Number of TryPush calls rejected because the ring was full. Safe to read from any thread.
+    uint64_t GetOverflowCount() const { return overflowCount.load(std::memory_order_relaxed); }
+
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+private:
+    static constexpr size_t Mask = Capacity - 1;
+
+    // Consumer-owned line.
+    alignas(CacheLineSize) std::atomic<size_t> headIndex{ 0 };
+    size_t cachedTail = 0;
+
+    // Producer-owned line.
+    alignas(CacheLineSize) std::atomic<size_t> tailIndex{ 0 };
+    size_t cachedHead = 0;
+    std::atomic<uint64_t> overflowCount{ 0 };
+
+    alignas(CacheLineSize) std::unique_ptr<T[]> slots;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the service's startup stages on a small thread pool, each as soon as the stages it
+// depends on have succeeded, so independent work (connecting to ViGEmBus, loading profiles,
+// the device sweep) overlaps instead of adding up.
+//
+// Stages that must run on a particular thread, such as creating the window whose thread
+// receives raw input, are marked OnCaller: the pool never runs them, and the owning thread
+// runs them with RunHere once their dependencies are done. A stage that fails (returns false
+// or throws) skips everything that depends on it, directly or not.
+//
+// Every stage's start and end are kept for Dump, relative to Start.
+class StartupOrchestrator {
+public:
+    using StageId = uint32_t;
+
+    static constexpr size_t MaxThreads = 4;
+
+    enum class Runs : uint8_t { OnPool, OnCaller };
+    enum class State : uint8_t { Waiting, Running, Succeeded, Failed, Skipped };
+
+    struct Timing {
+        const char* name;
+        State state;
+        uint8_t thread;   // 0 = the caller, 1.. = pool threads
+        uint64_t startNs; // Since Start; both 0 if the stage never ran
+        uint64_t endNs;
+    };
+
+    // 0 threads: MaxThreads. Startup stages mostly wait on drivers and the disk, so they
+    // overlap even on a single core.
+    explicit StartupOrchestrator(size_t threadCount = 0);
+
+    // Skips the OnCaller stages that never ran, waits for the rest and joins the pool.
+    ~StartupOrchestrator();
+
+    StartupOrchestrator(const StartupOrchestrator&) = delete;
+    StartupOrchestrator& operator=(const StartupOrchestrator&) = delete;
+
+    // Adds a stage that runs `work` after every stage in `after`. All stages are added
+    // before Start. `name` must outlive the orchestrator (it is logged as is).
+    StageId Add(const char* name, std::function<bool()> work, const std::vector<StageId>& after = {}, Runs runs = Runs::OnPool);
+
+    // Starts the pool on the stages with nothing to wait for.
+    void Start();
+
+    // Runs an OnCaller stage on this thread once its dependencies are done, and returns
+    // whether it succeeded. For an OnPool stage, the same as Wait.
+    bool RunHere(StageId stage);
+
+    // Waits until `stage` has finished or been skipped; true if it succeeded.
+    bool Wait(StageId stage);
+
+    // Skips the OnCaller stages that have not run and waits for everything else.
+    void WaitAll();
+
+    State GetState(StageId stage) const;
+    std::vector<Timing> GetTimings() const;
+
+    // A table of the stages in the order they started, with their threads and times.
+    void Dump(std::ostream& out) const;
+
+private:
+    struct Stage {
+        const char* name;
+        std::function<bool()> work;
+        std::vector<StageId> dependents;
+        uint32_t waitingFor = 0;
+        Runs runs;
+        State state = State::Waiting;
+        uint8_t thread = 0;
+        uint64_t startNs = 0;
+        uint64_t endNs = 0;
+    };
+
+    static bool IsDone(State state) { return state == State::Succeeded || state == State::Failed || state == State::Skipped; }
+
+    void WorkerLoop(uint8_t thread);
+
+    // Runs `stage`, which the caller has just taken out of Waiting, with the lock released.
+    void Run(std::unique_lock<std::mutex>& lock, StageId stage, uint8_t thread);
+
+    // Records the outcome of a stage and releases or skips its dependents. Lock held.
+    void Finish(StageId stage, State state);
+    void Skip(StageId stage);
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Stage> stages;
+    std::vector<StageId> ready; // OnPool stages with nothing left to wait for
+    std::vector<std::thread> workers;
+    size_t threadCount;
+    size_t unfinished = 0;
+    uint64_t startNs = 0;
+    bool started = false;
+    bool stopping = false;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A hierarchical timer wheel over a fixed pool of timers.
+//
+// Time is cut into ticks of `tickNs`. Level 0 has one slot per tick for the next 64 ticks,
+// level 1 one slot per 64 ticks for the next 4096, and so on for four levels (about 28
+// minutes at 100 us ticks). A timer sits in the finest level that can still hold it and is
+// moved down a level when the wheel reaches its slot's boundary. Scheduling, cancelling and
+// firing are O(1); nothing is allocated after construction because timers are indices into
+// a pool owned by the wheel.
+//
+// The wheel has no clock of its own: Advance is handed the current time, so the same code
+// runs on the scheduler thread and under a virtual clock.
+class TimerWheel {
+public:
+    static constexpr uint32_t NoTimer = UINT32_MAX;
+    static constexpr size_t LevelBits = 6;
+    static constexpr size_t SlotsPerLevel = size_t{ 1 } << LevelBits;
+    static constexpr size_t Levels = 4;
+
+    // `capacity` timers, numbered 0 .. capacity-1. `startNs` is the time of tick 0.
+    TimerWheel(size_t capacity, uint64_t tickNs, uint64_t startNs)
+        : nodes(capacity), tickNs(tickNs), originNs(startNs) {
+        heads.fill(NoTimer);
+    }
+
+    // Arms `timer` to fire at the first tick at or after `deadlineNs`, replacing any earlier
+    // schedule. Deadlines in the past fire on the next Advance.
+    void Schedule(uint32_t timer, uint64_t deadlineNs) {
+        if (nodes[timer].scheduled) {
+            Unlink(timer);
+        }
+        Node& node = nodes[timer];
+        node.deadlineNs = deadlineNs;
+        node.tick = deadlineNs <= originNs ? 0 : (deadlineNs - originNs + tickNs - 1) / tickNs;
+        Insert(timer, currentTick, currentTick + 1);
+    }
+
+    void Cancel(uint32_t timer) {
+        if (nodes[timer].scheduled) {
+            Unlink(timer);
+        }
+    }
+
+    bool IsScheduled(uint32_t timer) const { return nodes[timer].scheduled; }
+    uint64_t GetDeadline(uint32_t timer) const { return nodes[timer].deadlineNs; }
+    size_t GetScheduledCount() const { return scheduledCount; }
+    uint64_t GetTickNs() const { return tickNs; }
+
+    // Fires every timer due at or before `nowNs`, in tick order, by calling fire(timer).
+    // The timer is already disarmed when fire runs, so fire may schedule it again; it may
+    // also schedule or cancel any other timer.
+    template <typename Fire>
+    void Advance(uint64_t nowNs, Fire&& fire) {
+        if (nowNs < originNs) {
+            return;
+        }
+        const uint64_t nowTick = (nowNs - originNs) / tickNs;
+        while (currentTick < nowTick) {
+            if (scheduledCount == 0) {
+                currentTick = nowTick;
+                break;
+            }
+
+            // Skip straight to the next boundary of the finest non-empty level; nothing in
+            // between can fire.
+            uint64_t tick = currentTick + 1;
+            for (size_t level = 0; level < Levels - 1 && levelCounts[level] == 0; ++level) {
+                const size_t shift = LevelBits * (level + 1);
+                tick = ((currentTick >> shift) + 1) << shift;
+            }
+            if (tick > nowTick) {
+                currentTick = nowTick;
+                break;
+            }
+
+            // Move timers down from coarser levels whose slot boundary is this tick, coarsest
+            // first, so a timer can fall through several levels at once.
+            for (size_t level = Levels - 1; level > 0; --level) {
+                const size_t shift = LevelBits * level;
+                if ((tick & ((uint64_t{ 1 } << shift) - 1)) == 0) {
+                    Cascade(level, static_cast<size_t>((tick >> shift) & (SlotsPerLevel - 1)), tick);
+                }
+            }
+
+            currentTick = tick;
+            uint32_t& head = heads[tick & (SlotsPerLevel - 1)];
+            for (uint32_t timer; (timer = head) != NoTimer;) {
+                Unlink(timer);
+                fire(timer);
+            }
+        }
+    }
+
+    // The earliest time at which Advance could have work to do; UINT64_MAX if nothing is
+    // scheduled. Callers sleep until then (or until something new is scheduled).
+    uint64_t GetNextWakeNs() const {
+        if (scheduledCount == 0) {
+            return UINT64_MAX;
+        }
+        // The next cascade of the finest non-empty coarse level may bring a timer down
+        // before anything already in level 0 is due.
+        uint64_t wakeTick = UINT64_MAX;
+        for (size_t level = 1; level < Levels; ++level) {
+            if (levelCounts[level] != 0) {
+                const size_t shift = LevelBits * level;
+                wakeTick = ((currentTick >> shift) + 1) << shift;
+                break;
+            }
+        }
+        if (levelCounts[0] != 0) {
+            for (uint64_t tick = currentTick + 1; tick <= currentTick + SlotsPerLevel && tick < wakeTick; ++tick) {
+                if (heads[tick & (SlotsPerLevel - 1)] != NoTimer) {
+                    wakeTick = tick;
+                    break;
+                }
+            }
+        }
+        return originNs + wakeTick * tickNs;
+    }
+
+private:
+    struct Node {
+        uint64_t deadlineNs = 0;
+        uint64_t tick = 0;
+        uint32_t next = NoTimer;
+        uint32_t prev = NoTimer;
+        uint16_t slot = 0; // level * SlotsPerLevel + slot within the level
+        bool scheduled = false;
+    };
+
+    // Files `timer` relative to `reference`, the tick the wheel is at (or is cascading
+    // to). A timer goes to the finest level whose range above it agrees with `reference`,
+    // so it is reached by that level's slot walk or cascade before it is due. Ticks
+    // earlier than `earliest` are treated as `earliest`.
+    void Insert(uint32_t timer, uint64_t reference, uint64_t earliest) {
+        Node& node = nodes[timer];
+        const uint64_t tick = node.tick > earliest ? node.tick : earliest;
+
+        size_t level = 0;
+        while (level < Levels - 1 && (tick >> (LevelBits * (level + 1))) != (reference >> (LevelBits * (level + 1)))) {
+            ++level;
+        }
+        // The top level has no range above it; it covers one revolution ahead of
+        // `reference`. Anything further out waits in the last slot to come round and is
+        // re-filed from there.
+        uint64_t block = tick >> (LevelBits * level);
+        if (level == Levels - 1) {
+            const uint64_t lastBlock = (reference >> (LevelBits * level)) + SlotsPerLevel;
+            block = block < lastBlock ? block : lastBlock;
+        }
+        size_t slot = static_cast<size_t>(block & (SlotsPerLevel - 1));
+        slot += level * SlotsPerLevel;
+
+        node.slot = static_cast<uint16_t>(slot);
+        node.prev = NoTimer;
+        node.next = heads[slot];
+        if (node.next != NoTimer) {
+            nodes[node.next].prev = timer;
+        }
+        heads[slot] = timer;
+        node.scheduled = true;
+        ++levelCounts[level];
+        ++scheduledCount;
+    }
+
+    void Unlink(uint32_t timer) {
+        Node& node = nodes[timer];
+        if (node.prev != NoTimer) {
+            nodes[node.prev].next = node.next;
+        } else {
+            heads[node.slot] = node.next;
+        }
+        if (node.next != NoTimer) {
+            nodes[node.next].prev = node.prev;
+        }
+        node.next = node.prev = NoTimer;
+        node.scheduled = false;
+        --levelCounts[node.slot / SlotsPerLevel];
+        --scheduledCount;
+    }
+
+    // Re-files every timer in one slot now that the wheel has reached `tick`, that slot's
+    // boundary. Each lands on a finer level, or in level 0 at `tick` itself if it is due.
+    void Cascade(size_t level, size_t slot, uint64_t tick) {
+        uint32_t timer = heads[level * SlotsPerLevel + slot];
+        while (timer != NoTimer) {
+            const uint32_t next = nodes[timer].next;
+            Unlink(timer);
+            Insert(timer, tick, tick);
+            timer = next;
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::array<uint32_t, Levels * SlotsPerLevel> heads;
+    std::array<size_t, Levels> levelCounts{};
+    size_t scheduledCount = 0;
+    uint64_t currentTick = 0;
+    uint64_t tickNs;
+    uint64_t originNs;
+};
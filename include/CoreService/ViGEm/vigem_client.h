@@ -24,4 +24,17 @@ void vigem_target_free(PVIGEM_TARGET target);
 int vigem_target_add(PVIGEM_CLIENT vigem, PVIGEM_TARGET target);
 int vigem_target_remove(PVIGEM_CLIENT vigem, PVIGEM_TARGET target);
 
-// ... other function prototypes for updating the target state (buttons, axes, etc.)
+// Xbox 360 report, as submitted to an Xbox360Wired target
+typedef struct _XUSB_REPORT {
+    unsigned short wButtons;
+    unsigned char bLeftTrigger;
+    unsigned char bRightTrigger;
+    short sThumbLX;
+    short sThumbLY;
+    short sThumbRX;
+    short sThumbRY;
+} XUSB_REPORT;
+
+int vigem_target_x360_update(PVIGEM_CLIENT vigem, PVIGEM_TARGET target, XUSB_REPORT report);
+
+// ... other function prototypes for other target types (DualShock 4, etc.)
@@ -0,0 +1,365 @@
+#include "CoreService/Mapping/AxisTransform.h"
+#include "GamepadSink.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CORESERVICE_AXIS_SSE2 1
+#include <emmintrin.h>
+#else
+#define CORESERVICE_AXIS_SSE2 0
+#endif
+
+// Everything below relies on each float expression being evaluated exactly as written.
+// Contracting a multiply and an add into an FMA in one version but not the other would
+// break bit-exactness, so the build compiles this file with -ffp-contract=off.
+
+namespace {
+    // Same results as MINPS/MAXPS, including which zero comes back, so the scalar code
+    // matches the SIMD code exactly.
+    inline float Min(float a, float b) { return a < b ? a : b; }
+    inline float Max(float a, float b) { return a > b ? a : b; }
+
+    bool IsTrigger(size_t lane) {
+        return lane == AxisTransformSet::LeftTrigger || lane == AxisTransformSet::RightTrigger;
+    }
+
+    float FullScale(size_t lane) {
+        return IsTrigger(lane) ? 255.0f : 32767.0f;
+    }
+
+    void ReadLanes(const GamepadReport& report, int32_t (&lanes)[AxisTransformSet::LaneCount]) {
+        lanes[AxisTransformSet::LeftX] = report.thumbLX;
+        lanes[AxisTransformSet::LeftY] = report.thumbLY;
+        lanes[AxisTransformSet::RightX] = report.thumbRX;
+        lanes[AxisTransformSet::RightY] = report.thumbRY;
+        lanes[AxisTransformSet::LeftTrigger] = report.leftTrigger;
+        lanes[AxisTransformSet::RightTrigger] = report.rightTrigger;
+        lanes[6] = lanes[7] = 0;
+    }
+
+    void WriteLanes(const int32_t (&lanes)[AxisTransformSet::LaneCount], GamepadReport& report) {
+        report.thumbLX = static_cast<int16_t>(lanes[AxisTransformSet::LeftX]);
+        report.thumbLY = static_cast<int16_t>(lanes[AxisTransformSet::LeftY]);
+        report.thumbRX = static_cast<int16_t>(lanes[AxisTransformSet::RightX]);
+        report.thumbRY = static_cast<int16_t>(lanes[AxisTransformSet::RightY]);
+        report.leftTrigger = static_cast<uint8_t>(lanes[AxisTransformSet::LeftTrigger]);
+        report.rightTrigger = static_cast<uint8_t>(lanes[AxisTransformSet::RightTrigger]);
+    }
+
+    // Samples a transform's curve at CurvePoints evenly spaced magnitudes. This is the
+    // definition of the curve: everything interpolates linearly between these samples.
+    void SampleCurve(const AxisTransform& transform, float* samples) {
+        constexpr size_t last = AxisTransformSet::CurvePoints - 1;
+        for (size_t i = 0; i <= last; ++i) {
+            const double x = static_cast<double>(i) / last;
+            double y = x;
+            if (transform.curve == AxisTransform::Curve::Exponential) {
+                y = std::pow(x, static_cast<double>(transform.exponent));
+            } else if (transform.curve == AxisTransform::Curve::Custom && transform.points.size() >= 2) {
+                const double position = x * static_cast<double>(transform.points.size() - 1);
+                const size_t index = std::min(static_cast<size_t>(position), transform.points.size() - 2);
+                const double t = position - static_cast<double>(index);
+                y = transform.points[index] + (transform.points[index + 1] - transform.points[index]) * t;
+            }
+            samples[i] = static_cast<float>(y < 0.0 ? 0.0 : (y > 1.0 ? 1.0 : y));
+        }
+    }
+
+    bool HasCurve(const AxisTransform& transform) {
+        return transform.curve == AxisTransform::Curve::Exponential ||
+               (transform.curve == AxisTransform::Curve::Custom && transform.points.size() >= 2);
+    }
+
+    float Clamp01(float value) {
+        return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    }
+
+    // Profiles write fractions; anything at or above 1 would divide by zero below.
+    float ClampDeadzone(float value) {
+        return value < 0.0f ? 0.0f : (value > 0.99f ? 0.99f : value);
+    }
+}
+
+AxisTransformSet::AxisTransformSet() : AxisTransformSet(std::vector<AxisTransform>{}) {}
+
+AxisTransformSet::AxisTransformSet(const std::vector<AxisTransform>& transforms) {
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        const float scale = lane < UsedLanes ? FullScale(lane) : 1.0f;
+        inputScale[lane] = 1.0f / scale;
+        outputScale[lane] = scale;
+        outputMin[lane] = lane < UsedLanes && !IsTrigger(lane) ? -32768.0f : 0.0f;
+        outputMax[lane] = scale;
+        radialDeadzone[lane] = 0.0f;
+        radialScale[lane] = 1.0f;
+        deadzone[lane] = 0.0f;
+        deadzoneScale[lane] = 1.0f;
+        antiDeadzone[lane] = 0.0f;
+        antiDeadzoneScale[lane] = 1.0f;
+        sensitivity[lane] = 1.0f;
+        invertScale[lane] = 1.0f;
+        invertOffset[lane] = 0.0f;
+        activeMask[lane] = 0;
+        radialMask[lane] = 0;
+        curves[lane].fill(0.0f);
+    }
+
+    for (const auto& transform : transforms) {
+        const size_t lane = LaneOf(transform.axis);
+        if (lane == UsedLanes) {
+            continue;
+        }
+        activeLanes |= 1u << lane;
+
+        if (!IsTrigger(lane) && transform.radialDeadzone > 0.0f) {
+            // A radial deadzone belongs to the whole stick.
+            const size_t first = lane & ~size_t{ 1 };
+            const float radial = ClampDeadzone(Max(transform.radialDeadzone, radialDeadzone[first]));
+            for (size_t stickLane = first; stickLane < first + 2; ++stickLane) {
+                activeLanes |= 1u << stickLane;
+                radialDeadzone[stickLane] = radial;
+                radialScale[stickLane] = 1.0f / (1.0f - radial);
+                radialMask[stickLane] = ~0u;
+            }
+        }
+
+        deadzone[lane] = ClampDeadzone(transform.deadzone);
+        deadzoneScale[lane] = 1.0f / (1.0f - deadzone[lane]);
+        antiDeadzone[lane] = Clamp01(transform.antiDeadzone);
+        antiDeadzoneScale[lane] = 1.0f - antiDeadzone[lane];
+        sensitivity[lane] = transform.sensitivity > 0.0f ? transform.sensitivity : 0.0f;
+        invertScale[lane] = transform.invert ? -1.0f : 1.0f;
+        invertOffset[lane] = transform.invert && IsTrigger(lane) ? 1.0f : 0.0f;
+        // A later transform for the same axis replaces the earlier one, curve included.
+        if (HasCurve(transform)) {
+            curveLanes |= 1u << lane;
+            SampleCurve(transform, curves[lane].data());
+        } else {
+            curveLanes &= ~(1u << lane);
+        }
+    }
+
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        activeMask[lane] = (activeLanes >> lane) & 1 ? ~0u : 0u;
+    }
+}
+
+size_t AxisTransformSet::LaneOf(VirtualAxisType axis) {
+    switch (axis) {
+        case VirtualAxisType::XBOX_LEFT_STICK_X: return LeftX;
+        case VirtualAxisType::XBOX_LEFT_STICK_Y: return LeftY;
+        case VirtualAxisType::XBOX_RIGHT_STICK_X: return RightX;
+        case VirtualAxisType::XBOX_RIGHT_STICK_Y: return RightY;
+        case VirtualAxisType::XBOX_LEFT_TRIGGER: return LeftTrigger;
+        case VirtualAxisType::XBOX_RIGHT_TRIGGER: return RightTrigger;
+        default: return UsedLanes;
+    }
+}
+
+bool AxisTransformSet::HasSimd() {
+    return CORESERVICE_AXIS_SSE2 != 0;
+}
+
+void AxisTransformSet::Apply(GamepadReport& report) const {
+    if (activeLanes == 0) {
+        return;
+    }
+#if CORESERVICE_AXIS_SSE2
+    ApplySimd(report);
+#else
+    ApplyScalar(report);
+#endif
+}
+
+float AxisTransformSet::Interpolate(size_t lane, float magnitude) const {
+    const float position = magnitude * static_cast<float>(CurvePoints - 1);
+    size_t index = static_cast<size_t>(position);
+    index = index < CurvePoints - 2 ? index : CurvePoints - 2;
+    const float t = position - static_cast<float>(index);
+    const float* samples = curves[lane].data();
+    return samples[index] + (samples[index + 1] - samples[index]) * t;
+}
+
+void AxisTransformSet::ApplyScalar(GamepadReport& report) const {
+    if (activeLanes == 0) {
+        return;
+    }
+    int32_t lanes[LaneCount];
+    ReadLanes(report, lanes);
+
+    float value[LaneCount];
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        value[lane] = static_cast<float>(lanes[lane]) * inputScale[lane];
+    }
+
+    // Radial deadzone, on the length of each stick. Lanes come in (X, Y) pairs.
+    float radial[LaneCount];
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        const float partner = value[lane ^ 1];
+        const float length = std::sqrt(value[lane] * value[lane] + partner * partner);
+        const float factor = length <= radialDeadzone[lane] ? 0.0f : Min((length - radialDeadzone[lane]) * radialScale[lane], 1.0f) / length;
+        radial[lane] = radialMask[lane] != 0 ? value[lane] * factor : value[lane];
+    }
+
+    float magnitude[LaneCount];
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        value[lane] = radial[lane];
+        magnitude[lane] = Min(Max(std::fabs(value[lane]) - deadzone[lane], 0.0f) * deadzoneScale[lane], 1.0f);
+    }
+
+    for (uint32_t curved = curveLanes; curved != 0; curved &= curved - 1) {
+        size_t lane = 0;
+        while (((curved >> lane) & 1) == 0) {
+            ++lane;
+        }
+        magnitude[lane] = Interpolate(lane, magnitude[lane]);
+    }
+
+    for (size_t lane = 0; lane < LaneCount; ++lane) {
+        float m = magnitude[lane] > 0.0f ? antiDeadzone[lane] + magnitude[lane] * antiDeadzoneScale[lane] : 0.0f;
+        m = Min(m * sensitivity[lane], 1.0f);
+        const float shaped = std::copysign(m, value[lane]) * invertScale[lane] + invertOffset[lane];
+        const float scaled = Min(Max(shaped * outputScale[lane], outputMin[lane]), outputMax[lane]);
+        if (activeMask[lane] != 0) {
+            lanes[lane] = static_cast<int32_t>(std::nearbyint(scaled));
+        }
+    }
+    WriteLanes(lanes, report);
+}
+
+void AxisTransformSet::ApplySimd(GamepadReport& report) const {
+#if CORESERVICE_AXIS_SSE2
+    if (activeLanes == 0) {
+        return;
+    }
+    alignas(16) int32_t lanes[LaneCount];
+    ReadLanes(report, lanes);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    auto load = [](const float* p) { return _mm_load_ps(p); };
+    auto loadMask = [](const uint32_t* p) { return _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(p))); };
+    auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+    // First half of the pipeline, up to the curve, for lanes 4h..4h+3.
+    __m128 value[2], magnitude[2];
+    for (size_t h = 0; h < 2; ++h) {
+        const size_t base = h * 4;
+        __m128 v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(lanes + base))), load(inputScale + base));
+
+        // Swapping neighbours puts each stick axis next to its partner.
+        const __m128 partner = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(v, v), _mm_mul_ps(partner, partner)));
+        const __m128 outside = _mm_cmpgt_ps(length, load(radialDeadzone + base)); // !(length <= deadzone)
+        const __m128 factor = _mm_and_ps(outside, _mm_div_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(length, load(radialDeadzone + base)), load(radialScale + base)), one), length));
+        v = select(loadMask(radialMask + base), _mm_mul_ps(v, factor), v);
+
+        value[h] = v;
+        magnitude[h] = _mm_min_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, v), load(deadzone + base)), zero), load(deadzoneScale + base)), one);
+    }
+
+    if (curveLanes != 0) {
+        alignas(16) float m[LaneCount];
+        _mm_store_ps(m, magnitude[0]);
+        _mm_store_ps(m + 4, magnitude[1]);
+        for (uint32_t curved = curveLanes; curved != 0; curved &= curved - 1) {
+            size_t lane = 0;
+            while (((curved >> lane) & 1) == 0) {
+                ++lane;
+            }
+            m[lane] = Interpolate(lane, m[lane]);
+        }
+        magnitude[0] = _mm_load_ps(m);
+        magnitude[1] = _mm_load_ps(m + 4);
+    }
+
+    for (size_t h = 0; h < 2; ++h) {
+        const size_t base = h * 4;
+        __m128 m = magnitude[h];
+        m = _mm_and_ps(_mm_cmpgt_ps(m, zero), _mm_add_ps(load(antiDeadzone + base), _mm_mul_ps(m, load(antiDeadzoneScale + base))));
+        m = _mm_min_ps(_mm_mul_ps(m, load(sensitivity + base)), one);
+        const __m128 shaped = _mm_add_ps(_mm_mul_ps(_mm_or_ps(m, _mm_and_ps(value[h], signBit)), load(invertScale + base)), load(invertOffset + base));
+        const __m128 scaled = _mm_min_ps(_mm_max_ps(_mm_mul_ps(shaped, load(outputScale + base)), load(outputMin + base)), load(outputMax + base));
+        const __m128i rounded = _mm_cvtps_epi32(scaled);
+        const __m128i active = _mm_load_si128(reinterpret_cast<const __m128i*>(activeMask + base));
+        const __m128i original = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes + base));
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + base),
+                        _mm_or_si128(_mm_and_si128(active, rounded), _mm_andnot_si128(active, original)));
+    }
+    WriteLanes(lanes, report);
+#else
+    ApplyScalar(report);
+#endif
+}
+
+void AxisTransformSet::ApplyReference(const std::vector<AxisTransform>& transforms, GamepadReport& report) {
+    int32_t lanes[LaneCount];
+    ReadLanes(report, lanes);
+
+    // Gather each axis's transform, and each stick's radial deadzone.
+    const AxisTransform* byLane[UsedLanes] = {};
+    float stickRadial[UsedLanes] = {};
+    for (const auto& transform : transforms) {
+        const size_t lane = LaneOf(transform.axis);
+        if (lane == UsedLanes) {
+            continue;
+        }
+        byLane[lane] = &transform;
+        if (!IsTrigger(lane) && transform.radialDeadzone > 0.0f) {
+            const size_t first = lane & ~size_t{ 1 };
+            stickRadial[first] = stickRadial[first + 1] = ClampDeadzone(Max(transform.radialDeadzone, stickRadial[first]));
+        }
+    }
+
+    int32_t result[LaneCount];
+    std::memcpy(result, lanes, sizeof(result));
+    for (size_t lane = 0; lane < UsedLanes; ++lane) {
+        if (byLane[lane] == nullptr && stickRadial[lane] == 0.0f) {
+            continue;
+        }
+        static const AxisTransform identity;
+        const AxisTransform& transform = byLane[lane] != nullptr ? *byLane[lane] : identity;
+        const float fullScale = FullScale(lane);
+
+        float value = static_cast<float>(lanes[lane]) * (1.0f / fullScale);
+        if (stickRadial[lane] > 0.0f) {
+            const float partner = static_cast<float>(lanes[lane ^ 1]) * (1.0f / fullScale);
+            const float length = std::sqrt(value * value + partner * partner);
+            if (length <= stickRadial[lane]) {
+                value = value * 0.0f;
+            } else {
+                value = value * (Min((length - stickRadial[lane]) * (1.0f / (1.0f - stickRadial[lane])), 1.0f) / length);
+            }
+        }
+
+        const float dz = ClampDeadzone(transform.deadzone);
+        float magnitude = Min(Max(std::fabs(value) - dz, 0.0f) * (1.0f / (1.0f - dz)), 1.0f);
+
+        if (HasCurve(transform)) {
+            float samples[CurvePoints];
+            SampleCurve(transform, samples);
+            const float position = magnitude * static_cast<float>(CurvePoints - 1);
+            const size_t index = std::min(static_cast<size_t>(position), CurvePoints - 2);
+            const float t = position - static_cast<float>(index);
+            magnitude = samples[index] + (samples[index + 1] - samples[index]) * t;
+        }
+
+        if (magnitude > 0.0f) {
+            const float anti = Clamp01(transform.antiDeadzone);
+            magnitude = anti + magnitude * (1.0f - anti);
+        }
+        magnitude = Min(magnitude * (transform.sensitivity > 0.0f ? transform.sensitivity : 0.0f), 1.0f);
+
+        float shaped = std::copysign(magnitude, value);
+        if (transform.invert) {
+            shaped = IsTrigger(lane) ? shaped * -1.0f + 1.0f : shaped * -1.0f + 0.0f;
+        } else {
+            shaped = shaped * 1.0f + 0.0f;
+        }
+        const float scaled = Min(Max(shaped * fullScale, IsTrigger(lane) ? 0.0f : -32768.0f), fullScale);
+        result[lane] = static_cast<int32_t>(std::nearbyint(scaled));
+    }
+    WriteLanes(result, report);
+}
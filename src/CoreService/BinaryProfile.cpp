@@ -0,0 +1,524 @@
+#include "CoreService/BinaryProfile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    uint32_t Fnv1a(const uint8_t* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    uint32_t AlignUp(size_t value) {
+        return static_cast<uint32_t>((value + 7) & ~size_t{ 7 });
+    }
+
+    // Collects NUL-terminated strings and hands out their offsets.
+    class StringTable {
+    public:
+        StringTable() : bytes(1, '\0') {}
+
+        uint32_t Add(const std::string& text) {
+            if (text.empty()) {
+                return 0;
+            }
+            const auto offset = static_cast<uint32_t>(bytes.size());
+            bytes.insert(bytes.end(), text.begin(), text.end());
+            bytes.push_back('\0');
+            return offset;
+        }
+
+        const std::vector<char>& GetBytes() const { return bytes; }
+
+    private:
+        std::vector<char> bytes;
+    };
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        ::close(file);
+        return false;
+    }
+    fd = file;
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(data), size);
+    ::close(fd);
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+bool BinaryProfile::ReadName(const std::string& path, uint64_t sourceSize, int64_t sourceTime, std::string& name) {
+    std::ifstream file(path, std::ios::binary);
+    BinaryProfileHeader candidate;
+    if (!file.read(reinterpret_cast<char*>(&candidate), sizeof(candidate)) || candidate.magic != BinaryProfileHeader::Magic ||
+        candidate.version != BinaryProfileHeader::CurrentVersion || candidate.headerSize != sizeof(BinaryProfileHeader) ||
+        candidate.sourceSize != sourceSize || candidate.sourceTime != sourceTime || candidate.nameOffset >= candidate.stringBytes) {
+        return false;
+    }
+    // The name runs to its NUL; a file that ends first is truncated.
+    file.seekg(static_cast<std::streamoff>(uint64_t{ candidate.stringOffset } + candidate.nameOffset));
+    std::getline(file, name, '\0');
+    return file.good();
+}
+
+bool BinaryProfile::Open(const std::string& path) {
+    header = nullptr;
+    if (!file.Open(path)) {
+        return false;
+    }
+
+    const uint8_t* base = file.GetData();
+    const size_t size = file.GetSize();
+    const auto* candidate = reinterpret_cast<const BinaryProfileHeader*>(base);
+    if (size < sizeof(BinaryProfileHeader) || candidate->magic != BinaryProfileHeader::Magic) {
+        std::cerr << "Error: " << path << " is not a compiled profile." << std::endl;
+        return false;
+    }
+    if (candidate->version != BinaryProfileHeader::CurrentVersion || candidate->headerSize != sizeof(BinaryProfileHeader)) {
+        std::cerr << "Compiled profile " << path << " has version " << candidate->version << ", expected "
+                  << BinaryProfileHeader::CurrentVersion << "." << std::endl;
+        return false;
+    }
+
+    // Every section must lie inside the file before anything is read through it.
+    auto fits = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+    if (!fits(candidate->ruleOffset, uint64_t{ candidate->ruleCount } * sizeof(BinaryRule)) ||
+        !fits(candidate->actionOffset, uint64_t{ candidate->actionCount } * sizeof(BinaryAction)) ||
+        !fits(candidate->macroOffset, uint64_t{ candidate->macroCount } * sizeof(BinaryMacro)) ||
+        !fits(candidate->stepOffset, uint64_t{ candidate->stepCount } * sizeof(MacroStep)) ||
+        !fits(candidate->transformOffset, uint64_t{ candidate->transformCount } * sizeof(BinaryAxisTransform)) ||
+        !fits(candidate->pointOffset, uint64_t{ candidate->pointCount } * sizeof(float)) ||
+        candidate->mouseStickCount > 1 ||
+        !fits(candidate->mouseStickOffset, uint64_t{ candidate->mouseStickCount } * sizeof(BinaryMouseStick)) ||
+        !fits(candidate->stringOffset, candidate->stringBytes) || candidate->stringBytes == 0 ||
+        base[candidate->stringOffset + candidate->stringBytes - 1] != '\0' ||
+        candidate->nameOffset >= candidate->stringBytes) {
+        std::cerr << "Error: Compiled profile " << path << " is truncated or malformed." << std::endl;
+        return false;
+    }
+    if (Fnv1a(base + sizeof(BinaryProfileHeader), size - sizeof(BinaryProfileHeader)) != candidate->checksum) {
+        std::cerr << "Error: Compiled profile " << path << " failed its checksum." << std::endl;
+        return false;
+    }
+
+    const auto* ruleTable = reinterpret_cast<const BinaryRule*>(base + candidate->ruleOffset);
+    const auto* actionTable = reinterpret_cast<const BinaryAction*>(base + candidate->actionOffset);
+    for (uint32_t i = 0; i < candidate->ruleCount; ++i) {
+        if (ruleTable[i].firstAction > candidate->actionCount || ruleTable[i].actionCount > candidate->actionCount - ruleTable[i].firstAction) {
+            std::cerr << "Error: Compiled profile " << path << " has a rule outside the action pool." << std::endl;
+            return false;
+        }
+        // The rule index is laid out by input type, so an unknown type cannot be loaded.
+        if (ruleTable[i].inputType > static_cast<uint8_t>(InputType::MouseButton)) {
+            std::cerr << "Error: Compiled profile " << path << " has a rule for an unknown input type." << std::endl;
+            return false;
+        }
+        bool chordValid = true;
+        for (const auto& input : ruleTable[i].chord) {
+            chordValid = chordValid && input.inputType <= static_cast<uint8_t>(InputType::MouseButton);
+        }
+        if (ruleTable[i].gesture >= static_cast<uint8_t>(Gesture::Count) || !chordValid) {
+            std::cerr << "Error: Compiled profile " << path << " has a rule with an unknown gesture or chord." << std::endl;
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < candidate->actionCount; ++i) {
+        if (actionTable[i].kind > BinaryAction::Layer) {
+            std::cerr << "Error: Compiled profile " << path << " has an action of an unknown kind." << std::endl;
+            return false;
+        }
+        if (actionTable[i].kind == BinaryAction::Layer &&
+            (actionTable[i].target >= InputCondition::MaxLayers || actionTable[i].value < 0 ||
+             actionTable[i].value > static_cast<int32_t>(LayerAction::Mode::OneShot))) {
+            std::cerr << "Error: Compiled profile " << path << " has a layer action for an unknown layer or mode." << std::endl;
+            return false;
+        }
+        if (actionTable[i].slot >= MaxVirtualControllers && actionTable[i].slot != RouteByDevice) {
+            std::cerr << "Error: Compiled profile " << path << " has an action for a controller slot that does not exist." << std::endl;
+            return false;
+        }
+        if (actionTable[i].kind == BinaryAction::Button && actionTable[i].mode > static_cast<uint8_t>(VirtualButtonAction::Mode::Turbo)) {
+            std::cerr << "Error: Compiled profile " << path << " has a button action with an unknown mode." << std::endl;
+            return false;
+        }
+        if (actionTable[i].nameOffset >= candidate->stringBytes) {
+            std::cerr << "Error: Compiled profile " << path << " has an action outside the string table." << std::endl;
+            return false;
+        }
+    }
+
+    const auto* macroTable = reinterpret_cast<const BinaryMacro*>(base + candidate->macroOffset);
+    for (uint32_t i = 0; i < candidate->macroCount; ++i) {
+        if (macroTable[i].nameOffset >= candidate->stringBytes || macroTable[i].firstStep > candidate->stepCount ||
+            macroTable[i].stepCount > candidate->stepCount - macroTable[i].firstStep) {
+            std::cerr << "Error: Compiled profile " << path << " has a macro outside the step pool." << std::endl;
+            return false;
+        }
+    }
+
+    const auto* transformTable = reinterpret_cast<const BinaryAxisTransform*>(base + candidate->transformOffset);
+    for (uint32_t i = 0; i < candidate->transformCount; ++i) {
+        if (transformTable[i].firstPoint > candidate->pointCount ||
+            transformTable[i].pointCount > candidate->pointCount - transformTable[i].firstPoint) {
+            std::cerr << "Error: Compiled profile " << path << " has an axis transform outside the point pool." << std::endl;
+            return false;
+        }
+    }
+
+    header = candidate;
+    rules = ruleTable;
+    actions = actionTable;
+    macros = macroTable;
+    steps = reinterpret_cast<const MacroStep*>(base + candidate->stepOffset);
+    transforms = transformTable;
+    points = reinterpret_cast<const float*>(base + candidate->pointOffset);
+    mouseStick = candidate->mouseStickCount != 0 ? reinterpret_cast<const BinaryMouseStick*>(base + candidate->mouseStickOffset) : nullptr;
+    strings = reinterpret_cast<const char*>(base + candidate->stringOffset);
+    return true;
+}
+
+std::vector<MappingRule> BinaryProfile::ToRules() const {
+    std::vector<MappingRule> result;
+    result.reserve(header->ruleCount);
+    std::vector<OutputAction> ruleActions;
+    for (uint32_t i = 0; i < header->ruleCount; ++i) {
+        const BinaryRule& rule = rules[i];
+
+        InputCondition condition{};
+        condition.type = static_cast<InputType>(rule.inputType);
+        condition.idType = static_cast<InputCondition::IdType>(rule.idType);
+        if (condition.idType == InputCondition::IsButton) {
+            condition.id.buttonId = rule.id;
+        } else {
+            condition.id.axisId = rule.id;
+        }
+        condition.gesture = static_cast<Gesture>(rule.gesture);
+        condition.layer = rule.layer;
+        condition.timeMs = rule.timeMs;
+        condition.model = { rule.vendorId, rule.productId };
+        for (size_t c = 0; c < InputCondition::MaxChordInputs; ++c) {
+            condition.chord[c] = { static_cast<InputType>(rule.chord[c].inputType), rule.chord[c].id };
+        }
+
+        ruleActions.clear();
+        const BinaryAction* action = GetActions(rule);
+        for (uint32_t a = 0; a < rule.actionCount; ++a, ++action) {
+            switch (action->kind) {
+                case BinaryAction::Button:
+                    ruleActions.push_back({ VirtualButtonAction{ static_cast<VirtualButtonType>(action->target), (action->value & 1) != 0,
+                                                                 static_cast<VirtualButtonAction::Mode>(action->mode),
+                                                                 static_cast<uint16_t>(static_cast<uint32_t>(action->value) >> 16) } });
+                    break;
+                case BinaryAction::Axis:
+                    ruleActions.push_back({ VirtualAxisAction{ static_cast<VirtualAxisType>(action->target), action->value } });
+                    break;
+                case BinaryAction::Macro:
+                    ruleActions.push_back({ MacroAction{ GetString(action->nameOffset) } });
+                    break;
+                case BinaryAction::Layer:
+                    ruleActions.push_back({ LayerAction{ static_cast<uint8_t>(action->target), static_cast<LayerAction::Mode>(action->value) } });
+                    break;
+            }
+            ruleActions.back().slot = action->slot;
+        }
+        result.emplace_back(condition, ruleActions);
+    }
+    return result;
+}
+
+std::vector<MacroDefinition> BinaryProfile::ToMacros() const {
+    std::vector<MacroDefinition> result(header->macroCount);
+    for (uint32_t i = 0; i < header->macroCount; ++i) {
+        const BinaryMacro& macro = macros[i];
+        result[i].name = GetString(macro.nameOffset);
+        result[i].steps.assign(steps + macro.firstStep, steps + macro.firstStep + macro.stepCount);
+        result[i].repeatWhileHeld = (macro.flags & BinaryMacro::RepeatWhileHeld) != 0;
+        result[i].cancelOnRelease = (macro.flags & BinaryMacro::CancelOnRelease) != 0;
+    }
+    return result;
+}
+
+std::vector<AxisTransform> BinaryProfile::ToAxisTransforms() const {
+    std::vector<AxisTransform> result(header->transformCount);
+    for (uint32_t i = 0; i < header->transformCount; ++i) {
+        const BinaryAxisTransform& packed = transforms[i];
+        AxisTransform& transform = result[i];
+        transform.axis = static_cast<VirtualAxisType>(packed.axis);
+        transform.curve = static_cast<AxisTransform::Curve>(packed.curve);
+        transform.invert = packed.invert != 0;
+        transform.radialDeadzone = packed.radialDeadzone;
+        transform.deadzone = packed.deadzone;
+        transform.antiDeadzone = packed.antiDeadzone;
+        transform.exponent = packed.exponent;
+        transform.sensitivity = packed.sensitivity;
+        transform.points.assign(points + packed.firstPoint, points + packed.firstPoint + packed.pointCount);
+    }
+    return result;
+}
+
+MouseStickSettings BinaryProfile::ToMouseStick() const {
+    MouseStickSettings settings;
+    if (mouseStick != nullptr) {
+        settings.enabled = mouseStick->enabled != 0;
+        settings.stick = static_cast<MouseStickSettings::Stick>(mouseStick->stick);
+        settings.smoothing = static_cast<MouseStickSettings::Smoothing>(mouseStick->smoothing);
+        settings.rateHz = mouseStick->rateHz;
+        settings.sensitivity = mouseStick->sensitivity;
+        settings.acceleration = mouseStick->acceleration;
+        settings.windowMs = mouseStick->windowMs;
+        settings.decayMs = mouseStick->decayMs;
+        settings.smoothingMs = mouseStick->smoothingMs;
+        settings.minCutoffHz = mouseStick->minCutoffHz;
+        settings.beta = mouseStick->beta;
+        settings.derivativeCutoffHz = mouseStick->derivativeCutoffHz;
+    }
+    return settings;
+}
+
+std::vector<uint8_t> CompileBinaryProfile(const std::string& name, const std::vector<MappingRule>& ruleList,
+                                          const std::vector<MacroDefinition>& macroList,
+                                          const std::vector<AxisTransform>& axisTransforms,
+                                          const MouseStickSettings& mouseStick, uint64_t sourceSize, int64_t sourceTime,
+                                          uint32_t sourceHash, uint32_t skippedBindings) {
+    StringTable strings;
+    std::vector<BinaryRule> ruleTable;
+    std::vector<BinaryAction> actionTable;
+    ruleTable.reserve(ruleList.size());
+
+    const uint32_t nameOffset = strings.Add(name);
+    for (const auto& rule : ruleList) {
+        const InputCondition& condition = rule.GetCondition();
+        BinaryRule entry{};
+        entry.inputType = static_cast<uint8_t>(condition.type);
+        entry.idType = static_cast<uint8_t>(condition.idType);
+        entry.id = condition.idType == InputCondition::IsButton ? condition.id.buttonId : condition.id.axisId;
+        entry.firstAction = static_cast<uint32_t>(actionTable.size());
+        entry.gesture = static_cast<uint8_t>(condition.gesture);
+        entry.layer = condition.layer;
+        entry.timeMs = condition.timeMs;
+        entry.vendorId = condition.model.vendorId;
+        entry.productId = condition.model.productId;
+        for (size_t c = 0; c < InputCondition::MaxChordInputs; ++c) {
+            entry.chord[c] = { static_cast<uint8_t>(condition.chord[c].type), 0, condition.chord[c].id };
+        }
+
+        for (const auto& action : rule.GetActions()) {
+            BinaryAction packed{};
+            packed.slot = action.slot;
+            if (const auto* button = std::get_if<VirtualButtonAction>(&action.action)) {
+                packed.kind = BinaryAction::Button;
+                packed.target = static_cast<uint16_t>(button->button);
+                packed.mode = static_cast<uint8_t>(button->mode);
+                packed.value = static_cast<int32_t>(static_cast<uint32_t>(button->turboHz) << 16 | (button->press ? 1u : 0u));
+            } else if (const auto* axis = std::get_if<VirtualAxisAction>(&action.action)) {
+                packed.kind = BinaryAction::Axis;
+                packed.target = static_cast<uint16_t>(axis->axis);
+                packed.value = axis->value;
+            } else if (const auto* macro = std::get_if<MacroAction>(&action.action)) {
+                packed.kind = BinaryAction::Macro;
+                packed.nameOffset = strings.Add(macro->macroName);
+            } else if (const auto* layer = std::get_if<LayerAction>(&action.action)) {
+                packed.kind = BinaryAction::Layer;
+                packed.target = layer->layer;
+                packed.value = static_cast<int32_t>(layer->mode);
+            }
+            actionTable.push_back(packed);
+        }
+        entry.actionCount = static_cast<uint32_t>(actionTable.size()) - entry.firstAction;
+        ruleTable.push_back(entry);
+    }
+
+    std::vector<BinaryMacro> macroTable;
+    std::vector<MacroStep> stepTable;
+    macroTable.reserve(macroList.size());
+    for (const auto& macro : macroList) {
+        BinaryMacro entry{};
+        entry.nameOffset = strings.Add(macro.name);
+        entry.firstStep = static_cast<uint32_t>(stepTable.size());
+        entry.stepCount = static_cast<uint32_t>(macro.steps.size());
+        entry.flags = (macro.repeatWhileHeld ? static_cast<uint32_t>(BinaryMacro::RepeatWhileHeld) : 0u) |
+                      (macro.cancelOnRelease ? static_cast<uint32_t>(BinaryMacro::CancelOnRelease) : 0u);
+        macroTable.push_back(entry);
+        stepTable.insert(stepTable.end(), macro.steps.begin(), macro.steps.end());
+    }
+
+    std::vector<BinaryAxisTransform> transformTable;
+    std::vector<float> pointTable;
+    transformTable.reserve(axisTransforms.size());
+    for (const auto& transform : axisTransforms) {
+        BinaryAxisTransform entry{};
+        entry.axis = static_cast<uint16_t>(transform.axis);
+        entry.curve = static_cast<uint8_t>(transform.curve);
+        entry.invert = transform.invert ? 1 : 0;
+        entry.radialDeadzone = transform.radialDeadzone;
+        entry.deadzone = transform.deadzone;
+        entry.antiDeadzone = transform.antiDeadzone;
+        entry.exponent = transform.exponent;
+        entry.sensitivity = transform.sensitivity;
+        entry.firstPoint = static_cast<uint32_t>(pointTable.size());
+        entry.pointCount = static_cast<uint32_t>(transform.points.size());
+        transformTable.push_back(entry);
+        pointTable.insert(pointTable.end(), transform.points.begin(), transform.points.end());
+    }
+
+    // Only written when enabled; an image without one loads as disabled.
+    std::vector<BinaryMouseStick> mouseStickTable;
+    if (mouseStick.enabled) {
+        BinaryMouseStick entry{};
+        entry.enabled = 1;
+        entry.stick = static_cast<uint8_t>(mouseStick.stick);
+        entry.smoothing = static_cast<uint8_t>(mouseStick.smoothing);
+        entry.rateHz = mouseStick.rateHz;
+        entry.sensitivity = mouseStick.sensitivity;
+        entry.acceleration = mouseStick.acceleration;
+        entry.windowMs = mouseStick.windowMs;
+        entry.decayMs = mouseStick.decayMs;
+        entry.smoothingMs = mouseStick.smoothingMs;
+        entry.minCutoffHz = mouseStick.minCutoffHz;
+        entry.beta = mouseStick.beta;
+        entry.derivativeCutoffHz = mouseStick.derivativeCutoffHz;
+        mouseStickTable.push_back(entry);
+    }
+
+    BinaryProfileHeader header{};
+    header.magic = BinaryProfileHeader::Magic;
+    header.version = BinaryProfileHeader::CurrentVersion;
+    header.headerSize = sizeof(BinaryProfileHeader);
+    header.nameOffset = nameOffset;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.sourceHash = sourceHash;
+    header.skippedBindings = skippedBindings;
+    header.ruleCount = static_cast<uint32_t>(ruleTable.size());
+    header.ruleOffset = sizeof(BinaryProfileHeader);
+    header.actionCount = static_cast<uint32_t>(actionTable.size());
+    header.actionOffset = AlignUp(header.ruleOffset + ruleTable.size() * sizeof(BinaryRule));
+    header.macroCount = static_cast<uint32_t>(macroTable.size());
+    header.macroOffset = AlignUp(header.actionOffset + actionTable.size() * sizeof(BinaryAction));
+    header.stepCount = static_cast<uint32_t>(stepTable.size());
+    header.stepOffset = AlignUp(header.macroOffset + macroTable.size() * sizeof(BinaryMacro));
+    header.transformCount = static_cast<uint32_t>(transformTable.size());
+    header.transformOffset = AlignUp(header.stepOffset + stepTable.size() * sizeof(MacroStep));
+    header.pointCount = static_cast<uint32_t>(pointTable.size());
+    header.pointOffset = AlignUp(header.transformOffset + transformTable.size() * sizeof(BinaryAxisTransform));
+    header.stringBytes = static_cast<uint32_t>(strings.GetBytes().size());
+    header.mouseStickCount = static_cast<uint32_t>(mouseStickTable.size());
+    header.mouseStickOffset = AlignUp(header.pointOffset + pointTable.size() * sizeof(float));
+    header.stringOffset = AlignUp(header.mouseStickOffset + mouseStickTable.size() * sizeof(BinaryMouseStick));
+
+    std::vector<uint8_t> image(AlignUp(header.stringOffset + header.stringBytes), 0);
+    std::memcpy(image.data() + header.ruleOffset, ruleTable.data(), ruleTable.size() * sizeof(BinaryRule));
+    std::memcpy(image.data() + header.actionOffset, actionTable.data(), actionTable.size() * sizeof(BinaryAction));
+    std::memcpy(image.data() + header.macroOffset, macroTable.data(), macroTable.size() * sizeof(BinaryMacro));
+    std::memcpy(image.data() + header.stepOffset, stepTable.data(), stepTable.size() * sizeof(MacroStep));
+    std::memcpy(image.data() + header.transformOffset, transformTable.data(), transformTable.size() * sizeof(BinaryAxisTransform));
+    std::memcpy(image.data() + header.pointOffset, pointTable.data(), pointTable.size() * sizeof(float));
+    std::memcpy(image.data() + header.mouseStickOffset, mouseStickTable.data(), mouseStickTable.size() * sizeof(BinaryMouseStick));
+    std::memcpy(image.data() + header.stringOffset, strings.GetBytes().data(), header.stringBytes);
+    header.checksum = Fnv1a(image.data() + sizeof(BinaryProfileHeader), image.size() - sizeof(BinaryProfileHeader));
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+uint32_t HashProfileSource(const std::string& text) {
+    return Fnv1a(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+bool WriteBinaryProfile(const std::string& path, const std::vector<uint8_t>& image) {
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error: Could not open " << temporaryPath << " for writing." << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+        if (!out.good()) {
+            std::cerr << "Error: Failed to write " << temporaryPath << "." << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::cerr << "Error: Could not replace " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#include "CoreService/Clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+uint64_t MonotonicNanoseconds() {
+#ifdef _WIN32
+    static const uint64_t frequency = [] {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return static_cast<uint64_t>(f.QuadPart);
+    }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    const uint64_t ticks = static_cast<uint64_t>(counter.QuadPart);
+    // Split the conversion so ticks * 1e9 cannot overflow.
+    return (ticks / frequency) * 1000000000ull + (ticks % frequency) * 1000000000ull / frequency;
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
@@ -0,0 +1,221 @@
+#include "CoreService/Mapping/CompiledRuleSet.h"
+#include "CoreService/Mapping/GestureRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <utility>
+
+namespace {
+    std::atomic<uint64_t> nextGeneration{ 1 };
+
+    enum RuleKind : uint8_t { PlainRule, MachineRule, IgnoredRule };
+}
+
+CompiledRuleSet::CompiledRuleSet()
+    : rules(std::make_shared<const std::vector<MappingRule>>()), tables(1), generation(nextGeneration.fetch_add(1)) {
+    tables[0].rules = rules->data();
+}
+
+CompiledRuleSet::CompiledRuleSet(std::vector<MappingRule> ruleList, const MacroProgram* macroProgram,
+                                 const std::vector<AxisTransform>& transforms, const MouseStickSettings& mouseStickSettings)
+    : macros(macroProgram), axisTransforms(transforms), mouseStick(mouseStickSettings), generation(nextGeneration.fetch_add(1)) {
+    ResolveMacros(ruleList);
+    rules = std::make_shared<const std::vector<MappingRule>>(std::move(ruleList));
+    Index();
+}
+
+CompiledRuleSet::CompiledRuleSet(std::shared_ptr<const std::vector<MappingRule>> sharedRules, const MacroProgram* macroProgram,
+                                 const std::vector<AxisTransform>& transforms, const MouseStickSettings& mouseStickSettings)
+    : rules(std::move(sharedRules)), macros(macroProgram), axisTransforms(transforms), mouseStick(mouseStickSettings),
+      generation(nextGeneration.fetch_add(1)) {
+    if (!rules) {
+        rules = std::make_shared<const std::vector<MappingRule>>();
+    }
+    // Shared rules cannot be changed, so resolving macros takes a copy.
+    if (std::any_of(rules->begin(), rules->end(), StartsMacro)) {
+        std::vector<MappingRule> own = *rules;
+        ResolveMacros(own);
+        rules = std::make_shared<const std::vector<MappingRule>>(std::move(own));
+    }
+    Index();
+}
+
+bool CompiledRuleSet::StartsMacro(const MappingRule& rule) {
+    const auto& actions = rule.GetActions();
+    return std::any_of(actions.begin(), actions.end(),
+                       [](const OutputAction& action) { return std::holds_alternative<MacroAction>(action.action); });
+}
+
+void CompiledRuleSet::ResolveMacros(std::vector<MappingRule>& ruleList) const {
+    // Rules are immutable, so the few that start macros are rebuilt with the resolved copies
+    // of their actions.
+    for (auto& rule : ruleList) {
+        if (!StartsMacro(rule)) {
+            continue;
+        }
+        std::vector<OutputAction> actions = rule.GetActions();
+        for (auto& action : actions) {
+            if (auto* macro = std::get_if<MacroAction>(&action.action)) {
+                macro->macroId = macros != nullptr ? macros->Find(macro->macroName) : MacroProgram::NoMacro;
+                if (macro->macroId == MacroProgram::NoMacro) {
+                    std::cerr << "Warning: Mapping refers to unknown macro \"" << macro->macroName << "\"; it will do nothing." << std::endl;
+                }
+            }
+        }
+        rule = MappingRule(rule.GetCondition(), actions);
+    }
+}
+
+void CompiledRuleSet::Index() {
+    const std::vector<MappingRule>& ruleList = *rules;
+    for (const auto& rule : ruleList) {
+        for (const auto& action : rule.GetActions()) {
+            const auto* button = std::get_if<VirtualButtonAction>(&action.action);
+            hasTurbo = hasTurbo || (button != nullptr && button->mode == VirtualButtonAction::Mode::Turbo);
+        }
+    }
+
+    // Rules with a gesture or chord become machines. Only buttons can take part in them.
+    std::vector<uint8_t> ruleKinds(ruleList.size(), PlainRule);
+    for (uint32_t i = 0; i < ruleList.size(); ++i) {
+        const InputCondition& condition = ruleList[i].GetCondition();
+        if (condition.layer >= InputCondition::MaxLayers) {
+            std::cerr << "Warning: Rule " << i << " is on layer " << int{ condition.layer } << ", past the last layer; it is ignored." << std::endl;
+            ruleKinds[i] = IgnoredRule;
+            continue;
+        }
+        if (condition.IsPlain()) {
+            continue;
+        }
+        if (condition.idType != InputCondition::IsButton || condition.gesture >= Gesture::Count) {
+            std::cerr << "Warning: Rule " << i << " has a gesture or chord on something other than a button; it is ignored." << std::endl;
+            ruleKinds[i] = IgnoredRule;
+            continue;
+        }
+        const size_t chordCount = condition.GetChordCount();
+        const uint64_t timeNs = condition.timeMs != 0 ? uint64_t{ condition.timeMs } * 1'000'000 : GestureDefaultTimeNs(condition.gesture);
+        machines.push_back({ i, condition.gesture, static_cast<uint8_t>((1u << (chordCount + 1)) - 1), timeNs });
+        ruleKinds[i] = MachineRule;
+    }
+
+    // Note which layers use each input, as a rule's own input or a chord member.
+    LayerUse layerUse;
+    for (uint32_t i = 0; i < ruleList.size(); ++i) {
+        if (ruleKinds[i] == IgnoredRule) {
+            continue;
+        }
+        const InputCondition& condition = ruleList[i].GetCondition();
+        const LayerMask layer = static_cast<LayerMask>(1u << condition.layer);
+        const IdKind kind = condition.idType == InputCondition::IsButton ? ButtonKind : AxisKind;
+        layerUse[InputKey(condition.type, kind, kind == ButtonKind ? condition.id.buttonId : condition.id.axisId)] |= layer;
+        for (size_t c = 0; c < condition.GetChordCount(); ++c) {
+            layerUse[InputKey(condition.chord[c].type, ButtonKind, condition.chord[c].id)] |= layer;
+        }
+        usedLayers |= layer;
+    }
+
+    // One table for every combination of the layers in use. Masks of unused layers are
+    // folded away by GetTable, so only these are ever looked up.
+    for (unsigned mask = 1; mask < tableIndex.size(); mask += 2) {
+        if ((mask & usedLayers) == mask) {
+            tableIndex[mask] = static_cast<uint8_t>(tables.size());
+            tables.emplace_back();
+            BuildTable(tables.back(), static_cast<LayerMask>(mask), layerUse, ruleKinds);
+        }
+    }
+}
+
+void CompiledRuleSet::BuildTable(DispatchTable& table, LayerMask layers, const LayerUse& layerUse,
+                                 const std::vector<uint8_t>& ruleKinds) const {
+    const std::vector<MappingRule>& ruleList = *rules;
+    table.rules = ruleList.data();
+
+    // An input is owned by the highest layer that is on and uses it.
+    auto owns = [&layerUse, layers](uint8_t layer, InputType type, IdKind kind, uint16_t id) {
+        const auto use = layerUse.find(InputKey(type, kind, id));
+        const unsigned active = use != layerUse.end() ? use->second & layers : 0;
+        return active != 0 && (active >> layer) == 1;
+    };
+
+    // First pass: count the rules and listeners per key. Counts are accumulated in the buckets
+    // themselves and pages are created on demand, so only the parts of the ID space in use cost memory.
+    auto bucketFor = [&table](InputType type, IdKind kind, uint16_t id) -> Bucket& {
+        uint16_t& pageIndex = table.directories[static_cast<size_t>(type)][kind][id >> 8];
+        if (pageIndex == 0) {
+            pageIndex = static_cast<uint16_t>(table.pages.size());
+            table.pages.emplace_back();
+        }
+        return table.pages[pageIndex][id & 0xFF];
+    };
+    // Calls visit(bucket) for the rule if it is a plain rule in this table.
+    auto forPlainRule = [&ruleList, &ruleKinds, &owns, &bucketFor](uint32_t i, auto&& visit) {
+        const InputCondition& condition = ruleList[i].GetCondition();
+        const IdKind kind = condition.idType == InputCondition::IsButton ? ButtonKind : AxisKind;
+        const uint16_t id = kind == ButtonKind ? condition.id.buttonId : condition.id.axisId;
+        if (ruleKinds[i] == PlainRule && owns(condition.layer, condition.type, kind, id)) {
+            visit(bucketFor(condition.type, kind, id));
+        }
+    };
+    // Calls visit(bucket, bit) for every button the machine watches in this table.
+    auto forEachWatched = [&ruleList, &owns, &bucketFor](const GestureMachine& machine, auto&& visit) {
+        const InputCondition& condition = ruleList[machine.rule].GetCondition();
+        if (owns(condition.layer, condition.type, ButtonKind, condition.id.buttonId)) {
+            visit(bucketFor(condition.type, ButtonKind, condition.id.buttonId), uint8_t{ 0 });
+        }
+        for (size_t c = 0; c < condition.GetChordCount(); ++c) {
+            if (owns(condition.layer, condition.chord[c].type, ButtonKind, condition.chord[c].id)) {
+                visit(bucketFor(condition.chord[c].type, ButtonKind, condition.chord[c].id), static_cast<uint8_t>(c + 1));
+            }
+        }
+    };
+
+    size_t candidateTotal = 0;
+    for (uint32_t i = 0; i < ruleList.size(); ++i) {
+        forPlainRule(i, [&candidateTotal](Bucket& bucket) {
+            ++bucket.count;
+            ++candidateTotal;
+        });
+    }
+    size_t listenerTotal = 0;
+    for (const auto& machine : machines) {
+        forEachWatched(machine, [&listenerTotal](Bucket& bucket, uint8_t) {
+            ++bucket.listenerCount;
+            ++listenerTotal;
+        });
+    }
+
+    // Second pass: turn the counts into offsets into the candidate and listener arrays.
+    uint32_t offset = 0;
+    uint32_t listenerOffset = 0;
+    for (size_t p = 1; p < table.pages.size(); ++p) {
+        for (auto& bucket : table.pages[p]) {
+            bucket.first = offset;
+            offset += bucket.count;
+            bucket.count = 0;
+            bucket.firstListener = listenerOffset;
+            listenerOffset += bucket.listenerCount;
+            bucket.listenerCount = 0;
+        }
+    }
+
+    // Third pass: fill the buckets. Walking the rules in order keeps every bucket in
+    // profile order, which is what FirstMatch relies on.
+    table.candidates.resize(candidateTotal);
+    for (uint32_t i = 0; i < ruleList.size(); ++i) {
+        forPlainRule(i, [&table, i](Bucket& bucket) {
+            table.candidates[bucket.first + bucket.count++] = i;
+        });
+    }
+    table.listeners.resize(listenerTotal);
+    for (uint32_t m = 0; m < machines.size(); ++m) {
+        forEachWatched(machines[m], [&table, m](Bucket& bucket, uint8_t bit) {
+            table.listeners[bucket.firstListener + bucket.listenerCount++] = { m, bit };
+        });
+    }
+}
+
+CompiledRuleSet::~CompiledRuleSet() {
+    if (macros != nullptr) {
+        macros->Release();
+    }
+}
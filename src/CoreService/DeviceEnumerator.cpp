@@ -1,5 +1,7 @@
 #include "DeviceEnumerator.h"
+#include "CoreService/DeviceRegistry.h"
 #include <iostream>
+#include <iterator>
 
 // Link with SetupAPI.lib
 #pragma comment(lib, "Setupapi.lib")
@@ -23,65 +25,110 @@ std::vector<InputDevice> DeviceEnumerator::EnumerateDevices() {
 
     // Iterate through all the devices in the set.
     for (DWORD i = 0; SetupDiEnumDeviceInfo(hDevInfo, i, &devInfoData); ++i) {
-        InputDevice currentDevice;
-        GetDeviceDetails(hDevInfo, &devInfoData, currentDevice);
-        devices.push_back(currentDevice);
+        devices.emplace_back();
+        GetDeviceDetails(hDevInfo, &devInfoData, devices.back());
     }
 
     SetupDiDestroyDeviceInfoList(hDevInfo);
     return devices;
 }
 
-void DeviceEnumerator::GetDeviceDetails(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, InputDevice& device) {
-    // Get Device Instance ID
-    device.instanceId = DeviceEnumerator::GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_DEVICEDESC);
-
-    // Get a friendly name if available, otherwise use the description
-    device.name = DeviceEnumerator::GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_FRIENDLYNAME);
-    if (device.name.empty()) {
-        device.name = device.instanceId;
+bool DeviceEnumerator::QueryDevice(const std::wstring& instanceId, InputDevice& device) {
+    HDEVINFO hDevInfo = SetupDiCreateDeviceInfoList(nullptr, nullptr);
+    if (hDevInfo == INVALID_HANDLE_VALUE) {
+        return false;
     }
-
-    // Get Hardware IDs (contains VID and PID)
-    std::wstring hardwareIds = DeviceEnumerator::GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_HARDWAREID);
-    DeviceEnumerator::ParseHardwareIds(hardwareIds, device);
+    SP_DEVINFO_DATA devInfoData;
+    devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+    const bool found = SetupDiOpenDeviceInfoW(hDevInfo, instanceId.c_str(), nullptr, 0, &devInfoData) != FALSE;
+    if (found) {
+        GetDeviceDetails(hDevInfo, &devInfoData, device);
+    }
+    SetupDiDestroyDeviceInfoList(hDevInfo);
+    return found;
 }
 
-std::wstring DeviceEnumerator::GetDeviceRegistryProperty(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, DWORD property) {
-    DWORD dataType;
-    DWORD requiredSize = 0;
+void DeviceEnumerator::OnDeviceChange(WPARAM change, HANDLE device, DeviceTable& table) {
+    if (change == GIDC_REMOVAL) {
+        auto it = arrivedDevices.find(device);
+        if (it != arrivedDevices.end()) {
+            table.Remove(it->second);
+            arrivedDevices.erase(it);
+        }
+        return;
+    }
+    if (change != GIDC_ARRIVAL) {
+        return;
+    }
 
-    // First call to get the size of the buffer needed
-    SetupDiGetDeviceRegistryProperty(hDevInfo, pDevInfoData, property, &dataType, nullptr, 0, &requiredSize);
-    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-        return L""; // Property may not exist
+    wchar_t path[512];
+    UINT length = static_cast<UINT>(std::size(path));
+    const UINT copied = GetRawInputDeviceInfoW(device, RIDI_DEVICENAME, path, &length);
+    if (copied == 0 || copied == static_cast<UINT>(-1)) {
+        return;
+    }
+    InputDevice arrived;
+    arrived.instanceId = DeviceTable::InstanceIdFromInterface(path, copied);
+    if (arrived.instanceId.empty()) {
+        return;
     }
+    // This is the raw input thread, so no SetupAPI here: the interface path holds the model,
+    // and the friendly name comes with the next sweep (or QueryDevice, off this thread).
+    arrived.name = arrived.instanceId;
+    arrived.model = DeviceRegistry::ParseModel(path, copied);
+    arrivedDevices[device] = arrived.instanceId;
+    table.Add(std::move(arrived));
+}
+
+void DeviceEnumerator::GetDeviceDetails(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, InputDevice& device) {
+    PropertyBuffer buffer;
 
-    std::vector<BYTE> buffer(requiredSize);
-    if (!SetupDiGetDeviceRegistryProperty(hDevInfo, pDevInfoData, property, &dataType, buffer.data(), (DWORD)buffer.size(), &requiredSize)) {
-        return L""; // Failed to get property
+    // Get Device Instance ID
+    wchar_t instanceId[MAX_DEVICE_ID_LEN];
+    if (SetupDiGetDeviceInstanceIdW(hDevInfo, pDevInfoData, instanceId, MAX_DEVICE_ID_LEN, nullptr)) {
+        device.instanceId = instanceId;
     }
 
-    // Assuming the property is a string (REG_SZ)
-    if (dataType == REG_SZ || dataType == REG_MULTI_SZ) {
-        return std::wstring(reinterpret_cast<wchar_t*>(buffer.data()));
+    // Get a friendly name if available, otherwise use the description
+    std::wstring_view name = GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_FRIENDLYNAME, buffer);
+    if (name.empty()) {
+        name = GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_DEVICEDESC, buffer);
     }
+    device.name = name.empty() ? device.instanceId : std::wstring(name);
 
-    return L"";
+    // Get Hardware IDs (contains VID and PID), e.g. "HID\VID_045E&PID_028E&REV_0110"; the
+    // numbers are read straight out of the buffer.
+    const std::wstring_view hardwareId = GetDeviceRegistryProperty(hDevInfo, pDevInfoData, SPDRP_HARDWAREID, buffer);
+    device.model = DeviceRegistry::ParseModel(hardwareId.data(), hardwareId.size());
 }
 
-void DeviceEnumerator::ParseHardwareIds(const std::wstring& hardwareIds, InputDevice& device) {
-    // The hardware ID string is a multi-string (null-character separated strings, ending with a double null).
-    // The format is typically something like "HID\VID_045E&PID_028E&REV_0110".
-    // We need to find the VID and PID substrings.
-
-    size_t vidPos = hardwareIds.find(L"VID_");
-    if (vidPos != std::wstring::npos) {
-        device.vendorId = hardwareIds.substr(vidPos + 4, 4);
+std::wstring_view DeviceEnumerator::GetDeviceRegistryProperty(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, DWORD property, PropertyBuffer& buffer) {
+    DWORD dataType = 0;
+    DWORD requiredSize = 0;
+    wchar_t* text = buffer.text;
+
+    // One call in the common case; the size query only when the stack buffer is too small.
+    if (!SetupDiGetDeviceRegistryPropertyW(hDevInfo, pDevInfoData, property, &dataType, reinterpret_cast<PBYTE>(buffer.text),
+                                           sizeof(buffer.text), &requiredSize)) {
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+            return {}; // Property may not exist
+        }
+        buffer.overflow.resize(requiredSize / sizeof(wchar_t) + 1);
+        if (!SetupDiGetDeviceRegistryPropertyW(hDevInfo, pDevInfoData, property, &dataType, reinterpret_cast<PBYTE>(buffer.overflow.data()),
+                                               requiredSize, &requiredSize)) {
+            return {}; // Failed to get property
+        }
+        text = buffer.overflow.data();
     }
 
-    size_t pidPos = hardwareIds.find(L"PID_");
-    if (pidPos != std::wstring::npos) {
-        device.productId = hardwareIds.substr(pidPos + 4, 4);
+    if (dataType != REG_SZ && dataType != REG_MULTI_SZ) {
+        return {};
+    }
+    // The value need not be NUL-terminated; stop at the first NUL or its end.
+    const size_t capacity = requiredSize / sizeof(wchar_t);
+    size_t length = 0;
+    while (length < capacity && text[length] != L'\0') {
+        ++length;
     }
+    return { text, length };
 }
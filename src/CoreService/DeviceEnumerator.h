@@ -2,28 +2,45 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <windows.h> // Required for Windows data types like HDEVINFO, etc.
 #include <SetupAPI.h>
 #include <devguid.h>
-
-struct InputDevice {
-    std::wstring name;
-    std::wstring instanceId;
-    std::wstring vendorId;
-    std::wstring productId;
-};
+#include "CoreService/DeviceTable.h"
 
 class DeviceEnumerator {
 public:
     DeviceEnumerator();
     ~DeviceEnumerator();
 
+    // A full SetupAPI sweep of the present HID devices. Slow; run it off the startup path
+    // and hand the result to DeviceTable::Sync. Any thread.
     std::vector<InputDevice> EnumerateDevices();
 
+    // Looks up one device by instance ID, without a sweep. Slow too; any thread.
+    bool QueryDevice(const std::wstring& instanceId, InputDevice& device);
+
+    // Keeps `table` current from one WM_INPUT_DEVICE_CHANGE. Raw input sends an arrival for
+    // every device already present when it registers with RIDEV_DEVNOTIFY, so the table
+    // fills up from these alone; the sweep adds the HID devices raw input does not read, and
+    // the friendly names. Window thread only, and cheap enough for it.
+    void OnDeviceChange(WPARAM change, HANDLE device, DeviceTable& table);
+
 private:
-    // This is a placeholder for the actual device enumeration logic.
-    // In a real implementation, this would use SetupAPI.
+    // Room for any string property in one call; a longer one is read into the heap.
+    struct PropertyBuffer {
+        wchar_t text[512];
+        std::vector<wchar_t> overflow;
+    };
+
     static void GetDeviceDetails(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, InputDevice& device);
-    static std::wstring GetDeviceRegistryProperty(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, DWORD property);
-    static void ParseHardwareIds(const std::wstring& hardwareIds, InputDevice& device);
+
+    // The property as text (the first string of a multi-string), empty if it is missing.
+    // The result points into `buffer`.
+    static std::wstring_view GetDeviceRegistryProperty(HDEVINFO hDevInfo, PSP_DEVINFO_DATA pDevInfoData, DWORD property, PropertyBuffer& buffer);
+
+    // The instance IDs of the raw input devices that arrived, so a removal, whose handle
+    // can no longer be queried, can be matched up.
+    std::unordered_map<HANDLE, std::wstring> arrivedDevices;
 };
@@ -0,0 +1,120 @@
+#include "CoreService/DeviceRegistry.h"
+
+namespace {
+    // The value of a hex digit, or -1.
+    int HexDigit(wchar_t c) {
+        if (c >= L'0' && c <= L'9') {
+            return c - L'0';
+        }
+        if (c >= L'a' && c <= L'f') {
+            return c - L'a' + 10;
+        }
+        if (c >= L'A' && c <= L'F') {
+            return c - L'A' + 10;
+        }
+        return -1;
+    }
+
+    wchar_t ToUpper(wchar_t c) {
+        return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - L'a' + L'A') : c;
+    }
+
+    // The four hex digits after the first `tag` ("VID_" or "PID_") in `text`, or 0.
+    uint16_t ParseTaggedId(const wchar_t* text, size_t length, const wchar_t* tag) {
+        constexpr size_t TagLength = 4;
+        constexpr size_t Digits = 4;
+        for (size_t start = 0; start + TagLength + Digits <= length; ++start) {
+            size_t matched = 0;
+            while (matched < TagLength && ToUpper(text[start + matched]) == tag[matched]) {
+                ++matched;
+            }
+            if (matched != TagLength) {
+                continue;
+            }
+            uint32_t value = 0;
+            for (size_t i = 0; i < Digits; ++i) {
+                const int digit = HexDigit(text[start + TagLength + i]);
+                if (digit < 0) {
+                    return 0;
+                }
+                value = value << 4 | static_cast<uint32_t>(digit);
+            }
+            return static_cast<uint16_t>(value);
+        }
+        return 0;
+    }
+}
+
+DeviceIndex DeviceRegistry::Add(PhysicalDeviceID device) {
+    if (used == ~uint64_t{ 0 } >> (64 - MaxDevices)) {
+        return NoDeviceIndex;
+    }
+    // The lowest free index keeps the used ones packed at the bottom.
+    DeviceIndex index = 0;
+    while ((used >> index) & 1) {
+        ++index;
+    }
+    used |= uint64_t{ 1 } << index;
+    handles[index] = device;
+
+    size_t slot = Home(device);
+    while (table[slot].handle != nullptr) {
+        slot = (slot + 1) & (TableSize - 1);
+    }
+    table[slot] = { device, index };
+    return index;
+}
+
+DeviceIndex DeviceRegistry::Remove(PhysicalDeviceID device) {
+    if (device == nullptr) {
+        return NoDeviceIndex;
+    }
+    size_t slot = Home(device);
+    while (table[slot].handle != device) {
+        if (table[slot].handle == nullptr) {
+            return NoDeviceIndex;
+        }
+        slot = (slot + 1) & (TableSize - 1);
+    }
+    const DeviceIndex index = table[slot].index;
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole wherever
+    // that does not move them before their home slot, so lookups never need tombstones.
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & (TableSize - 1); table[next].handle != nullptr; next = (next + 1) & (TableSize - 1)) {
+        const size_t home = Home(table[next].handle);
+        // The entry may fill the hole if its home is not in (hole, next], cyclically.
+        const bool homeAfterHole = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!homeAfterHole) {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole] = Entry{};
+
+    used &= ~(uint64_t{ 1 } << index);
+    identified &= ~(uint64_t{ 1 } << index);
+    handles[index] = nullptr;
+    models[index].store(0, std::memory_order_relaxed);
+    return index;
+}
+
+void DeviceRegistry::SetModel(DeviceIndex index, DeviceModel model) {
+    if (index >= MaxDevices || ((used >> index) & 1) == 0) {
+        return;
+    }
+    models[index].store(static_cast<uint32_t>(model.vendorId) << 16 | model.productId, std::memory_order_relaxed);
+    identified |= uint64_t{ 1 } << index;
+}
+
+size_t DeviceRegistry::GetCount() const {
+    size_t count = 0;
+    for (uint64_t bits = used; bits != 0; bits &= bits - 1) {
+        ++count;
+    }
+    return count;
+}
+
+DeviceModel DeviceRegistry::ParseModel(const wchar_t* text, size_t length) {
+    return { ParseTaggedId(text, length, L"VID_"), ParseTaggedId(text, length, L"PID_") };
+}
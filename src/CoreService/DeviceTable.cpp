@@ -0,0 +1,155 @@
+#include "CoreService/DeviceTable.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+    bool SameDetails(const InputDevice& a, const InputDevice& b) {
+        return a.model == b.model && a.name == b.name;
+    }
+}
+
+void DeviceTable::BeginSync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    syncing = true;
+    pending.clear();
+}
+
+std::vector<DeviceTable::Change> DeviceTable::Sync(std::vector<InputDevice> sweep) {
+    for (auto& device : sweep) {
+        Normalize(device.instanceId);
+    }
+    std::sort(sweep.begin(), sweep.end(), [](const InputDevice& a, const InputDevice& b) { return a.instanceId < b.instanceId; });
+    // A device listed twice (it was re-plugged mid-sweep) counts once.
+    sweep.erase(std::unique(sweep.begin(), sweep.end(), [](const InputDevice& a, const InputDevice& b) { return a.instanceId == b.instanceId; }),
+                sweep.end());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& notification : pending) {
+        Apply(sweep, notification);
+    }
+    pending.clear();
+    syncing = false;
+    synced = true;
+
+    // Both lists are sorted, so one merge finds every difference.
+    std::vector<Change> changes;
+    size_t before = 0;
+    size_t after = 0;
+    while (before < devices.size() || after < sweep.size()) {
+        if (after == sweep.size() || (before < devices.size() && devices[before].instanceId < sweep[after].instanceId)) {
+            changes.push_back({ Change::Removed, std::move(devices[before++]) });
+        } else if (before == devices.size() || sweep[after].instanceId < devices[before].instanceId) {
+            changes.push_back({ Change::Added, sweep[after++] });
+        } else {
+            if (!SameDetails(devices[before], sweep[after])) {
+                changes.push_back({ Change::Updated, sweep[after] });
+            }
+            ++before;
+            ++after;
+        }
+    }
+    devices = std::move(sweep);
+    return changes;
+}
+
+bool DeviceTable::Add(InputDevice device) {
+    Normalize(device.instanceId);
+    std::lock_guard<std::mutex> lock(mutex);
+    Notification notification{ true, std::move(device) };
+    const bool changed = Apply(devices, notification);
+    if (syncing) {
+        pending.push_back(std::move(notification));
+    }
+    return changed;
+}
+
+bool DeviceTable::Remove(const std::wstring& instanceId) {
+    Notification notification{ false, InputDevice{ {}, instanceId, {} } };
+    Normalize(notification.device.instanceId);
+    std::lock_guard<std::mutex> lock(mutex);
+    const bool changed = Apply(devices, notification);
+    if (syncing) {
+        pending.push_back(std::move(notification));
+    }
+    return changed;
+}
+
+bool DeviceTable::Find(const std::wstring& instanceId, InputDevice& device) const {
+    std::wstring key = instanceId;
+    Normalize(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t at = LowerBound(devices, key);
+    if (at == devices.size() || devices[at].instanceId != key) {
+        return false;
+    }
+    device = devices[at];
+    return true;
+}
+
+std::vector<InputDevice> DeviceTable::GetDevices() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices;
+}
+
+size_t DeviceTable::GetCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return devices.size();
+}
+
+bool DeviceTable::IsSynced() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return synced;
+}
+
+std::wstring DeviceTable::InstanceIdFromInterface(const wchar_t* path, size_t length) {
+    // "\\?\" + the instance ID with '#' for '\' + "#{interface class GUID}".
+    constexpr size_t PrefixLength = 4;
+    if (length < PrefixLength || path[0] != L'\\' || path[1] != L'\\' || (path[2] != L'?' && path[2] != L'.') || path[3] != L'\\') {
+        return {};
+    }
+    size_t end = length;
+    while (end > PrefixLength && path[end - 1] != L'#') {
+        --end;
+    }
+    if (end == PrefixLength || path[end] != L'{') {
+        return {};
+    }
+    std::wstring instanceId(path + PrefixLength, end - 1 - PrefixLength);
+    std::replace(instanceId.begin(), instanceId.end(), L'#', L'\\');
+    Normalize(instanceId);
+    return instanceId;
+}
+
+size_t DeviceTable::LowerBound(const std::vector<InputDevice>& list, const std::wstring& instanceId) {
+    const auto it = std::lower_bound(list.begin(), list.end(), instanceId,
+                                     [](const InputDevice& device, const std::wstring& key) { return device.instanceId < key; });
+    return static_cast<size_t>(it - list.begin());
+}
+
+bool DeviceTable::Apply(std::vector<InputDevice>& list, const Notification& notification) {
+    const size_t at = LowerBound(list, notification.device.instanceId);
+    const bool present = at != list.size() && list[at].instanceId == notification.device.instanceId;
+    if (!notification.added) {
+        if (present) {
+            list.erase(list.begin() + static_cast<std::ptrdiff_t>(at));
+        }
+        return present;
+    }
+    if (!present) {
+        list.insert(list.begin() + static_cast<std::ptrdiff_t>(at), notification.device);
+        return true;
+    }
+    if (SameDetails(list[at], notification.device)) {
+        return false;
+    }
+    list[at] = notification.device;
+    return true;
+}
+
+void DeviceTable::Normalize(std::wstring& instanceId) {
+    for (auto& c : instanceId) {
+        if (c >= L'a' && c <= L'z') {
+            c = static_cast<wchar_t>(c - L'a' + L'A');
+        }
+    }
+}
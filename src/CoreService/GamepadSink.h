@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A complete virtual gamepad state, laid out like ViGEm's XUSB_REPORT.
+// VirtualController keeps one of these as its shadow and hands the whole report to a
+// GamepadSink whenever it changes.
+struct GamepadReport {
+    uint16_t buttons = 0; // GamepadButton bits
+    uint8_t leftTrigger = 0;
+    uint8_t rightTrigger = 0;
+    int16_t thumbLX = 0;
+    int16_t thumbLY = 0;
+    int16_t thumbRX = 0;
+    int16_t thumbRY = 0;
+
+    bool operator==(const GamepadReport& other) const {
+        return buttons == other.buttons && leftTrigger == other.leftTrigger && rightTrigger == other.rightTrigger &&
+               thumbLX == other.thumbLX && thumbLY == other.thumbLY && thumbRX == other.thumbRX && thumbRY == other.thumbRY;
+    }
+    bool operator!=(const GamepadReport& other) const { return !(*this == other); }
+};
+
+// Button bits of GamepadReport::buttons. The values match XUSB_GAMEPAD_* so the ViGEm sink
+// can pass them through unchanged.
+enum GamepadButton : uint16_t {
+    GamepadDpadUp = 0x0001,
+    GamepadDpadDown = 0x0002,
+    GamepadDpadLeft = 0x0004,
+    GamepadDpadRight = 0x0008,
+    GamepadStart = 0x0010,
+    GamepadBack = 0x0020,
+    GamepadLeftThumb = 0x0040,
+    GamepadRightThumb = 0x0080,
+    GamepadLeftShoulder = 0x0100,
+    GamepadRightShoulder = 0x0200,
+    GamepadGuide = 0x0400,
+    GamepadA = 0x1000,
+    GamepadB = 0x2000,
+    GamepadX = 0x4000,
+    GamepadY = 0x8000
+};
+
+// Where VirtualController sends its flushed reports. The service uses the ViGEmBus sink;
+// RecordingGamepadSink keeps them in memory so the mapping pipeline can run without a driver.
+class GamepadSink {
+public:
+    virtual ~GamepadSink() = default;
+
+    // Creates/plugs in the virtual device. Returns false if it is not available.
+    virtual bool Connect() = 0;
+    virtual void Disconnect() = 0;
+
+    // Sends a complete report. Returns false if the device rejected it.
+    virtual bool SubmitReport(const GamepadReport& report) = 0;
+};
+
+// Records every submitted report, in order.
+class RecordingGamepadSink : public GamepadSink {
+public:
+    bool Connect() override { connected = true; return true; }
+    void Disconnect() override { connected = false; }
+
+    bool SubmitReport(const GamepadReport& report) override {
+        reports.push_back(report);
+        return connected;
+    }
+
+    const std::vector<GamepadReport>& GetReports() const { return reports; }
+    void Clear() { reports.clear(); }
+    void Reserve(size_t count) { reports.reserve(count); }
+
+private:
+    bool connected = false;
+    std::vector<GamepadReport> reports;
+};
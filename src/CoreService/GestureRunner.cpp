@@ -0,0 +1,157 @@
+#include "CoreService/Mapping/GestureRunner.h"
+
+namespace {
+    enum State : uint8_t { Idle, Held, Active, TooLong, Gap, StateCount };
+    enum Symbol : uint8_t { Down, Up, Timeout, SymbolCount };
+
+    // What a transition does besides changing state.
+    enum Effect : uint8_t {
+        None = 0,
+        Press = 1,   // Fire a press
+        Release = 2, // Fire a release
+        Pulse = 4,   // Fire a press now and a release GesturePulseNs later
+        Arm = 8,     // Start the gesture's time limit
+        Cancel = 16  // Stop it
+    };
+
+    struct Transition {
+        uint8_t next;
+        uint8_t effects;
+    };
+
+    constexpr size_t GestureCount = static_cast<size_t>(Gesture::Count);
+
+    struct TransitionTable {
+        Transition entries[GestureCount][StateCount][SymbolCount];
+
+        constexpr const Transition& At(Gesture gesture, uint8_t state, uint8_t symbol) const {
+            return entries[static_cast<size_t>(gesture)][state][symbol];
+        }
+    };
+
+    // Anything not listed leaves the state as it is and does nothing.
+    constexpr TransitionTable BuildTransitions() {
+        TransitionTable table{};
+        for (size_t g = 0; g < GestureCount; ++g) {
+            for (uint8_t s = 0; s < StateCount; ++s) {
+                for (uint8_t y = 0; y < SymbolCount; ++y) {
+                    table.entries[g][s][y] = { s, None };
+                }
+            }
+        }
+        auto set = [&table](Gesture gesture, State from, Symbol symbol, State to, uint8_t effects) {
+            table.entries[static_cast<size_t>(gesture)][from][symbol] = { to, effects };
+        };
+
+        set(Gesture::Press, Idle, Down, Active, Press);
+        set(Gesture::Press, Active, Up, Idle, Release);
+
+        set(Gesture::Release, Idle, Down, Held, None);
+        set(Gesture::Release, Held, Up, Idle, Pulse);
+
+        set(Gesture::Tap, Idle, Down, Held, Arm);
+        set(Gesture::Tap, Held, Up, Idle, Cancel | Pulse);
+        set(Gesture::Tap, Held, Timeout, TooLong, None);
+        set(Gesture::Tap, TooLong, Up, Idle, None);
+
+        set(Gesture::LongPress, Idle, Down, Held, Arm);
+        set(Gesture::LongPress, Held, Up, Idle, Cancel);
+        set(Gesture::LongPress, Held, Timeout, Active, Press);
+        set(Gesture::LongPress, Active, Up, Idle, Release);
+
+        set(Gesture::DoubleTap, Idle, Down, Held, None);
+        set(Gesture::DoubleTap, Held, Up, Gap, Arm);
+        set(Gesture::DoubleTap, Gap, Down, Active, Cancel | Press);
+        set(Gesture::DoubleTap, Gap, Timeout, Idle, None);
+        set(Gesture::DoubleTap, Active, Up, Idle, Release);
+        return table;
+    }
+
+    constexpr TransitionTable Transitions = BuildTransitions();
+
+    static_assert(Transitions.At(Gesture::Tap, Held, Up).effects == (Cancel | Pulse), "Tap must fire on a quick release");
+    static_assert(Transitions.At(Gesture::LongPress, Held, Up).next == Idle, "A short press is not a long press");
+    static_assert(Transitions.At(Gesture::Press, Held, Down).next == Held, "Unlisted transitions must keep the state");
+}
+
+void GestureRunner::Bind(const CompiledRuleSet& set, uint64_t nowNs) {
+    if (set.GetGeneration() == generation) {
+        return;
+    }
+    generation = set.GetGeneration();
+    machines.assign(set.GetMachineCount(), MachineState{});
+    timers.reset();
+    if (!machines.empty()) {
+        timers = std::make_unique<TimerWheel>(machines.size() * 2, TickNs, nowNs);
+    }
+    firings.clear();
+}
+
+void GestureRunner::OnButton(const CompiledRuleSet& set, const CompiledRuleSet::DispatchTable& table,
+                             const CompiledRuleSet::Bucket& bucket, DeviceIndex device, DeviceModel model, bool pressed,
+                             uint64_t timeNs) {
+    for (uint32_t i = 0; i < bucket.listenerCount; ++i) {
+        const auto& listener = table.GetListener(bucket.firstListener + i);
+        const auto& machine = set.GetMachine(listener.machine);
+        if (!set.GetRules()[machine.rule].MatchesDevice(device, model)) {
+            continue;
+        }
+
+        // Only a change in whether the whole chord is held is a symbol for the machine.
+        MachineState& state = machines[listener.machine];
+        const bool wasFull = state.held == machine.fullMask;
+        const uint8_t bit = static_cast<uint8_t>(1u << listener.bit);
+        state.held = pressed ? (state.held | bit) : (state.held & ~bit);
+        const bool isFull = state.held == machine.fullMask;
+        if (isFull != wasFull) {
+            if (isFull) {
+                state.device = device;
+            }
+            Step(set, listener.machine, isFull ? Down : Up, timeNs);
+        }
+    }
+}
+
+void GestureRunner::Advance(const CompiledRuleSet& set, uint64_t nowNs) {
+    if (!timers) {
+        return;
+    }
+    timers->Advance(nowNs, [this, &set](uint32_t timer) {
+        const uint32_t machine = timer / 2;
+        const uint64_t dueNs = timers->GetDeadline(timer);
+        if (timer == PulseTimer(machine)) {
+            firings.push_back({ machine, false, machines[machine].device, dueNs });
+        } else {
+            Step(set, machine, Timeout, dueNs);
+        }
+    });
+}
+
+void GestureRunner::Step(const CompiledRuleSet& set, uint32_t machine, uint8_t symbol, uint64_t timeNs) {
+    MachineState& state = machines[machine];
+    const auto& compiled = set.GetMachine(machine);
+    const Transition& transition = Transitions.At(compiled.gesture, state.state, symbol);
+    state.state = transition.next;
+
+    const uint8_t effects = transition.effects;
+    if (effects & Cancel) {
+        timers->Cancel(GestureTimer(machine));
+    }
+    if (effects & Arm) {
+        timers->Schedule(GestureTimer(machine), timeNs + compiled.timeNs);
+    }
+    if (effects & Release) {
+        firings.push_back({ machine, false, state.device, timeNs });
+    }
+    if (effects & (Press | Pulse)) {
+        // A pulse still running from the last time just has its end moved.
+        if (!timers->IsScheduled(PulseTimer(machine))) {
+            firings.push_back({ machine, true, state.device, timeNs });
+        }
+        if (effects & Pulse) {
+            timers->Schedule(PulseTimer(machine), timeNs + GesturePulseNs);
+        } else {
+            timers->Cancel(PulseTimer(machine));
+        }
+    }
+}
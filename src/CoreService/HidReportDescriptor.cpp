@@ -0,0 +1,486 @@
+#include "CoreService/Mapping/HidReportDescriptor.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr uint16_t UsagePageGenericDesktop = 0x01;
+    constexpr uint16_t UsagePageSimulation = 0x02;
+    constexpr uint16_t UsagePageButton = 0x09;
+    constexpr uint16_t UsageX = 0x30;
+    constexpr uint16_t UsageWheel = 0x38;
+    constexpr uint16_t UsageHatSwitch = 0x39;
+    constexpr uint16_t UsageVx = 0x40;
+    constexpr uint16_t UsageVno = 0x46;
+
+    // Reads the 64 bits starting at the byte that holds `bitOffset`, shifted so the field
+    // starts at bit 0. The caller guarantees 8 readable bytes. Reports are little-endian,
+    // as is every platform the service runs on.
+    inline uint64_t LoadBits(const uint8_t* buffer, uint32_t bitOffset) {
+        uint64_t bits;
+        std::memcpy(&bits, buffer + (bitOffset >> 3), sizeof(bits));
+        return bits >> (bitOffset & 7);
+    }
+
+    inline uint64_t FieldMask(uint8_t bitSize) {
+        return (uint64_t{ 1 } << bitSize) - 1;
+    }
+}
+
+bool HidExtractionPlan::Decode(const uint8_t* report, size_t size, InputSnapshot& state) const {
+    if (size == 0 || size > MaxReportBytes) {
+        return false;
+    }
+
+    const uint8_t programIndex = programByReportId[hasReportIdPrefix ? report[0] : 0];
+    if (programIndex == NoProgram) {
+        return false;
+    }
+    const ReportProgram& program = programs[programIndex];
+    if (size < program.minimumBytes) {
+        return false;
+    }
+
+    // Pad the report so every field can be fetched with a single unaligned 64-bit load,
+    // including the ones in the last few bytes.
+    uint8_t buffer[MaxReportBytes + sizeof(uint64_t)];
+    std::memcpy(buffer, report, size);
+    std::memset(buffer + size, 0, sizeof(uint64_t));
+
+    for (uint32_t i = program.firstRun; i < uint32_t(program.firstRun) + program.runCount; ++i) {
+        const ButtonRun& run = runs[i];
+        const uint64_t bits = LoadBits(buffer, run.bitOffset) & FieldMask(run.bitCount);
+        state.buttons[run.word] = (state.buttons[run.word] & ~run.mask) | (bits << run.shift);
+    }
+
+    if (program.slotCount != 0) {
+        for (size_t w = 0; w < InputSnapshot::ButtonWords; ++w) {
+            state.buttons[w] &= ~program.slotClear[w];
+        }
+        for (uint32_t i = program.firstSlot; i < uint32_t(program.firstSlot) + program.slotCount; ++i) {
+            const ButtonSlot& slot = slots[i];
+            const int64_t value = static_cast<int64_t>(LoadBits(buffer, slot.bitOffset) & FieldMask(slot.bitSize));
+            const uint64_t index = static_cast<uint64_t>(value - slot.logicalMin);
+            if (index < slot.buttonCount) {
+                const size_t button = slot.firstButton + index;
+                state.buttons[button / InputSnapshot::ButtonWordBits] |= uint64_t{ 1 } << (button % InputSnapshot::ButtonWordBits);
+            }
+        }
+    }
+
+    for (uint32_t i = program.firstAxis; i < uint32_t(program.firstAxis) + program.axisCount; ++i) {
+        const AxisField& axis = axisFields[i];
+        const uint32_t raw = static_cast<uint32_t>(LoadBits(buffer, axis.bitOffset) & FieldMask(axis.bitSize));
+        const int32_t value = static_cast<int32_t>(raw << axis.signShift) >> axis.signShift;
+        const int64_t scaled = ((static_cast<int64_t>(value) - axis.logicalMin) * axis.scale >> 16) - 32768;
+        state.axes[axis.target] = static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(scaled, -32768), 32767));
+    }
+
+    for (uint32_t i = program.firstHat; i < uint32_t(program.firstHat) + program.hatCount; ++i) {
+        const HatField& hat = hatFields[i];
+        const int64_t raw = static_cast<int64_t>(LoadBits(buffer, hat.bitOffset) & FieldMask(hat.bitSize));
+        const uint64_t direction = static_cast<uint64_t>(raw - hat.logicalMin);
+        state.hats[hat.target] = direction < hat.directionCount ? static_cast<int8_t>(direction << hat.directionShift) : int8_t{ -1 };
+    }
+
+    return true;
+}
+
+HidPlanBuilder::HidPlanBuilder(bool reportIdPrefix) : reportIdPrefix(reportIdPrefix) {}
+
+void HidPlanBuilder::AddVariable(uint8_t reportId, uint32_t bitOffset, uint8_t bitSize,
+                                 uint16_t usagePage, uint16_t usage, int32_t logicalMin, int32_t logicalMax) {
+    if (bitSize == 0 || bitSize > 32) {
+        return;
+    }
+
+    if (usagePage == UsagePageButton) {
+        // Button usage 0 means "no button"; multi-bit (pressure) buttons are not decoded.
+        if (usage == 0 || usage > InputSnapshot::MaxButtons || bitSize != 1) {
+            return;
+        }
+        const uint16_t button = usage - 1;
+        buttons.push_back({ reportId, bitOffset, button });
+        controls.push_back({ HidControlInfo::Kind::Button, reportId, button, usagePage, usage, bitOffset, bitSize, logicalMin, logicalMax });
+        return;
+    }
+
+    if (usagePage == UsagePageGenericDesktop && usage == UsageHatSwitch) {
+        // Hats are numbered per report, so a device that repeats its layout under several
+        // report IDs (e.g. USB and Bluetooth modes) still reports the same hat 0.
+        const auto hatIndex = static_cast<uint16_t>(std::count_if(values.begin(), values.end(), [reportId](const PendingValue& v) {
+            return v.isHat && v.reportId == reportId;
+        }));
+        if (hatIndex >= InputSnapshot::MaxHats) {
+            return;
+        }
+        values.push_back({ reportId, bitOffset, bitSize, static_cast<uint8_t>(hatIndex), true, logicalMin, logicalMax });
+        controls.push_back({ HidControlInfo::Kind::Hat, reportId, hatIndex, usagePage, usage, bitOffset, bitSize, logicalMin, logicalMax });
+        return;
+    }
+
+    uint16_t axis;
+    if (usagePage == UsagePageGenericDesktop && usage >= UsageX && usage <= UsageWheel) {
+        axis = usage - UsageX;
+    } else if ((usagePage == UsagePageGenericDesktop && usage >= UsageVx && usage <= UsageVno) || usagePage == UsagePageSimulation) {
+        // Other axes get IDs in order of first appearance; a usage seen before keeps its ID.
+        auto existing = std::find_if(controls.begin(), controls.end(), [&](const HidControlInfo& c) {
+            return c.kind == HidControlInfo::Kind::Axis && c.usagePage == usagePage && c.usage == usage;
+        });
+        if (existing != controls.end()) {
+            axis = existing->controlId;
+        } else if (nextDynamicAxis < InputSnapshot::MaxAxes) {
+            axis = nextDynamicAxis++;
+        } else {
+            return;
+        }
+    } else {
+        return; // Vendor-defined and other usages carry nothing we map.
+    }
+
+    values.push_back({ reportId, bitOffset, bitSize, static_cast<uint8_t>(axis), false, logicalMin, logicalMax });
+    controls.push_back({ HidControlInfo::Kind::Axis, reportId, axis, usagePage, usage, bitOffset, bitSize, logicalMin, logicalMax });
+}
+
+void HidPlanBuilder::AddArray(uint8_t reportId, uint32_t bitOffset, uint8_t bitSize,
+                              uint16_t usagePage, uint16_t usageMin, uint16_t usageMax, int32_t logicalMin) {
+    if (usagePage != UsagePageButton || bitSize == 0 || bitSize > 32 || usageMax < usageMin) {
+        return;
+    }
+    // Usage 0 is "no button", so a range starting there loses its first entry.
+    const uint16_t firstUsage = std::max<uint16_t>(usageMin, 1);
+    const uint16_t lastUsage = std::min<uint16_t>(usageMax, InputSnapshot::MaxButtons);
+    if (firstUsage > lastUsage) {
+        return;
+    }
+    const auto count = static_cast<uint16_t>(lastUsage - firstUsage + 1);
+    arrays.push_back({ reportId, bitOffset, bitSize, static_cast<uint16_t>(firstUsage - 1), count,
+                       logicalMin + (firstUsage - usageMin) });
+    for (uint16_t usage = firstUsage; usage <= lastUsage; ++usage) {
+        controls.push_back({ HidControlInfo::Kind::Button, reportId, static_cast<uint16_t>(usage - 1), usagePage, usage,
+                             bitOffset, bitSize, logicalMin, logicalMin + (usage - usageMin) });
+    }
+}
+
+void HidPlanBuilder::SetReportBits(uint8_t reportId, uint32_t bitLength) {
+    reportBits[reportId] = std::max(reportBits[reportId], bitLength);
+}
+
+HidExtractionPlan HidPlanBuilder::Build() {
+    HidExtractionPlan plan;
+    plan.hasReportIdPrefix = reportIdPrefix;
+
+    auto byReportThenOffset = [](const auto& a, const auto& b) {
+        return a.reportId != b.reportId ? a.reportId < b.reportId : a.bitOffset < b.bitOffset;
+    };
+    std::sort(buttons.begin(), buttons.end(), byReportThenOffset);
+    std::sort(arrays.begin(), arrays.end(), byReportThenOffset);
+    std::sort(values.begin(), values.end(), byReportThenOffset);
+
+    auto programFor = [&plan](uint8_t reportId) -> HidExtractionPlan::ReportProgram& {
+        uint8_t& index = plan.programByReportId[reportId];
+        if (index == HidExtractionPlan::NoProgram) {
+            index = static_cast<uint8_t>(plan.programs.size());
+            plan.programs.emplace_back();
+        }
+        return plan.programs[index];
+    };
+
+    // Because every list is sorted by report ID, each report's fields form one contiguous
+    // range per array, so a program only needs a start index and a count per array.
+    for (size_t i = 0; i < buttons.size(); ++i) {
+        const PendingButton& b = buttons[i];
+        auto& program = programFor(b.reportId);
+        if (program.runCount == 0) {
+            program.firstRun = static_cast<uint16_t>(plan.runs.size());
+        }
+
+        // Extend the previous run if this button directly follows it in both the report and
+        // the bitset, stays in the same bitset word, and the run still fits one shifted load.
+        const uint8_t word = static_cast<uint8_t>(b.button / InputSnapshot::ButtonWordBits);
+        const uint8_t shift = static_cast<uint8_t>(b.button % InputSnapshot::ButtonWordBits);
+        if (program.runCount != 0 && i != 0 && buttons[i - 1].reportId == b.reportId) {
+            auto& run = plan.runs.back();
+            const bool adjacent = run.bitOffset + run.bitCount == b.bitOffset && run.word == word && run.shift + run.bitCount == shift;
+            if (adjacent && run.bitCount < 56) {
+                ++run.bitCount;
+                run.mask |= uint64_t{ 1 } << shift;
+                continue;
+            }
+        }
+        plan.runs.push_back({ b.bitOffset, 1, word, shift, uint64_t{ 1 } << shift });
+        ++program.runCount;
+    }
+
+    for (const auto& a : arrays) {
+        auto& program = programFor(a.reportId);
+        if (program.slotCount == 0) {
+            program.firstSlot = static_cast<uint16_t>(plan.slots.size());
+        }
+        plan.slots.push_back({ a.bitOffset, a.bitSize, static_cast<uint8_t>(a.firstButton), static_cast<uint8_t>(a.count), a.logicalMin });
+        ++program.slotCount;
+        for (uint16_t button = a.firstButton; button < a.firstButton + a.count; ++button) {
+            program.slotClear[button / InputSnapshot::ButtonWordBits] |= uint64_t{ 1 } << (button % InputSnapshot::ButtonWordBits);
+        }
+    }
+
+    for (const auto& v : values) {
+        auto& program = programFor(v.reportId);
+        if (v.isHat) {
+            if (program.hatCount == 0) {
+                program.firstHat = static_cast<uint16_t>(plan.hatFields.size());
+            }
+            const uint32_t directions = v.logicalMax >= v.logicalMin ? static_cast<uint32_t>(v.logicalMax - v.logicalMin) + 1 : 0;
+            plan.hatFields.push_back({ v.bitOffset, v.bitSize, v.target, static_cast<uint8_t>(directions == 4 ? 1 : 0),
+                                       v.logicalMin, std::min<uint32_t>(directions, 8) });
+            ++program.hatCount;
+        } else {
+            if (program.axisCount == 0) {
+                program.firstAxis = static_cast<uint16_t>(plan.axisFields.size());
+            }
+            // Round the scale up so logicalMax reaches 32767 exactly; the decode clamps the rest.
+            const int64_t range = static_cast<int64_t>(v.logicalMax) - v.logicalMin;
+            const int64_t scale = range > 0 ? ((int64_t{ 65535 } << 16) + range - 1) / range : 0;
+            const uint8_t signShift = v.logicalMin < 0 ? static_cast<uint8_t>(32 - v.bitSize) : 0;
+            plan.axisFields.push_back({ v.bitOffset, v.bitSize, signShift, v.target, v.logicalMin, scale });
+            ++program.axisCount;
+        }
+    }
+
+    for (size_t id = 0; id < reportBits.size(); ++id) {
+        const uint8_t index = plan.programByReportId[id];
+        if (index != HidExtractionPlan::NoProgram) {
+            plan.programs[index].minimumBytes = (reportBits[id] + 7) / 8;
+        }
+    }
+
+    plan.controls = std::move(controls);
+    return plan;
+}
+
+namespace {
+    // The global item state of the descriptor parser (HID 1.11, section 6.2.2.7).
+    struct GlobalItems {
+        uint16_t usagePage = 0;
+        int32_t logicalMin = 0;
+        int32_t logicalMaxSigned = 0;
+        uint32_t logicalMaxUnsigned = 0;
+        uint32_t reportSize = 0;
+        uint32_t reportCount = 0;
+        uint8_t reportId = 0;
+    };
+
+    // Walks the short items of a descriptor, calling visit(type, tag, unsignedData, signedData, dataSize).
+    // Long items are skipped. Returns false if an item runs past the end of the descriptor.
+    template <typename Visitor>
+    bool ForEachItem(const uint8_t* descriptor, size_t size, Visitor&& visit) {
+        size_t pos = 0;
+        while (pos < size) {
+            const uint8_t prefix = descriptor[pos++];
+            if (prefix == 0xFE) { // Long item: bDataSize, bLongItemTag, data
+                if (pos + 2 > size || pos + 2 + descriptor[pos] > size) {
+                    return false;
+                }
+                pos += 2 + descriptor[pos];
+                continue;
+            }
+
+            static constexpr uint8_t DataSizes[4] = { 0, 1, 2, 4 };
+            const uint8_t dataSize = DataSizes[prefix & 0x03];
+            if (pos + dataSize > size) {
+                return false;
+            }
+            uint32_t data = 0;
+            for (uint8_t i = 0; i < dataSize; ++i) {
+                data |= static_cast<uint32_t>(descriptor[pos + i]) << (8 * i);
+            }
+            int32_t signedData = static_cast<int32_t>(data);
+            if (dataSize == 1) {
+                signedData = static_cast<int8_t>(data);
+            } else if (dataSize == 2) {
+                signedData = static_cast<int16_t>(data);
+            }
+            pos += dataSize;
+
+            if (!visit(static_cast<uint8_t>((prefix >> 2) & 0x03), static_cast<uint8_t>(prefix >> 4), data, signedData, dataSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    enum ItemType : uint8_t { MainItem = 0, GlobalItem = 1, LocalItem = 2 };
+    enum MainTag : uint8_t { InputTag = 0x8, OutputTag = 0x9, CollectionTag = 0xA, FeatureTag = 0xB, EndCollectionTag = 0xC };
+    enum GlobalTag : uint8_t { UsagePageTag = 0x0, LogicalMinTag = 0x1, LogicalMaxTag = 0x2, ReportSizeTag = 0x7,
+                               ReportIdTag = 0x8, ReportCountTag = 0x9, PushTag = 0xA, PopTag = 0xB };
+    enum LocalTag : uint8_t { UsageTag = 0x0, UsageMinTag = 0x1, UsageMaxTag = 0x2 };
+
+    constexpr uint32_t InputConstant = 0x01;
+    constexpr uint32_t InputVariable = 0x02;
+    constexpr uint32_t InputRelative = 0x04;
+}
+
+bool ParseHidReportDescriptor(const uint8_t* descriptor, size_t size, HidExtractionPlan& plan) {
+    if (descriptor == nullptr || size == 0) {
+        return false;
+    }
+
+    // Reports only start with an ID byte if the descriptor declares report IDs at all,
+    // which has to be known before the first bit offset is assigned.
+    bool usesReportIds = false;
+    if (!ForEachItem(descriptor, size, [&](uint8_t type, uint8_t tag, uint32_t, int32_t, uint8_t) {
+            usesReportIds |= type == GlobalItem && tag == ReportIdTag;
+            return true;
+        })) {
+        return false;
+    }
+
+    HidPlanBuilder builder(usesReportIds);
+    GlobalItems global;
+    std::vector<GlobalItems> globalStack;
+    std::array<uint32_t, 256> bitCursor;
+    bitCursor.fill(usesReportIds ? 8 : 0);
+    std::array<bool, 256> hasInput{};
+
+    // Local items; usages carry their page in the high 16 bits once resolved.
+    std::vector<uint32_t> usages;
+    std::vector<bool> usageHasPage;
+    uint32_t usageMin = 0, usageMax = 0;
+    bool usageMinHasPage = false, hasUsageRange = false;
+    int collectionDepth = 0;
+
+    auto resolve = [&global](uint32_t usage, bool hasPage) {
+        return hasPage ? usage : (static_cast<uint32_t>(global.usagePage) << 16) | (usage & 0xFFFF);
+    };
+
+    auto handleInput = [&](uint32_t flags) {
+        const uint8_t id = global.reportId;
+        const uint32_t fieldBits = global.reportSize;
+        const uint32_t start = bitCursor[id];
+        bitCursor[id] += fieldBits * global.reportCount;
+        hasInput[id] = true;
+
+        if ((flags & InputConstant) || fieldBits == 0 || fieldBits > 32) {
+            return; // Padding, or a field too wide to be a control we decode
+        }
+
+        const int32_t logicalMin = global.logicalMin;
+        const int32_t logicalMax = logicalMin < 0 ? global.logicalMaxSigned : static_cast<int32_t>(global.logicalMaxUnsigned);
+
+        if (flags & InputVariable) {
+            if (flags & InputRelative) {
+                return; // Relative motion (mice, wheels) is captured elsewhere.
+            }
+            // Each report slot takes the next usage; a list that runs short repeats its last entry.
+            std::vector<uint32_t> fieldUsages;
+            for (size_t u = 0; u < usages.size(); ++u) {
+                fieldUsages.push_back(resolve(usages[u], usageHasPage[u]));
+            }
+            if (hasUsageRange) {
+                const uint32_t first = resolve(usageMin, usageMinHasPage);
+                for (uint32_t u = usageMin & 0xFFFF; u <= (usageMax & 0xFFFF) && fieldUsages.size() < global.reportCount; ++u) {
+                    fieldUsages.push_back((first & 0xFFFF0000) | u);
+                }
+            }
+            if (fieldUsages.empty()) {
+                return;
+            }
+            for (uint32_t i = 0; i < global.reportCount; ++i) {
+                const uint32_t usage = fieldUsages[std::min<size_t>(i, fieldUsages.size() - 1)];
+                builder.AddVariable(id, start + i * fieldBits, static_cast<uint8_t>(fieldBits),
+                                    static_cast<uint16_t>(usage >> 16), static_cast<uint16_t>(usage & 0xFFFF), logicalMin, logicalMax);
+            }
+        } else {
+            uint32_t first, last;
+            if (hasUsageRange) {
+                first = resolve(usageMin, usageMinHasPage);
+                last = (first & 0xFFFF0000) | (usageMax & 0xFFFF);
+            } else if (!usages.empty()) {
+                first = resolve(usages.front(), usageHasPage.front());
+                last = resolve(usages.back(), usageHasPage.back());
+            } else {
+                return;
+            }
+            for (uint32_t i = 0; i < global.reportCount; ++i) {
+                builder.AddArray(id, start + i * fieldBits, static_cast<uint8_t>(fieldBits), static_cast<uint16_t>(first >> 16),
+                                 static_cast<uint16_t>(first & 0xFFFF), static_cast<uint16_t>(last & 0xFFFF), logicalMin);
+            }
+        }
+    };
+
+    const bool wellFormed = ForEachItem(descriptor, size, [&](uint8_t type, uint8_t tag, uint32_t data, int32_t signedData, uint8_t dataSize) {
+        switch (type) {
+        case MainItem:
+            if (tag == InputTag) {
+                handleInput(data);
+            } else if (tag == CollectionTag) {
+                ++collectionDepth;
+            } else if (tag == EndCollectionTag) {
+                if (--collectionDepth < 0) {
+                    return false;
+                }
+            } else if (tag != OutputTag && tag != FeatureTag) {
+                return false;
+            }
+            // Local items only apply to the main item that follows them.
+            usages.clear();
+            usageHasPage.clear();
+            hasUsageRange = false;
+            return true;
+
+        case GlobalItem:
+            switch (tag) {
+            case UsagePageTag: global.usagePage = static_cast<uint16_t>(data); break;
+            case LogicalMinTag: global.logicalMin = signedData; break;
+            case LogicalMaxTag: global.logicalMaxSigned = signedData; global.logicalMaxUnsigned = data; break;
+            case ReportSizeTag: global.reportSize = data; break;
+            case ReportCountTag: global.reportCount = data; break;
+            case ReportIdTag:
+                if (data == 0 || data > 0xFF) {
+                    return false;
+                }
+                global.reportId = static_cast<uint8_t>(data);
+                break;
+            case PushTag: globalStack.push_back(global); break;
+            case PopTag:
+                if (globalStack.empty()) {
+                    return false;
+                }
+                global = globalStack.back();
+                globalStack.pop_back();
+                break;
+            default: break; // Physical range and units do not affect decoding.
+            }
+            return true;
+
+        case LocalItem:
+            // A 4-byte usage is an extended usage that names its own page.
+            if (tag == UsageTag) {
+                usages.push_back(data);
+                usageHasPage.push_back(dataSize == 4);
+            } else if (tag == UsageMinTag) {
+                usageMin = data;
+                usageMinHasPage = dataSize == 4;
+                hasUsageRange = true;
+            } else if (tag == UsageMaxTag) {
+                usageMax = data;
+            }
+            return true;
+
+        default:
+            return false; // Reserved item type
+        }
+    });
+
+    if (!wellFormed || collectionDepth != 0) {
+        return false;
+    }
+
+    for (size_t id = 0; id < hasInput.size(); ++id) {
+        if (hasInput[id]) {
+            builder.SetReportBits(static_cast<uint8_t>(id), bitCursor[id]);
+        }
+    }
+
+    plan = builder.Build();
+    return !plan.IsEmpty();
+}
@@ -0,0 +1,162 @@
+#include "CoreService/InputCapture.h"
+#include <iostream>
+
+namespace {
+    struct CaptureHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint64_t recordCount;
+    };
+    static_assert(sizeof(CaptureHeader) == 16, "capture header is 16 bytes on disk");
+}
+
+InputCaptureWriter::~InputCaptureWriter() {
+    Close();
+}
+
+bool InputCaptureWriter::Open(const std::string& path) {
+    Close();
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open capture file for writing: " << path << std::endl;
+        return false;
+    }
+
+    // Written again with the real count by Close.
+    const CaptureHeader header{ InputCaptureRecord::Magic, InputCaptureRecord::Version, 0, 0 };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.reserve(BufferedRecords);
+    recordCount = 0;
+    lastTimestamp = 0;
+    haveFirstTimestamp = false;
+    lastEventTimestamp = 0;
+    return true;
+}
+
+bool InputCaptureWriter::Close() {
+    if (!file.is_open()) {
+        return true;
+    }
+    FlushBuffer();
+    const CaptureHeader header{ InputCaptureRecord::Magic, InputCaptureRecord::Version, 0, recordCount };
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const bool ok = file.good();
+    file.close();
+    if (!ok) {
+        std::cerr << "Error: Failed to write capture file." << std::endl;
+    }
+    return ok;
+}
+
+void InputCaptureWriter::Append(const InputEvent& event) {
+    InputCaptureRecord record{};
+    record.timestamp = event.timestamp;
+    record.type = static_cast<uint8_t>(event.type);
+    record.device = event.device;
+    record.id = event.id;
+    record.value = event.value;
+    Push(record);
+}
+
+void InputCaptureWriter::EndFrame(uint64_t timestamp) {
+    InputCaptureRecord record{};
+    record.timestamp = timestamp;
+    record.type = static_cast<uint8_t>(InputType::Unknown);
+    record.device = InputCaptureRecord::NoDevice;
+    Push(record);
+}
+
+void InputCaptureWriter::Append(const InputEventBatch& batch) {
+    const InputType* types = batch.GetTypes();
+    for (size_t i = 0; i < batch.GetSize(); ++i) {
+        if (types[i] == InputType::Unknown) {
+            EndFrame(lastEventTimestamp);
+        } else {
+            const InputEvent event = batch.Get(i);
+            Append(event);
+            lastEventTimestamp = event.timestamp;
+        }
+    }
+}
+
+void InputCaptureWriter::Push(InputCaptureRecord record) {
+    if (!file.is_open()) {
+        return;
+    }
+    // Timestamps are stored relative to the first record so recordings from different
+    // sessions line up. A record stamped earlier than that keeps the previous timestamp.
+    if (!haveFirstTimestamp) {
+        firstTimestamp = record.timestamp;
+        haveFirstTimestamp = true;
+    }
+    record.timestamp = record.timestamp >= firstTimestamp ? record.timestamp - firstTimestamp : lastTimestamp;
+    lastTimestamp = record.timestamp;
+
+    buffer.push_back(record);
+    ++recordCount;
+    if (buffer.size() >= BufferedRecords) {
+        FlushBuffer();
+    }
+}
+
+void InputCaptureWriter::FlushBuffer() {
+    if (!buffer.empty()) {
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size() * sizeof(InputCaptureRecord)));
+        buffer.clear();
+    }
+}
+
+bool LoadInputCapture(const std::string& path, std::vector<InputEvent>& events) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open capture file: " << path << std::endl;
+        return false;
+    }
+
+    CaptureHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != InputCaptureRecord::Magic) {
+        std::cerr << "Error: " << path << " is not an input capture." << std::endl;
+        return false;
+    }
+    if (header.version != InputCaptureRecord::Version) {
+        std::cerr << "Error: Capture " << path << " has unsupported version " << header.version << "." << std::endl;
+        return false;
+    }
+
+    std::vector<InputCaptureRecord> records(header.recordCount);
+    if (!file.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(InputCaptureRecord)))) {
+        std::cerr << "Error: Capture " << path << " is truncated." << std::endl;
+        return false;
+    }
+
+    events.clear();
+    events.reserve(records.size());
+    for (const auto& record : records) {
+        const auto type = static_cast<InputType>(record.type);
+        if (type == InputType::Unknown) {
+            InputEvent marker;
+            marker.timestamp = record.timestamp;
+            events.push_back(marker);
+        } else {
+            events.push_back({ record.timestamp, type, record.device, record.id, record.value });
+        }
+    }
+    return true;
+}
+
+bool SaveInputCapture(const std::string& path, const std::vector<InputEvent>& events) {
+    InputCaptureWriter writer;
+    if (!writer.Open(path)) {
+        return false;
+    }
+    for (const auto& event : events) {
+        if (event.type == InputType::Unknown) {
+            writer.EndFrame(event.timestamp);
+        } else {
+            writer.Append(event);
+        }
+    }
+    return writer.Close();
+}
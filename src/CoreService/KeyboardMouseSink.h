@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CoreService/Mapping/KeyNames.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One synthetic keyboard or mouse input, as VirtualKeyboardMouse queues it. The fields map
+// one to one onto a Windows INPUT, so the SendInput sink only has to copy them across.
+struct InjectedInput {
+    enum Kind : uint8_t {
+        Key,         // code is a KeyCode
+        MouseButton, // code is a MouseButtonId
+        MouseMove,   // dx/dy in mouse counts, y growing downwards
+        MouseWheel   // dy in wheel units, 120 per notch, positive away from the user
+    };
+
+    Kind kind;
+    bool pressed = false; // Key and MouseButton
+    uint16_t code = 0;
+    int32_t dx = 0;
+    int32_t dy = 0;
+
+    bool operator==(const InjectedInput& other) const {
+        return kind == other.kind && pressed == other.pressed && code == other.code && dx == other.dx && dy == other.dy;
+    }
+    bool operator!=(const InjectedInput& other) const { return !(*this == other); }
+};
+
+// Where VirtualKeyboardMouse sends its batches. The service injects them with SendInput;
+// RecordingKeyboardMouseSink keeps them in memory so the mapping pipeline can run without it.
+class KeyboardMouseSink {
+public:
+    virtual ~KeyboardMouseSink() = default;
+
+    // Injects `count` inputs as one batch, in order. Returns false if any were dropped.
+    virtual bool SubmitInputs(const InjectedInput* inputs, size_t count) = 0;
+};
+
+// Records every submitted input, in order, and how many batches they came in.
+class RecordingKeyboardMouseSink : public KeyboardMouseSink {
+public:
+    bool SubmitInputs(const InjectedInput* inputs, size_t count) override {
+        this->inputs.insert(this->inputs.end(), inputs, inputs + count);
+        ++batches;
+        return true;
+    }
+
+    const std::vector<InjectedInput>& GetInputs() const { return inputs; }
+    size_t GetBatchCount() const { return batches; }
+    void Clear() { inputs.clear(); batches = 0; }
+    void Reserve(size_t count) { inputs.reserve(count); }
+
+private:
+    std::vector<InjectedInput> inputs;
+    size_t batches = 0;
+};
@@ -0,0 +1,56 @@
+#include "CoreService/LatencyMonitor.h"
+#include <iomanip>
+#include <ostream>
+
+namespace {
+    const char* StageName(size_t stage) {
+        static const char* const Names[] = { "decode", "dispatch", "action", "flush" };
+        return Names[stage];
+    }
+
+    void DumpHistogram(std::ostream& out, const char* label, const LatencyHistogram& histogram) {
+        auto micros = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        out << "  " << std::left << std::setw(10) << label << std::right
+            << " n=" << std::setw(9) << histogram.GetCount()
+            << std::fixed << std::setprecision(1)
+            << "  p50=" << std::setw(8) << micros(histogram.GetPercentile(50.0)) << "us"
+            << "  p99=" << std::setw(8) << micros(histogram.GetPercentile(99.0)) << "us"
+            << "  p99.9=" << std::setw(8) << micros(histogram.GetPercentile(99.9)) << "us"
+            << "  max=" << std::setw(8) << micros(histogram.GetMax()) << "us" << '\n';
+    }
+}
+
+void LatencyMonitor::Record(LatencyStage stage, DeviceIndex device, uint64_t captureTimestamp, uint64_t now) {
+    if (captureTimestamp == 0 || now < captureTimestamp) {
+        return; // Event was not stamped at capture (e.g. synthetic input)
+    }
+    const uint64_t latency = now - captureTimestamp;
+    const auto stageIndex = static_cast<size_t>(stage);
+    totals[stageIndex].Record(latency);
+
+    // Device indices are small and dense, so they pick the histograms directly.
+    if (device < MaxTrackedDevices) {
+        perDevice[device][stageIndex].Record(latency);
+    }
+}
+
+void LatencyMonitor::Dump(std::ostream& out) const {
+    out << "Input latency since capture:\n";
+    for (size_t stage = 0; stage < StageCount; ++stage) {
+        DumpHistogram(out, StageName(stage), totals[stage]);
+    }
+    for (size_t device = 0; device < MaxTrackedDevices; ++device) {
+        bool seen = false;
+        for (size_t stage = 0; stage < StageCount && !seen; ++stage) {
+            seen = perDevice[device][stage].GetCount() != 0;
+        }
+        if (!seen) {
+            continue;
+        }
+        out << "Device " << device << ":\n";
+        for (size_t stage = 0; stage < StageCount; ++stage) {
+            DumpHistogram(out, StageName(stage), perDevice[device][stage]);
+        }
+    }
+    out.flush();
+}
@@ -0,0 +1,257 @@
+#include "CoreService/Log.h"
+#include "CoreService/Clock.h"
+#include "CoreService/SpscRing.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    using LogRing = SpscRing<LogRecord, 1024>;
+
+    // A thread's ring, and whether the thread has exited. Once it has, nothing more can be
+    // pushed, so the drain that sees the flag empties the ring for good and frees it.
+    struct ThreadLog {
+        LogRing ring;
+        std::atomic<bool> retired{ false };
+        bool drained = false; // Set by the draining thread only
+    };
+
+    // How often the background thread looks for new records when nobody asks it to stop.
+    constexpr auto DrainInterval = std::chrono::milliseconds(5);
+
+    struct LoggerState {
+        std::mutex registryMutex; // Guards `rings` and `retiredDropped`; taken when a thread logs for the first time
+        std::vector<std::unique_ptr<ThreadLog>> rings;
+        uint64_t retiredDropped = 0; // Overflow counts of the rings already freed
+        std::vector<std::pair<ThreadLog*, bool>> drainList; // DrainAll's snapshot of `rings` and their retired flags
+        const uint64_t startNs = MonotonicNanoseconds(); // Record times are printed relative to this
+
+        std::thread writer;
+        std::mutex wakeMutex;
+        std::condition_variable wakeSignal;
+        bool running = false;
+
+        // Covers exits that skip Logger::Stop, which would otherwise destroy a joinable thread.
+        ~LoggerState() {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                running = false;
+            }
+            wakeSignal.notify_one();
+            if (writer.joinable()) {
+                writer.join();
+            }
+        }
+    };
+
+    LoggerState& State() {
+        static LoggerState state;
+        return state;
+    }
+
+    // Retires the thread's ring when the thread exits.
+    struct RingOwner {
+        ThreadLog* log = nullptr;
+
+        ~RingOwner() {
+            if (log != nullptr) {
+                log->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    LogRing& ThreadRing() {
+        thread_local RingOwner owner;
+        if (owner.log == nullptr) {
+            LoggerState& state = State();
+            std::lock_guard<std::mutex> lock(state.registryMutex);
+            state.rings.push_back(std::make_unique<ThreadLog>());
+            owner.log = state.rings.back().get();
+        }
+        return owner.log->ring;
+    }
+
+    const char* LevelName(LogLevel level) {
+        switch (level) {
+            case LogLevel::Trace: return "TRACE";
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info: return "INFO";
+            case LogLevel::Warning: return "WARNING";
+            case LogLevel::Error: return "ERROR";
+        }
+        return "?";
+    }
+
+    void AppendArgument(std::string& out, const LogRecord& record, size_t i) {
+        const uint64_t value = record.values[i];
+        switch (record.types[i]) {
+            case LogRecord::Int: out += std::to_string(static_cast<int64_t>(value)); break;
+            case LogRecord::UInt: out += std::to_string(value); break;
+            case LogRecord::Bool: out += value ? "true" : "false"; break;
+            case LogRecord::Double: {
+                double d;
+                std::memcpy(&d, &value, sizeof(d));
+                out += std::to_string(d);
+                break;
+            }
+            case LogRecord::CString: {
+                const char* text = reinterpret_cast<const char*>(static_cast<uintptr_t>(value));
+                out += text != nullptr ? text : "(null)";
+                break;
+            }
+            case LogRecord::Pointer: {
+                char buffer[2 + 16 + 1];
+                static const char Digits[] = "0123456789abcdef";
+                buffer[0] = '0';
+                buffer[1] = 'x';
+                for (int nibble = 0; nibble < 16; ++nibble) {
+                    buffer[2 + nibble] = Digits[(value >> (60 - 4 * nibble)) & 0xF];
+                }
+                buffer[18] = '\0';
+                out += buffer;
+                break;
+            }
+        }
+    }
+
+    // Prefixes the time the record was logged, in seconds since the logger came up, and
+    // replaces each "{}" in the format with the next argument. Rings are drained one after
+    // the other, so the times are what orders lines from different threads.
+    void FormatRecord(std::string& out, const LogRecord& record, uint64_t startNs) {
+        const uint64_t elapsedUs = record.timestamp > startNs ? (record.timestamp - startNs) / 1000 : 0;
+        char time[32];
+        std::snprintf(time, sizeof(time), "[%6llu.%06llu] ", static_cast<unsigned long long>(elapsedUs / 1000000),
+                      static_cast<unsigned long long>(elapsedUs % 1000000));
+        out.clear();
+        out += time;
+        out += '[';
+        out += LevelName(record.level);
+        out += "] ";
+        size_t argument = 0;
+        for (const char* p = record.format; *p != '\0'; ++p) {
+            if (p[0] == '{' && p[1] == '}' && argument < record.argumentCount) {
+                AppendArgument(out, record, argument++);
+                ++p;
+            } else {
+                out += *p;
+            }
+        }
+    }
+
+    // Drains every registered ring, and frees those whose threads had exited before the drain
+    // began. Only the writer thread (or Stop, after joining it) calls this.
+    void DrainAll(LoggerState& state) {
+        std::vector<std::pair<ThreadLog*, bool>>& rings = state.drainList;
+        {
+            std::lock_guard<std::mutex> lock(state.registryMutex);
+            rings.clear();
+            for (auto& log : state.rings) {
+                // Read before draining: a thread that had exited by now pushed its last
+                // record before setting the flag, so this drain gets all of them.
+                rings.emplace_back(log.get(), log->retired.load(std::memory_order_acquire));
+            }
+        }
+
+        std::string line;
+        LogRecord batch[64];
+        bool wroteOut = false, wroteErr = false;
+        bool anyDrained = false;
+        for (const auto& entry : rings) {
+            LogRing* ring = &entry.first->ring;
+            entry.first->drained = entry.second;
+            anyDrained = anyDrained || entry.second;
+            for (size_t count; (count = ring->PopBatch(batch, 64)) != 0;) {
+                for (size_t i = 0; i < count; ++i) {
+                    FormatRecord(line, batch[i], state.startNs);
+                    line += '\n';
+                    if (batch[i].level >= LogLevel::Warning) {
+                        std::cerr << line;
+                        wroteErr = true;
+                    } else {
+                        std::cout << line;
+                        wroteOut = true;
+                    }
+                }
+            }
+        }
+        if (wroteOut) {
+            std::cout.flush();
+        }
+        if (wroteErr) {
+            std::cerr.flush();
+        }
+
+        if (anyDrained) {
+            std::lock_guard<std::mutex> lock(state.registryMutex);
+            for (const auto& log : state.rings) {
+                state.retiredDropped += log->drained ? log->ring.GetOverflowCount() : 0;
+            }
+            state.rings.erase(std::remove_if(state.rings.begin(), state.rings.end(),
+                                             [](const std::unique_ptr<ThreadLog>& log) { return log->drained; }),
+                              state.rings.end());
+        }
+    }
+}
+
+void Logger::Start() {
+    LoggerState& state = State();
+    std::lock_guard<std::mutex> lock(state.wakeMutex);
+    if (state.running) {
+        return;
+    }
+    state.running = true;
+    state.writer = std::thread([&state] {
+        std::unique_lock<std::mutex> lock(state.wakeMutex);
+        while (state.running) {
+            lock.unlock();
+            DrainAll(state);
+            lock.lock();
+            state.wakeSignal.wait_for(lock, DrainInterval, [&state] { return !state.running; });
+        }
+    });
+}
+
+void Logger::Stop() {
+    LoggerState& state = State();
+    {
+        std::lock_guard<std::mutex> lock(state.wakeMutex);
+        if (!state.running) {
+            return;
+        }
+        state.running = false;
+    }
+    state.wakeSignal.notify_one();
+    state.writer.join();
+    DrainAll(state);
+}
+
+uint64_t Logger::GetDroppedCount() {
+    LoggerState& state = State();
+    std::lock_guard<std::mutex> lock(state.registryMutex);
+    uint64_t dropped = state.retiredDropped;
+    for (const auto& log : state.rings) {
+        dropped += log->ring.GetOverflowCount();
+    }
+    return dropped;
+}
+
+size_t Logger::GetRingCount() {
+    LoggerState& state = State();
+    std::lock_guard<std::mutex> lock(state.registryMutex);
+    return state.rings.size();
+}
+
+void Logger::Submit(LogRecord& record) {
+    record.timestamp = MonotonicNanoseconds();
+    ThreadRing().TryPush(record);
+}
@@ -0,0 +1,31 @@
+#include "CoreService/Mapping/MacroProgram.h"
+
+MacroProgram::MacroProgram(const std::vector<MacroDefinition>& definitions) {
+    size_t stepTotal = 0;
+    for (const auto& definition : definitions) {
+        stepTotal += definition.steps.size();
+    }
+    macros.reserve(definitions.size());
+    names.reserve(definitions.size());
+    steps.reserve(stepTotal);
+
+    for (const auto& definition : definitions) {
+        Macro macro;
+        macro.firstStep = static_cast<uint32_t>(steps.size());
+        macro.stepCount = static_cast<uint32_t>(definition.steps.size());
+        macro.repeatWhileHeld = definition.repeatWhileHeld;
+        macro.cancelOnRelease = definition.cancelOnRelease;
+        macros.push_back(macro);
+        names.push_back(definition.name);
+        steps.insert(steps.end(), definition.steps.begin(), definition.steps.end());
+    }
+}
+
+uint32_t MacroProgram::Find(const std::string& name) const {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    return NoMacro;
+}
@@ -0,0 +1,171 @@
+#include "CoreService/MacroRunner.h"
+
+namespace {
+    constexpr uint32_t NoInstance = UINT32_MAX;
+
+    // heldButtons is a 32-bit mask; buttons past that are not tracked for release.
+    uint32_t ButtonBit(uint16_t button) {
+        return button < 32 ? uint32_t{ 1 } << button : 0;
+    }
+}
+
+MacroRunner::MacroRunner(uint64_t startNs, uint64_t tickNs) : timers(MaxInstances, tickNs, startNs) {
+    for (uint32_t i = 0; i < MaxInstances; ++i) {
+        instances[i].nextFree = i + 1 < MaxInstances ? i + 1 : NoInstance;
+    }
+}
+
+MacroRunner::~MacroRunner() {
+    for (auto& instance : instances) {
+        if (instance.program != nullptr) {
+            instance.program->Release();
+        }
+    }
+}
+
+bool MacroRunner::Start(const MacroProgram* program, uint32_t macroId, uint64_t trigger, uint64_t startNs, MacroOutput& output,
+                        uint8_t slot) {
+    if (program == nullptr) {
+        return false;
+    }
+    if (macroId >= program->GetMacroCount()) {
+        program->Release();
+        return false;
+    }
+
+    // Pressing the trigger again restarts its macro rather than running two copies that
+    // fight over the same buttons.
+    for (uint32_t i = 0; i < MaxInstances; ++i) {
+        if (instances[i].program != nullptr && instances[i].trigger == trigger) {
+            Finish(i, output);
+        }
+    }
+
+    if (firstFree == NoInstance) {
+        program->Release();
+        EndSteps(output);
+        return false;
+    }
+    const uint32_t index = firstFree;
+    Instance& instance = instances[index];
+    firstFree = instance.nextFree;
+    ++runningCount;
+
+    const MacroProgram::Macro& macro = program->GetMacro(macroId);
+    instance.program = program;
+    instance.steps = program->GetSteps(macro);
+    instance.stepCount = macro.stepCount;
+    instance.nextStep = 0;
+    instance.trigger = trigger;
+    instance.dueNs = startNs;
+    instance.heldButtons = 0;
+    instance.repeatWhileHeld = macro.repeatWhileHeld;
+    instance.cancelOnRelease = macro.cancelOnRelease;
+    instance.triggerHeld = true;
+    instance.slot = slot;
+
+    Run(index, output);
+    EndSteps(output);
+    return true;
+}
+
+void MacroRunner::Release(uint64_t trigger, MacroOutput& output) {
+    for (uint32_t i = 0; i < MaxInstances; ++i) {
+        Instance& instance = instances[i];
+        if (instance.program == nullptr || instance.trigger != trigger) {
+            continue;
+        }
+        instance.triggerHeld = false;
+        if (instance.cancelOnRelease) {
+            Finish(i, output);
+        }
+    }
+    EndSteps(output);
+}
+
+void MacroRunner::Advance(uint64_t nowNs, MacroOutput& output) {
+    timers.Advance(nowNs, [&](uint32_t index) {
+        jitter.Record(nowNs > instances[index].dueNs ? nowNs - instances[index].dueNs : 0);
+        Run(index, output);
+    });
+    EndSteps(output);
+}
+
+void MacroRunner::StopAll(MacroOutput& output) {
+    for (uint32_t i = 0; i < MaxInstances; ++i) {
+        if (instances[i].program != nullptr) {
+            Finish(i, output);
+        }
+    }
+    EndSteps(output);
+}
+
+void MacroRunner::Run(uint32_t index, MacroOutput& output) {
+    Instance& instance = instances[index];
+    bool wrapped = false;
+    for (;;) {
+        if (instance.nextStep == instance.stepCount) {
+            if (!instance.repeatWhileHeld || !instance.triggerHeld) {
+                Finish(index, output);
+                return;
+            }
+            instance.nextStep = 0;
+            // A macro without delays would otherwise repeat forever within this call.
+            // Give it one pass per tick instead.
+            if (wrapped) {
+                instance.dueNs += timers.GetTickNs();
+                timers.Schedule(index, instance.dueNs);
+                return;
+            }
+            wrapped = true;
+        }
+
+        const MacroStep& step = instance.steps[instance.nextStep++];
+        switch (step.kind) {
+            case MacroStep::Press:
+                instance.heldButtons |= ButtonBit(step.target);
+                Post(step, instance.slot, output);
+                break;
+            case MacroStep::Release:
+                instance.heldButtons &= ~ButtonBit(step.target);
+                Post(step, instance.slot, output);
+                break;
+            case MacroStep::Axis:
+                Post(step, instance.slot, output);
+                break;
+            case MacroStep::Delay:
+                if (step.value > 0) {
+                    instance.dueNs += static_cast<uint64_t>(step.value) * 1000;
+                    timers.Schedule(index, instance.dueNs);
+                    return;
+                }
+                break;
+        }
+    }
+}
+
+void MacroRunner::Finish(uint32_t index, MacroOutput& output) {
+    Instance& instance = instances[index];
+    for (uint32_t held = instance.heldButtons; held != 0; held &= held - 1) {
+        uint16_t button = 0;
+        while ((held & (uint32_t{ 1 } << button)) == 0) {
+            ++button;
+        }
+        Post(MacroStep{ MacroStep::Release, 0, button, 0 }, instance.slot, output);
+    }
+
+    timers.Cancel(index);
+    instance.program->Release();
+    instance.program = nullptr;
+    instance.steps = nullptr;
+    instance.nextFree = firstFree;
+    firstFree = index;
+    --runningCount;
+}
+
+void MacroRunner::EndSteps(MacroOutput& output) {
+    if (posted) {
+        posted = false;
+        output.EndSteps();
+    }
+}
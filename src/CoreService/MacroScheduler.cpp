@@ -0,0 +1,236 @@
+#include "CoreService/MacroScheduler.h"
+#include "CoreService/Clock.h"
+#include "ThreadAffinity.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+    // The thread re-checks for commands at least this often even with nothing scheduled.
+    constexpr uint64_t MaxSleepNs = 100'000'000;
+
+    constexpr size_t CommandBatch = 64;
+}
+
+MacroScheduler::MacroScheduler(MacroOutput& output, uint64_t startNs, uint64_t tickNs)
+    : output(output), runner(startNs, tickNs) {
+#ifdef _WIN32
+    wakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    waitTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (waitTimer == nullptr) {
+        // Older than Windows 10 1803: a normal timer, and more of the wait is spun.
+        waitTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+#endif
+}
+
+MacroScheduler::~MacroScheduler() {
+    Stop();
+    DiscardCommands();
+#ifdef _WIN32
+    CloseHandle(waitTimer);
+    CloseHandle(wakeEvent);
+#endif
+}
+
+bool MacroScheduler::Start(int cpuCore) {
+    if (running.exchange(true)) {
+        return true;
+    }
+    worker = std::thread(&MacroScheduler::Run, this, cpuCore);
+    return true;
+}
+
+void MacroScheduler::Stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    Wake();
+    worker.join();
+}
+
+void MacroScheduler::StartMacro(const MacroProgram& program, uint32_t macroId, uint64_t trigger, uint64_t timestampNs, uint8_t slot) {
+    program.AddRef();
+    if (!commands.TryPush({ Command::StartMacro, slot, macroId, &program, trigger, timestampNs })) {
+        program.Release();
+        return;
+    }
+    Wake();
+}
+
+void MacroScheduler::ReleaseTrigger(uint64_t trigger) {
+    if (commands.TryPush({ Command::ReleaseTrigger, 0, 0, nullptr, trigger, 0 })) {
+        Wake();
+    }
+}
+
+void MacroScheduler::SetTickInterval(uint64_t intervalNs) {
+    tickInterval.store(intervalNs);
+    Wake();
+}
+
+void MacroScheduler::SetAlarm(uint64_t deadlineNs) {
+    alarmNs.store(deadlineNs);
+    Wake();
+}
+
+void MacroScheduler::Poll(uint64_t nowNs) {
+    Command batch[CommandBatch];
+    for (size_t count; (count = commands.PopBatch(batch, CommandBatch)) != 0;) {
+        for (size_t i = 0; i < count; ++i) {
+            const Command& command = batch[i];
+            if (command.kind == Command::StartMacro) {
+                // Timing from capture keeps the macro's steps where they would have been had
+                // the command arrived instantly, as long as that is not in the future.
+                const uint64_t startNs = command.timestampNs != 0 && command.timestampNs <= nowNs ? command.timestampNs : nowNs;
+                runner.Start(command.program, command.macroId, command.trigger, startNs, output, command.slot);
+            } else {
+                runner.Release(command.trigger, output);
+            }
+        }
+    }
+    runner.Advance(nowNs, output);
+    PollTick(nowNs);
+    PollAlarm(nowNs);
+}
+
+void MacroScheduler::PollAlarm(uint64_t nowNs) {
+    uint64_t due = alarmNs.load(std::memory_order_relaxed);
+    // A new alarm set meanwhile wins; it is seen on the next pass.
+    if (due <= nowNs && alarmNs.compare_exchange_strong(due, UINT64_MAX)) {
+        output.PostAlarm(due);
+    }
+}
+
+void MacroScheduler::PollTick(uint64_t nowNs) {
+    const uint64_t interval = tickInterval.load(std::memory_order_relaxed);
+    if (interval == 0) {
+        nextTickNs = 0;
+        return;
+    }
+    if (nextTickNs == 0) {
+        nextTickNs = nowNs;
+    }
+    if (nowNs < nextTickNs) {
+        return;
+    }
+    output.PostTick(nextTickNs);
+    // After a long stall, carry on from now rather than firing every missed tick at once.
+    nextTickNs += interval;
+    if (nextTickNs <= nowNs) {
+        nextTickNs = nowNs + interval;
+    }
+}
+
+uint64_t MacroScheduler::GetNextWakeNs() const {
+    uint64_t wake = runner.GetNextWakeNs();
+    if (tickInterval.load(std::memory_order_relaxed) != 0 && nextTickNs != 0 && nextTickNs < wake) {
+        wake = nextTickNs;
+    }
+    const uint64_t alarm = alarmNs.load(std::memory_order_relaxed);
+    return alarm < wake ? alarm : wake;
+}
+
+void MacroScheduler::Run(int cpuCore) {
+    if (!PinCurrentThreadToCore(cpuCore)) {
+        std::cerr << "MacroScheduler: Could not pin the scheduler thread to core " << cpuCore << "." << std::endl;
+    }
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+
+    while (running.load(std::memory_order_relaxed)) {
+        Poll(MonotonicNanoseconds());
+        if (commands.IsEmpty()) {
+            // Only macro steps are worth spinning for; see the class comment. With nothing
+            // scheduled at all there is nothing to spin up to either.
+            const uint64_t macroWake = runner.GetNextWakeNs();
+            const uint64_t wake = GetNextWakeNs();
+            WaitUntil(wake, wake == macroWake && macroWake != UINT64_MAX);
+        }
+    }
+
+    // Leave nothing pressed behind.
+    DiscardCommands();
+    runner.StopAll(output);
+}
+
+void MacroScheduler::WaitUntil(uint64_t wakeNs, bool spin) {
+    const uint64_t now = MonotonicNanoseconds();
+    const uint64_t spinWindow = spin ? SpinWindowNs : 0;
+    if (wakeNs > now + spinWindow) {
+        uint64_t sleepNs = wakeNs - now - spinWindow;
+        sleepNs = sleepNs < MaxSleepNs ? sleepNs : MaxSleepNs;
+
+        // Same handshake as MappingWorker: either the mapping side sees `sleeping` and wakes
+        // us, or we see its command here and skip the sleep.
+        sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!commands.IsEmpty() || !running.load() || (nextTickNs == 0) != (tickInterval.load() == 0) || alarmNs.load() < wakeNs) {
+            sleeping.store(false);
+            return;
+        }
+#ifdef _WIN32
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -static_cast<LONGLONG>(sleepNs / 100); // Relative, in 100 ns units
+        SetWaitableTimer(waitTimer, &dueTime, 0, nullptr, nullptr, FALSE);
+        HANDLE handles[2] = { wakeEvent, waitTimer };
+        WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+#else
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeSignal.wait_for(lock, std::chrono::nanoseconds(sleepNs), [this] {
+            return !sleeping.load() || !running.load();
+        });
+#endif
+        sleeping.store(false);
+    }
+
+    while (spin && MonotonicNanoseconds() < wakeNs && commands.IsEmpty() && running.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+    }
+}
+
+void MacroScheduler::Wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed)) {
+        return;
+    }
+#ifdef _WIN32
+    sleeping.store(false);
+    SetEvent(wakeEvent);
+#else
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        sleeping.store(false);
+    }
+    wakeSignal.notify_one();
+#endif
+}
+
+void MacroScheduler::DiscardCommands() {
+    Command command;
+    while (commands.TryPop(command)) {
+        if (command.program != nullptr) {
+            command.program->Release();
+        }
+    }
+}
+
+void MacroScheduler::DumpStats(std::ostream& out) const {
+    const LatencyHistogram& jitter = runner.GetJitter();
+    auto micros = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    out << "Macro step timing (late by):" << std::fixed << std::setprecision(1)
+        << " n=" << jitter.GetCount()
+        << "  p50=" << micros(jitter.GetPercentile(50.0)) << "us"
+        << "  p99=" << micros(jitter.GetPercentile(99.0)) << "us"
+        << "  p99.9=" << micros(jitter.GetPercentile(99.9)) << "us"
+        << "  max=" << micros(jitter.GetMax()) << "us";
+    if (GetDroppedCount() != 0) {
+        out << "  dropped commands=" << GetDroppedCount();
+    }
+    out << std::endl;
+}
@@ -4,17 +4,44 @@
 #include <vector>
 #include <codecvt>
 #include <locale>
+#include <memory>
+#include <cstdlib>
 
 #include "CoreService/VirtualController.h"
+#include "CoreService/VirtualControllerPool.h"
+#include "CoreService/ViGEmGamepadSink.h"
+#include "CoreService/VirtualKeyboardMouse.h"
+#include "CoreService/SendInputSink.h"
 #include "CoreService/DeviceEnumerator.h"
+#include "CoreService/DeviceTable.h"
 #include "CoreService/RawInputHandler.h"
+#include "CoreService/DeviceRegistry.h"
 #include "CoreService/MappingEngine.h"
+#include "CoreService/MappingWorker.h"
+#include "CoreService/MacroScheduler.h"
+#include "CoreService/Clock.h"
 #include "CoreService/ProfileManager.h"
-#include "CoreService/Mapping/MappingRule.h" // For creating test mappings
+#include "CoreService/Log.h"
+#include "CoreService/LatencyMonitor.h"
+#include "CoreService/InputCapture.h"
+#include "CoreService/StartupOrchestrator.h"
 
 // In a more complex app, you'd have a central context object rather than globals.
 // For this example, we'll pass references down from main.
 RawInputHandler* g_pRawInputHandler = nullptr;
+DeviceEnumerator* g_pDeviceEnumerator = nullptr;
+DeviceTable* g_pDeviceTable = nullptr;
+LatencyMonitor* g_pLatencyMonitor = nullptr;
+
+// Ctrl+Break prints the latency histograms without stopping the service.
+// Other console events fall through to the default handler.
+BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType) {
+    if (ctrlType == CTRL_BREAK_EVENT && g_pLatencyMonitor) {
+        g_pLatencyMonitor->Dump(std::cout);
+        return TRUE;
+    }
+    return FALSE;
+}
 
 std::string wstring_to_string(const std::wstring& wstr) {
     using convert_type = std::codecvt_utf8<wchar_t>;
@@ -22,15 +49,16 @@ std::string wstring_to_string(const std::wstring& wstr) {
     return converter.to_bytes(wstr);
 }
 
-void PrintDeviceList() {
-    std::cout << "\nEnumerating HID devices..." << std::endl;
-    DeviceEnumerator enumerator;
-    std::vector<InputDevice> devices = enumerator.EnumerateDevices();
-    if (devices.empty()) {
-        std::cout << "No HID devices found." << std::endl;
+// A startup stage in the background: raw input device notifications keep the table current,
+// and the sweep only adds the HID devices they do not cover.
+void SweepDevices(DeviceEnumerator& enumerator, DeviceTable& table) {
+    const uint64_t start = MonotonicNanoseconds();
+    const std::vector<DeviceTable::Change> changes = table.Sync(enumerator.EnumerateDevices());
+    const uint64_t elapsedUs = (MonotonicNanoseconds() - start) / 1000;
+    if (table.GetCount() == 0) {
+        LOG_INFO("No HID devices found ({} us).", elapsedUs);
     } else {
-        std::cout << "Found " << devices.size() << " devices." << std::endl;
-        // ... (printing logic is the same)
+        LOG_INFO("Found {} HID devices, {} of them new or renamed by the sweep ({} us).", table.GetCount(), changes.size(), elapsedUs);
     }
 }
 
@@ -39,6 +67,10 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case WM_INPUT:
             if (g_pRawInputHandler) g_pRawInputHandler->ProcessRawInput(lParam);
             return 0;
+        case WM_INPUT_DEVICE_CHANGE:
+            if (g_pRawInputHandler) g_pRawInputHandler->OnDeviceChange(wParam, reinterpret_cast<HANDLE>(lParam));
+            if (g_pDeviceEnumerator) g_pDeviceEnumerator->OnDeviceChange(wParam, reinterpret_cast<HANDLE>(lParam), *g_pDeviceTable);
+            return 0;
         case WM_DESTROY:
             PostQuitMessage(0);
             return 0;
@@ -57,83 +89,165 @@ HWND CreateHiddenWindow() {
     return CreateWindowEx(0, CLASS_NAME, L"Core Service Hidden Window", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, GetModuleHandle(NULL), NULL);
 }
 
-// --- Task 2.2: Implement the Translation Loop ---
-// This function creates a hardcoded mapping for demonstration purposes.
-// In a real app, this would be loaded from a profile file.
-void SetupTestMappings(MappingEngine& engine) {
-    std::cout << "\nSetting up test mappings..." << std::endl;
+int main(int argc, char* argv[]) {
+    std::cout << "Core Service Starting..." << std::endl;
 
-    // Rule: Map physical button 0 to virtual Xbox 'A' button.
-    // This mapping needs to handle both press and release.
-    // Our simplified rule system doesn't differentiate yet, so the mapping engine's
-    // ExecuteAction will get called on both press and release. The RawInputHandler's fake parser
-    // and the MappingEngine's ExecuteAction will interpret the state.
+    // --record <file> saves everything the mapping engine sees to an input capture that
+    // CoreServiceBench can replay. --pads <n> plugs in n virtual controllers (1 to 4), one
+    // per player; game controllers join as players by pressing a button.
+    std::string recordPath;
+    size_t padCount = 1;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--record") {
+            recordPath = argv[++i];
+        } else if (std::string(argv[i]) == "--pads") {
+            padCount = std::strtoul(argv[++i], nullptr, 10);
+            padCount = padCount < 1 ? 1 : (padCount > MaxVirtualControllers ? MaxVirtualControllers : padCount);
+        }
+    }
 
-    InputCondition condition = InputCondition::OnButtonPress(0); // Physical button 0
+    Logger::Start();
 
-    // The action doesn't specify press/release, as that will be determined by the input event.
-    // So we just specify the target button. A more complex system might have separate actions
-    // for press and release. For now, the engine's `ExecuteAction` has logic to handle this.
-    std::vector<OutputAction> actions;
-    actions.push_back({ .action = VirtualButtonAction{ .button = VirtualButtonType::XBOX_A, .press = true } });
-    // Note: The `.press` value here is somewhat redundant with our current simplified `ExecuteAction`
-    // which relies on the source event. We'll keep it for clarity. A refined engine would use this.
+    // --- Core Component Initialization ---
+    // Everything is constructed up front, which is cheap. The slow parts are the startup
+    // stages below, which overlap wherever they do not depend on each other.
+    DeviceEnumerator deviceEnumerator;
+    DeviceTable deviceTable;
 
-    MappingRule rule(condition, actions);
+    // All virtual controllers share one ViGEmBus connection; each is its own target with its
+    // own report. They are connected by a startup stage.
+    ViGEmClient vigemClient;
+    std::vector<std::unique_ptr<ViGEmGamepadSink>> gamepadSinks;
+    std::vector<std::unique_ptr<VirtualController>> controllers;
+    VirtualControllerPool controllerPool;
+    for (size_t slot = 0; slot < padCount; ++slot) {
+        gamepadSinks.push_back(std::make_unique<ViGEmGamepadSink>(vigemClient));
+        controllers.push_back(std::make_unique<VirtualController>(*gamepadSinks.back()));
+        controllerPool.Add(*controllers.back());
+    }
 
-    engine.LoadMappings({ rule });
-}
+    // Keyboard and mouse targets of a profile are injected with SendInput.
+    SendInputSink sendInputSink;
+    VirtualKeyboardMouse keyboardMouse(sendInputSink);
 
-int main() {
-    std::cout << "Core Service Starting..." << std::endl;
-    PrintDeviceList();
+    // Latency is measured from capture to the virtual gamepad update for every event.
+    // The histograms are large, so the monitor lives on the heap.
+    auto latencyMonitor = std::make_unique<LatencyMonitor>();
+    g_pLatencyMonitor = latencyMonitor.get();
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 
-    // --- Core Component Initialization ---
-    VirtualController controller;
-    if (!controller.Initialize()) {
-        std::cerr << "Failed to initialize virtual controller. Exiting." << std::endl;
-        return 1;
-    }
-    std::cout << "Virtual controller initialized successfully." << std::endl;
+    // Numbers the input devices. Raw input fills it in; the engine reads the models of the
+    // devices from it for rules bound to one.
+    DeviceRegistry deviceRegistry;
 
-    MappingEngine mappingEngine(controller); // Create the mapping engine
+    MappingEngine mappingEngine(controllerPool); // Create the mapping engine
+    mappingEngine.SetDeviceRegistry(&deviceRegistry);
+    mappingEngine.SetAutoAssignSlots(padCount > 1);
+    mappingEngine.SetLatencyMonitor(latencyMonitor.get());
+    mappingEngine.SetKeyboardMouse(&keyboardMouse);
     ProfileManager profileManager(mappingEngine);
-
-    // --- Load Profiles ---
     std::string profilePath = "Profiles"; // Relative path to the profiles directory
-    profileManager.LoadProfilesFromDirectory(profilePath);
 
-    const auto& profiles = profileManager.GetProfiles();
-    if (!profiles.empty()) {
-        std::cout << "\n--- Available Profiles ---" << std::endl;
-        for (const auto& profile : profiles) {
-            std::cout << "- " << profile.GetName() << std::endl;
-        }
-        // Activate the first loaded profile for demonstration
-        profileManager.ActivateProfile(profiles.front());
-    } else {
-        std::cout << "\nNo profiles found. Using default empty mapping." << std::endl;
+    // Mapping runs on its own thread so nothing it does can stall raw input intake.
+    // Pass a core index to Start() to pin the mapping thread.
+    // Declared before the worker so it outlives the worker thread.
+    InputCaptureWriter captureWriter;
+    MappingWorker mappingWorker(mappingEngine);
+    if (!recordPath.empty() && captureWriter.Open(recordPath)) {
+        mappingWorker.SetCaptureWriter(&captureWriter);
+        std::cout << "Recording input to " << recordPath << std::endl;
     }
-    // --------------------
 
+    // Macros run on their own high-resolution thread and send their steps back through
+    // the mapping worker, which owns the virtual controller. The same thread ticks the
+    // mouse-to-stick output at the rate the active profile asks for.
+    MacroScheduler macroScheduler(mappingWorker, MonotonicNanoseconds());
+    mappingEngine.SetMacroScheduler(&macroScheduler);
 
-    HWND hwnd = CreateHiddenWindow();
-    if (hwnd == NULL) {
-        std::cerr << "Failed to create hidden window. Exiting." << std::endl;
-        return 1;
-    }
-    std::cout << "\nCreated hidden window for message processing." << std::endl;
+    RawInputHandler rawInputHandler(mappingWorker, deviceRegistry); // Pass the worker's queue to the handler
+    rawInputHandler.SetLatencyMonitor(latencyMonitor.get());
+    HWND hwnd = NULL;
+
+    // --- Startup Stages ---
+    // Input is handled as soon as the window, the controllers and the active profile are
+    // ready. The profile library scan and the HID device sweep finish in the background. The
+    // orchestrator is declared last so it waits for its stages before anything they use goes
+    // away.
+    StartupOrchestrator startup;
+    const auto window = startup.Add("hidden window", [&hwnd] {
+        // Raw input goes to the thread that owns the window, which is this one.
+        hwnd = CreateHiddenWindow();
+        return hwnd != NULL;
+    }, {}, StartupOrchestrator::Runs::OnCaller);
+    const auto pads = startup.Add("virtual controllers", [&controllers] {
+        for (size_t slot = 0; slot < controllers.size(); ++slot) {
+            if (!controllers[slot]->Initialize()) {
+                std::cerr << "Failed to initialize virtual controller " << slot + 1 << "." << std::endl;
+                return false;
+            }
+        }
+        std::cout << controllers.size() << " virtual controller(s) initialized successfully." << std::endl;
+        return true;
+    });
+    // The first profile is the active one, for demonstration. It is loaded straight from its
+    // file, so startup waits for one profile rather than for a scan of all of them.
+    const auto activeProfile = startup.Add("active profile", [&profileManager, &profilePath] {
+        for (const auto& path : ProfileManager::ListProfileFiles(profilePath)) {
+            if (const auto profile = ProfileManager::ReadProfile(path)) {
+                profileManager.ActivateProfile(*profile);
+                return true;
+            }
+        }
+        std::cout << "\nNo profiles found. Using default empty mapping." << std::endl;
+        return true;
+    });
+    // Only the names of the profiles are read, for switching between them later; their rules
+    // are built whenever they are switched to. Nothing waits for this. It may run alongside
+    // the active profile stage: that one only touches the engine, this one only the library.
+    startup.Add("profile library", [&profileManager, &profilePath] {
+        profileManager.LoadProfilesFromDirectory(profilePath);
+        const auto& profiles = profileManager.GetLibrary().GetEntries();
+        if (!profiles.empty()) {
+            std::cout << "\n--- Available Profiles ---" << std::endl;
+            for (const auto& profile : profiles) {
+                std::cout << "- " << profile.name << std::endl;
+            }
+        }
+        return true;
+    });
+    const auto rawInput = startup.Add("raw input", [&] {
+        macroScheduler.Start();
+        mappingWorker.Start();
+        g_pRawInputHandler = &rawInputHandler;
+        g_pDeviceTable = &deviceTable;
+        g_pDeviceEnumerator = &deviceEnumerator;
+        return rawInputHandler.RegisterForRawInput(hwnd);
+    }, { window, pads, activeProfile }, StartupOrchestrator::Runs::OnCaller);
+    // The HID device list is not needed to handle input. Raw input's device notifications
+    // keep it current; the sweep adds the devices they do not cover.
+    deviceTable.BeginSync();
+    startup.Add("device sweep", [&deviceEnumerator, &deviceTable] {
+        SweepDevices(deviceEnumerator, deviceTable);
+        return true;
+    });
 
-    RawInputHandler rawInputHandler(mappingEngine); // Pass engine to handler
-    g_pRawInputHandler = &rawInputHandler;
-    if (!rawInputHandler.RegisterForRawInput(hwnd)) {
-        std::cerr << "Failed to register for raw input. Exiting." << std::endl;
+    startup.Start();
+    const bool ready = startup.RunHere(window) && startup.RunHere(rawInput);
+    startup.Dump(std::cout);
+    if (!ready) {
+        std::cerr << "Startup failed. Exiting." << std::endl;
+        startup.WaitAll();
+        g_pRawInputHandler = nullptr;
+        g_pDeviceEnumerator = nullptr;
+        macroScheduler.Stop();
+        mappingWorker.Stop();
+        Logger::Stop();
         return 1;
     }
     // ---------------------------------------
 
-    std::cout << "\nCore service is running. Pressing physical button 0 should now trigger virtual Xbox 'A' button." << std::endl;
-    std::cout << "Waiting for raw input... (Press Ctrl+C in console or close window to exit)" << std::endl;
+    std::cout << "\nCore service is running." << std::endl;
+    std::cout << "Waiting for raw input... (Press Ctrl+C in console or close window to exit, Ctrl+Break for latency stats)" << std::endl;
 
     MSG msg = {};
     while (GetMessage(&msg, NULL, 0, 0)) {
@@ -143,7 +257,30 @@ int main() {
 
     // Cleanup
     g_pRawInputHandler = nullptr;
-    controller.Shutdown();
+    g_pDeviceEnumerator = nullptr;
+    startup.WaitAll();
+    startup.Dump(std::cout);
+    macroScheduler.Stop(); // Releases whatever running macros still hold, through the worker
+    mappingWorker.Stop();
+    if (mappingWorker.GetStallCount() != 0) {
+        std::cout << "Input capture waited " << mappingWorker.GetStallCount() << " time(s) for room in the mapping queue." << std::endl;
+    }
+    if (mappingWorker.GetDroppedCount() != 0) {
+        std::cerr << "Dropped " << mappingWorker.GetDroppedCount() << " input events that arrived after the mapping worker stopped." << std::endl;
+    }
+    captureWriter.Close();
+    for (auto& controller : controllers) {
+        controller->Shutdown();
+    }
+    keyboardMouse.ReleaseAll(); // The worker has stopped, so nothing else touches it now
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    g_pLatencyMonitor = nullptr;
+    latencyMonitor->Dump(std::cout);
+    macroScheduler.DumpStats(std::cout);
+    Logger::Stop();
+    if (Logger::GetDroppedCount() != 0) {
+        std::cerr << "Dropped " << Logger::GetDroppedCount() << " log records because a log buffer was full." << std::endl;
+    }
     std::cout << "Core Service Shutting Down..." << std::endl;
     return 0;
 }
@@ -1,96 +1,719 @@
 #include "CoreService/MappingEngine.h"
+#include "CoreService/DeviceRegistry.h"
 #include "CoreService/VirtualController.h" // For sending output
-#include <iostream> // For debug messages
+#include "CoreService/VirtualControllerPool.h"
+#include "CoreService/VirtualKeyboardMouse.h"
+#include "CoreService/Log.h"
+#include "CoreService/Clock.h"
+#include "CoreService/LatencyMonitor.h"
+#include "CoreService/MacroScheduler.h"
+#include <utility>
 
-MappingEngine::MappingEngine(VirtualController& controller) : virtualController(controller) {}
+MappingEngine::MappingEngine(VirtualController& controller) : MappingEngine(VirtualControllerPool(controller)) {}
 
-MappingEngine::~MappingEngine() {}
+MappingEngine::MappingEngine(const VirtualControllerPool& pool)
+    : activeMappings(new CompiledRuleSet()), inputReader(retiredMappings.RegisterReader()) {
+    for (size_t slot = 0; slot < pool.GetCount(); ++slot) {
+        controllers[slot] = pool.Get(slot);
+    }
+    controllerCount = pool.GetCount();
+}
+
+void MappingEngine::SetDeviceSlot(DeviceIndex device, uint8_t slot) {
+    if (device >= MaxDevices) {
+        LOG_WARNING("MappingEngine: Device index {} cannot be given a slot.", device);
+        return;
+    }
+    deviceSlots[device] = static_cast<uint8_t>(slot + 1);
+}
+
+uint8_t MappingEngine::RouteDevice(const InputEvent& event) {
+    if (event.device < MaxDevices && deviceSlots[event.device] != 0) {
+        return static_cast<uint8_t>(deviceSlots[event.device] - 1);
+    }
+    const bool gameController = event.type == InputType::Button || event.type == InputType::Axis;
+    if (!autoAssignSlots || !gameController) {
+        return 0;
+    }
+
+    // A game controller joins with a button press, taking the lowest slot no other has.
+    if (!event.IsButton() || !event.IsPressed() || event.device >= MaxDevices) {
+        return NoSlot;
+    }
+    uint32_t taken = 0;
+    for (const uint8_t routed : deviceSlots) {
+        taken |= routed != 0 ? 1u << (routed - 1) : 0u;
+    }
+    for (uint8_t slot = 0; slot < controllerCount; ++slot) {
+        if ((taken & (1u << slot)) == 0) {
+            deviceSlots[event.device] = static_cast<uint8_t>(slot + 1);
+            LOG_INFO("MappingEngine: A controller joined as player {}.", slot + 1);
+            return slot;
+        }
+    }
+    return NoSlot;
+}
+
+void MappingEngine::ForgetDevice(DeviceIndex device) {
+    if (device >= MaxDevices) {
+        return;
+    }
+    // The capture side has already released whatever the device held; what is left is its
+    // seat and any presses whose releases never came.
+    if (deviceSlots[device] != 0 && autoAssignSlots) {
+        LOG_INFO("MappingEngine: Player {} left.", deviceSlots[device]);
+    }
+    deviceSlots[device] = 0;
+    downInputs[device] = {};
+    for (size_t i = 0; i < heldCount;) {
+        if (heldInputs[i].device == device) {
+            heldInputs[i] = heldInputs[--heldCount];
+        } else {
+            ++i;
+        }
+    }
+}
+
+void MappingEngine::SetButtons(uint64_t buttons, bool pressed) {
+    for (uint8_t slot = 0; buttons != 0 && slot < controllerCount; ++slot, buttons >>= 16) {
+        if ((buttons & 0xFFFF) != 0) {
+            controllers[slot]->SetButtons(static_cast<uint16_t>(buttons), pressed);
+        }
+    }
+}
+
+MappingEngine::~MappingEngine() {
+    // Sets still waiting in retiredMappings are freed by its destructor.
+    delete activeMappings.load();
+}
+
+void MappingEngine::LoadMappings(std::vector<MappingRule> rules, const std::vector<MacroDefinition>& macros,
+                                 const std::vector<AxisTransform>& axisTransforms, const MouseStickSettings& mouseStickSettings) {
+    // All of the expensive work happens here, on the caller's thread. The input thread
+    // only ever sees the finished set.
+    const MacroProgram* program = macros.empty() ? nullptr : new MacroProgram(macros);
+    Publish(new CompiledRuleSet(std::move(rules), program, axisTransforms, mouseStickSettings));
+}
 
-void MappingEngine::LoadMappings(const std::vector<MappingRule>& rules) {
-    activeMappings = rules;
-    std::cout << "MappingEngine: Loaded " << activeMappings.size() << " mapping rules." << std::endl;
+void MappingEngine::LoadSharedMappings(std::shared_ptr<const std::vector<MappingRule>> rules, const std::vector<MacroDefinition>& macros,
+                                       const std::vector<AxisTransform>& axisTransforms, const MouseStickSettings& mouseStickSettings) {
+    const MacroProgram* program = macros.empty() ? nullptr : new MacroProgram(macros);
+    Publish(new CompiledRuleSet(std::move(rules), program, axisTransforms, mouseStickSettings));
+}
+
+void MappingEngine::Publish(const CompiledRuleSet* compiled) {
+    const CompiledRuleSet* previous = activeMappings.exchange(compiled, std::memory_order_seq_cst);
+    UpdateTickInterval(*compiled);
+    retiredMappings.Retire(previous);
+    retiredMappings.Reclaim();
+    LOG_INFO("MappingEngine: Loaded {} mapping rules.", compiled->GetRuleCount());
 }
 
 void MappingEngine::ProcessInput(const InputEvent& event) {
-    // std::cout << "MappingEngine: Processing input event..." << std::endl; // Can be noisy
-
-    for (const auto& rule : activeMappings) {
-        if (rule.IsTriggeredBy(event)) {
-            std::cout << "MappingEngine: Rule triggered by input." << std::endl;
-            const auto& actions = rule.GetActions();
-            for (const auto& action : actions) {
-                ExecuteAction(action, event);
+    if (event.type == InputType::DeviceRemoved) {
+        ForgetDevice(event.device);
+        return;
+    }
+
+    if (latencyMonitor != nullptr) {
+        latencyMonitor->Record(LatencyStage::Dispatch, event.device, event.timestamp, MonotonicNanoseconds());
+        if (frameTimestamp == 0) {
+            frameDevice = event.device;
+            frameTimestamp = event.timestamp;
+        }
+    }
+
+    // The first event of a frame picks the rule set for the whole frame, so a profile
+    // switch never splits one input report across two profiles.
+    if (frameMappings == nullptr) {
+        retiredMappings.Enter(inputReader);
+        frameMappings = activeMappings.load(std::memory_order_seq_cst);
+    }
+    const CompiledRuleSet& mappings = *frameMappings;
+    SyncActionState(mappings);
+
+    // A game controller may join on any button, mapped or not.
+    const bool isButton = event.IsButton();
+    if (autoAssignSlots && isButton && event.IsPressed()) {
+        RouteDevice(event);
+    }
+
+    // With layers, a button is looked up in the table for the layers it was pressed under.
+    // Which buttons are down is tracked either way, for the next rule set (see SyncActionState).
+    const CompiledRuleSet::DispatchTable* table = activeTable;
+    if (isButton) {
+        const size_t bit = DownBit(event.type, event.id);
+        if (bit < DownBits && event.device < MaxDevices) {
+            uint64_t& word = downInputs[event.device][bit / 64];
+            const uint64_t mask = uint64_t{ 1 } << (bit % 64);
+            word = event.IsPressed() ? (word | mask) : (word & ~mask);
+        }
+        if (mappings.HasLayers()) {
+            table = &mappings.GetTable(RouteButton(event));
+        }
+    }
+    const LayerMask oneShotBefore = oneShotLayers;
+    const auto& bucket = table->Find(event);
+    const DeviceModel model = devices != nullptr ? devices->GetModel(event.device) : DeviceModel{};
+
+    // Gesture time limits that ran out before this input was captured count first.
+    if (mappings.GetMachineCount() != 0) {
+        const uint64_t timeNs = event.timestamp != 0 ? event.timestamp : MonotonicNanoseconds();
+        gestures.Bind(mappings, timeNs);
+        gestures.Advance(mappings, timeNs);
+        if (bucket.listenerCount != 0 && isButton) {
+            gestures.OnButton(mappings, *table, bucket, event.device, model, event.IsPressed(), timeNs);
+        }
+        RunGestureFirings(mappings);
+    }
+
+    // The index hands back only the rules keyed on this event's type and ID,
+    // so the cost here does not depend on the size of the profile.
+    for (uint32_t i = 0; i < bucket.count; ++i) {
+        const MappingRule& rule = table->GetCandidate(bucket.first + i);
+        if (!rule.MatchesDevice(event.device, model)) {
+            continue;
+        }
+
+        LOG_DEBUG("MappingEngine: Rule triggered by input.");
+        for (const auto& action : rule.GetActions()) {
+            ExecuteAction(action, event);
+        }
+        if (latencyMonitor != nullptr) {
+            latencyMonitor->Record(LatencyStage::Action, event.device, event.timestamp, MonotonicNanoseconds());
+        }
+
+        if (matchPolicy == MatchPolicy::FirstMatch) {
+            break;
+        }
+    }
+
+    // A one-shot layer lasts for one press of another button.
+    if (oneShotBefore != 0 && isButton && event.IsPressed()) {
+        oneShotLayers &= static_cast<LayerMask>(~oneShotBefore);
+        UpdateLayers();
+    }
+}
+
+void MappingEngine::SyncActionState(const CompiledRuleSet& mappings) {
+    if (mappings.GetGeneration() == actionGeneration) {
+        return;
+    }
+    actionGeneration = mappings.GetGeneration();
+    activeTable = &mappings.GetTable(1);
+
+    // What the inputs still down would hold under the new set stays down; the rest of what
+    // the old set holds goes up, whichever of its rules put it there.
+    uint64_t keepButtons = 0;
+    uint32_t keepKeys = 0;
+    uint64_t keepAxes = 0;
+    for (DeviceIndex device = 0; device < MaxDevices; ++device) {
+        const DeviceModel model = devices != nullptr ? devices->GetModel(device) : DeviceModel{};
+        const uint8_t routed = deviceSlots[device] != 0 ? static_cast<uint8_t>(deviceSlots[device] - 1) : autoAssignSlots ? NoSlot : 0;
+        for (size_t word = 0; word < DownWords; ++word) {
+            for (uint64_t bits = downInputs[device][word]; bits != 0; bits &= bits - 1) {
+                const auto bucket = activeTable->Find(DownInput(device, word * 64 + InputEventBatch::LowestBit(bits)));
+                for (uint32_t r = 0; r < bucket.count; ++r) {
+                    const MappingRule& rule = activeTable->GetCandidate(bucket.first + r);
+                    if (!rule.MatchesDevice(device, model)) {
+                        continue;
+                    }
+                    for (const auto& action : rule.GetActions()) {
+                        const uint8_t slot = action.slot == RouteByDevice ? routed : action.slot;
+                        if (const auto* button = std::get_if<VirtualButtonAction>(&action.action)) {
+                            const ButtonTarget& target = GetButtonTarget(button->button);
+                            if (!button->press || button->mode != VirtualButtonAction::Mode::Hold) {
+                                continue;
+                            }
+                            if (target.device != OutputDevice::Gamepad) {
+                                keepKeys |= 1u << static_cast<uint32_t>(button->button);
+                            } else if (slot < controllerCount) {
+                                keepButtons |= SlotButtons(slot, target.code);
+                            }
+                        } else if (const auto* axis = std::get_if<VirtualAxisAction>(&action.action)) {
+                            if (axis->value != 0 && axis->value != -1 && slot < controllerCount &&
+                                GetAxisTarget(axis->axis).device == OutputDevice::Gamepad) {
+                                keepAxes |= uint64_t{ 1 } << (slot * VirtualAxisTypeCount + static_cast<size_t>(axis->axis));
+                            }
+                        }
+                    }
+                    if (matchPolicy == MatchPolicy::FirstMatch) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    keepButtons &= holdButtons;
+    SetButtons((holdButtons | latchedButtons | turboButtons) & ~keepButtons, false);
+    for (uint32_t keys = holdKeys & ~keepKeys; keys != 0; keys &= keys - 1) {
+        ApplyButton(nullptr, static_cast<VirtualButtonType>(InputEventBatch::LowestBit(keys)), false);
+    }
+    for (uint64_t axes = pushedAxes & ~keepAxes; axes != 0; axes &= axes - 1) {
+        const size_t bit = InputEventBatch::LowestBit(axes);
+        controllers[bit / VirtualAxisTypeCount]->SetAxis(GetAxisTarget(static_cast<VirtualAxisType>(bit % VirtualAxisTypeCount)), 0);
+    }
+    holdButtons = keepButtons;
+    holdKeys &= keepKeys;
+    pushedAxes &= keepAxes;
+
+    latchedButtons = 0;
+    turboGroups.fill(TurboGroup{});
+    turboButtons = 0;
+    layerHolds.fill(0);
+    toggledLayers = 0;
+    oneShotLayers = 0;
+    activeLayers = 1;
+    heldCount = 0;
+}
+
+InputEvent MappingEngine::DownInput(DeviceIndex device, size_t bit) {
+    if (bit >= InputSnapshot::MaxButtons + KeyCodeCount) {
+        return InputEvent::Button(device, InputType::MouseButton, static_cast<ButtonID>(bit - InputSnapshot::MaxButtons - KeyCodeCount), true, 0);
+    }
+    if (bit >= InputSnapshot::MaxButtons) {
+        return InputEvent::Button(device, InputType::Key, static_cast<ButtonID>(bit - InputSnapshot::MaxButtons), true, 0);
+    }
+    return InputEvent::Button(device, InputType::Button, static_cast<ButtonID>(bit), true, 0);
+}
+
+size_t MappingEngine::DownBit(InputType type, ButtonID id) {
+    switch (type) {
+        case InputType::Button:
+            return id < InputSnapshot::MaxButtons ? id : DownBits;
+        case InputType::Key:
+            return id < KeyCodeCount ? InputSnapshot::MaxButtons + id : DownBits;
+        case InputType::MouseButton:
+            return id < static_cast<size_t>(MouseButtonId::Count) ? InputSnapshot::MaxButtons + KeyCodeCount + id : DownBits;
+        default:
+            return DownBits;
+    }
+}
+
+void MappingEngine::UpdateLayers() {
+    LayerMask layers = 1 | toggledLayers | oneShotLayers;
+    for (size_t layer = 1; layer < layerHolds.size(); ++layer) {
+        if (layerHolds[layer] != 0) {
+            layers |= static_cast<LayerMask>(1u << layer);
+        }
+    }
+    if (layers != activeLayers) {
+        LOG_DEBUG("MappingEngine: Layer mask is now {}.", layers);
+        activeLayers = layers;
+        activeTable = &frameMappings->GetTable(activeLayers);
+    }
+}
+
+MappingEngine::LayerMask MappingEngine::RouteButton(const InputEvent& event) {
+    for (size_t i = 0; i < heldCount; ++i) {
+        HeldInput& held = heldInputs[i];
+        if (held.device == event.device && held.type == event.type && held.id == event.id) {
+            const LayerMask layers = held.layers;
+            if (!event.IsPressed()) {
+                held = heldInputs[--heldCount];
+            }
+            return layers; // A repeated press keeps its original layers too
+        }
+    }
+    if (event.IsPressed() && heldCount < MaxHeldInputs) {
+        heldInputs[heldCount++] = { event.device, event.type, event.id, activeLayers };
+    }
+    return activeLayers;
+}
+
+void MappingEngine::EndFrame() {
+    const bool sent = FlushController();
+    if (latencyMonitor != nullptr) {
+        if (sent) {
+            latencyMonitor->Record(LatencyStage::Flush, frameDevice, frameTimestamp, MonotonicNanoseconds());
+        }
+        frameDevice = NoDeviceIndex;
+        frameTimestamp = 0;
+    }
+}
+
+void MappingEngine::ProcessBatch(const InputEventBatch& batch) {
+    // The frame markers are picked out of the type column up front, in one pass; the events
+    // between them are then mapped one by one.
+    const InputEventBatch::Mask markers = batch.Match(InputType::Unknown);
+    size_t begin = 0;
+    for (size_t word = 0; word < markers.size(); ++word) {
+        for (uint64_t bits = markers[word]; bits != 0; bits &= bits - 1) {
+            const size_t end = word * 64 + InputEventBatch::LowestBit(bits);
+            for (size_t i = begin; i < end; ++i) {
+                ProcessInput(batch.Get(i));
             }
-            // Optimization: If a rule is triggered, do we stop or allow multiple rules to match?
-            // For now, let's assume only one rule (or the first matching) should apply for a single input event.
-            // This behavior might need to be configurable per profile/mapping.
-            // For simplicity, we'll break after the first match.
+            EndFrame();
+            begin = end + 1;
+        }
+    }
+    for (size_t i = begin; i < batch.GetSize(); ++i) {
+        ProcessInput(batch.Get(i));
+    }
+}
+
+void MappingEngine::ApplyMacroStep(const MacroStep& step) {
+    VirtualController* controller = step.slot < controllerCount ? controllers[step.slot] : nullptr;
+    switch (step.kind) {
+        case MacroStep::Press:
+        case MacroStep::Release:
+            ApplyButton(controller, static_cast<VirtualButtonType>(step.target), step.kind == MacroStep::Press);
+            break;
+        case MacroStep::Axis:
+            ApplyAxis(controller, GetAxisTarget(static_cast<VirtualAxisType>(step.target)), step.value);
             break;
+        case MacroStep::Delay:
+            break;
+    }
+}
+
+void MappingEngine::ApplyButton(VirtualController* controller, VirtualButtonType button, bool pressed) {
+    const ButtonTarget& target = GetButtonTarget(button);
+    if (target.device == OutputDevice::Gamepad) {
+        if (controller != nullptr) {
+            controller->SetButtons(target.code, pressed);
+        }
+    } else if (keyboardMouse != nullptr) {
+        keyboardMouse->SetButton(target, pressed);
+    }
+}
+
+void MappingEngine::ApplyAxis(VirtualController* controller, const AxisTarget& target, int value) {
+    if (target.device == OutputDevice::Gamepad) {
+        if (controller != nullptr) {
+            controller->SetAxis(target, value);
+        }
+    } else if (keyboardMouse != nullptr) {
+        keyboardMouse->Move(target, value);
+    }
+}
+
+void MappingEngine::SetMacroScheduler(MacroScheduler* scheduler) {
+    macroScheduler = scheduler;
+    if (macroScheduler != nullptr) {
+        macroScheduler->SetTickInterval(tickIntervalNs.load());
+    }
+}
+
+void MappingEngine::UpdateTickInterval(const CompiledRuleSet& mappings) {
+    // One tick serves both the mouse stick and turbo, at the stick's rate if there is one.
+    const MouseStickSettings& settings = mappings.GetMouseStick();
+    uint64_t interval = settings.enabled ? settings.GetTickIntervalNs() : 0;
+    if (interval == 0 && mappings.HasTurbo()) {
+        interval = TurboTickNs;
+    }
+    tickIntervalNs.store(interval);
+    if (macroScheduler != nullptr) {
+        macroScheduler->SetTickInterval(tickIntervalNs.load());
+    }
+}
+
+void MappingEngine::Tick(uint64_t tickNs, int32_t dx, int32_t dy) {
+    const bool inFrame = frameMappings != nullptr;
+    if (!inFrame) {
+        retiredMappings.Enter(inputReader);
+        frameMappings = activeMappings.load(std::memory_order_seq_cst);
+    }
+    SyncActionState(*frameMappings);
+
+    // Turbo works on whole groups of buttons, never on single ones.
+    if (turboButtons != 0) {
+        for (const auto& group : turboGroups) {
+            if (group.buttons != 0) {
+                SetButtons(group.buttons, IsTurboDown(group, tickNs));
+            }
+        }
+    }
+
+    const MouseStickSettings& settings = frameMappings->GetMouseStick();
+    auto stickAxes = [](const MouseStickSettings& stickSettings) {
+        return stickSettings.stick == MouseStickSettings::Stick::Left
+            ? std::make_pair(VirtualAxisType::XBOX_LEFT_STICK_X, VirtualAxisType::XBOX_LEFT_STICK_Y)
+            : std::make_pair(VirtualAxisType::XBOX_RIGHT_STICK_X, VirtualAxisType::XBOX_RIGHT_STICK_Y);
+    };
+    if (settings != mouseStick.GetSettings()) {
+        // A different profile: center the stick the old settings were driving and start over.
+        if (mouseStick.GetSettings().enabled) {
+            const auto axes = stickAxes(mouseStick.GetSettings());
+            controllers[0]->SetAxis(axes.first, 0);
+            controllers[0]->SetAxis(axes.second, 0);
+        }
+        mouseStick.Configure(settings);
+        lastMouseTickNs = 0;
+    }
+
+    // At rest with no new movement, the tick has nothing to change.
+    if (settings.enabled && (dx != 0 || dy != 0 || mouseStick.IsMoving())) {
+        const uint64_t dtNs = lastMouseTickNs != 0 && tickNs > lastMouseTickNs ? tickNs - lastMouseTickNs : settings.GetTickIntervalNs();
+        const MouseStickFilter::Output output = mouseStick.Tick(dx, dy, dtNs);
+        const auto axes = stickAxes(settings);
+        controllers[0]->SetAxis(axes.first, output.x);
+        controllers[0]->SetAxis(axes.second, output.y);
+    }
+    lastMouseTickNs = tickNs;
+
+    // Inside a frame, the frame's own EndFrame sends this along with the rest.
+    if (!inFrame) {
+        FlushController();
+    }
+}
+
+void MappingEngine::StartTurbo(uint64_t mask, uint16_t turboHz, uint64_t timeNs) {
+    StopTurbo(mask); // In case it was running at another rate
+    const uint64_t halfPeriodNs = 500'000'000 / (turboHz != 0 ? turboHz : DefaultTurboHz);
+    TurboGroup* group = nullptr;
+    TurboGroup* unused = nullptr;
+    for (auto& candidate : turboGroups) {
+        if (candidate.buttons != 0 && candidate.halfPeriodNs == halfPeriodNs) {
+            group = &candidate;
+            break;
+        }
+        if (candidate.buttons == 0 && unused == nullptr) {
+            unused = &candidate;
+        }
+    }
+    if (group == nullptr) {
+        if (unused == nullptr) {
+            LOG_WARNING("MappingEngine: More than {} turbo rates at once; holding the button instead.", MaxTurboGroups);
+            SetButtons(mask, true);
+            return;
+        }
+        group = unused;
+        *group = TurboGroup{ halfPeriodNs, timeNs, 0 };
+    }
+    group->buttons |= mask;
+    turboButtons |= mask;
+    SetButtons(mask, IsTurboDown(*group, timeNs));
+}
+
+void MappingEngine::StopTurbo(uint64_t mask) {
+    for (auto& group : turboGroups) {
+        group.buttons &= ~mask;
+    }
+    turboButtons &= ~mask;
+    SetButtons(mask, false);
+}
+
+void MappingEngine::AdvanceGestures(uint64_t nowNs) {
+    postedGestureWakeNs = UINT64_MAX; // The alarm that brought us here is spent
+    const bool inFrame = frameMappings != nullptr;
+    if (!inFrame) {
+        retiredMappings.Enter(inputReader);
+        frameMappings = activeMappings.load(std::memory_order_seq_cst);
+    }
+
+    const CompiledRuleSet& mappings = *frameMappings;
+    SyncActionState(mappings);
+    if (mappings.GetMachineCount() != 0) {
+        gestures.Bind(mappings, nowNs);
+        gestures.Advance(mappings, nowNs);
+        RunGestureFirings(mappings);
+    }
+
+    if (!inFrame) {
+        FlushController();
+    }
+}
+
+void MappingEngine::RunGestureFirings(const CompiledRuleSet& mappings) {
+    // The rule's actions see its own button going down and up, at the time the gesture
+    // decided it, so holds, axes and macros behave as they would for a plain binding.
+    for (const auto& firing : gestures.GetFirings()) {
+        const MappingRule& rule = mappings.GetRules()[mappings.GetMachine(firing.machine).rule];
+        const InputCondition& condition = rule.GetCondition();
+        const InputEvent synthesized = InputEvent::Button(firing.device, condition.type, condition.id.buttonId, firing.press, firing.timeNs);
+        LOG_DEBUG("MappingEngine: Gesture {} fired, press {}.", firing.machine, firing.press);
+        for (const auto& action : rule.GetActions()) {
+            ExecuteAction(action, synthesized);
         }
     }
+    gestures.ClearFirings();
+
+    // Have the scheduler thread wake us for the next time limit, unless it already will.
+    const uint64_t wakeNs = gestures.GetNextWakeNs();
+    if (macroScheduler != nullptr && wakeNs != postedGestureWakeNs) {
+        postedGestureWakeNs = wakeNs;
+        macroScheduler->SetAlarm(wakeNs);
+    }
+}
+
+void MappingEngine::FlushMacroSteps() {
+    if (frameMappings == nullptr) {
+        FlushController();
+    }
+}
+
+bool MappingEngine::FlushController() {
+    // The frame's rule set also decides how its axes are shaped. Outside a frame (macro
+    // steps), the active set is pinned just for the flush.
+    if (frameMappings == nullptr) {
+        retiredMappings.Enter(inputReader);
+        frameMappings = activeMappings.load(std::memory_order_seq_cst);
+    }
+    // Each controller compares against its own last report and sends only if it changed.
+    bool sent = false;
+    for (size_t slot = 0; slot < controllerCount; ++slot) {
+        sent = controllers[slot]->Flush(&frameMappings->GetAxisTransforms()) || sent;
+    }
+    if (keyboardMouse != nullptr) {
+        sent = keyboardMouse->Flush() || sent;
+    }
+    frameMappings = nullptr;
+    retiredMappings.Exit(inputReader);
+    return sent;
 }
 
 void MappingEngine::ExecuteAction(const OutputAction& action, const InputEvent& sourceEvent) {
-    std::cout << "MappingEngine: Executing action." << std::endl;
+    LOG_DEBUG("MappingEngine: Executing action.");
+
+    // Layers belong to the engine; every other action drives one controller, which an
+    // unrouted device or a slot without a controller leaves without one.
+    uint8_t slot = action.slot;
+    if (slot == RouteByDevice) {
+        // A routed device is one array read; others drive slot 0 unless auto-assignment
+        // makes them wait for a slot of their own.
+        const uint8_t routed = sourceEvent.device < MaxDevices ? deviceSlots[sourceEvent.device] : 0;
+        slot = routed != 0 ? static_cast<uint8_t>(routed - 1) : autoAssignSlots ? RouteDevice(sourceEvent) : 0;
+    }
+    VirtualController* controller = slot < controllerCount ? controllers[slot] : nullptr;
+    if (controller == nullptr && !std::holds_alternative<LayerAction>(action.action)) {
+        return;
+    }
 
     if (std::holds_alternative<VirtualButtonAction>(action.action)) {
         const auto& btnAction = std::get<VirtualButtonAction>(action.action);
-        bool shouldBePressed = false; // Default to not pressed
 
         // The action is for a button, so the source event must also be a button event.
-        if (std::holds_alternative<ButtonInput>(sourceEvent.data)) {
-            const auto& sourceButton = std::get<ButtonInput>(sourceEvent.data);
-            shouldBePressed = sourceButton.isPressed;
-        } else {
+        if (!sourceEvent.IsButton()) {
             // This case should ideally not happen if rules are set up correctly
             // (i.e., button actions only triggered by button inputs).
-            std::cerr << "Warning: VirtualButtonAction triggered by a non-button input event." << std::endl;
+            LOG_WARNING("VirtualButtonAction triggered by a non-button input event.");
             return;
         }
+        const bool shouldBePressed = sourceEvent.IsPressed();
+        LOG_DEBUG("  Action Type: VirtualButton, Button: {}, Should Press: {}", btnAction.button, shouldBePressed);
 
-        std::cout << "  Action Type: VirtualButton, Button: " << static_cast<int>(btnAction.button)
-                  << ", Should Press: " << shouldBePressed << std::endl;
+        const ButtonTarget& target = GetButtonTarget(btnAction.button);
+        if (target.device != OutputDevice::Gamepad) {
+            // Keys and mouse buttons follow the input; toggle and turbo are for gamepad buttons.
+            if (btnAction.press || shouldBePressed) {
+                const bool down = btnAction.press && shouldBePressed;
+                ApplyButton(controller, btnAction.button, down);
+                const uint32_t key = 1u << static_cast<uint32_t>(btnAction.button);
+                holdKeys = down ? (holdKeys | key) : (holdKeys & ~key);
+            }
+            return;
+        }
 
-        // Example: Map to VirtualController's Button A for demonstration
-        if (btnAction.button == VirtualButtonType::XBOX_A) {
+        const uint64_t mask = SlotButtons(slot, target.code);
+        if (!btnAction.press) {
+            // A release binding lets go of the button when its input goes down, whatever holds it.
             if (shouldBePressed) {
-                virtualController.PressButtonA();
-            } else {
-                virtualController.ReleaseButtonA();
+                latchedButtons &= ~mask;
+                StopTurbo(mask);
             }
+            return;
+        }
+        switch (btnAction.mode) {
+            case VirtualButtonAction::Mode::Hold:
+                controller->SetButtons(target.code, shouldBePressed);
+                holdButtons = shouldBePressed ? (holdButtons | mask) : (holdButtons & ~mask);
+                break;
+            case VirtualButtonAction::Mode::Toggle:
+                if (shouldBePressed) {
+                    latchedButtons ^= mask;
+                    SetButtons(mask, (latchedButtons & mask) != 0);
+                }
+                break;
+            case VirtualButtonAction::Mode::Turbo:
+                if (shouldBePressed) {
+                    StartTurbo(mask, btnAction.turboHz, sourceEvent.timestamp != 0 ? sourceEvent.timestamp : MonotonicNanoseconds());
+                } else {
+                    StopTurbo(mask);
+                }
+                break;
         }
-        // TODO: Implement a comprehensive mapping from VirtualButtonType to actual ViGEmBus calls
-        // This will likely involve a switch statement or a map.
-        // virtualController.SetButtonState(btnAction.button, shouldBePressed);
 
     } else if (std::holds_alternative<VirtualAxisAction>(action.action)) {
         const auto& axisAction = std::get<VirtualAxisAction>(action.action);
-        std::cout << "  Action Type: VirtualAxis, Axis: " << static_cast<int>(axisAction.axis)
-                  << ", Value: " << axisAction.value << std::endl;
+        LOG_DEBUG("  Action Type: VirtualAxis, Axis: {}, Value: {}", axisAction.axis, axisAction.value);
 
         // If the source event was an axis, pass its value directly.
-        // This is a common scenario for axis-to-axis mapping.
+        // This is a common scenario for axis-to-axis mapping. Deadzones, curves and the like
+        // are not applied here but to the whole report when it is flushed (see AxisTransformSet).
+        const AxisTarget& target = GetAxisTarget(axisAction.axis);
         int valueToApply = axisAction.value;
-        if (std::holds_alternative<AxisInput>(sourceEvent.data)) {
-            const auto& sourceAxisData = std::get<AxisInput>(sourceEvent.data);
-            // Potentially transform the value (e.g., scaling, inversion, deadzone)
-            // For now, a direct pass-through if action value is a sentinel (e.g. -1 means use source)
-            // This is a simplification; a more robust system is needed for axis transformation.
+        if (!sourceEvent.IsButton()) {
             if (axisAction.value == -1) { // Sentinel to indicate "use source value"
-                 valueToApply = sourceAxisData.value;
-                 std::cout << "  Using source axis value: " << valueToApply << std::endl;
+                 valueToApply = sourceEvent.value;
+                 // Source axes are normalized to -32768..32767; triggers (the one-byte fields) take 0..255.
+                 if (target.device == OutputDevice::Gamepad && target.size == sizeof(uint8_t)) {
+                     valueToApply = (valueToApply + 32768) >> 8;
+                 }
+                 LOG_DEBUG("  Using source axis value: {}", valueToApply);
+            }
+        } else {
+            // A button driving an axis (a key pushing a stick, a mouse button pulling a
+            // trigger) holds the axis at the rule's value while pressed and centers it on release.
+            valueToApply = sourceEvent.IsPressed() && axisAction.value != -1 ? axisAction.value : 0;
+            if (target.device == OutputDevice::Gamepad) {
+                const uint64_t axisBit = uint64_t{ 1 } << (slot * VirtualAxisTypeCount + static_cast<size_t>(axisAction.axis));
+                pushedAxes = valueToApply != 0 ? (pushedAxes | axisBit) : (pushedAxes & ~axisBit);
             }
         }
 
-        // TODO: Implement mapping from VirtualAxisType to actual ViGEmBus calls
-        // virtualController.SetAxisValue(axisAction.axis, valueToApply);
+        ApplyAxis(controller, target, valueToApply);
 
-    } else if (std::holds_alternative<MacroAction>(action.action)) {
-        const auto& macroAction = std::get<MacroAction>(action.action);
-        std::cout << "  Action Type: Macro, Name: " << macroAction.macroName << std::endl;
-        // TODO: Implement macro execution logic
-        // This would involve looking up the macro by name and executing its sequence of actions.
+    } else if (const auto* macroAction = std::get_if<MacroAction>(&action.action)) {
+        // The macro name is a runtime string, which the async logger cannot carry.
+        LOG_DEBUG("  Action Type: Macro, Id: {}", macroAction->macroId);
+        if (macroScheduler == nullptr || macroAction->macroId == MacroProgram::NoMacro) {
+            return;
+        }
+
+        // Press starts the macro and release tells it the button is up; the scheduler
+        // thread does the rest, so nothing here waits for the macro's delays.
+        if (!sourceEvent.IsButton()) {
+            LOG_WARNING("MacroAction triggered by a non-button input event.");
+            return;
+        }
+        const uint64_t trigger = MacroTrigger(sourceEvent.device, sourceEvent.id);
+        if (sourceEvent.IsPressed()) {
+            macroScheduler->StartMacro(*frameMappings->GetMacros(), macroAction->macroId, trigger, sourceEvent.timestamp, slot);
+        } else {
+            macroScheduler->ReleaseTrigger(trigger);
+        }
+    } else if (const auto* layerAction = std::get_if<LayerAction>(&action.action)) {
+        LOG_DEBUG("  Action Type: Layer, Layer: {}", layerAction->layer);
+        if (!sourceEvent.IsButton()) {
+            LOG_WARNING("LayerAction triggered by a non-button input event.");
+            return;
+        }
+        if (layerAction->layer == 0 || layerAction->layer >= InputCondition::MaxLayers) {
+            return; // The base layer is always on
+        }
+        const auto bit = static_cast<LayerMask>(1u << layerAction->layer);
+        switch (layerAction->mode) {
+            case LayerAction::Mode::Momentary:
+                if (sourceEvent.IsPressed()) {
+                    ++layerHolds[layerAction->layer];
+                } else if (layerHolds[layerAction->layer] != 0) {
+                    --layerHolds[layerAction->layer];
+                }
+                break;
+            case LayerAction::Mode::Toggle:
+                if (sourceEvent.IsPressed()) {
+                    toggledLayers ^= bit;
+                }
+                break;
+            case LayerAction::Mode::OneShot:
+                if (sourceEvent.IsPressed()) {
+                    oneShotLayers |= bit;
+                }
+                break;
+        }
+        UpdateLayers();
     } else {
-        std::cout << "  Action Type: Unknown or not yet implemented." << std::endl;
+        LOG_DEBUG("  Action Type: Unknown or not yet implemented.");
     }
 }
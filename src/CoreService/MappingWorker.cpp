@@ -0,0 +1,214 @@
+#include "CoreService/MappingWorker.h"
+#include "CoreService/MappingEngine.h"
+#include "CoreService/InputCapture.h"
+#include "ThreadAffinity.h"
+#include <chrono>
+#include <iostream>
+
+namespace {
+    // Frame boundaries travel through the queue as events of type Unknown, which the
+    // capture side never produces for real input.
+    const InputEvent FrameEndMarker{};
+
+    // How many times the worker polls an empty queue before it goes to sleep. Input usually
+    // arrives in bursts, so a short spin avoids most sleep/wake round trips.
+    constexpr int SpinsBeforeSleep = 200;
+}
+
+MappingWorker::MappingWorker(MappingEngine& engine) : engine(engine) {}
+
+MappingWorker::~MappingWorker() {
+    Stop();
+}
+
+bool MappingWorker::Start(int cpuCore) {
+    if (running.exchange(true)) {
+        return true;
+    }
+    worker = std::thread(&MappingWorker::Run, this, cpuCore);
+    return true;
+}
+
+void MappingWorker::Stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        sleeping.store(false);
+    }
+    wakeSignal.notify_one();
+    worker.join();
+}
+
+void MappingWorker::Push(const InputEvent& event) {
+    PushAll(queue, &event, 1);
+}
+
+void MappingWorker::EndFrame() {
+    PushAll(queue, &FrameEndMarker, 1);
+    Wake();
+}
+
+void MappingWorker::PushBatch(const InputEvent* events, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    PushAll(queue, events, count);
+    Wake();
+}
+
+template <typename Ring, typename Item>
+void MappingWorker::PushAll(Ring& ring, const Item* items, size_t count) {
+    size_t pushed = ring.PushBatch(items, count);
+    if (pushed == count) {
+        return;
+    }
+    stallCount.fetch_add(1, std::memory_order_relaxed);
+    while (pushed != count) {
+        if (!running.load(std::memory_order_acquire)) {
+            // Stopped, or not started yet: nobody is going to make room.
+            droppedCount.fetch_add(count - pushed, std::memory_order_relaxed);
+            return;
+        }
+        Wake();
+        std::this_thread::yield();
+        pushed += ring.PushBatch(items + pushed, count - pushed);
+    }
+}
+
+void MappingWorker::PushMouseDelta(int32_t dx, int32_t dy) {
+    // Only summed; nothing is sent until the next tick, so there is no need to wake anyone.
+    mouseX.fetch_add(dx, std::memory_order_relaxed);
+    mouseY.fetch_add(dy, std::memory_order_relaxed);
+}
+
+void MappingWorker::PostTick(uint64_t tickNs) {
+    // A tick the worker has not got to yet is simply replaced; its movement is still in
+    // the counters for the newer one.
+    pendingTick.store(tickNs, std::memory_order_release);
+    Wake();
+}
+
+void MappingWorker::PostAlarm(uint64_t alarmNs) {
+    pendingAlarm.store(alarmNs, std::memory_order_release);
+    Wake();
+}
+
+void MappingWorker::PostStep(const MacroStep& step) {
+    PushAll(macroSteps, &step, 1);
+}
+
+void MappingWorker::EndSteps() {
+    Wake();
+}
+
+void MappingWorker::Wake() {
+    // Pairs with the fence in WaitForInput: either the worker sees the new items when it
+    // re-checks the queues, or we see it asleep here and wake it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            sleeping.store(false);
+        }
+        wakeSignal.notify_one();
+    }
+}
+
+void MappingWorker::Run(int cpuCore) {
+    if (!PinCurrentThreadToCore(cpuCore)) {
+        std::cerr << "MappingWorker: Could not pin the mapping thread to core " << cpuCore << "." << std::endl;
+    }
+
+    InputEvent events[BatchSize];
+    while (running.load(std::memory_order_relaxed)) {
+        const bool appliedSteps = ApplyMacroSteps();
+        const bool appliedTick = ApplyTick();
+        const bool appliedAlarm = ApplyAlarm();
+        const size_t count = queue.PopBatch(events, BatchSize);
+        if (count == 0) {
+            if (!appliedSteps && !appliedTick && !appliedAlarm) {
+                WaitForInput();
+            }
+            continue;
+        }
+        Dispatch(events, count);
+    }
+
+    // Finish what the capture side already handed over so no frame is left half-applied.
+    for (size_t count; (count = queue.PopBatch(events, BatchSize)) != 0;) {
+        Dispatch(events, count);
+    }
+    ApplyMacroSteps();
+}
+
+bool MappingWorker::ApplyMacroSteps() {
+    MacroStep steps[BatchSize];
+    size_t total = 0;
+    for (size_t count; (count = macroSteps.PopBatch(steps, BatchSize)) != 0; total += count) {
+        for (size_t i = 0; i < count; ++i) {
+            engine.ApplyMacroStep(steps[i]);
+        }
+    }
+    if (total == 0) {
+        return false;
+    }
+    engine.FlushMacroSteps();
+    return true;
+}
+
+bool MappingWorker::ApplyTick() {
+    const uint64_t tickNs = pendingTick.exchange(0, std::memory_order_acquire);
+    if (tickNs == 0) {
+        return false;
+    }
+    const int32_t dx = mouseX.exchange(0, std::memory_order_relaxed);
+    const int32_t dy = mouseY.exchange(0, std::memory_order_relaxed);
+    engine.Tick(tickNs, dx, dy);
+    return true;
+}
+
+bool MappingWorker::ApplyAlarm() {
+    const uint64_t alarmNs = pendingAlarm.exchange(0, std::memory_order_acquire);
+    if (alarmNs == 0) {
+        return false;
+    }
+    // Timed at the deadline rather than now, so input captured just before it that is still
+    // queued is not overtaken by the timeout.
+    engine.AdvanceGestures(alarmNs);
+    return true;
+}
+
+void MappingWorker::Dispatch(const InputEvent* events, size_t count) {
+    batch.Clear();
+    batch.Append(events, count);
+    if (captureWriter != nullptr) {
+        captureWriter->Append(batch);
+    }
+    engine.ProcessBatch(batch);
+}
+
+void MappingWorker::WaitForInput() {
+    for (int spin = 0; spin < SpinsBeforeSleep; ++spin) {
+        if (!queue.IsEmpty() || !macroSteps.IsEmpty() || pendingTick.load(std::memory_order_relaxed) != 0 ||
+            pendingAlarm.load(std::memory_order_relaxed) != 0) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    sleeping.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue.IsEmpty() || !macroSteps.IsEmpty() || pendingTick.load() != 0 || pendingAlarm.load() != 0 || !running.load()) {
+        sleeping.store(false);
+        return;
+    }
+
+    // The timeout is only a safety net; EndFrame, EndSteps, PostTick, PostAlarm and Stop wake the worker explicitly.
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    wakeSignal.wait_for(lock, std::chrono::milliseconds(10), [this] {
+        return !sleeping.load() || !running.load();
+    });
+    sleeping.store(false);
+}
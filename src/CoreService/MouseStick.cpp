@@ -0,0 +1,153 @@
+#include "CoreService/Mapping/MouseStick.h"
+#include <cmath>
+
+namespace {
+    constexpr float Pi = 3.14159265358979f;
+
+    // Below these the stick is treated as centered, so a filter tail never keeps it
+    // twitching by one unit forever.
+    constexpr float RestDeflection = 0.5f / 32767.0f;
+    constexpr float RestVelocity = 1e-4f; // Thousands of counts per second
+
+    // Smoothing factor of a first-order low-pass with the given cutoff, for one step of `dt`.
+    float LowPassAlpha(float cutoffHz, float dt) {
+        const float tau = 1.0f / (2.0f * Pi * cutoffHz);
+        return 1.0f / (1.0f + tau / dt);
+    }
+
+    int16_t ToStick(float deflection) {
+        const float scaled = std::nearbyint(deflection * 32767.0f);
+        return static_cast<int16_t>(scaled > 32767.0f ? 32767.0f : (scaled < -32767.0f ? -32767.0f : scaled));
+    }
+}
+
+void MouseStickFilter::Configure(const MouseStickSettings& newSettings) {
+    settings = newSettings;
+    const float windowMs = settings.windowMs > 0.0f ? settings.windowMs : 0.0f;
+    windowNs = static_cast<uint64_t>(windowMs * 1e6f);
+    Reset();
+}
+
+void MouseStickFilter::Reset() {
+    binCount = 0;
+    nextBin = 0;
+    windowCountsX = 0;
+    windowCountsY = 0;
+    windowSpanNs = 0;
+    velocityX = 0.0f;
+    velocityY = 0.0f;
+    speedDerivative = 0.0f;
+    filterPrimed = false;
+    deflectionX = 0.0f;
+    deflectionY = 0.0f;
+}
+
+MouseStickFilter::Output MouseStickFilter::Tick(int32_t dx, int32_t dy, uint64_t dtNs) {
+    if (dtNs == 0) {
+        return { ToStick(deflectionX), ToStick(deflectionY) };
+    }
+    const float dt = static_cast<float>(dtNs) * 1e-9f;
+
+    // Velocity over the window. The newest tick always counts, and older ones drop out once
+    // the rest of the window covers windowNs without them.
+    Bin& bin = bins[nextBin];
+    if (binCount == MaxWindowTicks) {
+        windowCountsX -= bin.dx;
+        windowCountsY -= bin.dy;
+        windowSpanNs -= bin.dtNs;
+        --binCount;
+    }
+    bin = { dx, dy, dtNs };
+    nextBin = (nextBin + 1) % MaxWindowTicks;
+    ++binCount;
+    windowCountsX += dx;
+    windowCountsY += dy;
+    windowSpanNs += dtNs;
+    for (;;) {
+        const Bin& oldest = bins[(nextBin + MaxWindowTicks - binCount) % MaxWindowTicks];
+        if (binCount == 1 || windowSpanNs - oldest.dtNs < windowNs) {
+            break;
+        }
+        windowCountsX -= oldest.dx;
+        windowCountsY -= oldest.dy;
+        windowSpanNs -= oldest.dtNs;
+        --binCount;
+    }
+
+    const float span = static_cast<float>(windowSpanNs) * 1e-9f;
+    const float rawX = static_cast<float>(windowCountsX) / span * 1e-3f;
+    const float rawY = -static_cast<float>(windowCountsY) / span * 1e-3f;
+
+    switch (settings.smoothing) {
+        case MouseStickSettings::Smoothing::None:
+            velocityX = rawX;
+            velocityY = rawY;
+            break;
+        case MouseStickSettings::Smoothing::Ema: {
+            const float alpha = settings.smoothingMs > 0.0f ? 1.0f - std::exp(-dt * 1000.0f / settings.smoothingMs) : 1.0f;
+            velocityX += (rawX - velocityX) * alpha;
+            velocityY += (rawY - velocityY) * alpha;
+            break;
+        }
+        case MouseStickSettings::Smoothing::OneEuro: {
+            // Both axes share one cutoff, driven by the speed, so the filter never bends the
+            // direction of a movement by smoothing one axis more than the other.
+            if (!filterPrimed) {
+                velocityX = rawX;
+                velocityY = rawY;
+                speedDerivative = 0.0f;
+                filterPrimed = true;
+                break;
+            }
+            const float previousSpeed = std::sqrt(velocityX * velocityX + velocityY * velocityY);
+            const float rawSpeed = std::sqrt(rawX * rawX + rawY * rawY);
+            const float derivativeAlpha = LowPassAlpha(settings.derivativeCutoffHz, dt);
+            speedDerivative += ((rawSpeed - previousSpeed) / dt - speedDerivative) * derivativeAlpha;
+            const float cutoff = settings.minCutoffHz + settings.beta * std::fabs(speedDerivative);
+            const float alpha = LowPassAlpha(cutoff, dt);
+            velocityX += (rawX - velocityX) * alpha;
+            velocityY += (rawY - velocityY) * alpha;
+            break;
+        }
+    }
+    if (std::fabs(velocityX) < RestVelocity && std::fabs(velocityY) < RestVelocity && windowCountsX == 0 && windowCountsY == 0) {
+        velocityX = 0.0f;
+        velocityY = 0.0f;
+    }
+
+    // Response: gain grows with speed, and the direction is kept when it saturates.
+    const float speed = std::sqrt(velocityX * velocityX + velocityY * velocityY);
+    float targetX = 0.0f;
+    float targetY = 0.0f;
+    float target = 0.0f;
+    if (speed > 0.0f) {
+        target = settings.sensitivity * speed * (1.0f + settings.acceleration * speed);
+        target = target < 1.0f ? target : 1.0f;
+        targetX = velocityX / speed * target;
+        targetY = velocityY / speed * target;
+    }
+
+    // Decay: the stick may not fall back faster than the decay curve allows.
+    if (settings.decayMs > 0.0f) {
+        const float previous = std::sqrt(deflectionX * deflectionX + deflectionY * deflectionY);
+        const float floor = previous * std::exp(-dt * 1000.0f / settings.decayMs);
+        if (target < floor) {
+            if (target > RestDeflection) {
+                targetX *= floor / target;
+                targetY *= floor / target;
+            } else {
+                targetX = previous > 0.0f ? deflectionX / previous * floor : 0.0f;
+                targetY = previous > 0.0f ? deflectionY / previous * floor : 0.0f;
+            }
+            target = floor;
+        }
+    }
+    if (target < RestDeflection) {
+        targetX = 0.0f;
+        targetY = 0.0f;
+    }
+
+    deflectionX = targetX;
+    deflectionY = targetY;
+    return { ToStick(deflectionX), ToStick(deflectionY) };
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "GamepadSink.h"
+#include "CoreService/Mapping/KeyNames.h"
+#include "CoreService/Mapping/OutputAction.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Where every VirtualButtonType and VirtualAxisType lands in the output.
+//
+// Both tables are built at compile time and indexed by the enum value, so applying an action
+// is one table load followed by one OR/AND-NOT on the gamepad's button word or one store into
+// a field of its report. A static_assert below makes sure no target is left unmapped.
+// Keyboard and mouse targets are not part of the gamepad report; they name the key or mouse
+// input that VirtualKeyboardMouse injects instead.
+
+enum class OutputDevice : uint8_t {
+    None, // Not a valid target (e.g. an out-of-range value read from a profile)
+    Gamepad,
+    Keyboard,
+    Mouse
+};
+
+// The relative mouse movements an axis target can make.
+enum class MouseAxis : uint16_t {
+    X,
+    Y,
+    Wheel
+};
+
+struct ButtonTarget {
+    OutputDevice device = OutputDevice::None;
+    uint16_t code = 0; // Gamepad: its GamepadButton bit. Keyboard: KeyCode. Mouse: MouseButtonId
+};
+
+struct AxisTarget {
+    OutputDevice device = OutputDevice::None;
+    uint8_t size = 0;  // Gamepad: bytes in the report field, 2 for a stick and 1 for a trigger
+    uint16_t code = 0; // Gamepad: byte offset of the field in GamepadReport. Mouse: MouseAxis
+    int32_t min = 0;   // The range values are clamped to before they are stored
+    int32_t max = 0;
+};
+
+constexpr ButtonTarget GamepadButtonTarget(GamepadButton bit) { return { OutputDevice::Gamepad, bit }; }
+constexpr ButtonTarget KeyTarget(std::string_view name) { return { OutputDevice::Keyboard, KeyCodeFromName(name) }; }
+constexpr ButtonTarget MouseButtonTarget(MouseButtonId button) { return { OutputDevice::Mouse, static_cast<uint16_t>(button) }; }
+
+constexpr AxisTarget StickTarget(size_t offset) { return { OutputDevice::Gamepad, 2, static_cast<uint16_t>(offset), -32768, 32767 }; }
+constexpr AxisTarget TriggerTarget(size_t offset) { return { OutputDevice::Gamepad, 1, static_cast<uint16_t>(offset), 0, 255 }; }
+constexpr AxisTarget MouseAxisTarget(MouseAxis axis) { return { OutputDevice::Mouse, 0, static_cast<uint16_t>(axis), INT32_MIN, INT32_MAX }; }
+
+constexpr std::array<ButtonTarget, VirtualButtonTypeCount> MakeButtonTargets() {
+    std::array<ButtonTarget, VirtualButtonTypeCount> table{};
+    auto set = [&table](VirtualButtonType button, ButtonTarget target) { table[static_cast<size_t>(button)] = target; };
+    set(VirtualButtonType::XBOX_DPAD_UP, GamepadButtonTarget(GamepadDpadUp));
+    set(VirtualButtonType::XBOX_DPAD_DOWN, GamepadButtonTarget(GamepadDpadDown));
+    set(VirtualButtonType::XBOX_DPAD_LEFT, GamepadButtonTarget(GamepadDpadLeft));
+    set(VirtualButtonType::XBOX_DPAD_RIGHT, GamepadButtonTarget(GamepadDpadRight));
+    set(VirtualButtonType::XBOX_START, GamepadButtonTarget(GamepadStart));
+    set(VirtualButtonType::XBOX_BACK, GamepadButtonTarget(GamepadBack));
+    set(VirtualButtonType::XBOX_LEFT_THUMB, GamepadButtonTarget(GamepadLeftThumb));
+    set(VirtualButtonType::XBOX_RIGHT_THUMB, GamepadButtonTarget(GamepadRightThumb));
+    set(VirtualButtonType::XBOX_LEFT_SHOULDER, GamepadButtonTarget(GamepadLeftShoulder));
+    set(VirtualButtonType::XBOX_RIGHT_SHOULDER, GamepadButtonTarget(GamepadRightShoulder));
+    set(VirtualButtonType::XBOX_GUIDE, GamepadButtonTarget(GamepadGuide));
+    set(VirtualButtonType::XBOX_A, GamepadButtonTarget(GamepadA));
+    set(VirtualButtonType::XBOX_B, GamepadButtonTarget(GamepadB));
+    set(VirtualButtonType::XBOX_X, GamepadButtonTarget(GamepadX));
+    set(VirtualButtonType::XBOX_Y, GamepadButtonTarget(GamepadY));
+    set(VirtualButtonType::KEY_SPACE, KeyTarget("Spacebar"));
+    set(VirtualButtonType::KEY_W, KeyTarget("W"));
+    set(VirtualButtonType::KEY_A, KeyTarget("A"));
+    set(VirtualButtonType::KEY_S, KeyTarget("S"));
+    set(VirtualButtonType::KEY_D, KeyTarget("D"));
+    set(VirtualButtonType::MOUSE_LEFT_BUTTON, MouseButtonTarget(MouseButtonId::Left));
+    set(VirtualButtonType::MOUSE_RIGHT_BUTTON, MouseButtonTarget(MouseButtonId::Right));
+    return table;
+}
+
+constexpr std::array<AxisTarget, VirtualAxisTypeCount> MakeAxisTargets() {
+    std::array<AxisTarget, VirtualAxisTypeCount> table{};
+    auto set = [&table](VirtualAxisType axis, AxisTarget target) { table[static_cast<size_t>(axis)] = target; };
+    set(VirtualAxisType::XBOX_LEFT_STICK_X, StickTarget(offsetof(GamepadReport, thumbLX)));
+    set(VirtualAxisType::XBOX_LEFT_STICK_Y, StickTarget(offsetof(GamepadReport, thumbLY)));
+    set(VirtualAxisType::XBOX_RIGHT_STICK_X, StickTarget(offsetof(GamepadReport, thumbRX)));
+    set(VirtualAxisType::XBOX_RIGHT_STICK_Y, StickTarget(offsetof(GamepadReport, thumbRY)));
+    set(VirtualAxisType::XBOX_LEFT_TRIGGER, TriggerTarget(offsetof(GamepadReport, leftTrigger)));
+    set(VirtualAxisType::XBOX_RIGHT_TRIGGER, TriggerTarget(offsetof(GamepadReport, rightTrigger)));
+    set(VirtualAxisType::MOUSE_X, MouseAxisTarget(MouseAxis::X));
+    set(VirtualAxisType::MOUSE_Y, MouseAxisTarget(MouseAxis::Y));
+    set(VirtualAxisType::MOUSE_SCROLL_WHEEL, MouseAxisTarget(MouseAxis::Wheel));
+    return table;
+}
+
+inline constexpr std::array<ButtonTarget, VirtualButtonTypeCount> ButtonTargets = MakeButtonTargets();
+inline constexpr std::array<AxisTarget, VirtualAxisTypeCount> AxisTargets = MakeAxisTargets();
+
+template <typename Table>
+constexpr bool AllTargetsMapped(const Table& table) {
+    for (const auto& target : table) {
+        if (target.device == OutputDevice::None) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(AllTargetsMapped(ButtonTargets), "A VirtualButtonType has no entry in the button target table");
+static_assert(AllTargetsMapped(AxisTargets), "A VirtualAxisType has no entry in the axis target table");
+static_assert(ButtonTargets[static_cast<size_t>(VirtualButtonType::KEY_W)].code == 0x11, "Key targets must carry scan codes");
+
+// Profiles can carry any number for a target, so lookups are bounds-checked. Unknown targets
+// come back as OutputDevice::None and are ignored.
+inline const ButtonTarget& GetButtonTarget(VirtualButtonType button) {
+    static constexpr ButtonTarget none{};
+    const auto index = static_cast<size_t>(button);
+    return index < ButtonTargets.size() ? ButtonTargets[index] : none;
+}
+
+inline const AxisTarget& GetAxisTarget(VirtualAxisType axis) {
+    static constexpr AxisTarget none{};
+    const auto index = static_cast<size_t>(axis);
+    return index < AxisTargets.size() ? AxisTargets[index] : none;
+}
@@ -0,0 +1,236 @@
+#include "CoreService/ProfileLibrary.h"
+#include "CoreService/ProfileManager.h"
+#include "CoreService/BinaryProfile.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+    constexpr int IndexVersion = 2; // 2 dropped the content hash
+
+    // Stops at the top-level "profileName". Nothing is built for the values passed over on
+    // the way; strings and keys are only looked at.
+    class NameReader : public nlohmann::json_sax<json> {
+    public:
+        explicit NameReader(std::string& name) : name(name) {}
+
+        bool found = false;
+
+        bool null() override { return Value(); }
+        bool boolean(bool) override { return Value(); }
+        bool number_integer(number_integer_t) override { return Value(); }
+        bool number_unsigned(number_unsigned_t) override { return Value(); }
+        bool number_float(number_float_t, const string_t&) override { return Value(); }
+        bool binary(binary_t&) override { return Value(); }
+        bool string(string_t& value) override {
+            if (nameNext) {
+                name = std::move(value);
+                found = true;
+                return false; // Done; the rest of the file is not read
+            }
+            return true;
+        }
+        bool start_object(std::size_t) override { return Open(); }
+        bool start_array(std::size_t) override { return Open(); }
+        bool end_object() override { return Close(); }
+        bool end_array() override { return Close(); }
+        bool key(string_t& value) override {
+            nameNext = depth == 1 && value == "profileName";
+            return true;
+        }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+
+    private:
+        // A name that is not a string makes the profile unusable, as a full parse would.
+        bool Value() const { return !nameNext; }
+        bool Open() {
+            ++depth;
+            return !nameNext;
+        }
+        bool Close() {
+            --depth;
+            return true;
+        }
+
+        std::string& name;
+        int depth = 0;
+        bool nameNext = false;
+    };
+}
+
+ProfileLibrary::ProfileLibrary(size_t cacheCapacity) : cacheCapacity(std::max<size_t>(1, cacheCapacity)) {}
+
+ProfileLibrary::ScanResult ProfileLibrary::Scan(const std::string& directoryPath) {
+    ScanResult result;
+    std::vector<Entry> scanned;
+    // Both lists are sorted by path, so one pass pairs each file with its old entry.
+    size_t known = 0;
+    for (auto& path : ProfileManager::ListProfileFiles(directoryPath)) {
+        while (known < entries.size() && entries[known].path < path) {
+            ++known;
+            ++result.removed;
+        }
+        const Entry* previous = known < entries.size() && entries[known].path == path ? &entries[known++] : nullptr;
+
+        Entry entry{ {}, std::move(path), 0, 0 };
+        if (!ProfileManager::GetSourceStamp(entry.path, entry.size, entry.modifiedTime)) {
+            ++result.failed;
+            if (previous) {
+                ++result.removed;
+            }
+            continue;
+        }
+        if (previous && previous->size == entry.size && previous->modifiedTime == entry.modifiedTime) {
+            scanned.push_back(*previous);
+            continue;
+        }
+        ++result.read;
+        if (!IndexFile(entry)) {
+            ++result.failed;
+            if (previous) {
+                ++result.removed;
+            }
+            continue;
+        }
+        if (!previous) {
+            ++result.added;
+        } else {
+            ++result.updated;
+        }
+        scanned.push_back(std::move(entry));
+    }
+    result.removed += entries.size() - known;
+    entries = std::move(scanned);
+    IndexNames();
+
+    // A cached profile stays only while its file is as it was when it was built.
+    cache.erase(std::remove_if(cache.begin(), cache.end(),
+                               [this](const Cached& cached) {
+                                   const auto it = std::lower_bound(entries.begin(), entries.end(), cached.path,
+                                                                    [](const Entry& entry, const std::string& path) { return entry.path < path; });
+                                   return it == entries.end() || it->path != cached.path || it->size != cached.size ||
+                                          it->modifiedTime != cached.modifiedTime;
+                               }),
+                cache.end());
+    return result;
+}
+
+bool ProfileLibrary::LoadIndex(const std::string& indexPath) {
+    entries.clear();
+    byName.clear();
+    std::ifstream ifs(indexPath);
+    if (!ifs.is_open()) {
+        return false;
+    }
+    try {
+        json j;
+        ifs >> j;
+        if (j.value("version", 0) != IndexVersion) {
+            return false;
+        }
+        for (const auto& profile : j.at("profiles")) {
+            entries.push_back({ profile.at("name").get<std::string>(), profile.at("path").get<std::string>(), profile.at("modifiedTime").get<int64_t>(),
+                                profile.at("size").get<uint64_t>() });
+        }
+    } catch (json::exception& e) {
+        std::cerr << "Warning: Ignoring profile index " << indexPath << ": " << e.what() << std::endl;
+        entries.clear();
+        return false;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path == b.path; }), entries.end());
+    IndexNames();
+    return true;
+}
+
+bool ProfileLibrary::SaveIndex(const std::string& indexPath) const {
+    json j;
+    j["version"] = IndexVersion;
+    j["profiles"] = json::array();
+    for (const auto& entry : entries) {
+        j["profiles"].push_back(json{ { "name", entry.name },
+                                      { "path", entry.path },
+                                      { "modifiedTime", entry.modifiedTime },
+                                      { "size", entry.size } });
+    }
+
+    std::ofstream ofs(indexPath);
+    if (!ofs.is_open()) {
+        std::cerr << "Warning: Could not save profile index " << indexPath << "." << std::endl;
+        return false;
+    }
+    ofs << j.dump(2);
+    return ofs.good();
+}
+
+const ProfileLibrary::Entry* ProfileLibrary::Find(const std::string& name) const {
+    const auto it = std::lower_bound(byName.begin(), byName.end(), name,
+                                     [this](uint32_t index, const std::string& key) { return entries[index].name < key; });
+    return it != byName.end() && entries[*it].name == name ? &entries[*it] : nullptr;
+}
+
+std::shared_ptr<const Profile> ProfileLibrary::Materialize(const Entry& entry) {
+    ++useCount;
+    // Hashed before loading, so a change made while the profile loads is caught next time
+    // rather than hidden.
+    uint32_t sourceHash;
+    if (!ProfileManager::GetSourceHash(entry.path, sourceHash)) {
+        std::cerr << "Error: Could not open profile file: " << entry.path << std::endl;
+        return nullptr;
+    }
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        if (it->path == entry.path && it->size == entry.size && it->modifiedTime == entry.modifiedTime) {
+            if (it->sourceHash == sourceHash) {
+                it->lastUse = useCount;
+                return it->profile;
+            }
+            cache.erase(it);
+            break;
+        }
+    }
+
+    std::shared_ptr<Profile> profile = ProfileManager::ReadProfile(entry.path);
+    if (!profile) {
+        return nullptr;
+    }
+    if (cache.size() >= cacheCapacity) {
+        cache.erase(std::min_element(cache.begin(), cache.end(), [](const Cached& a, const Cached& b) { return a.lastUse < b.lastUse; }));
+    }
+    cache.push_back({ entry.path, entry.modifiedTime, entry.size, sourceHash, useCount, profile });
+    return profile;
+}
+
+bool ProfileLibrary::ReadName(std::istream& stream, std::string& name) {
+    NameReader reader(name);
+    json::sax_parse(stream, &reader);
+    return reader.found;
+}
+
+bool ProfileLibrary::IndexFile(Entry& entry) {
+    // A compiled image built from this very file has the name in its header.
+    if (BinaryProfile::ReadName(ProfileManager::GetCompiledPath(entry.path), entry.size, entry.modifiedTime, entry.name)) {
+        return true;
+    }
+    std::ifstream file(entry.path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open profile file: " << entry.path << std::endl;
+        return false;
+    }
+    if (!ReadName(file, entry.name)) {
+        std::cerr << "Error: Profile file " << entry.path << " has no profileName." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ProfileLibrary::IndexNames() {
+    byName.resize(entries.size());
+    for (uint32_t i = 0; i < byName.size(); ++i) {
+        byName[i] = i;
+    }
+    // Stable, so equal names stay in path order and Find returns the first.
+    std::stable_sort(byName.begin(), byName.end(), [this](uint32_t a, uint32_t b) { return entries[a].name < entries[b].name; });
+}
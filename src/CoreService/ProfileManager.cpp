@@ -1,152 +1,727 @@
 #include "CoreService/ProfileManager.h"
 #include "CoreService/Mapping/MappingRule.h" // Required for full type definition
+#include "CoreService/BinaryProfile.h"
+#include "CoreService/Mapping/KeyNames.h"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream> // For error messages
+#include <iterator>
+#include <system_error>
 
 // Use the nlohmann json alias
 using json = nlohmann::json;
+namespace fs = std::filesystem;
 
 Profile::Profile(std::string name) : profileName(std::move(name)) {}
 
+Profile::Profile(std::shared_ptr<const BinaryProfile> compiled)
+    : profileName(compiled->GetName()), macros(compiled->ToMacros()), axisTransforms(compiled->ToAxisTransforms()),
+      mouseStick(compiled->ToMouseStick()), image(std::move(compiled)), imageRules(std::make_shared<ImageRules>()) {}
+
 const std::string& Profile::GetName() const {
     return profileName;
 }
 
+void Profile::DetachImage() {
+    if (imageRules) {
+        mappings = GetMappings();
+        imageRules.reset();
+    }
+    image.reset();
+}
+
 const std::vector<MappingRule>& Profile::GetMappings() const {
-    return mappings;
+    if (!imageRules) {
+        return mappings;
+    }
+    std::call_once(imageRules->built, [this] { imageRules->rules = image->ToRules(); });
+    return imageRules->rules;
+}
+
+std::shared_ptr<const std::vector<MappingRule>> Profile::GetSharedMappings() const {
+    if (!imageRules) {
+        return nullptr;
+    }
+    GetMappings();
+    return std::shared_ptr<const std::vector<MappingRule>>(imageRules, &imageRules->rules);
 }
 
 void Profile::AddMapping(const MappingRule& rule) {
+    DetachImage();
     mappings.push_back(rule);
 }
 
+const std::vector<MacroDefinition>& Profile::GetMacros() const {
+    return macros;
+}
+
+void Profile::AddMacro(const MacroDefinition& macro) {
+    DetachImage();
+    macros.push_back(macro);
+}
+
+const std::vector<AxisTransform>& Profile::GetAxisTransforms() const {
+    return axisTransforms;
+}
+
+void Profile::AddAxisTransform(const AxisTransform& transform) {
+    DetachImage();
+    axisTransforms.push_back(transform);
+}
+
+const MouseStickSettings& Profile::GetMouseStick() const {
+    return mouseStick;
+}
+
+void Profile::SetMouseStick(const MouseStickSettings& settings) {
+    DetachImage();
+    mouseStick = settings;
+}
+
 ProfileManager::ProfileManager(MappingEngine& engine) : mappingEngine(engine) {}
 
-// Forward declare the actual (de)serialization functions for MappingRule
-// These need to be in the nlohmann namespace or accessible via ADL.
-// For simplicity, we'll define them here.
-namespace nlohmann {
-    void to_json(json& j, const InputCondition& cond) {
-        j = json{{"type", static_cast<int>(cond.type)},
-                 {"id_type", static_cast<int>(cond.idType)}};
-        if (cond.idType == InputCondition::IsButton) {
-            j["button_id"] = cond.id.buttonId;
-        } else {
-            j["axis_id"] = cond.id.axisId;
-        }
-    }
-
-    void from_json(const json& j, InputCondition& cond) {
-        cond.type = static_cast<InputType>(j.at("type").get<int>());
-        cond.idType = static_cast<InputCondition::IdType>(j.at("id_type").get<int>());
-        if (cond.idType == InputCondition::IsButton) {
-            cond.id.buttonId = j.at("button_id").get<ButtonID>();
-        } else {
-            cond.id.axisId = j.at("axis_id").get<AxisID>();
-        }
-    }
-
-    void to_json(json& j, const OutputAction& action) {
-        // This is a simplified version. A real implementation would handle
-        // the variant (VirtualButtonAction, VirtualAxisAction, etc.) properly.
-        if (std::holds_alternative<VirtualButtonAction>(action.action)) {
-            const auto& btnAction = std::get<VirtualButtonAction>(action.action);
-            j = json{{"type", "VirtualButtonAction"},
-                     {"button", static_cast<int>(btnAction.button)},
-                     {"press", btnAction.press}};
-        } else if (std::holds_alternative<VirtualAxisAction>(action.action)) {
-            const auto& axisAction = std::get<VirtualAxisAction>(action.action);
-             j = json{{"type", "VirtualAxisAction"},
-                     {"axis", static_cast<int>(axisAction.axis)},
-                     {"value", axisAction.value}};
-        }
-        // Add other action types as needed
-    }
-
-    void from_json(const json& j, OutputAction& action) {
-        std::string type = j.at("type").get<std::string>();
-        if (type == "VirtualButtonAction") {
-            VirtualButtonAction btnAction;
-            btnAction.button = static_cast<VirtualButtonType>(j.at("button").get<int>());
-            btnAction.press = j.at("press").get<bool>();
-            action.action = btnAction;
-        } else if (type == "VirtualAxisAction") {
-            VirtualAxisAction axisAction;
-            axisAction.axis = static_cast<VirtualAxisType>(j.at("axis").get<int>());
-            axisAction.value = j.at("value").get<int>();
-            action.action = axisAction;
-        }
-        // Add other action types as needed
-    }
-
-    void to_json(json& j, const MappingRule& rule) {
-        // This requires MappingRule to expose its members or have getters
-        // For now, assuming direct access or suitable getters for condition and actions
-        // This is a conceptual placeholder as MappingRule's internals are private.
-        // We would need to make MappingRule::condition and MappingRule::actions accessible.
-        // For now, this won't compile without changes to MappingRule.
-        // Let's assume MappingRule has:
-        // const InputCondition& GetCondition() const;
-        // const std::vector<OutputAction>& GetActions() const;
-        // j = json{{"condition", rule.GetCondition()}, {"actions", rule.GetActions()}};
-
-        // Placeholder if MappingRule internals are not accessible
-        // This part needs to be adjusted based on MappingRule's actual interface
-        j = json{{"error", "MappingRule to_json not fully implemented due to private members"}};
-    }
-
-    void from_json(const json& j, MappingRule& rule) {
-        // Conceptual placeholder - requires MappingRule to be modifiable or have a suitable constructor
-        // InputCondition cond = j.at("condition").get<InputCondition>();
-        // std::vector<OutputAction> actions = j.at("actions").get<std::vector<OutputAction>>();
-        // rule = MappingRule(cond, actions); // Assuming such a constructor or setters exist
-
-        // Placeholder if MappingRule internals are not accessible
-        std::cerr << "MappingRule from_json not fully implemented" << std::endl;
-    }
-} // namespace nlohmann
+namespace {
+    // The whole file in one read, as the bytes on disk.
+    bool ReadFileText(const std::string& path, std::string& text) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        text.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        return static_cast<bool>(file.read(&text[0], static_cast<std::streamsize>(text.size())));
+    }
 
-#include <filesystem>
-namespace fs = std::filesystem;
+    // Gestures by their profile names, in Gesture order.
+    constexpr const char* GestureNames[] = { "press", "release", "tap", "longPress", "doubleTap" };
+    static_assert(sizeof(GestureNames) / sizeof(GestureNames[0]) == static_cast<size_t>(Gesture::Count), "A gesture has no name");
+
+    // Layer modes by their profile names, in LayerAction::Mode order.
+    constexpr const char* LayerModeNames[] = { "momentary", "toggle", "oneShot" };
 
-// ... (rest of the file)
+    // Button modes by their profile names, in VirtualButtonAction::Mode order.
+    constexpr const char* ButtonModeNames[] = { "hold", "toggle", "turbo" };
 
-void ProfileManager::LoadProfilesFromDirectory(const std::string& directoryPath) {
-    for (const auto& entry : fs::directory_iterator(directoryPath)) {
-        if (entry.is_regular_file() && entry.path().extension() == ".json") {
-            std::cout << "Loading profile: " << entry.path().string() << std::endl;
-            LoadProfile(entry.path().string());
+    // The index of `name` in `names`; N if it is not there.
+    template <size_t N>
+    size_t FindName(const char* const (&names)[N], const std::string& name) {
+        size_t index = 0;
+        while (index < N && name != names[index]) {
+            ++index;
         }
+        return index;
+    }
+}
+
+// The gesture and layer fields are only written when they differ from a plain press on the
+// base layer, e.g. {"type": 5, "id_type": 0, "button_id": 17, "layer": 1, "gesture": "tap",
+// "timeMs": 150, "chord": [{"type": 5, "button_id": 29}]}, and the device model only for a
+// rule bound to one, e.g. "vendor_id": 1118, "product_id": 654 (an Xbox 360 pad).
+void to_json(json& j, const InputCondition& cond) {
+    j = json{{"type", static_cast<int>(cond.type)},
+             {"id_type", static_cast<int>(cond.idType)}};
+    if (cond.idType == InputCondition::IsButton) {
+        j["button_id"] = cond.id.buttonId;
+    } else {
+        j["axis_id"] = cond.id.axisId;
+    }
+    if (cond.model.IsKnown()) {
+        j["vendor_id"] = cond.model.vendorId;
+        j["product_id"] = cond.model.productId;
+    }
+    if (cond.layer != 0) {
+        j["layer"] = cond.layer;
+    }
+    if (cond.gesture != Gesture::Press) {
+        j["gesture"] = GestureNames[static_cast<size_t>(cond.gesture)];
+    }
+    if (cond.timeMs != 0) {
+        j["timeMs"] = cond.timeMs;
+    }
+    for (size_t c = 0; c < cond.GetChordCount(); ++c) {
+        j["chord"].push_back(json{{"type", static_cast<int>(cond.chord[c].type)}, {"button_id", cond.chord[c].id}});
     }
 }
 
+void from_json(const json& j, InputCondition& cond) {
+    cond.type = static_cast<InputType>(j.at("type").get<int>());
+    cond.idType = static_cast<InputCondition::IdType>(j.at("id_type").get<int>());
+    if (cond.idType == InputCondition::IsButton) {
+        cond.id.buttonId = j.at("button_id").get<ButtonID>();
+    } else {
+        cond.id.axisId = j.at("axis_id").get<AxisID>();
+    }
+
+    cond.model = { j.value("vendor_id", uint16_t{ 0 }), j.value("product_id", uint16_t{ 0 }) };
+    cond.layer = j.value("layer", uint8_t{ 0 });
+    cond.gesture = Gesture::Press;
+    if (j.contains("gesture")) {
+        const std::string gesture = j.at("gesture").get<std::string>();
+        const size_t index = FindName(GestureNames, gesture);
+        if (index == static_cast<size_t>(Gesture::Count)) {
+            throw json::other_error::create(501, "unknown gesture \"" + gesture + "\"", &j);
+        }
+        cond.gesture = static_cast<Gesture>(index);
+    }
+    cond.timeMs = j.value("timeMs", uint16_t{ 0 });
+
+    std::fill(std::begin(cond.chord), std::end(cond.chord), ChordInput{});
+    if (j.contains("chord")) {
+        const json& chord = j.at("chord");
+        if (chord.size() > InputCondition::MaxChordInputs) {
+            throw json::other_error::create(501, "a chord can hold at most 3 other buttons", &j);
+        }
+        for (size_t c = 0; c < chord.size(); ++c) {
+            cond.chord[c] = { static_cast<InputType>(chord[c].at("type").get<int>()), chord[c].at("button_id").get<ButtonID>() };
+        }
+    }
+}
+
+// A button's mode and turbo rate, and any action's controller slot, are only written when
+// they are not the defaults, e.g. {"type": "VirtualButtonAction", "button": 11, "press": true,
+// "mode": "turbo", "turboHz": 15, "slot": 1}.
+void to_json(json& j, const OutputAction& action) {
+    if (std::holds_alternative<VirtualButtonAction>(action.action)) {
+        const auto& btnAction = std::get<VirtualButtonAction>(action.action);
+        j = json{{"type", "VirtualButtonAction"},
+                 {"button", static_cast<int>(btnAction.button)},
+                 {"press", btnAction.press}};
+        if (btnAction.mode != VirtualButtonAction::Mode::Hold) {
+            j["mode"] = ButtonModeNames[static_cast<size_t>(btnAction.mode)];
+        }
+        if (btnAction.turboHz != 0) {
+            j["turboHz"] = btnAction.turboHz;
+        }
+    } else if (std::holds_alternative<VirtualAxisAction>(action.action)) {
+        const auto& axisAction = std::get<VirtualAxisAction>(action.action);
+        j = json{{"type", "VirtualAxisAction"},
+                 {"axis", static_cast<int>(axisAction.axis)},
+                 {"value", axisAction.value}};
+    } else if (std::holds_alternative<MacroAction>(action.action)) {
+        j = json{{"type", "MacroAction"},
+                 {"name", std::get<MacroAction>(action.action).macroName}};
+    } else if (const auto* layerAction = std::get_if<LayerAction>(&action.action)) {
+        j = json{{"type", "LayerAction"},
+                 {"layer", layerAction->layer},
+                 {"mode", LayerModeNames[static_cast<size_t>(layerAction->mode)]}};
+    }
+    if (action.slot != RouteByDevice) {
+        j["slot"] = action.slot;
+    }
+}
+
+void from_json(const json& j, OutputAction& action) {
+    std::string type = j.at("type").get<std::string>();
+    if (type == "VirtualButtonAction") {
+        VirtualButtonAction btnAction;
+        btnAction.button = static_cast<VirtualButtonType>(j.at("button").get<int>());
+        btnAction.press = j.value("press", true);
+        const std::string mode = j.value("mode", std::string(ButtonModeNames[0]));
+        const size_t index = FindName(ButtonModeNames, mode);
+        if (index == std::size(ButtonModeNames)) {
+            throw json::other_error::create(501, "unknown button mode \"" + mode + "\"", &j);
+        }
+        btnAction.mode = static_cast<VirtualButtonAction::Mode>(index);
+        btnAction.turboHz = j.value("turboHz", uint16_t{ 0 });
+        action.action = btnAction;
+    } else if (type == "VirtualAxisAction") {
+        VirtualAxisAction axisAction;
+        axisAction.axis = static_cast<VirtualAxisType>(j.at("axis").get<int>());
+        axisAction.value = j.value("value", -1); // -1 = use the source value
+        action.action = axisAction;
+    } else if (type == "MacroAction") {
+        action.action = MacroAction{ j.at("name").get<std::string>() };
+    } else if (type == "LayerAction") {
+        LayerAction layerAction{ j.at("layer").get<uint8_t>() };
+        const std::string mode = j.value("mode", std::string(LayerModeNames[0]));
+        const size_t index = FindName(LayerModeNames, mode);
+        if (index == std::size(LayerModeNames)) {
+            throw json::other_error::create(501, "unknown layer mode \"" + mode + "\"", &j);
+        }
+        layerAction.mode = static_cast<LayerAction::Mode>(index);
+        action.action = layerAction;
+    } else {
+        throw json::other_error::create(501, "unknown action type \"" + type + "\"", &j);
+    }
+
+    const int slot = j.value("slot", int{ RouteByDevice });
+    if (slot != RouteByDevice && (slot < 0 || slot >= MaxVirtualControllers)) {
+        throw json::other_error::create(501, "controller slot " + std::to_string(slot) + " does not exist", &j);
+    }
+    action.slot = static_cast<uint8_t>(slot);
+}
+
+void to_json(json& j, const MappingRule& rule) {
+    j = json{{"condition", rule.GetCondition()}, {"actions", rule.GetActions()}};
+}
+
+void from_json(const json& j, MappingRule& rule) {
+    rule = MappingRule(j.at("condition").get<InputCondition>(), j.at("actions").get<std::vector<OutputAction>>());
+}
+
+// Macro steps are written the way a person would, e.g. {"type": "press", "button": 11} or
+// {"type": "delay", "ms": 16}. Delays may also be given in "us".
+void to_json(json& j, const MacroStep& step) {
+    switch (step.kind) {
+        case MacroStep::Press:
+            j = json{{"type", "press"}, {"button", step.target}};
+            break;
+        case MacroStep::Release:
+            j = json{{"type", "release"}, {"button", step.target}};
+            break;
+        case MacroStep::Axis:
+            j = json{{"type", "axis"}, {"axis", step.target}, {"value", step.value}};
+            break;
+        case MacroStep::Delay:
+            if (step.value % 1000 == 0) {
+                j = json{{"type", "delay"}, {"ms", step.value / 1000}};
+            } else {
+                j = json{{"type", "delay"}, {"us", step.value}};
+            }
+            break;
+    }
+}
+
+void from_json(const json& j, MacroStep& step) {
+    step = MacroStep{};
+    const std::string type = j.at("type").get<std::string>();
+    if (type == "press" || type == "release") {
+        step.kind = type == "press" ? MacroStep::Press : MacroStep::Release;
+        step.target = j.at("button").get<uint16_t>();
+    } else if (type == "axis") {
+        step.kind = MacroStep::Axis;
+        step.target = j.at("axis").get<uint16_t>();
+        step.value = j.at("value").get<int32_t>();
+    } else if (type == "delay") {
+        step.kind = MacroStep::Delay;
+        const double micros = j.contains("us") ? j.at("us").get<double>() : j.at("ms").get<double>() * 1000.0;
+        if (micros < 0 || micros > INT32_MAX) {
+            throw json::other_error::create(501, "macro delay out of range", &j);
+        }
+        step.value = static_cast<int32_t>(micros);
+    } else {
+        throw json::other_error::create(501, "unknown macro step type \"" + type + "\"", &j);
+    }
+}
+
+void to_json(json& j, const MacroDefinition& macro) {
+    j = json{{"name", macro.name},
+             {"steps", macro.steps},
+             {"repeatWhileHeld", macro.repeatWhileHeld},
+             {"cancelOnRelease", macro.cancelOnRelease}};
+}
+
+void from_json(const json& j, MacroDefinition& macro) {
+    macro.name = j.at("name").get<std::string>();
+    macro.steps = j.at("steps").get<std::vector<MacroStep>>();
+    macro.repeatWhileHeld = j.value("repeatWhileHeld", false);
+    macro.cancelOnRelease = j.value("cancelOnRelease", false);
+}
+
+// Only the settings that differ from a pass-through are written, e.g.
+// {"axis": 0, "radialDeadzone": 0.08, "curve": "exponential", "exponent": 1.6}.
+void to_json(json& j, const AxisTransform& transform) {
+    static const AxisTransform defaults;
+    j = json{{"axis", static_cast<int>(transform.axis)}};
+    if (transform.radialDeadzone != defaults.radialDeadzone) j["radialDeadzone"] = transform.radialDeadzone;
+    if (transform.deadzone != defaults.deadzone) j["deadzone"] = transform.deadzone;
+    if (transform.antiDeadzone != defaults.antiDeadzone) j["antiDeadzone"] = transform.antiDeadzone;
+    if (transform.curve == AxisTransform::Curve::Exponential) {
+        j["curve"] = "exponential";
+        j["exponent"] = transform.exponent;
+    } else if (transform.curve == AxisTransform::Curve::Custom) {
+        j["curve"] = "custom";
+        j["points"] = transform.points;
+    }
+    if (transform.sensitivity != defaults.sensitivity) j["sensitivity"] = transform.sensitivity;
+    if (transform.invert) j["invert"] = true;
+}
+
+void from_json(const json& j, AxisTransform& transform) {
+    transform = AxisTransform{};
+    transform.axis = static_cast<VirtualAxisType>(j.at("axis").get<int>());
+    transform.radialDeadzone = j.value("radialDeadzone", 0.0f);
+    transform.deadzone = j.value("deadzone", 0.0f);
+    transform.antiDeadzone = j.value("antiDeadzone", 0.0f);
+    const std::string curve = j.value("curve", std::string("linear"));
+    if (curve == "exponential") {
+        transform.curve = AxisTransform::Curve::Exponential;
+        transform.exponent = j.at("exponent").get<float>();
+    } else if (curve == "custom") {
+        transform.curve = AxisTransform::Curve::Custom;
+        transform.points = j.at("points").get<std::vector<float>>();
+        if (transform.points.size() < 2) {
+            throw json::other_error::create(501, "a custom curve needs at least two points", &j);
+        }
+    } else if (curve != "linear") {
+        throw json::other_error::create(501, "unknown curve \"" + curve + "\"", &j);
+    }
+    transform.sensitivity = j.value("sensitivity", 1.0f);
+    transform.invert = j.value("invert", false);
+}
+
+// {"stick": "right", "sensitivity": 0.3, "smoothing": "oneEuro", ...}. Having the object
+// turns the mouse stick on unless it says "enabled": false; fields left out keep their defaults.
+void to_json(json& j, const MouseStickSettings& settings) {
+    static const char* const smoothingNames[] = { "none", "ema", "oneEuro" };
+    j = json{{"enabled", settings.enabled},
+             {"stick", settings.stick == MouseStickSettings::Stick::Left ? "left" : "right"},
+             {"rateHz", settings.rateHz},
+             {"sensitivity", settings.sensitivity},
+             {"acceleration", settings.acceleration},
+             {"windowMs", settings.windowMs},
+             {"decayMs", settings.decayMs},
+             {"smoothing", smoothingNames[static_cast<size_t>(settings.smoothing)]},
+             {"smoothingMs", settings.smoothingMs},
+             {"minCutoffHz", settings.minCutoffHz},
+             {"beta", settings.beta},
+             {"derivativeCutoffHz", settings.derivativeCutoffHz}};
+}
+
+void from_json(const json& j, MouseStickSettings& settings) {
+    settings = MouseStickSettings{};
+    settings.enabled = j.value("enabled", true);
+    const std::string stick = j.value("stick", std::string("right"));
+    if (stick == "left") {
+        settings.stick = MouseStickSettings::Stick::Left;
+    } else if (stick != "right") {
+        throw json::other_error::create(501, "unknown stick \"" + stick + "\"", &j);
+    }
+    settings.rateHz = j.value("rateHz", settings.rateHz);
+    settings.sensitivity = j.value("sensitivity", settings.sensitivity);
+    settings.acceleration = j.value("acceleration", settings.acceleration);
+    settings.windowMs = j.value("windowMs", settings.windowMs);
+    settings.decayMs = j.value("decayMs", settings.decayMs);
+    const std::string smoothing = j.value("smoothing", std::string("none"));
+    if (smoothing == "ema") {
+        settings.smoothing = MouseStickSettings::Smoothing::Ema;
+    } else if (smoothing == "oneEuro") {
+        settings.smoothing = MouseStickSettings::Smoothing::OneEuro;
+    } else if (smoothing != "none") {
+        throw json::other_error::create(501, "unknown smoothing \"" + smoothing + "\"", &j);
+    }
+    settings.smoothingMs = j.value("smoothingMs", settings.smoothingMs);
+    settings.minCutoffHz = j.value("minCutoffHz", settings.minCutoffHz);
+    settings.beta = j.value("beta", settings.beta);
+    settings.derivativeCutoffHz = j.value("derivativeCutoffHz", settings.derivativeCutoffHz);
+}
+
+ProfileLibrary::ScanResult ProfileManager::LoadProfilesFromDirectory(const std::string& directoryPath) {
+    const std::string indexPath = ProfileLibrary::GetIndexPath(directoryPath);
+    if (library.GetEntries().empty()) {
+        library.LoadIndex(indexPath);
+    }
+    const ProfileLibrary::ScanResult result = library.Scan(directoryPath);
+    std::cout << "Profile library: " << library.GetEntries().size() << " profile(s), " << result.read << " read, " << result.added << " added, "
+              << result.updated << " changed, " << result.removed << " removed." << std::endl;
+    // Saving an unchanged index again would only cost a write.
+    if (result.read != 0 || result.removed != 0 || result.failed != 0) {
+        library.SaveIndex(indexPath);
+    }
+    return result;
+}
+
+std::vector<std::string> ProfileManager::ListProfileFiles(const std::string& directoryPath) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (fs::directory_iterator it(directoryPath, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error) && it->path().extension() == ".json") {
+            paths.push_back(it->path().string());
+        }
+    }
+    if (error) {
+        std::cerr << "Error: Could not list profiles in " << directoryPath << ": " << error.message() << std::endl;
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
 bool ProfileManager::LoadProfile(const std::string& filepath) {
-    std::ifstream ifs(filepath);
-    if (!ifs.is_open()) {
+    std::shared_ptr<Profile> profile = ReadProfile(filepath);
+    if (!profile) {
+        return false;
+    }
+    profiles.push_back(std::move(*profile));
+    std::cout << "Profile loaded and added to manager: " << profiles.back().GetName() << std::endl;
+    return true;
+}
+
+std::shared_ptr<Profile> ProfileManager::ReadProfile(const std::string& filepath) {
+    // Compiled images are mapped and used as they are; only their rules are built later,
+    // when the profile is activated.
+    auto openCompiled = [](const std::string& path) -> std::shared_ptr<BinaryProfile> {
+        auto image = std::make_shared<BinaryProfile>();
+        return image->Open(path) ? image : nullptr;
+    };
+
+    if (fs::path(filepath).extension() == ".bin") {
+        auto image = openCompiled(filepath);
+        if (!image) {
+            std::cerr << "Error: Could not load compiled profile: " << filepath << std::endl;
+            return nullptr;
+        }
+        return std::make_shared<Profile>(std::move(image));
+    }
+
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!GetSourceStamp(filepath, sourceSize, sourceTime)) {
+        std::cerr << "Error: Could not open profile file: " << filepath << std::endl;
+        return nullptr;
+    }
+
+    // An edit can keep the size, and land within the write time's resolution, so the
+    // contents are hashed too before the image is trusted.
+    const std::string compiledPath = GetCompiledPath(filepath);
+    if (fs::exists(compiledPath)) {
+        auto image = openCompiled(compiledPath);
+        uint32_t sourceHash = 0;
+        if (image && GetSourceHash(filepath, sourceHash) && image->IsCompiledFrom(sourceSize, sourceTime, sourceHash)) {
+            return std::make_shared<Profile>(std::move(image));
+        }
+        std::cout << "Compiled profile " << compiledPath << " is out of date; loading the JSON." << std::endl;
+    }
+
+    std::string profileName;
+    std::vector<MappingRule> rules;
+    std::vector<MacroDefinition> macros;
+    std::vector<AxisTransform> axisTransforms;
+    MouseStickSettings mouseStick;
+    uint32_t sourceHash = 0;
+    uint32_t skippedBindings = 0;
+    if (!ParseJsonProfile(filepath, profileName, rules, macros, axisTransforms, mouseStick, sourceHash, skippedBindings)) {
+        return nullptr;
+    }
+
+    // Rebuild the image so the next start can skip the JSON. Failing to write it (e.g. a
+    // read-only profile directory) only costs startup time.
+    const auto image = CompileBinaryProfile(profileName, rules, macros, axisTransforms, mouseStick, sourceSize, sourceTime,
+                                            sourceHash, skippedBindings);
+    if (!WriteBinaryProfile(compiledPath, image)) {
+        std::cerr << "Warning: Could not save compiled profile " << compiledPath << "." << std::endl;
+    }
+
+    auto loadedProfile = std::make_shared<Profile>(profileName);
+    for (const auto& rule : rules) {
+        loadedProfile->AddMapping(rule);
+    }
+    for (const auto& macro : macros) {
+        loadedProfile->AddMacro(macro);
+    }
+    for (const auto& transform : axisTransforms) {
+        loadedProfile->AddAxisTransform(transform);
+    }
+    loadedProfile->SetMouseStick(mouseStick);
+    return loadedProfile;
+}
+
+bool ProfileManager::CompileProfile(const std::string& jsonPath, const std::string& binaryPath) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!GetSourceStamp(jsonPath, sourceSize, sourceTime)) {
+        std::cerr << "Error: Could not open profile file: " << jsonPath << std::endl;
+        return false;
+    }
+
+    std::string profileName;
+    std::vector<MappingRule> rules;
+    std::vector<MacroDefinition> macros;
+    std::vector<AxisTransform> axisTransforms;
+    MouseStickSettings mouseStick;
+    uint32_t sourceHash = 0;
+    uint32_t skippedBindings = 0;
+    if (!ParseJsonProfile(jsonPath, profileName, rules, macros, axisTransforms, mouseStick, sourceHash, skippedBindings)) {
+        return false;
+    }
+    return WriteBinaryProfile(binaryPath, CompileBinaryProfile(profileName, rules, macros, axisTransforms, mouseStick, sourceSize,
+                                                               sourceTime, sourceHash, skippedBindings));
+}
+
+namespace {
+    // Controller inputs as game-action bindings name them. Buttons follow the key; sticks
+    // are pushed fully in one direction and triggers fully pulled while the key is held.
+    struct ControllerTarget {
+        std::string_view name;
+        OutputActionData action;
+    };
+
+    const ControllerTarget ControllerTargets[] = {
+        { "A_Button", VirtualButtonAction{ VirtualButtonType::XBOX_A, true } },
+        { "B_Button", VirtualButtonAction{ VirtualButtonType::XBOX_B, true } },
+        { "X_Button", VirtualButtonAction{ VirtualButtonType::XBOX_X, true } },
+        { "Y_Button", VirtualButtonAction{ VirtualButtonType::XBOX_Y, true } },
+        { "LB", VirtualButtonAction{ VirtualButtonType::XBOX_LEFT_SHOULDER, true } },
+        { "RB", VirtualButtonAction{ VirtualButtonType::XBOX_RIGHT_SHOULDER, true } },
+        { "LeftAnalogStick_Click", VirtualButtonAction{ VirtualButtonType::XBOX_LEFT_THUMB, true } },
+        { "RightAnalogStick_Click", VirtualButtonAction{ VirtualButtonType::XBOX_RIGHT_THUMB, true } },
+        { "Dpad_Up", VirtualButtonAction{ VirtualButtonType::XBOX_DPAD_UP, true } },
+        { "Dpad_Down", VirtualButtonAction{ VirtualButtonType::XBOX_DPAD_DOWN, true } },
+        { "Dpad_Left", VirtualButtonAction{ VirtualButtonType::XBOX_DPAD_LEFT, true } },
+        { "Dpad_Right", VirtualButtonAction{ VirtualButtonType::XBOX_DPAD_RIGHT, true } },
+        { "ViewButton", VirtualButtonAction{ VirtualButtonType::XBOX_BACK, true } },
+        { "MenuButton", VirtualButtonAction{ VirtualButtonType::XBOX_START, true } },
+        { "GuideButton", VirtualButtonAction{ VirtualButtonType::XBOX_GUIDE, true } },
+        { "LT", VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_TRIGGER, 255 } },
+        { "RT", VirtualAxisAction{ VirtualAxisType::XBOX_RIGHT_TRIGGER, 255 } },
+        { "LeftAnalogStick_Forward", VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_STICK_Y, 32767 } },
+        { "LeftAnalogStick_Backward", VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_STICK_Y, -32767 } },
+        { "LeftAnalogStick_Left", VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_STICK_X, -32767 } },
+        { "LeftAnalogStick_Right", VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_STICK_X, 32767 } },
+        { "RightAnalogStick_Forward", VirtualAxisAction{ VirtualAxisType::XBOX_RIGHT_STICK_Y, 32767 } },
+        { "RightAnalogStick_Backward", VirtualAxisAction{ VirtualAxisType::XBOX_RIGHT_STICK_Y, -32767 } },
+        { "RightAnalogStick_Left", VirtualAxisAction{ VirtualAxisType::XBOX_RIGHT_STICK_X, -32767 } },
+        { "RightAnalogStick_Right", VirtualAxisAction{ VirtualAxisType::XBOX_RIGHT_STICK_X, 32767 } },
+    };
+
+    const ControllerTarget* FindControllerTarget(const std::string& name) {
+        for (const auto& target : ControllerTargets) {
+            if (target.name == name) {
+                return &target;
+            }
+        }
+        return nullptr;
+    }
+
+    // A key or mouse button name as a rule condition. False if the name is neither.
+    bool ResolveKeyboardMouseInput(const std::string& name, InputCondition& condition) {
+        condition = InputCondition{};
+        condition.idType = InputCondition::IsButton;
+        if (const KeyCode key = KeyCodeFromName(name); key != NoKey) {
+            condition.type = InputType::Key;
+            condition.id.buttonId = key;
+            return true;
+        }
+        if (const MouseButtonId button = MouseButtonFromName(name); button != MouseButtonId::Count) {
+            condition.type = InputType::MouseButton;
+            condition.id.buttonId = static_cast<ButtonID>(button);
+            return true;
+        }
+        return false;
+    }
+
+    // Turns one game action, e.g. {"keyboardMouse": {"primary": "C", "secondary": "LeftControl",
+    // "type": "key"}, "xboxController": {"primary": "B_Button", ...}}, into a rule per key.
+    // Mouse movement bound to a stick turns the mouse stick on. Returns false, with the
+    // reason, if the action cannot be bound.
+    bool CompileActionBinding(const json& binding, std::vector<MappingRule>& rules, MouseStickSettings& mouseStick,
+                              bool mouseStickDisabled, std::string& reason) {
+        if (!binding.contains("keyboardMouse") || !binding.at("keyboardMouse").is_object() ||
+            !binding.contains("xboxController") || !binding.at("xboxController").is_object()) {
+            reason = "it has no keyboard/mouse or controller side";
+            return false;
+        }
+        const json& source = binding.at("keyboardMouse");
+        const std::string type = source.value("type", std::string("key"));
+        const std::string target = binding.at("xboxController").value("primary", std::string());
+
+        std::vector<std::string> inputs;
+        for (const char* slot : { "primary", "secondary" }) {
+            if (source.contains(slot) && source.at(slot).is_string()) {
+                inputs.push_back(source.at(slot).get<std::string>());
+            }
+        }
+        if (inputs.empty()) {
+            reason = "it names no key";
+            return false;
+        }
+
+        if (type == "mouse_axis") {
+            if (inputs.front() != "Mouse_Movement" || (target != "LeftAnalogStick_Movement" && target != "RightAnalogStick_Movement")) {
+                reason = "mouse movement can only drive a whole stick";
+                return false;
+            }
+            mouseStick.stick = target == "LeftAnalogStick_Movement" ? MouseStickSettings::Stick::Left : MouseStickSettings::Stick::Right;
+            mouseStick.enabled = !mouseStickDisabled;
+            return true;
+        }
+        const ControllerTarget* output = FindControllerTarget(target);
+        if (output == nullptr) {
+            reason = "\"" + target + "\" is not a controller input";
+            return false;
+        }
+        // "key_toggle" latches a button with each press. "key_toggle_hold" (toggle on a tap,
+        // hold on a long press) is bound as a plain hold.
+        OutputActionData outputAction = output->action;
+        if (auto* button = std::get_if<VirtualButtonAction>(&outputAction); button != nullptr && type == "key_toggle") {
+            button->mode = VirtualButtonAction::Mode::Toggle;
+        }
+        // A combination is one chord: the last key fires it while the ones before it are held
+        // ("Alt_Left" + "Mouse_Wheel_Down" is a wheel step with Alt down).
+        if (type == "combination") {
+            InputCondition condition;
+            if (inputs.size() > InputCondition::MaxChordInputs + 1 || !ResolveKeyboardMouseInput(inputs.back(), condition)) {
+                reason = "\"" + inputs.back() + "\" is not a key or mouse button";
+                return false;
+            }
+            for (size_t i = 0; i + 1 < inputs.size(); ++i) {
+                InputCondition member;
+                if (!ResolveKeyboardMouseInput(inputs[i], member)) {
+                    reason = "\"" + inputs[i] + "\" is not a key or mouse button";
+                    return false;
+                }
+                condition.chord[i] = { member.type, member.id.buttonId };
+            }
+            rules.emplace_back(condition, std::vector<OutputAction>{ OutputAction{ outputAction } });
+            return true;
+        }
+
+        // The primary and secondary keys are alternatives; each gets its own rule.
+        std::vector<MappingRule> compiled;
+        for (const auto& input : inputs) {
+            InputCondition condition;
+            if (!ResolveKeyboardMouseInput(input, condition)) {
+                reason = "\"" + input + "\" is not a key or mouse button";
+                return false;
+            }
+            compiled.emplace_back(condition, std::vector<OutputAction>{ OutputAction{ outputAction } });
+        }
+        rules.insert(rules.end(), compiled.begin(), compiled.end());
+        return true;
+    }
+}
+
+bool ProfileManager::ParseJsonProfile(const std::string& filepath, std::string& name, std::vector<MappingRule>& rules,
+                                      std::vector<MacroDefinition>& macros, std::vector<AxisTransform>& axisTransforms,
+                                      MouseStickSettings& mouseStick, uint32_t& sourceHash, uint32_t& skippedBindings) {
+    // Read in one piece, so the hash the image records is of exactly the text parsed here.
+    std::string text;
+    if (!ReadFileText(filepath, text)) {
         std::cerr << "Error: Could not open profile file: " << filepath << std::endl;
         return false;
     }
+    sourceHash = HashProfileSource(text);
 
     try {
-        json j;
-        ifs >> j;
+        json j = json::parse(text);
 
-        std::string profileName = j.at("profileName").get<std::string>();
-        Profile loadedProfile(profileName);
+        name = j.at("profileName").get<std::string>();
 
+        // Rules in the engine's own terms, as written by SaveProfile.
+        if (j.contains("mappings")) {
+            rules = j.at("mappings").get<std::vector<MappingRule>>();
+        }
+        if (j.contains("macros")) {
+            macros = j.at("macros").get<std::vector<MacroDefinition>>();
+        }
+        if (j.contains("axisTransforms")) {
+            axisTransforms = j.at("axisTransforms").get<std::vector<AxisTransform>>();
+        }
+        mouseStick = j.contains("mouseStick") ? j.at("mouseStick").get<MouseStickSettings>() : MouseStickSettings{};
+
+        // Game-action bindings ("actions") name keyboard and mouse inputs and the controller
+        // input each one stands for. Whatever cannot be bound is counted, so the gap is visible.
+        skippedBindings = 0;
         if (j.contains("actions") && j.at("actions").is_array()) {
-            // This part is complex because it requires a full deserialization logic
-            // based on your JSON structure. For now, we'll just log the action names.
-            for (const auto& action_json : j.at("actions")) {
-                 std::string actionName = action_json.at("name").get<std::string>();
-                 // Here you would deserialize the full action and create a MappingRule
-                 // For now, we'll just print the name as a placeholder for loading logic.
-                 std::cout << "  - Found action: " << actionName << std::endl;
+            const bool mouseStickDisabled = j.contains("mouseStick") && !mouseStick.enabled;
+            for (const auto& binding : j.at("actions")) {
+                std::string reason;
+                if (!CompileActionBinding(binding, rules, mouseStick, mouseStickDisabled, reason)) {
+                    std::cout << "  Skipped action \"" << binding.value("name", std::string("?")) << "\" in " << name << ": " << reason << "." << std::endl;
+                    ++skippedBindings;
+                }
             }
         }
-
-        profiles.push_back(loadedProfile); // Add the loaded profile to the list
-        std::cout << "Profile loaded and added to manager: " << profileName << std::endl;
         return true;
 
     } catch (json::parse_error& e) {
@@ -157,21 +732,42 @@ bool ProfileManager::LoadProfile(const std::string& filepath) {
     return false;
 }
 
-bool ProfileManager::SaveProfile(const Profile& profile, const std::string& filepath) {
-    json j;
-    j["profile_name"] = profile.GetName();
-
-    // This will not work until MappingRule's to_json is correctly implemented
-    // j["mappings"] = profile.GetMappings(); // This requires a to_json for std::vector<MappingRule>
+bool ProfileManager::GetSourceStamp(const std::string& filepath, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    const auto fileSize = fs::file_size(filepath, error);
+    if (error) {
+        return false;
+    }
+    const auto writeTime = fs::last_write_time(filepath, error);
+    if (error) {
+        return false;
+    }
+    size = static_cast<uint64_t>(fileSize);
+    time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    return true;
+}
 
-    j["mappings"] = json::array(); // Placeholder
-    for(const auto& rule : profile.GetMappings()) {
-        // json rule_json;
-        // to_json(rule_json, rule); // This needs a working to_json for MappingRule
-        // j["mappings"].push_back(rule_json);
+bool ProfileManager::GetSourceHash(const std::string& filepath, uint32_t& hash) {
+    std::string text;
+    if (!ReadFileText(filepath, text)) {
+        return false;
     }
-     std::cerr << "Warning: Skipping mapping saving due to incomplete MappingRule serialization." << std::endl;
+    hash = HashProfileSource(text);
+    return true;
+}
 
+bool ProfileManager::SaveProfile(const Profile& profile, const std::string& filepath) {
+    json j;
+    j["mappings"] = profile.GetMappings();
+    if (!profile.GetMacros().empty()) {
+        j["macros"] = profile.GetMacros();
+    }
+    if (!profile.GetAxisTransforms().empty()) {
+        j["axisTransforms"] = profile.GetAxisTransforms();
+    }
+    if (profile.GetMouseStick().enabled) {
+        j["mouseStick"] = profile.GetMouseStick();
+    }
 
     std::ofstream ofs(filepath);
     if (!ofs.is_open()) {
@@ -180,7 +776,13 @@ bool ProfileManager::SaveProfile(const Profile& profile, const std::string& file
     }
 
     try {
-        ofs << j.dump(4); // Save with an indent of 4 for readability
+        // The name goes first, ahead of the sorted keys, so indexing the library can stop
+        // reading there (see ProfileLibrary::ReadName).
+        nlohmann::ordered_json ordered{ { "profileName", profile.GetName() } };
+        for (auto& item : j.items()) {
+            ordered[item.key()] = std::move(item.value());
+        }
+        ofs << ordered.dump(4); // Save with an indent of 4 for readability
         std::cout << "Profile saved: " << profile.GetName() << " to " << filepath << std::endl;
         return true;
     } catch (json::exception& e) {
@@ -190,6 +792,26 @@ bool ProfileManager::SaveProfile(const Profile& profile, const std::string& file
 }
 
 void ProfileManager::ActivateProfile(const Profile& profile) {
-    mappingEngine.LoadMappings(profile.GetMappings());
+    // A compiled profile builds its rules once, however often it is activated, and the
+    // engine's rule set shares them instead of taking a copy.
+    if (auto rules = profile.GetSharedMappings()) {
+        mappingEngine.LoadSharedMappings(std::move(rules), profile.GetMacros(), profile.GetAxisTransforms(), profile.GetMouseStick());
+    } else {
+        mappingEngine.LoadMappings(profile.GetMappings(), profile.GetMacros(), profile.GetAxisTransforms(), profile.GetMouseStick());
+    }
     std::cout << "Profile activated: " << profile.GetName() << std::endl;
 }
+
+bool ProfileManager::ActivateProfile(const std::string& name) {
+    const ProfileLibrary::Entry* entry = library.Find(name);
+    if (!entry) {
+        std::cerr << "Error: No profile named " << name << " in the library." << std::endl;
+        return false;
+    }
+    const std::shared_ptr<const Profile> profile = library.Materialize(*entry);
+    if (!profile) {
+        return false;
+    }
+    ActivateProfile(*profile);
+    return true;
+}
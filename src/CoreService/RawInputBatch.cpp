@@ -0,0 +1,161 @@
+#include "CoreService/RawInputBatch.h"
+
+namespace {
+    // The down/up flag pair of each mouse button in RAWMOUSE's button flags. Reports carry
+    // only these transitions, never the buttons' state.
+    struct MouseButtonFlags {
+        uint16_t down;
+        uint16_t up;
+        MouseButtonId button;
+    };
+
+    constexpr MouseButtonFlags MouseButtonTable[] = {
+        { 0x0001, 0x0002, MouseButtonId::Left },   // RI_MOUSE_LEFT_BUTTON_DOWN/UP
+        { 0x0004, 0x0008, MouseButtonId::Right },  // RI_MOUSE_RIGHT_BUTTON_DOWN/UP
+        { 0x0010, 0x0020, MouseButtonId::Middle }, // RI_MOUSE_MIDDLE_BUTTON_DOWN/UP
+        { 0x0040, 0x0080, MouseButtonId::X1 },     // RI_MOUSE_BUTTON_4_DOWN/UP
+        { 0x0100, 0x0200, MouseButtonId::X2 },     // RI_MOUSE_BUTTON_5_DOWN/UP
+    };
+
+    const InputEvent FrameEndMarker{};
+}
+
+void RawInputArena::Reserve(size_t bytes) {
+    if (bytes <= GetCapacity()) {
+        return;
+    }
+    blockCount = (bytes + Alignment - 1) / Alignment;
+    blocks.reset(new Block[blockCount]);
+}
+
+const RawInputRecordHeader* RawInputWalker::Next() {
+    if (remaining == 0 || static_cast<size_t>(end - cursor) < sizeof(RawInputRecordHeader)) {
+        remaining = 0;
+        return nullptr;
+    }
+    const auto* record = reinterpret_cast<const RawInputRecordHeader*>(cursor);
+    if (record->size < sizeof(RawInputRecordHeader) || record->size > static_cast<size_t>(end - cursor)) {
+        remaining = 0;
+        return nullptr;
+    }
+    --remaining;
+
+    // NEXTRAWINPUTBLOCK: round the record's end up to pointer alignment.
+    const uintptr_t next = (reinterpret_cast<uintptr_t>(cursor) + record->size + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+    const uintptr_t limit = reinterpret_cast<uintptr_t>(end);
+    cursor = next < limit ? reinterpret_cast<const unsigned char*>(next) : end;
+    return record;
+}
+
+bool RawInputDecoder::Decode(const RawInputRecordHeader& record, DeviceIndex device, uint64_t captureTime, std::vector<InputEvent>& events) {
+    if (record.type == RawInputKeyboard && record.size >= sizeof(RawInputRecordHeader) + sizeof(RawKeyboardData)) {
+        DecodeKeyboard(device, RawInputWalker::GetPayload<RawKeyboardData>(record), captureTime, events);
+        return true;
+    }
+    if (record.type == RawInputMouse && record.size >= sizeof(RawInputRecordHeader) + sizeof(RawMouseData)) {
+        DecodeMouse(device, RawInputWalker::GetPayload<RawMouseData>(record), captureTime, events);
+        return true;
+    }
+    return false;
+}
+
+void RawInputDecoder::RemoveDevice(DeviceIndex device, uint64_t time, std::vector<InputEvent>& events) {
+    if (device >= MaxDevices) {
+        return;
+    }
+    auto& down = keysDown[device];
+    const uint8_t buttons = mouseButtonsDown[device];
+    if (down.none() && buttons == 0) {
+        return;
+    }
+    for (size_t code = 0; code < down.size(); ++code) {
+        if (down.test(code)) {
+            events.push_back(InputEvent::Button(device, InputType::Key, static_cast<ButtonID>(code), false, time));
+        }
+    }
+    for (ButtonID button = 0; button <= static_cast<ButtonID>(MouseButtonId::X2); ++button) {
+        if ((buttons >> button) & 1) {
+            events.push_back(InputEvent::Button(device, InputType::MouseButton, button, false, time));
+        }
+    }
+    events.push_back(FrameEndMarker);
+    down.reset();
+    mouseButtonsDown[device] = 0;
+}
+
+void RawInputDecoder::DecodeKeyboard(DeviceIndex device, const RawKeyboardData& keyboard, uint64_t captureTime,
+                                     std::vector<InputEvent>& events) {
+    if (device >= MaxDevices) {
+        return; // Injected input, or a device past what the registry can number
+    }
+    // VKey 0xFF marks the extra parts of escape sequences (the fake shifts around E0 keys,
+    // the second half of Pause), and make code 0xFF a keyboard buffer overrun.
+    if (keyboard.virtualKey == 0xFF || keyboard.makeCode == 0xFF) {
+        return;
+    }
+
+    KeyCode code = static_cast<KeyCode>(keyboard.makeCode & 0xFF);
+    if (keyboard.flags & RawKeyE1) {
+        code = KeyCodeFromName("Pause");
+    } else if (keyboard.flags & RawKeyE0) {
+        code |= KeyE0;
+    }
+    const bool pressed = (keyboard.flags & RawKeyBreak) == 0;
+
+    // Drops autorepeat, and releases of keys that were already down when the service started.
+    auto& down = keysDown[device];
+    if (down.test(code) == pressed) {
+        return;
+    }
+    down.set(code, pressed);
+
+    events.push_back(InputEvent::Button(device, InputType::Key, code, pressed, captureTime));
+    events.push_back(FrameEndMarker);
+}
+
+void RawInputDecoder::DecodeMouse(DeviceIndex device, const RawMouseData& mouse, uint64_t captureTime,
+                                  std::vector<InputEvent>& events) {
+    if (device >= MaxDevices) {
+        return;
+    }
+
+    // Absolute reports (tablets, remote desktop) have no meaningful delta and are ignored.
+    if ((mouse.flags & RawMouseAbsolute) == 0) {
+        mouseX += mouse.lastX;
+        mouseY += mouse.lastY;
+    }
+
+    const uint16_t flags = mouse.buttonFlags;
+    if (flags == 0) {
+        return;
+    }
+
+    const size_t before = events.size();
+    for (const auto& entry : MouseButtonTable) {
+        if (flags & (entry.down | entry.up)) {
+            const bool pressed = (flags & entry.down) != 0;
+            const auto bit = static_cast<uint8_t>(1u << static_cast<unsigned>(entry.button));
+            mouseButtonsDown[device] = pressed ? (mouseButtonsDown[device] | bit) : (mouseButtonsDown[device] & ~bit);
+            events.push_back(InputEvent::Button(device, InputType::MouseButton, static_cast<ButtonID>(entry.button), pressed, captureTime));
+        }
+    }
+    if (events.size() != before) {
+        events.push_back(FrameEndMarker);
+    }
+
+    // A wheel report is a step, not a state, so a bound button is seen down for exactly one frame.
+    auto wheelStep = [&events, device, captureTime](MouseButtonId button) {
+        const ButtonID id = static_cast<ButtonID>(button);
+        events.push_back(InputEvent::Button(device, InputType::MouseButton, id, true, captureTime));
+        events.push_back(FrameEndMarker);
+        events.push_back(InputEvent::Button(device, InputType::MouseButton, id, false, captureTime));
+        events.push_back(FrameEndMarker);
+    };
+    const int16_t wheelDelta = static_cast<int16_t>(mouse.buttonData);
+    if ((flags & RawMouseWheel) && wheelDelta != 0) {
+        wheelStep(wheelDelta > 0 ? MouseButtonId::WheelUp : MouseButtonId::WheelDown);
+    }
+    if ((flags & RawMouseHWheel) && wheelDelta != 0) {
+        wheelStep(wheelDelta > 0 ? MouseButtonId::WheelRight : MouseButtonId::WheelLeft);
+    }
+}
@@ -1,10 +1,39 @@
 #include "CoreService/RawInputHandler.h"
-#include "CoreService/MappingEngine.h" // To send events to
+#include "CoreService/MappingWorker.h" // To send events to
+#include "CoreService/Log.h"
+#include "CoreService/Clock.h"
+#include "CoreService/LatencyMonitor.h"
+#include <hidsdi.h>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
 #include <vector>
 
-// Constructor now takes a reference to the MappingEngine
-RawInputHandler::RawInputHandler(MappingEngine& engine) : mappingEngine(engine) {}
+// The batch decoder reads Windows' records through its own mirror of their layout.
+static_assert(sizeof(RawInputRecordHeader) == sizeof(RAWINPUTHEADER), "RawInputRecordHeader must match RAWINPUTHEADER");
+static_assert(offsetof(RawInputRecordHeader, device) == offsetof(RAWINPUTHEADER, hDevice), "RawInputRecordHeader must match RAWINPUTHEADER");
+static_assert(offsetof(RAWINPUT, data) == sizeof(RawInputRecordHeader), "Record payloads must follow the header");
+static_assert(sizeof(RawMouseData) == sizeof(RAWMOUSE) && offsetof(RawMouseData, lastX) == offsetof(RAWMOUSE, lLastX), "RawMouseData must match RAWMOUSE");
+static_assert(sizeof(RawKeyboardData) == sizeof(RAWKEYBOARD) && offsetof(RawKeyboardData, virtualKey) == offsetof(RAWKEYBOARD, VKey), "RawKeyboardData must match RAWKEYBOARD");
+static_assert(RawInputMouse == RIM_TYPEMOUSE && RawInputKeyboard == RIM_TYPEKEYBOARD && RawInputHid == RIM_TYPEHID, "Raw input types differ");
+static_assert(RawKeyBreak == RI_KEY_BREAK && RawKeyE0 == RI_KEY_E0 && RawKeyE1 == RI_KEY_E1, "Keyboard flags differ");
+static_assert(RawMouseWheel == RI_MOUSE_WHEEL && RawMouseHWheel == RI_MOUSE_HWHEEL, "Mouse flags differ");
+
+namespace {
+    // Events the batch holds before it is pushed. A drained burst that decodes to more is
+    // pushed in parts.
+    constexpr size_t BatchCapacity = 1024;
+    constexpr size_t BatchFlushThreshold = BatchCapacity - 64;
+
+    // The most events one HID report can change into: every button, axis and hat at once.
+    // Enough keyboard and mouse records fit between the threshold and the capacity.
+    constexpr size_t MaxEventsPerReport = InputSnapshot::MaxButtons + InputSnapshot::MaxAxes + InputSnapshot::MaxHats;
+    static_assert(MaxEventsPerReport + 3 <= BatchCapacity, "A report and its frame markers must fit in an empty batch");
+}
+
+RawInputHandler::RawInputHandler(MappingWorker& worker, DeviceRegistry& registry) : mappingWorker(worker), devices(registry) {
+    batch.reserve(BatchCapacity);
+}
 
 RawInputHandler::~RawInputHandler() {}
 
@@ -14,70 +43,324 @@ bool RawInputHandler::RegisterForRawInput(HWND hwnd) {
         return false;
     }
 
-    RAWINPUTDEVICE rid[2]; // Register for both gamepad and joystick
+    // Gamepads, joysticks, mice and keyboards. RIDEV_DEVNOTIFY asks for a
+    // WM_INPUT_DEVICE_CHANGE whenever one of them is plugged in or unplugged.
+    RAWINPUTDEVICE rid[4];
 
     // Gamepad
     rid[0].usUsagePage = 0x01;
     rid[0].usUsage = 0x05;
-    rid[0].dwFlags = RIDEV_INPUTSINK;
+    rid[0].dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
     rid[0].hwndTarget = hwnd;
 
     // Joystick
     rid[1].usUsagePage = 0x01;
     rid[1].usUsage = 0x04;
-    rid[1].dwFlags = RIDEV_INPUTSINK;
+    rid[1].dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
     rid[1].hwndTarget = hwnd;
 
-    if (RegisterRawInputDevices(rid, 2, sizeof(RAWINPUTDEVICE)) == FALSE) {
+    // Mouse. Without RIDEV_NOLEGACY the cursor and games keep working as usual.
+    rid[2].usUsagePage = 0x01;
+    rid[2].usUsage = 0x02;
+    rid[2].dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
+    rid[2].hwndTarget = hwnd;
+
+    // Keyboard, likewise without RIDEV_NOLEGACY.
+    rid[3].usUsagePage = 0x01;
+    rid[3].usUsage = 0x06;
+    rid[3].dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
+    rid[3].hwndTarget = hwnd;
+
+    if (RegisterRawInputDevices(rid, 4, sizeof(RAWINPUTDEVICE)) == FALSE) {
         std::cerr << "Failed to register raw input devices. Error: " << GetLastError() << std::endl;
         return false;
     }
 
-    std::cout << "Successfully registered for Raw Input from GamePads and Joysticks." << std::endl;
+    std::cout << "Successfully registered for Raw Input from GamePads, Joysticks, Mice and Keyboards." << std::endl;
     return true;
 }
 
 void RawInputHandler::ProcessRawInput(LPARAM lParam) {
-    UINT dwSize = 0;
-    GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &dwSize, sizeof(RAWINPUTHEADER));
+    // Taken first so every latency measurement includes the cost of fetching the report.
+    const uint64_t captureTime = MonotonicNanoseconds();
 
-    if (dwSize == 0) return;
+    // One call straight into the arena. Only an input larger than the arena needs the size
+    // query, after which the arena is grown for good.
+    UINT size = static_cast<UINT>(arena.GetCapacity());
+    UINT copied = GetRawInputData((HRAWINPUT)lParam, RID_INPUT, arena.GetData(), &size, sizeof(RAWINPUTHEADER));
+    if (copied == static_cast<UINT>(-1)) {
+        size = 0;
+        GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &size, sizeof(RAWINPUTHEADER));
+        arena.Reserve(size);
+        size = static_cast<UINT>(arena.GetCapacity());
+        copied = GetRawInputData((HRAWINPUT)lParam, RID_INPUT, arena.GetData(), &size, sizeof(RAWINPUTHEADER));
+        if (copied == static_cast<UINT>(-1)) {
+            LOG_WARNING("GetRawInputData failed.");
+            return;
+        }
+    }
+    DecodeRecords(copied, 1, captureTime);
 
-    std::vector<BYTE> lpb(dwSize);
-    if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb.data(), &dwSize, sizeof(RAWINPUTHEADER)) != dwSize) {
-        std::cerr << "GetRawInputData returned incorrect size." << std::endl;
+    // Anything queued behind this message was captured no later than it, so it shares
+    // the capture time.
+    DrainRawInputBuffer(captureTime);
+    FlushBatch();
+}
+
+void RawInputHandler::DrainRawInputBuffer(uint64_t captureTime) {
+    for (;;) {
+        UINT size = static_cast<UINT>(arena.GetCapacity());
+        const UINT count = GetRawInputBuffer(static_cast<PRAWINPUT>(arena.GetData()), &size, sizeof(RAWINPUTHEADER));
+        // (UINT)-1 means the next input does not fit. It stays queued and arrives as a
+        // WM_INPUT of its own, which grows the arena.
+        if (count == 0 || count == static_cast<UINT>(-1)) {
+            return;
+        }
+        DecodeRecords(arena.GetCapacity(), count, captureTime);
+    }
+}
+
+void RawInputHandler::DecodeRecords(size_t bytes, size_t count, uint64_t captureTime) {
+    RawInputWalker walker(arena.GetData(), bytes, count);
+    while (const RawInputRecordHeader* record = walker.Next()) {
+        const size_t before = batch.size();
+        const DeviceIndex device = GetDeviceIndex(record->device);
+        if (!inputDecoder.Decode(*record, device, captureTime, batch) && record->type == RawInputHid) {
+            DecodeHid(*record, device, captureTime);
+        }
+        if (latencyMonitor != nullptr && batch.size() != before) {
+            latencyMonitor->Record(LatencyStage::Decode, device, captureTime, MonotonicNanoseconds());
+        }
+        if (batch.size() >= BatchFlushThreshold) {
+            FlushBatch();
+        }
+    }
+}
+
+DeviceIndex RawInputHandler::GetDeviceIndex(HANDLE device) {
+    const DeviceIndex index = devices.GetIndex(device);
+    if (index == NoDeviceIndex || devices.IsIdentified(index)) {
+        return index;
+    }
+    // The interface name holds the hardware ID, e.g. "\\?\HID#VID_045E&PID_028E#...".
+    // Devices without one (or with a longer one) stay unknown and only match rules bound
+    // to no model.
+    wchar_t name[256];
+    UINT length = static_cast<UINT>(std::size(name));
+    const UINT copied = GetRawInputDeviceInfoW(device, RIDI_DEVICENAME, name, &length);
+    const DeviceModel model = copied != 0 && copied != static_cast<UINT>(-1) ? DeviceRegistry::ParseModel(name, copied) : DeviceModel{};
+    devices.SetModel(index, model);
+    LOG_INFO("Device {} is model {}:{}.", index, model.vendorId, model.productId);
+    return index;
+}
+
+void RawInputHandler::OnDeviceChange(WPARAM change, HANDLE device) {
+    if (change == GIDC_ARRIVAL) {
+        GetDeviceIndex(device);
+    } else if (change == GIDC_REMOVAL) {
+        RemoveDevice(device);
+    }
+}
+
+void RawInputHandler::RemoveDevice(HANDLE device) {
+    const DeviceIndex index = devices.Find(device);
+    if (index == NoDeviceIndex) {
         return;
     }
+    const uint64_t now = MonotonicNanoseconds();
 
-    RAWINPUT* raw = (RAWINPUT*)lpb.data();
+    // Whatever the device still held is let go first, as if it had reported everything
+    // released and centered, so no mapped output stays stuck down.
+    // Each part gets room for the most it can release: every key and mouse button, then
+    // every button, axis and hat, with the frame markers and DeviceRemoved.
+    MakeRoom(KeyCodeCount + static_cast<size_t>(MouseButtonId::X2) + 2);
+    inputDecoder.RemoveDevice(index, now, batch);
+    MakeRoom(MaxEventsPerReport + 3);
+    if (deviceStates.Find(index) != nullptr) {
+        deviceStates.Release(index, now, [this](const InputEvent& event) {
+            batch.push_back(event);
+        });
+        batch.push_back(InputEvent{});
+    } else {
+        deviceStates.Remove(index);
+    }
 
-    if (raw->header.dwType == RIM_TYPEHID) {
-        // This is a placeholder for a proper HID parser.
-        // A real implementation would need to parse the HID report descriptor
-        // for the device to understand the format of bRawData.
-        // For this example, we'll make a HUGE assumption that we're getting a
-        // simple gamepad report and we'll fake a translation.
+    // Queued behind the releases, so the mapping side forgets the index only after them.
+    batch.push_back(InputEvent{ now, InputType::DeviceRemoved, index, 0, 0 });
+    batch.push_back(InputEvent{});
+    devices.Remove(device);
+    decoders[index] = DeviceDecoder{};
+    FlushBatch();
+    LOG_INFO("Device {} was removed.", index);
+}
 
-        // --- Start of FAKE HID Parsing ---
-        // Let's pretend Button 0 is the first bit of the first byte of the data.
-        if (raw->data.hid.dwSizeHid > 0) {
-            bool isButtonPressed = (raw->data.hid.bRawData[0] & 0x01) != 0;
-            ButtonID fakeButtonId = 0; // Let's say we've identified this as button 0
+void RawInputHandler::FlushBatch() {
+    // Mouse movement only feeds the mouse-to-stick counters, once per batch.
+    int32_t dx;
+    int32_t dy;
+    inputDecoder.TakeMouseDelta(dx, dy);
+    if (dx != 0 || dy != 0) {
+        mappingWorker.PushMouseDelta(dx, dy);
+    }
+    mappingWorker.PushBatch(batch.data(), batch.size());
+    batch.clear();
+}
 
-            // To avoid spamming, we'd need to track the previous state.
-            // For now, we'll just fire the event. A real system needs state management.
-            // This is a major simplification.
+void RawInputHandler::MakeRoom(size_t events) {
+    if (batch.size() + events > BatchCapacity) {
+        FlushBatch();
+    }
+}
 
-            // Create a standardized InputEvent
-            ButtonInput btnInput{ fakeButtonId, isButtonPressed };
-            InputEvent event(raw->header.hDevice, InputType::Button, btnInput);
+void RawInputHandler::DecodeHid(const RawInputRecordHeader& record, DeviceIndex device, uint64_t captureTime) {
+    const RawHidData& hid = RawInputWalker::GetPayload<RawHidData>(record);
+    const size_t payloadBytes = record.size - sizeof(RawInputRecordHeader);
+    if (payloadBytes < offsetof(RawHidData, rawData) ||
+        uint64_t{ hid.sizeHid } * hid.count > payloadBytes - offsetof(RawHidData, rawData)) {
+        return;
+    }
+
+    if (device == NoDeviceIndex) {
+        return;
+    }
+    DeviceDecoder& decoder = GetDecoder(device, record.device);
+    if (!decoder.ready) {
+        return;
+    }
+
+    // A single input can carry several reports of sizeHid bytes each. Each report is
+    // decoded over a copy of the device's stored state, so controls the report does not
+    // carry keep their values, and only what actually changed is sent on.
+    InputSnapshot next = deviceStates.Get(device);
+    const BYTE* report = hid.rawData;
+    for (uint32_t i = 0; i < hid.count; ++i, report += hid.sizeHid) {
+        // Pushing part of a frame is fine; the worker leaves it open until its marker comes.
+        MakeRoom(MaxEventsPerReport + 1);
+        if (decoder.plan.Decode(report, hid.sizeHid, next)) {
+            deviceStates.Commit(device, next, captureTime, [this](const InputEvent& event) {
+                batch.push_back(event);
+            });
+        }
+    }
+    batch.push_back(InputEvent{});
+}
+
+RawInputHandler::DeviceDecoder& RawInputHandler::GetDecoder(DeviceIndex index, HANDLE device) {
+    DeviceDecoder& decoder = decoders[index];
+    if (decoder.built) {
+        return decoder;
+    }
+
+    decoder.built = true;
+    decoder.ready = BuildExtractionPlan(device, decoder.plan);
+    if (decoder.ready) {
+        LOG_INFO("Compiled HID extraction plan for device {}: {} controls.", device, decoder.plan.GetControls().size());
+    } else {
+        LOG_WARNING("Could not build a HID extraction plan for device {}; its input will be ignored.", device);
+    }
+    return decoder;
+}
 
-            // Pass the standardized event to the mapping engine
-            mappingEngine.ProcessInput(event);
+bool RawInputHandler::BuildExtractionPlan(HANDLE device, HidExtractionPlan& plan) {
+    UINT size = 0;
+    if (GetRawInputDeviceInfo(device, RIDI_PREPARSEDDATA, nullptr, &size) != 0 || size == 0) {
+        return false;
+    }
+    std::vector<BYTE> preparsedBuffer(size);
+    if (GetRawInputDeviceInfo(device, RIDI_PREPARSEDDATA, preparsedBuffer.data(), &size) == static_cast<UINT>(-1)) {
+        return false;
+    }
+    auto preparsed = reinterpret_cast<PHIDP_PREPARSED_DATA>(preparsedBuffer.data());
+
+    HIDP_CAPS caps;
+    if (HidP_GetCaps(preparsed, &caps) != HIDP_STATUS_SUCCESS || caps.InputReportByteLength == 0) {
+        return false;
+    }
+
+    // Raw Input always delivers the report ID byte, even for devices that do not use IDs (it is 0 then).
+    HidPlanBuilder builder(true);
+    const ULONG reportLength = caps.InputReportByteLength;
+    std::vector<CHAR> probe(reportLength);
+
+    auto resetProbe = [&probe](UCHAR reportId) {
+        std::fill(probe.begin(), probe.end(), 0);
+        probe[0] = static_cast<CHAR>(reportId);
+    };
+
+    // Finds the run of bits the last HidP_Set* call wrote into the probe report.
+    auto findBits = [&probe, reportLength](uint32_t& offset, uint8_t& count) {
+        count = 0;
+        for (uint32_t bit = 8; bit < reportLength * 8; ++bit) {
+            if ((static_cast<BYTE>(probe[bit / 8]) >> (bit % 8)) & 1) {
+                if (count == 0) {
+                    offset = bit;
+                }
+                ++count;
+            }
+        }
+        return count != 0;
+    };
+
+    USHORT buttonCapCount = caps.NumberInputButtonCaps;
+    std::vector<HIDP_BUTTON_CAPS> buttonCaps(buttonCapCount);
+    if (buttonCapCount != 0 && HidP_GetButtonCaps(HidP_Input, buttonCaps.data(), &buttonCapCount, preparsed) == HIDP_STATUS_SUCCESS) {
+        for (USHORT c = 0; c < buttonCapCount; ++c) {
+            const HIDP_BUTTON_CAPS& cap = buttonCaps[c];
+            builder.SetReportBits(cap.ReportID, reportLength * 8);
+            if ((cap.BitField & 0x02) == 0) {
+                continue; // Button arrays are rare on game controllers and are not probed.
+            }
+            const uint32_t first = cap.IsRange ? cap.Range.UsageMin : cap.NotRange.Usage;
+            const uint32_t last = cap.IsRange ? cap.Range.UsageMax : cap.NotRange.Usage;
+            for (uint32_t usage = first; usage <= last; ++usage) {
+                resetProbe(cap.ReportID);
+                USAGE usageList = static_cast<USAGE>(usage);
+                ULONG usageCount = 1;
+                if (HidP_SetUsages(HidP_Input, cap.UsagePage, cap.LinkCollection, &usageList, &usageCount,
+                                   preparsed, probe.data(), reportLength) != HIDP_STATUS_SUCCESS) {
+                    continue;
+                }
+                uint32_t offset;
+                uint8_t bits;
+                if (findBits(offset, bits) && bits == 1) {
+                    builder.AddVariable(cap.ReportID, offset, 1, cap.UsagePage, static_cast<uint16_t>(usage), 0, 1);
+                }
+            }
         }
-        // --- End of FAKE HID Parsing ---
+    }
+
+    USHORT valueCapCount = caps.NumberInputValueCaps;
+    std::vector<HIDP_VALUE_CAPS> valueCaps(valueCapCount);
+    if (valueCapCount != 0 && HidP_GetValueCaps(HidP_Input, valueCaps.data(), &valueCapCount, preparsed) == HIDP_STATUS_SUCCESS) {
+        for (USHORT c = 0; c < valueCapCount; ++c) {
+            const HIDP_VALUE_CAPS& cap = valueCaps[c];
+            builder.SetReportBits(cap.ReportID, reportLength * 8);
+            if (cap.ReportCount != 1 || cap.BitSize == 0 || cap.BitSize > 32 || !cap.IsAbsolute) {
+                continue;
+            }
+            const ULONG allOnes = cap.BitSize == 32 ? 0xFFFFFFFFu : (1u << cap.BitSize) - 1;
+            // HidP reports the logical range as signed, so a 0..255 range declared in one byte
+            // arrives as 0..-1. Reinterpret the maximum as unsigned in that case.
+            const LONG logicalMax = (cap.LogicalMin >= 0 && cap.LogicalMax < cap.LogicalMin)
+                ? static_cast<LONG>(static_cast<ULONG>(cap.LogicalMax) & allOnes) : cap.LogicalMax;
 
-        // The debug output is still useful
-        // std::cout << "Received Raw HID Input from device: " << raw->header.hDevice << std::endl;
+            const uint32_t first = cap.IsRange ? cap.Range.UsageMin : cap.NotRange.Usage;
+            const uint32_t last = cap.IsRange ? cap.Range.UsageMax : cap.NotRange.Usage;
+            for (uint32_t usage = first; usage <= last; ++usage) {
+                resetProbe(cap.ReportID);
+                if (HidP_SetUsageValue(HidP_Input, cap.UsagePage, cap.LinkCollection, static_cast<USAGE>(usage), allOnes,
+                                       preparsed, probe.data(), reportLength) != HIDP_STATUS_SUCCESS) {
+                    continue;
+                }
+                uint32_t offset;
+                uint8_t bits;
+                if (findBits(offset, bits) && bits == cap.BitSize) {
+                    builder.AddVariable(cap.ReportID, offset, bits, cap.UsagePage, static_cast<uint16_t>(usage), cap.LogicalMin, logicalMax);
+                }
+            }
+        }
     }
+
+    plan = builder.Build();
+    return !plan.IsEmpty();
 }
@@ -1,20 +1,87 @@
 #pragma once
 
 #include <windows.h>
+#include <array>
+#include <vector>
+#include "CoreService/Mapping/HidReportDescriptor.h"
+#include "CoreService/Mapping/DeviceStateStore.h"
+#include "CoreService/RawInputBatch.h"
+#include "CoreService/DeviceRegistry.h"
 
-// Forward declaration to avoid circular include
-class MappingEngine;
+// Forward declarations to avoid circular includes
+class MappingWorker;
+class LatencyMonitor;
 
 class RawInputHandler {
 public:
-    // The handler needs a reference to the mapping engine to send events to it.
-    RawInputHandler(MappingEngine& engine);
+    // The handler only decodes input; the events go to the mapping worker's queue and are
+    // mapped on the worker's thread. Devices are numbered by `registry`, which the handler
+    // fills in as they show up and go away.
+    RawInputHandler(MappingWorker& worker, DeviceRegistry& registry);
     ~RawInputHandler();
 
     bool RegisterForRawInput(HWND hwnd);
+
+    // Handles one WM_INPUT, then drains whatever else is already queued with
+    // GetRawInputBuffer, so a burst of input costs one message instead of one per event.
+    // Everything decoded goes to the mapping worker as one batch.
     void ProcessRawInput(LPARAM lParam);
 
+    // Handles one WM_INPUT_DEVICE_CHANGE. An unplugged device's held buttons are released and
+    // its index freed, after a DeviceRemoved event tells the mapping side to forget it.
+    void OnDeviceChange(WPARAM change, HANDLE device);
+
+    // Optional. When set, the time from capture to the end of decoding is recorded per event.
+    void SetLatencyMonitor(LatencyMonitor* monitor) { latencyMonitor = monitor; }
+
 private:
-    // Reference to the mapping engine.
-    MappingEngine& mappingEngine;
+    // Per-device decoding state, built the first time a device sends a report.
+    struct DeviceDecoder {
+        HidExtractionPlan plan;
+        bool built = false;
+        bool ready = false; // False if no plan could be built; reports are then ignored.
+    };
+
+    // The decoder of the device registered at `index`, building it on first use.
+    DeviceDecoder& GetDecoder(DeviceIndex index, HANDLE device);
+
+    // Decodes `count` packed records from the arena into the batch, in place.
+    void DecodeRecords(size_t bytes, size_t count, uint64_t captureTime);
+    void DecodeHid(const RawInputRecordHeader& record, DeviceIndex device, uint64_t captureTime);
+    void DrainRawInputBuffer(uint64_t captureTime);
+    void FlushBatch();
+    // Flushes the batch first if `events` more would take it past its capacity, so it never
+    // has to grow.
+    void MakeRoom(size_t events);
+
+    // The index of a device, read from the registry, whose model is looked up from the
+    // device's interface name the first time it is seen.
+    DeviceIndex GetDeviceIndex(HANDLE device);
+    void RemoveDevice(HANDLE device);
+
+    // Compiles an extraction plan from the device's preparsed data. Windows does not hand the
+    // raw report descriptor to user mode, so the layout is recovered by asking HidP to encode
+    // each usage into a zeroed report and noting which bits it set.
+    static bool BuildExtractionPlan(HANDLE device, HidExtractionPlan& plan);
+
+    // Where decoded events are queued for mapping.
+    MappingWorker& mappingWorker;
+
+    // Indexed by DeviceIndex, like the device states; cleared when the index is freed.
+    std::array<DeviceDecoder, MaxDevices> decoders;
+
+    // Every read lands in the arena and is decoded from there; the batch collects the
+    // events until they are pushed. Both are allocated up front and reused.
+    RawInputArena arena;
+    RawInputDecoder inputDecoder;
+    std::vector<InputEvent> batch;
+
+    // Numbers the device handles; events carry the numbers from here on.
+    DeviceRegistry& devices;
+
+    // Decoded reports are diffed against this so only changes reach the mapping engine.
+    // Capture thread only; the mapping side keeps its own state from the events.
+    DeviceStateStore deviceStates;
+
+    LatencyMonitor* latencyMonitor = nullptr;
 };
@@ -0,0 +1,85 @@
+#include "SendInputSink.h"
+#include "VirtualKeyboardMouse.h"
+#include <windows.h>
+#include <array>
+#include <iostream>
+#include <iterator>
+
+namespace {
+    // Down and up flags of the mouse buttons, by MouseButtonId. The wheel "buttons" are only
+    // ever input, and have none.
+    struct MouseButtonFlags {
+        DWORD down;
+        DWORD up;
+        DWORD data;
+    };
+
+    constexpr MouseButtonFlags MouseButtonFlagTable[] = {
+        { MOUSEEVENTF_LEFTDOWN, MOUSEEVENTF_LEFTUP, 0 },
+        { MOUSEEVENTF_RIGHTDOWN, MOUSEEVENTF_RIGHTUP, 0 },
+        { MOUSEEVENTF_MIDDLEDOWN, MOUSEEVENTF_MIDDLEUP, 0 },
+        { MOUSEEVENTF_XDOWN, MOUSEEVENTF_XUP, XBUTTON1 },
+        { MOUSEEVENTF_XDOWN, MOUSEEVENTF_XUP, XBUTTON2 },
+    };
+    static_assert(static_cast<size_t>(MouseButtonId::X2) + 1 == std::size(MouseButtonFlagTable), "Mouse button flag table is out of order");
+
+    // Fills `converted` from `input`. Returns false for inputs SendInput cannot express.
+    bool Convert(const InjectedInput& input, INPUT& converted) {
+        converted = INPUT{};
+        switch (input.kind) {
+            case InjectedInput::Key:
+                if (input.code & KeyE1) {
+                    return false; // Pause; SendInput has no flag for the E1 prefix
+                }
+                converted.type = INPUT_KEYBOARD;
+                converted.ki.wScan = static_cast<WORD>(input.code & 0xFF);
+                converted.ki.dwFlags = KEYEVENTF_SCANCODE | (input.code & KeyE0 ? KEYEVENTF_EXTENDEDKEY : 0) | (input.pressed ? 0 : KEYEVENTF_KEYUP);
+                return true;
+            case InjectedInput::MouseButton: {
+                if (input.code >= std::size(MouseButtonFlagTable)) {
+                    return false;
+                }
+                const MouseButtonFlags& flags = MouseButtonFlagTable[input.code];
+                converted.type = INPUT_MOUSE;
+                converted.mi.dwFlags = input.pressed ? flags.down : flags.up;
+                converted.mi.mouseData = flags.data;
+                return true;
+            }
+            case InjectedInput::MouseMove:
+                converted.type = INPUT_MOUSE;
+                converted.mi.dx = input.dx;
+                converted.mi.dy = input.dy;
+                converted.mi.dwFlags = MOUSEEVENTF_MOVE;
+                return true;
+            case InjectedInput::MouseWheel:
+                converted.type = INPUT_MOUSE;
+                converted.mi.mouseData = static_cast<DWORD>(input.dy);
+                converted.mi.dwFlags = MOUSEEVENTF_WHEEL;
+                return true;
+        }
+        return false;
+    }
+}
+
+bool SendInputSink::SubmitInputs(const InjectedInput* inputs, size_t count) {
+    // VirtualKeyboardMouse never batches more than this, so one array covers a batch.
+    std::array<INPUT, VirtualKeyboardMouse::MaxPendingInputs> converted;
+    bool complete = true;
+    size_t done = 0;
+    while (done < count) {
+        UINT filled = 0;
+        for (; done < count && filled < converted.size(); ++done) {
+            if (Convert(inputs[done], converted[filled])) {
+                ++filled;
+            } else {
+                complete = false;
+            }
+        }
+        if (filled != 0 && SendInput(filled, converted.data(), sizeof(INPUT)) != filled) {
+            // Blocked by UIPI (a higher-integrity window has the focus) or by another thread's input.
+            std::cerr << "SendInput injected only part of a batch. Error: " << GetLastError() << std::endl;
+            complete = false;
+        }
+    }
+    return complete;
+}
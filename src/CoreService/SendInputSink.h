@@ -0,0 +1,11 @@
+#pragma once
+
+#include "KeyboardMouseSink.h"
+
+// Injects keyboard and mouse output with SendInput. Each batch becomes one INPUT array and
+// one call, so the inputs of a frame reach the system in order and without others in between.
+// Keys are sent by scan code, so they land on the same physical key whatever the layout.
+class SendInputSink : public KeyboardMouseSink {
+public:
+    bool SubmitInputs(const InjectedInput* inputs, size_t count) override;
+};
@@ -0,0 +1,204 @@
+#include "CoreService/StartupOrchestrator.h"
+#include "CoreService/Clock.h"
+#include "CoreService/Log.h"
+#include <algorithm>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+    const char* StateName(StartupOrchestrator::State state) {
+        switch (state) {
+            case StartupOrchestrator::State::Waiting: return "waiting";
+            case StartupOrchestrator::State::Running: return "running";
+            case StartupOrchestrator::State::Succeeded: return "done";
+            case StartupOrchestrator::State::Failed: return "failed";
+            case StartupOrchestrator::State::Skipped: return "skipped";
+        }
+        return "?";
+    }
+}
+
+StartupOrchestrator::StartupOrchestrator(size_t threadCount) {
+    this->threadCount = threadCount == 0 ? MaxThreads : std::min(threadCount, MaxThreads);
+}
+
+StartupOrchestrator::~StartupOrchestrator() {
+    if (started) {
+        WaitAll();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+StartupOrchestrator::StageId StartupOrchestrator::Add(const char* name, std::function<bool()> work, const std::vector<StageId>& after, Runs runs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto id = static_cast<StageId>(stages.size());
+    Stage stage;
+    stage.name = name;
+    stage.work = std::move(work);
+    stage.runs = runs;
+    for (const StageId dependency : after) {
+        // Only earlier stages can be named, so the graph cannot have cycles.
+        if (dependency < id) {
+            stages[dependency].dependents.push_back(id);
+            ++stage.waitingFor;
+        }
+    }
+    stages.push_back(std::move(stage));
+    ++unfinished;
+    return id;
+}
+
+void StartupOrchestrator::Start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started) {
+        return;
+    }
+    started = true;
+    startNs = MonotonicNanoseconds();
+    for (StageId id = 0; id < stages.size(); ++id) {
+        if (stages[id].waitingFor == 0 && stages[id].runs == Runs::OnPool) {
+            ready.push_back(id);
+        }
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&StartupOrchestrator::WorkerLoop, this, static_cast<uint8_t>(i + 1));
+    }
+}
+
+bool StartupOrchestrator::RunHere(StageId stage) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stage >= stages.size()) {
+        return false;
+    }
+    if (stages[stage].runs == Runs::OnCaller) {
+        changed.wait(lock, [&] { return stages[stage].waitingFor == 0 || stages[stage].state != State::Waiting; });
+        if (stages[stage].state == State::Waiting) {
+            Run(lock, stage, 0);
+        }
+    }
+    changed.wait(lock, [&] { return IsDone(stages[stage].state); });
+    return stages[stage].state == State::Succeeded;
+}
+
+bool StartupOrchestrator::Wait(StageId stage) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stage >= stages.size()) {
+        return false;
+    }
+    changed.wait(lock, [&] { return IsDone(stages[stage].state); });
+    return stages[stage].state == State::Succeeded;
+}
+
+void StartupOrchestrator::WaitAll() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (StageId id = 0; id < stages.size(); ++id) {
+        if (stages[id].runs == Runs::OnCaller && stages[id].state == State::Waiting) {
+            Skip(id);
+        }
+    }
+    changed.notify_all();
+    changed.wait(lock, [this] { return unfinished == 0; });
+}
+
+StartupOrchestrator::State StartupOrchestrator::GetState(StageId stage) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stage < stages.size() ? stages[stage].state : State::Skipped;
+}
+
+std::vector<StartupOrchestrator::Timing> StartupOrchestrator::GetTimings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Timing> timings;
+    timings.reserve(stages.size());
+    for (const auto& stage : stages) {
+        timings.push_back({ stage.name, stage.state, stage.thread, stage.startNs, stage.endNs });
+    }
+    return timings;
+}
+
+void StartupOrchestrator::Dump(std::ostream& out) const {
+    std::vector<Timing> timings = GetTimings();
+    std::stable_sort(timings.begin(), timings.end(), [](const Timing& a, const Timing& b) {
+        // Stages that never ran go last.
+        const bool aRan = a.endNs != 0;
+        const bool bRan = b.endNs != 0;
+        return aRan != bRan ? aRan : a.startNs < b.startNs;
+    });
+    auto millis = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    out << "Startup stages (ms since start):\n";
+    for (const auto& timing : timings) {
+        out << "  " << std::left << std::setw(24) << timing.name << std::right << std::setw(8) << StateName(timing.state);
+        if (timing.endNs != 0) {
+            out << std::fixed << std::setprecision(1) << "  " << std::setw(8) << millis(timing.startNs) << " .. " << std::setw(8)
+                << millis(timing.endNs) << "  (" << millis(timing.endNs - timing.startNs) << ")"
+                << (timing.thread == 0 ? "  caller" : "  pool");
+        }
+        out << '\n';
+    }
+}
+
+void StartupOrchestrator::WorkerLoop(uint8_t thread) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        changed.wait(lock, [this] { return stopping || !ready.empty(); });
+        if (ready.empty()) {
+            return; // Stopping
+        }
+        // Stages become ready in the order they were added, which is the order to prefer.
+        const auto first = std::min_element(ready.begin(), ready.end());
+        const StageId stage = *first;
+        ready.erase(first);
+        Run(lock, stage, thread);
+    }
+}
+
+void StartupOrchestrator::Run(std::unique_lock<std::mutex>& lock, StageId stage, uint8_t thread) {
+    Stage& entry = stages[stage];
+    entry.state = State::Running;
+    entry.thread = thread;
+    entry.startNs = MonotonicNanoseconds() - startNs;
+    // The vector is complete once started, so the reference and function stay valid unlocked.
+    lock.unlock();
+    bool succeeded = false;
+    try {
+        succeeded = entry.work();
+    } catch (const std::exception& e) {
+        // Not logged: the message would be gone before the logger thread formats it.
+        std::cerr << "Startup stage " << entry.name << " failed: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Startup stage " << entry.name << " failed." << std::endl;
+    }
+    const uint64_t endNs = MonotonicNanoseconds() - startNs;
+    lock.lock();
+    entry.endNs = endNs;
+    Finish(stage, succeeded ? State::Succeeded : State::Failed);
+    LOG_INFO("Startup: {} {} after {} us.", entry.name, StateName(entry.state), (entry.endNs - entry.startNs) / 1000);
+}
+
+void StartupOrchestrator::Finish(StageId stage, State state) {
+    stages[stage].state = state;
+    --unfinished;
+    for (const StageId dependent : stages[stage].dependents) {
+        if (stages[dependent].state != State::Waiting) {
+            continue;
+        }
+        if (state != State::Succeeded) {
+            Skip(dependent);
+        } else if (--stages[dependent].waitingFor == 0 && stages[dependent].runs == Runs::OnPool) {
+            ready.push_back(dependent);
+        }
+    }
+    changed.notify_all();
+}
+
+void StartupOrchestrator::Skip(StageId stage) {
+    LOG_WARNING("Startup: {} skipped.", stages[stage].name);
+    Finish(stage, State::Skipped);
+}
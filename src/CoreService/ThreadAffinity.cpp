@@ -0,0 +1,28 @@
+#include "ThreadAffinity.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool PinCurrentThreadToCore(int core) {
+    if (core < 0) {
+        return true;
+    }
+#ifdef _WIN32
+    if (core >= static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << core) != 0;
+#else
+    if (core >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#endif
+}
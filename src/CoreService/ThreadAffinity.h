@@ -0,0 +1,5 @@
+#pragma once
+
+// Pins the calling thread to one logical CPU. Returns false if the core does not exist or
+// the OS refused. A negative core leaves the thread unpinned and returns true.
+bool PinCurrentThreadToCore(int core);
@@ -0,0 +1,103 @@
+#include "ViGEmGamepadSink.h"
+#include <iostream> // For placeholder messages
+
+ViGEmClient::~ViGEmClient() {
+    Disconnect();
+}
+
+bool ViGEmClient::Connect() {
+    if (client) {
+        return true;
+    }
+
+    std::cout << "Initializing ViGEmBus client..." << std::endl;
+    client = vigem_alloc(); // Placeholder SDK call
+
+    if (client == nullptr) {
+        std::cerr << "Failed to allocate ViGEmBus client." << std::endl;
+        return false;
+    }
+
+    // Note: In a real scenario, vigem_connect can return an error that needs to be checked.
+    // VIGEM_ERROR_BUS_NOT_FOUND is a common one if the ViGEmBus driver is not installed.
+    int connect_result = vigem_connect(client); // Placeholder SDK call
+    if (connect_result != 0) { // Assuming 0 is success, replace with actual SDK error codes
+        std::cerr << "Failed to connect to ViGEmBus. Error code: " << connect_result << std::endl;
+        vigem_free(client);
+        client = nullptr;
+        return false;
+    }
+    std::cout << "ViGEmBus client connected." << std::endl;
+    return true;
+}
+
+void ViGEmClient::Disconnect() {
+    if (client) {
+        vigem_disconnect(client); // Placeholder SDK call
+        vigem_free(client);       // Placeholder SDK call
+        client = nullptr;
+    }
+}
+
+ViGEmGamepadSink::ViGEmGamepadSink(ViGEmClient& client) : client(client), xbox_target(nullptr) {}
+
+ViGEmGamepadSink::~ViGEmGamepadSink() {
+    Disconnect();
+}
+
+bool ViGEmGamepadSink::Connect() {
+    if (xbox_target) {
+        return true;
+    }
+    if (!client.Connect()) {
+        return false;
+    }
+
+    std::cout << "Allocating Xbox 360 virtual controller..." << std::endl;
+    xbox_target = vigem_target_x360_alloc(); // Placeholder SDK call
+    if (xbox_target == nullptr) {
+        std::cerr << "Failed to allocate Xbox 360 target." << std::endl;
+        return false;
+    }
+
+    std::cout << "Adding virtual controller to ViGEmBus..." << std::endl;
+    // Note: In a real scenario, vigem_target_add can return an error.
+    int add_target_result = vigem_target_add(client.Get(), xbox_target); // Placeholder SDK call
+    if (add_target_result != 0) { // Assuming 0 is success
+        std::cerr << "Failed to add Xbox 360 target to ViGEmBus. Error code: " << add_target_result << std::endl;
+        vigem_target_free(xbox_target);
+        xbox_target = nullptr;
+        return false;
+    }
+    std::cout << "Virtual Xbox 360 controller added and ready." << std::endl;
+
+    // TODO: Register for notification when the virtual controller is ready to be fed input,
+    //       using something like `vigem_target_add_async` or a specific notification callback
+    //       provided by the ViGEmBus SDK if available. For now, we assume it's ready.
+    return true;
+}
+
+void ViGEmGamepadSink::Disconnect() {
+    if (xbox_target) {
+        vigem_target_remove(client.Get(), xbox_target); // Placeholder SDK call
+        vigem_target_free(xbox_target);                // Placeholder SDK call
+        xbox_target = nullptr;
+    }
+}
+
+bool ViGEmGamepadSink::SubmitReport(const GamepadReport& report) {
+    if (!xbox_target) {
+        return false;
+    }
+
+    // GamepadReport uses the XUSB layout and button bits, so this is a field-by-field copy.
+    XUSB_REPORT xusb;
+    xusb.wButtons = report.buttons;
+    xusb.bLeftTrigger = report.leftTrigger;
+    xusb.bRightTrigger = report.rightTrigger;
+    xusb.sThumbLX = report.thumbLX;
+    xusb.sThumbLY = report.thumbLY;
+    xusb.sThumbRX = report.thumbRX;
+    xusb.sThumbRY = report.thumbRY;
+    return vigem_target_x360_update(client.Get(), xbox_target, xusb) == 0; // Placeholder SDK call
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "GamepadSink.h"
+#include "CoreService/ViGEm/vigem_client.h" // Placeholder SDK header
+
+// One connection to the ViGEmBus driver, shared by every virtual controller on it.
+class ViGEmClient {
+public:
+    ViGEmClient() = default;
+    ~ViGEmClient();
+
+    ViGEmClient(const ViGEmClient&) = delete;
+    ViGEmClient& operator=(const ViGEmClient&) = delete;
+
+    // Connects on the first call; later calls just report whether the connection is up.
+    bool Connect();
+    void Disconnect();
+
+    PVIGEM_CLIENT Get() const { return client; }
+
+private:
+    PVIGEM_CLIENT client = nullptr;
+};
+
+// Feeds reports to a virtual Xbox 360 controller on the ViGEmBus driver. Each sink is its
+// own target on the shared client, and updates to different targets are independent
+// driver requests, so controllers never wait on each other.
+class ViGEmGamepadSink : public GamepadSink {
+public:
+    explicit ViGEmGamepadSink(ViGEmClient& client);
+    ~ViGEmGamepadSink() override;
+
+    bool Connect() override;
+    void Disconnect() override;
+    bool SubmitReport(const GamepadReport& report) override;
+
+private:
+    ViGEmClient& client;
+    PVIGEM_TARGET xbox_target; // Assuming an Xbox 360 target for now
+};
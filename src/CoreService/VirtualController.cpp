@@ -1,7 +1,11 @@
 #include "VirtualController.h"
+#include "CoreService/Log.h"
+#include "CoreService/Mapping/AxisTransform.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream> // For placeholder messages
 
-VirtualController::VirtualController() : client(nullptr), xbox_target(nullptr), initialized(false) {}
+VirtualController::VirtualController(GamepadSink& sink) : sink(sink), initialized(false) {}
 
 VirtualController::~VirtualController() {
     Shutdown();
@@ -12,52 +16,16 @@ bool VirtualController::Initialize() {
         return true;
     }
 
-    std::cout << "Initializing ViGEmBus client..." << std::endl;
-    client = vigem_alloc(); // Placeholder SDK call
-
-    if (client == nullptr) {
-        std::cerr << "Failed to allocate ViGEmBus client." << std::endl;
-        return false;
-    }
-
-    // Note: In a real scenario, vigem_connect can return an error that needs to be checked.
-    // VIGEM_ERROR_BUS_NOT_FOUND is a common one if the ViGEmBus driver is not installed.
-    int connect_result = vigem_connect(client); // Placeholder SDK call
-    if (connect_result != 0) { // Assuming 0 is success, replace with actual SDK error codes
-        std::cerr << "Failed to connect to ViGEmBus. Error code: " << connect_result << std::endl;
-        vigem_free(client);
-        client = nullptr;
-        return false;
-    }
-    std::cout << "ViGEmBus client connected." << std::endl;
-
-    std::cout << "Allocating Xbox 360 virtual controller..." << std::endl;
-    xbox_target = vigem_target_x360_alloc(); // Placeholder SDK call
-    if (xbox_target == nullptr) {
-        std::cerr << "Failed to allocate Xbox 360 target." << std::endl;
-        vigem_disconnect(client);
-        vigem_free(client);
-        client = nullptr;
-        return false;
-    }
-
-    std::cout << "Adding virtual controller to ViGEmBus..." << std::endl;
-    // Note: In a real scenario, vigem_target_add can return an error.
-    int add_target_result = vigem_target_add(client, xbox_target); // Placeholder SDK call
-    if (add_target_result != 0) { // Assuming 0 is success
-        std::cerr << "Failed to add Xbox 360 target to ViGEmBus. Error code: " << add_target_result << std::endl;
-        vigem_target_free(xbox_target);
-        xbox_target = nullptr;
-        vigem_disconnect(client);
-        vigem_free(client);
-        client = nullptr;
+    if (!sink.Connect()) {
         return false;
     }
-    std::cout << "Virtual Xbox 360 controller added and ready." << std::endl;
 
-    // TODO: Register for notification when the virtual controller is ready to be fed input,
-    //       using something like `vigem_target_add_async` or a specific notification callback
-    //       provided by the ViGEmBus SDK if available. For now, we assume it's ready.
+    // Start from a neutral pad, and make sure the device agrees.
+    shadow = GamepadReport{};
+    lastSent = shadow;
+    lastShadow = shadow;
+    lastTransforms = nullptr;
+    sink.SubmitReport(lastSent);
 
     initialized = true;
     return true;
@@ -69,47 +37,56 @@ void VirtualController::Shutdown() {
     }
 
     std::cout << "Shutting down virtual controller..." << std::endl;
-    if (xbox_target) {
-        vigem_target_remove(client, xbox_target); // Placeholder SDK call
-        vigem_target_free(xbox_target);          // Placeholder SDK call
-        xbox_target = nullptr;
-    }
-
-    if (client) {
-        vigem_disconnect(client); // Placeholder SDK call
-        vigem_free(client);       // Placeholder SDK call
-        client = nullptr;
-    }
+    // Release everything before unplugging so the game does not see a stuck input.
+    shadow = GamepadReport{};
+    Flush();
+    sink.Disconnect();
     initialized = false;
     std::cout << "Virtual controller shut down." << std::endl;
 }
 
-void VirtualController::PressButtonA() {
-    if (!initialized || !xbox_target) {
-        std::cerr << "Virtual controller not initialized. Cannot press button A." << std::endl;
-        return;
+void VirtualController::SetButtons(uint16_t mask, bool pressed) {
+    if (pressed) {
+        shadow.buttons |= mask;
+    } else {
+        shadow.buttons &= static_cast<uint16_t>(~mask);
     }
-    std::cout << "Simulating Button A Press on virtual Xbox 360 controller." << std::endl;
-    // TODO: Use actual ViGEmBus SDK functions to update the XUSB_REPORT structure
-    //       and then call vigem_target_x360_update(client, xbox_target, report).
-    //       Example (conceptual):
-    //       XUSB_REPORT report;
-    //       XUSB_REPORT_INIT(&report);
-    //       report.wButtons |= XUSB_GAMEPAD_A;
-    //       vigem_target_x360_update(client, xbox_target, report);
 }
 
-void VirtualController::ReleaseButtonA() {
-    if (!initialized || !xbox_target) {
-        std::cerr << "Virtual controller not initialized. Cannot release button A." << std::endl;
-        return;
+void VirtualController::SetAxis(const AxisTarget& target, int value) {
+    if (target.device != OutputDevice::Gamepad) {
+        return; // Mouse axes are not part of the gamepad report.
+    }
+    // One store of the clamped value into the field the table points at.
+    auto* field = reinterpret_cast<unsigned char*>(&shadow) + target.code;
+    const int32_t clamped = std::clamp<int32_t>(value, target.min, target.max);
+    if (target.size == sizeof(int16_t)) {
+        const auto stick = static_cast<int16_t>(clamped);
+        std::memcpy(field, &stick, sizeof(stick));
+    } else {
+        *field = static_cast<uint8_t>(clamped);
+    }
+}
+
+bool VirtualController::Flush(const AxisTransformSet* transforms) {
+    if (!initialized || (shadow == lastShadow && transforms == lastTransforms)) {
+        return false;
+    }
+
+    GamepadReport output = shadow;
+    if (transforms != nullptr) {
+        transforms->Apply(output);
+    }
+    bool sent = false;
+    if (output != lastSent) {
+        if (!sink.SubmitReport(output)) {
+            LOG_WARNING("Virtual controller rejected a report update.");
+            return false;
+        }
+        lastSent = output;
+        sent = true;
     }
-    std::cout << "Simulating Button A Release on virtual Xbox 360 controller." << std::endl;
-    // TODO: Use actual ViGEmBus SDK functions to update the XUSB_REPORT structure
-    //       and then call vigem_target_x360_update(client, xbox_target, report).
-    //       Example (conceptual):
-    //       XUSB_REPORT report;
-    //       XUSB_REPORT_INIT(&report);
-    //       // report.wButtons &= ~XUSB_GAMEPAD_A; // This would be if we had state
-    //       vigem_target_x360_update(client, xbox_target, report); // Send an empty report or one with A cleared
+    lastShadow = shadow;
+    lastTransforms = transforms;
+    return sent;
 }
@@ -1,23 +1,57 @@
 #pragma once
 
-#include "CoreService/ViGEm/vigem_client.h" // Placeholder SDK header
+#include "GamepadSink.h"
+#include "OutputTargets.h"
 
+class AxisTransformSet;
+
+// The virtual gamepad as the mapping engine sees it.
+//
+// Actions update a shadow copy of the complete gamepad report; nothing is sent while they
+// are applied. Flush() then hands the whole report to the sink once per input frame, and
+// skips the sink entirely if the frame left the report unchanged. Every action therefore
+// sees the state left by earlier ones, and a frame that touches several buttons produces
+// a single update.
+//
+// The shadow holds axis values as the actions set them. The profile's axis transforms
+// (deadzones, curves and so on) are applied to a copy on the way out, so they never feed
+// back into what later actions see.
 class VirtualController {
 public:
-    VirtualController();
+    explicit VirtualController(GamepadSink& sink);
     ~VirtualController();
 
     bool Initialize();
     void Shutdown();
 
-    // Example: Simulate pressing button A on an Xbox 360 controller
-    void PressButtonA();
-    void ReleaseButtonA();
+    // Updates the shadow report. Targets that are not part of the gamepad (keyboard keys,
+    // mouse buttons and axes) are ignored here.
+    void SetButton(VirtualButtonType button, bool pressed) { SetButtons(GetButtonMask(button), pressed); }
+
+    // Presses or releases every button in `mask`, a set of GamepadButton bits.
+    void SetButtons(uint16_t mask, bool pressed);
+
+    // The report bit of `button`; 0 for targets that are not part of the gamepad.
+    static uint16_t GetButtonMask(VirtualButtonType button) {
+        const ButtonTarget& target = GetButtonTarget(button);
+        return target.device == OutputDevice::Gamepad ? target.code : 0;
+    }
+
+    // Stick values are clamped to -32768..32767 and trigger values to 0..255.
+    void SetAxis(VirtualAxisType axis, int value) { SetAxis(GetAxisTarget(axis), value); }
+    void SetAxis(const AxisTarget& target, int value);
+
+    // Sends the shadow report, shaped by `transforms` if given, if the result differs from
+    // what was last sent. Returns true if a report was sent.
+    bool Flush(const AxisTransformSet* transforms = nullptr);
 
-    // Add more methods for other buttons, axes, etc.
+    const GamepadReport& GetReport() const { return shadow; }
 
 private:
-    PVIGEM_CLIENT client;
-    PVIGEM_TARGET xbox_target; // Assuming an Xbox 360 target for now
+    GamepadSink& sink;
+    GamepadReport shadow;   // State being built up by the current frame
+    GamepadReport lastSent; // State the sink currently has
+    GamepadReport lastShadow; // Shadow as of the last flush, before transforms
+    const AxisTransformSet* lastTransforms = nullptr;
     bool initialized;
 };
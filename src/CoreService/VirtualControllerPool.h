@@ -0,0 +1,35 @@
+#pragma once
+
+#include "VirtualController.h"
+#include <array>
+#include <cstddef>
+
+// The virtual gamepads the mapping engine drives, by slot (player 1 is slot 0).
+//
+// Every controller keeps its own shadow report and is flushed on its own, to its own sink,
+// and all of them are only touched from the mapping thread. Nothing is shared between
+// slots, so sending to four pads takes four independent submissions and no lock. The pool
+// does not own the controllers.
+class VirtualControllerPool {
+public:
+    VirtualControllerPool() = default;
+    explicit VirtualControllerPool(VirtualController& controller) { Add(controller); }
+
+    // Gives `controller` the next slot. Returns false if every slot is taken.
+    bool Add(VirtualController& controller) {
+        if (count == controllers.size()) {
+            return false;
+        }
+        controllers[count++] = &controller;
+        return true;
+    }
+
+    size_t GetCount() const { return count; }
+
+    // nullptr for a slot without a controller.
+    VirtualController* Get(size_t slot) const { return slot < count ? controllers[slot] : nullptr; }
+
+private:
+    std::array<VirtualController*, MaxVirtualControllers> controllers{};
+    size_t count = 0;
+};
@@ -0,0 +1,70 @@
+#include "VirtualKeyboardMouse.h"
+#include "CoreService/Log.h"
+
+VirtualKeyboardMouse::VirtualKeyboardMouse(KeyboardMouseSink& sink) : sink(sink) {}
+
+void VirtualKeyboardMouse::SetButton(const ButtonTarget& target, bool pressed) {
+    if (target.device == OutputDevice::Keyboard) {
+        if (target.code == NoKey || target.code >= KeyCodeCount || keysDown[target.code] == pressed) {
+            return;
+        }
+        keysDown[target.code] = pressed;
+        Queue({ InjectedInput::Key, pressed, target.code });
+    } else if (target.device == OutputDevice::Mouse) {
+        if (target.code >= mouseButtonsDown.size() || mouseButtonsDown[target.code] == pressed) {
+            return;
+        }
+        mouseButtonsDown[target.code] = pressed;
+        Queue({ InjectedInput::MouseButton, pressed, target.code });
+    }
+}
+
+void VirtualKeyboardMouse::Move(const AxisTarget& target, int value) {
+    if (target.device != OutputDevice::Mouse || value == 0) {
+        return;
+    }
+    const auto axis = static_cast<MouseAxis>(target.code);
+    const auto kind = axis == MouseAxis::Wheel ? InjectedInput::MouseWheel : InjectedInput::MouseMove;
+
+    // Fold into the movement just queued, if that is where the last input went.
+    if (pendingCount != 0 && pending[pendingCount - 1].kind == kind) {
+        InjectedInput& last = pending[pendingCount - 1];
+        (axis == MouseAxis::X ? last.dx : last.dy) += value;
+        return;
+    }
+    InjectedInput input{ kind };
+    (axis == MouseAxis::X ? input.dx : input.dy) = value;
+    Queue(input);
+}
+
+void VirtualKeyboardMouse::Queue(const InjectedInput& input) {
+    if (pendingCount == pending.size()) {
+        Flush();
+    }
+    pending[pendingCount++] = input;
+}
+
+bool VirtualKeyboardMouse::Flush() {
+    if (pendingCount == 0) {
+        return false;
+    }
+    if (!sink.SubmitInputs(pending.data(), pendingCount)) {
+        LOG_WARNING("Injecting {} keyboard/mouse inputs failed.", pendingCount);
+    }
+    pendingCount = 0;
+    return true;
+}
+
+void VirtualKeyboardMouse::ReleaseAll() {
+    for (size_t code = 0; code < keysDown.size(); ++code) {
+        if (keysDown[code]) {
+            SetButton({ OutputDevice::Keyboard, static_cast<uint16_t>(code) }, false);
+        }
+    }
+    for (size_t button = 0; button < mouseButtonsDown.size(); ++button) {
+        if (mouseButtonsDown[button]) {
+            SetButton({ OutputDevice::Mouse, static_cast<uint16_t>(button) }, false);
+        }
+    }
+    Flush();
+}
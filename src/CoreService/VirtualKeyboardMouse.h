@@ -0,0 +1,51 @@
+#pragma once
+
+#include "KeyboardMouseSink.h"
+#include "OutputTargets.h"
+#include <array>
+#include <bitset>
+
+// The keyboard and mouse outputs as the mapping engine sees them.
+//
+// Like VirtualController, applying an action sends nothing: key and mouse button changes and
+// mouse movement are queued, and Flush() hands the whole frame's worth to the sink as one
+// batch (one SendInput call on Windows). Repeated presses of a key that is already down and
+// releases of one that is up are dropped, and consecutive moves of the mouse or its wheel are
+// summed into one input. Only touched from the mapping thread.
+//
+// Input injected this way comes back through Raw Input without a device handle, and the
+// decoder drops it, so the mapping engine never sees its own output.
+class VirtualKeyboardMouse {
+public:
+    explicit VirtualKeyboardMouse(KeyboardMouseSink& sink);
+
+    // Presses or releases a Keyboard or Mouse target; other targets are ignored.
+    void SetButton(const ButtonTarget& target, bool pressed);
+
+    // Moves the mouse or turns its wheel by `value` (see InjectedInput for the units) if
+    // `target` is a Mouse axis; other targets are ignored. Mouse axes are relative, so unlike
+    // a stick nothing is held: each call is one movement, and 0 does nothing.
+    void Move(const AxisTarget& target, int value);
+
+    // Sends everything queued since the last flush as a single batch. Returns true if there
+    // was anything to send.
+    bool Flush();
+
+    // Releases every key and mouse button still down and sends the result, so nothing stays
+    // stuck when the service stops.
+    void ReleaseAll();
+
+    // The most inputs one batch holds. A frame that queues more sends them in several.
+    static constexpr size_t MaxPendingInputs = 64;
+
+private:
+    KeyboardMouseSink& sink;
+    std::array<InjectedInput, MaxPendingInputs> pending;
+    size_t pendingCount = 0;
+
+    // What the injected inputs have left down, to drop repeats and for ReleaseAll.
+    std::bitset<KeyCodeCount> keysDown;
+    std::bitset<static_cast<size_t>(MouseButtonId::Count)> mouseButtonsDown;
+
+    void Queue(const InjectedInput& input);
+};
@@ -0,0 +1,3252 @@
+// Replays an input stream through ProfileManager -> MappingEngine -> VirtualController
+// with a recording gamepad sink, and reports how fast the pipeline runs.
+//
+// It needs no window, driver or hardware, so it builds and runs on any platform. The
+// stream is either a capture recorded by the service (CoreService --record <file>) or a
+// synthetic, seeded one. The reports the controller sends can be written to a golden file
+// and compared against it on later runs, which catches mapping regressions as well as
+// speed regressions.
+//
+// Usage: CoreServiceBench [options]
+//   --capture <file>        Replay a recorded capture
+//   --synthetic <frames>    Generate a stream of this many frames (default 100000)
+//   --seed <n>              Seed for the synthetic stream (default 1)
+//   --save-capture <file>   Write the stream that was replayed
+//   --profile <file>        Load the rules from a profile instead of the built-in set
+//   --extra-rules <n>       Add n rules on unused inputs to the built-in set (default 0)
+//   --all-matches           Run every matching rule instead of the first one
+//   --realtime              Pace the replay by the event timestamps
+//   --repeat <n>            Replay the stream n times and report the best run (default 5)
+//   --swap-profile          Keep re-activating the profile from another thread during the
+//                           first run; the output must still match the golden file
+//   --golden <file>         Compare the sent reports with a golden file; exit code 1 on a mismatch
+//   --write-golden <file>   Write the sent reports to a golden file
+//   --macros <n>            Also run n repeating macros at once, first against a virtual clock
+//                           (step count must be exact) and then on the scheduler thread for a
+//                           second, and report how late their steps ran
+//   --check-axes <n>        Also run n random reports through random axis transform sets and
+//                           check that the SIMD, scalar and reference versions agree exactly
+//   --mouse <seconds>       Also run a synthetic mouse stream of this length through the
+//                           mouse-to-stick filter at 8000, 1000, 500, 250 and 125 Hz polling
+//                           and compare the stick output, then drive it for one second through
+//                           the real mapping worker and scheduler threads
+//   --raw-input <n>         Also pack n synthetic keyboard, mouse and HID inputs into buffers the
+//                           way GetRawInputBuffer does, walk and decode them in place and check
+//                           the events; truncated buffers must end the walk cleanly
+//   --hid <n>               Also parse the Xbox 360, Xbox One, DualShock 4, DualSense and generic
+//                           report descriptors in HidFixtures.h, check the plans against their
+//                           hand-written layouts and sample reports, then decode n random
+//                           reports per controller against the layouts
+//   --states <n>            Also check that a pad's state store reports sticks let go, held
+//                           still and released where they stopped, then run n reports of random
+//                           stick glides, noise, buttons and hats through it and check that a
+//                           mirror built from its events stays within the axis deadband
+//   --ring <n>              Also pass n items between two threads through an SPSC ring in random
+//                           batch sizes and check that none is lost, repeated or reordered, then
+//                           push one batch of frames four times the mapping worker's queue and
+//                           check that every frame reaches the controller
+//   --log-threads <n>       Also log from n short-lived threads, eight at a time, and check that
+//                           every exited thread's log ring is drained and freed
+//   --gestures <n>          Also play scripted tap, long-press, double-tap, release and chord
+//                           scenarios against a virtual clock and check the output, then time
+//                           key events with n extra chord rules in the profile against none
+//   --layers <n>            Also play scripted momentary, toggle and one-shot layer scenarios,
+//                           then n random presses, releases and layer switches, after which
+//                           letting go of everything must leave no button pressed
+//   --turbo <n>             Also play scripted turbo, toggle, release-binding and profile
+//                           switch scenarios against a virtual clock, then time n output ticks
+//                           with one turbo button held against every gamepad button held in turbo
+//   --pads <n>              Also check routing to four virtual controllers by device, by slot,
+//                           by auto-assignment and from macros, then time n random events from
+//                           four devices fanned out to the four controllers
+//   --outputs <n>           Also check that every virtual button and axis lands on its report
+//                           bit or field, and that keyboard and mouse output is batched per
+//                           frame, then time n random events across all three outputs
+//   --batches <n>           Also cut n synthetic frames into event batches of every size, check
+//                           their column scans and that mapping them batch by batch sends the
+//                           same reports as event by event, then time finding one button's
+//                           events by column against a loop over whole events
+//   --devices <n>           Also run n random device arrivals, lookups and removals through the
+//                           device registry against a hash map, check VID/PID parsing, rules
+//                           bound to a model and the release of a removed device's seat, then
+//                           time handle lookups against a hash map
+//   --device-list <n>       Also run n random device arrivals, removals and renames through the
+//                           device table, some notified and all seen by full sweeps that race
+//                           with the notifications, and check the table and the changes each
+//                           sweep reports against a reference; then time an unchanged sweep
+//   --startup <n>           Also run a random graph of n sleeping startup stages, some failing and
+//                           some bound to the calling thread, through the startup orchestrator,
+//                           check the order, threads and skips, and compare the wall time with
+//                           the sum of the stages and their critical path
+//   --library <n>           Also write n profiles to a temporary directory and index them with
+//                           the profile library: check the names, that rescans and a restart
+//                           from the saved index read only new and changed files, that names
+//                           come from compiled images when current, that SaveProfile writes the
+//                           name first, that activations go through the LRU cache, which
+//                           notices a same-size edit that kept the write time, and that a
+//                           compiled profile's rules are shared with the engine; time the scans
+//                           against loading every profile in full
+
+#include "CoreService/BinaryProfile.h"
+#include "CoreService/Clock.h"
+#include "CoreService/DeviceRegistry.h"
+#include "CoreService/DeviceTable.h"
+#include "CoreService/InputCapture.h"
+#include "CoreService/Mapping/AxisTransform.h"
+#include "CoreService/Mapping/DeviceStateStore.h"
+#include "CoreService/Mapping/HidReportDescriptor.h"
+#include "CoreService/Log.h"
+#include "CoreService/MacroScheduler.h"
+#include "CoreService/MappingEngine.h"
+#include "CoreService/MappingWorker.h"
+#include "CoreService/ProfileLibrary.h"
+#include "CoreService/ProfileManager.h"
+#include "CoreService/RawInputBatch.h"
+#include "CoreService/SpscRing.h"
+#include "CoreService/StartupOrchestrator.h"
+#include "CoreService/VirtualController.h"
+#include "CoreService/VirtualControllerPool.h"
+#include "CoreService/VirtualKeyboardMouse.h"
+#include "HidFixtures.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h> // For _aligned_malloc
+#endif
+
+// Every heap allocation in the process goes through these, so the benchmark can report how
+// many happened while events were being mapped. The hot path should not allocate at all.
+// The whole set is replaced, aligned and array forms included, so that every delete frees
+// memory the matching new got from the same allocator.
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+    std::atomic<uint64_t> allocationCount{ 0 };
+
+    void* Allocate(std::size_t size) noexcept {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void* AllocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        const std::size_t align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants a size that is a multiple of the alignment.
+        size = (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1);
+#ifdef _WIN32
+        return _aligned_malloc(size, align);
+#else
+        return std::aligned_alloc(align, size);
+#endif
+    }
+
+    // Not inlined: once a delete is inlined into its caller, GCC sees free() called on a
+    // pointer from operator new and warns (-Wmismatched-new-delete), though both are ours.
+    BENCH_NOINLINE void Free(void* p) noexcept {
+        std::free(p);
+    }
+
+    BENCH_NOINLINE void FreeAligned(void* p) noexcept {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = Allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = AllocateAligned(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+void operator delete(void* p, std::size_t) noexcept { Free(p); }
+void operator delete[](void* p, std::size_t) noexcept { Free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(p); }
+
+namespace {
+    struct Options {
+        std::string capturePath;
+        std::string saveCapturePath;
+        std::string profilePath;
+        std::string goldenPath;
+        std::string writeGoldenPath;
+        size_t syntheticFrames = 100000;
+        uint64_t seed = 1;
+        size_t extraRules = 0;
+        size_t macros = 0;
+        size_t axisChecks = 0;
+        double mouseSeconds = 0.0;
+        size_t rawInputs = 0;
+        size_t hidReports = 0;
+        size_t stateReports = 0;
+        size_t ringItems = 0;
+        size_t logThreads = 0;
+        size_t gestureCombos = 0;
+        size_t layerEvents = 0;
+        size_t turboTicks = 0;
+        size_t padEvents = 0;
+        size_t outputEvents = 0;
+        size_t batchFrames = 0;
+        size_t deviceSteps = 0;
+        size_t deviceListSteps = 0;
+        size_t startupStages = 0;
+        size_t libraryProfiles = 0;
+        int repeat = 5;
+        bool realtime = false;
+        bool allMatches = false;
+        bool swapProfile = false;
+    };
+
+    bool ParseOptions(int argc, char* argv[], Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--capture" && hasValue) {
+                options.capturePath = argv[++i];
+            } else if (arg == "--synthetic" && hasValue) {
+                options.syntheticFrames = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--save-capture" && hasValue) {
+                options.saveCapturePath = argv[++i];
+            } else if (arg == "--profile" && hasValue) {
+                options.profilePath = argv[++i];
+            } else if (arg == "--extra-rules" && hasValue) {
+                options.extraRules = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--macros" && hasValue) {
+                options.macros = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--check-axes" && hasValue) {
+                options.axisChecks = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--mouse" && hasValue) {
+                options.mouseSeconds = std::atof(argv[++i]);
+            } else if (arg == "--raw-input" && hasValue) {
+                options.rawInputs = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--hid" && hasValue) {
+                options.hidReports = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--states" && hasValue) {
+                options.stateReports = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--ring" && hasValue) {
+                options.ringItems = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--log-threads" && hasValue) {
+                options.logThreads = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--gestures" && hasValue) {
+                options.gestureCombos = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--pads" && hasValue) {
+                options.padEvents = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--outputs" && hasValue) {
+                options.outputEvents = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--batches" && hasValue) {
+                options.batchFrames = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--devices" && hasValue) {
+                options.deviceSteps = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--device-list" && hasValue) {
+                options.deviceListSteps = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--library" && hasValue) {
+                options.libraryProfiles = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--startup" && hasValue) {
+                options.startupStages = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--turbo" && hasValue) {
+                options.turboTicks = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--layers" && hasValue) {
+                options.layerEvents = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--repeat" && hasValue) {
+                options.repeat = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--golden" && hasValue) {
+                options.goldenPath = argv[++i];
+            } else if (arg == "--write-golden" && hasValue) {
+                options.writeGoldenPath = argv[++i];
+            } else if (arg == "--realtime") {
+                options.realtime = true;
+            } else if (arg == "--all-matches") {
+                options.allMatches = true;
+            } else if (arg == "--swap-profile") {
+                options.swapProfile = true;
+            } else {
+                std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A small xorshift generator, so synthetic streams are identical on every platform.
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed != 0 ? seed : 1) {}
+
+        uint64_t Next() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        uint32_t Below(uint32_t bound) { return static_cast<uint32_t>(Next() % bound); }
+
+    private:
+        uint64_t state;
+    };
+
+    constexpr size_t SyntheticDevices = 2;
+    constexpr ButtonID SyntheticButtons = 16;
+    constexpr AxisID SyntheticAxes = 6;
+
+    // Frames of one to three changes on two pads, one frame per millisecond, roughly like a
+    // player mashing buttons while moving both sticks.
+    std::vector<InputEvent> MakeSyntheticStream(size_t frames, uint64_t seed) {
+        Random random(seed);
+        std::vector<InputEvent> events;
+        events.reserve(frames * 4);
+
+        bool pressed[SyntheticDevices][SyntheticButtons] = {};
+        uint64_t timestamp = 0;
+        for (size_t frame = 0; frame < frames; ++frame, timestamp += 1000000) {
+            const size_t device = random.Below(SyntheticDevices);
+            const auto deviceIndex = static_cast<DeviceIndex>(device);
+            const uint32_t changes = 1 + random.Below(3);
+            for (uint32_t i = 0; i < changes; ++i) {
+                if (random.Below(2) == 0) {
+                    const auto button = static_cast<ButtonID>(random.Below(SyntheticButtons));
+                    pressed[device][button] = !pressed[device][button];
+                    events.push_back(InputEvent::Button(deviceIndex, InputType::Button, button, pressed[device][button], timestamp));
+                } else {
+                    const auto axis = static_cast<AxisID>(random.Below(SyntheticAxes));
+                    const int value = static_cast<int>(random.Below(65536)) - 32768;
+                    events.push_back(InputEvent::Axis(deviceIndex, InputType::Axis, axis, value, timestamp));
+                }
+            }
+            InputEvent marker;
+            marker.timestamp = timestamp;
+            events.push_back(marker);
+        }
+        return events;
+    }
+
+    OutputAction ButtonAction(VirtualButtonType button) {
+        return OutputAction{ VirtualButtonAction{ button, true } };
+    }
+
+    OutputAction AxisAction(VirtualAxisType axis) {
+        return OutputAction{ VirtualAxisAction{ axis, -1 } }; // -1 = use the source value
+    }
+
+    // The synthetic buttons and axes mapped onto a pad, plus `extraRules` rules on IDs the
+    // stream never uses, to see how the engine scales with profile size.
+    Profile MakeBuiltInProfile(size_t extraRules) {
+        static const VirtualButtonType Buttons[SyntheticButtons] = {
+            VirtualButtonType::XBOX_A, VirtualButtonType::XBOX_B, VirtualButtonType::XBOX_X, VirtualButtonType::XBOX_Y,
+            VirtualButtonType::XBOX_LEFT_SHOULDER, VirtualButtonType::XBOX_RIGHT_SHOULDER,
+            VirtualButtonType::XBOX_BACK, VirtualButtonType::XBOX_START,
+            VirtualButtonType::XBOX_LEFT_THUMB, VirtualButtonType::XBOX_RIGHT_THUMB,
+            VirtualButtonType::XBOX_DPAD_UP, VirtualButtonType::XBOX_DPAD_DOWN,
+            VirtualButtonType::XBOX_DPAD_LEFT, VirtualButtonType::XBOX_DPAD_RIGHT,
+            VirtualButtonType::XBOX_GUIDE, VirtualButtonType::XBOX_A,
+        };
+        static const VirtualAxisType Axes[SyntheticAxes] = {
+            VirtualAxisType::XBOX_LEFT_STICK_X, VirtualAxisType::XBOX_LEFT_STICK_Y,
+            VirtualAxisType::XBOX_RIGHT_STICK_X, VirtualAxisType::XBOX_RIGHT_STICK_Y,
+            VirtualAxisType::XBOX_LEFT_TRIGGER, VirtualAxisType::XBOX_RIGHT_TRIGGER,
+        };
+
+        Profile profile("Built-in benchmark profile");
+        for (ButtonID button = 0; button < SyntheticButtons; ++button) {
+            profile.AddMapping(MappingRule(InputCondition::OnButtonPress(button), { ButtonAction(Buttons[button]) }));
+        }
+        for (AxisID axis = 0; axis < SyntheticAxes; ++axis) {
+            profile.AddMapping(MappingRule(InputCondition::OnAxisMove(axis), { AxisAction(Axes[axis]) }));
+        }
+        for (size_t i = 0; i < extraRules; ++i) {
+            const auto button = static_cast<ButtonID>(SyntheticButtons + i % (0x10000 - SyntheticButtons));
+            profile.AddMapping(MappingRule(InputCondition::OnButtonPress(button), { ButtonAction(VirtualButtonType::XBOX_B) }));
+        }
+        return profile;
+    }
+
+    // Golden files: magic "GPRP", uint32 count, then count reports of 12 bytes, little-endian,
+    // in GamepadReport field order.
+    constexpr uint32_t GoldenMagic = 0x50525047; // "GPRP"
+
+    bool WriteGolden(const std::string& path, const std::vector<GamepadReport>& reports) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open golden file for writing: " << path << std::endl;
+            return false;
+        }
+        const uint32_t count = static_cast<uint32_t>(reports.size());
+        file.write(reinterpret_cast<const char*>(&GoldenMagic), sizeof(GoldenMagic));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& report : reports) {
+            const int16_t thumbs[4] = { report.thumbLX, report.thumbLY, report.thumbRX, report.thumbRY };
+            file.write(reinterpret_cast<const char*>(&report.buttons), sizeof(report.buttons));
+            file.put(static_cast<char>(report.leftTrigger));
+            file.put(static_cast<char>(report.rightTrigger));
+            file.write(reinterpret_cast<const char*>(thumbs), sizeof(thumbs));
+        }
+        return file.good();
+    }
+
+    bool ReadGolden(const std::string& path, std::vector<GamepadReport>& reports) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t magic = 0, count = 0;
+        if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != GoldenMagic ||
+            !file.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+            std::cerr << "Error: " << path << " is not a golden report file." << std::endl;
+            return false;
+        }
+        reports.resize(count);
+        for (auto& report : reports) {
+            char triggers[2];
+            int16_t thumbs[4];
+            file.read(reinterpret_cast<char*>(&report.buttons), sizeof(report.buttons));
+            file.read(triggers, 2);
+            file.read(reinterpret_cast<char*>(thumbs), sizeof(thumbs));
+            report.leftTrigger = static_cast<uint8_t>(triggers[0]);
+            report.rightTrigger = static_cast<uint8_t>(triggers[1]);
+            report.thumbLX = thumbs[0];
+            report.thumbLY = thumbs[1];
+            report.thumbRX = thumbs[2];
+            report.thumbRY = thumbs[3];
+        }
+        if (!file) {
+            std::cerr << "Error: Golden file " << path << " is truncated." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void PrintReport(const char* label, const GamepadReport& report) {
+        std::cout << "  " << label << ": buttons=0x" << std::hex << report.buttons << std::dec
+                  << " lt=" << int(report.leftTrigger) << " rt=" << int(report.rightTrigger)
+                  << " lx=" << report.thumbLX << " ly=" << report.thumbLY
+                  << " rx=" << report.thumbRX << " ry=" << report.thumbRY << std::endl;
+    }
+
+    bool CompareWithGolden(const std::vector<GamepadReport>& actual, const std::vector<GamepadReport>& golden) {
+        const size_t common = std::min(actual.size(), golden.size());
+        for (size_t i = 0; i < common; ++i) {
+            if (actual[i] != golden[i]) {
+                std::cout << "Golden mismatch at report " << i << ":" << std::endl;
+                PrintReport("expected", golden[i]);
+                PrintReport("actual  ", actual[i]);
+                return false;
+            }
+        }
+        if (actual.size() != golden.size()) {
+            std::cout << "Golden mismatch: expected " << golden.size() << " reports, got " << actual.size() << "." << std::endl;
+            return false;
+        }
+        std::cout << "Output matches golden file (" << golden.size() << " reports)." << std::endl;
+        return true;
+    }
+
+    struct RunResult {
+        uint64_t elapsedNs = 0;
+        uint64_t allocations = 0;
+    };
+
+    // Runs the stream once, the same way MappingWorker dispatches it.
+    RunResult Replay(MappingEngine& engine, const std::vector<InputEvent>& events, bool realtime) {
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const uint64_t start = MonotonicNanoseconds();
+        const uint64_t streamStart = events.empty() ? 0 : events.front().timestamp;
+
+        if (!realtime) {
+            // In queue-sized pieces, copied into a batch and processed as one, frames
+            // crossing from one piece into the next included.
+            InputEventBatch batch;
+            for (size_t begin = 0; begin < events.size(); begin += MappingWorker::BatchSize) {
+                batch.Clear();
+                batch.Append(events.data() + begin, std::min(MappingWorker::BatchSize, events.size() - begin));
+                engine.ProcessBatch(batch);
+            }
+        }
+        for (size_t i = 0; realtime && i < events.size(); ++i) {
+            const InputEvent& event = events[i];
+            const uint64_t due = start + (event.timestamp - streamStart);
+            for (uint64_t now = MonotonicNanoseconds(); now < due; now = MonotonicNanoseconds()) {
+                if (due - now > 1000000) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 1000000));
+                }
+            }
+            if (event.type == InputType::Unknown) {
+                engine.EndFrame();
+            } else {
+                engine.ProcessInput(event);
+            }
+        }
+
+        RunResult result;
+        result.elapsedNs = MonotonicNanoseconds() - start;
+        result.allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        return result;
+    }
+
+    // Counts macro steps instead of applying them.
+    class CountingMacroOutput : public MacroOutput {
+    public:
+        void PostStep(const MacroStep&) override { steps.fetch_add(1, std::memory_order_relaxed); }
+        void EndSteps() override {}
+
+        std::atomic<uint64_t> steps{ 0 };
+    };
+
+    // Taps A every 10 ms for as long as the trigger is held.
+    MacroProgram* MakeTapProgram() {
+        MacroDefinition tap;
+        tap.name = "tap";
+        tap.repeatWhileHeld = true;
+        tap.steps = { { MacroStep::Press, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_A), 0 },
+                      { MacroStep::Delay, 0, 0, 5000 },
+                      { MacroStep::Release, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_A), 0 },
+                      { MacroStep::Delay, 0, 0, 5000 } };
+        return new MacroProgram({ tap });
+    }
+
+    // Returns false if the virtual-clock run did not produce exactly the expected steps.
+    bool RunMacroBench(size_t count) {
+        constexpr uint64_t RunNs = 1'000'000'000;
+        constexpr uint64_t StepsPerTriggerPerSecond = 200; // One press and one release per 10 ms
+        const size_t triggers = std::min(count, MacroRunner::MaxInstances);
+        const MacroProgram* program = MakeTapProgram();
+        bool ok = true;
+
+        // Virtual clock: every step must land on schedule, so the count is exact. Each
+        // trigger is released just before its 100th tap would start.
+        {
+            CountingMacroOutput output;
+            MacroScheduler scheduler(output, 0);
+            for (size_t i = 0; i < triggers; ++i) {
+                scheduler.StartMacro(*program, 0, i, 1);
+            }
+            for (uint64_t now = 1; now <= RunNs; now += 50'000) {
+                scheduler.Poll(now);
+                if (now + 50'000 > RunNs) {
+                    for (size_t i = 0; i < triggers; ++i) {
+                        scheduler.ReleaseTrigger(i);
+                    }
+                }
+            }
+            scheduler.Poll(RunNs + 20'000'000);
+            const uint64_t expected = triggers * StepsPerTriggerPerSecond;
+            std::cout << "Macros (virtual clock): " << output.steps.load() << " steps from " << triggers
+                      << " macros, expected " << expected << std::endl;
+            ok = output.steps.load() == expected;
+        }
+
+        // Real clock, on the scheduler thread.
+        {
+            CountingMacroOutput output;
+            MacroScheduler scheduler(output, MonotonicNanoseconds());
+            scheduler.Start();
+            const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < triggers; ++i) {
+                scheduler.StartMacro(*program, 0, i, MonotonicNanoseconds());
+            }
+            std::this_thread::sleep_for(std::chrono::nanoseconds(RunNs));
+            for (size_t i = 0; i < triggers; ++i) {
+                scheduler.ReleaseTrigger(i);
+            }
+            const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            scheduler.Stop();
+            std::cout << "Macros (scheduler thread): " << output.steps.load() << " steps in 1 s, " << allocations
+                      << " allocations" << std::endl;
+            scheduler.DumpStats(std::cout);
+        }
+
+        program->Release();
+        return ok;
+    }
+
+    float RandomUnit(Random& random) {
+        return static_cast<float>(random.Below(1u << 24)) / static_cast<float>(1u << 24);
+    }
+
+    // A random transform on a random gamepad axis, favouring the edge cases: no deadzone,
+    // deadzones near full deflection and sensitivities that saturate.
+    AxisTransform MakeRandomTransform(Random& random) {
+        AxisTransform transform;
+        transform.axis = static_cast<VirtualAxisType>(random.Below(6));
+        transform.radialDeadzone = random.Below(3) == 0 ? RandomUnit(random) * 0.5f : 0.0f;
+        transform.deadzone = random.Below(2) == 0 ? RandomUnit(random) * 0.5f : 0.0f;
+        transform.antiDeadzone = random.Below(3) == 0 ? RandomUnit(random) * 0.3f : 0.0f;
+        switch (random.Below(3)) {
+            case 0:
+                break;
+            case 1:
+                transform.curve = AxisTransform::Curve::Exponential;
+                transform.exponent = 0.25f + RandomUnit(random) * 3.0f;
+                break;
+            default:
+                transform.curve = AxisTransform::Curve::Custom;
+                transform.points.resize(2 + random.Below(9));
+                for (auto& point : transform.points) {
+                    point = RandomUnit(random);
+                }
+                break;
+        }
+        transform.sensitivity = random.Below(2) == 0 ? 0.25f + RandomUnit(random) * 2.0f : 1.0f;
+        transform.invert = random.Below(4) == 0;
+        return transform;
+    }
+
+    GamepadReport MakeRandomReport(Random& random) {
+        GamepadReport report;
+        report.buttons = static_cast<uint16_t>(random.Next());
+        report.leftTrigger = static_cast<uint8_t>(random.Next());
+        report.rightTrigger = static_cast<uint8_t>(random.Next());
+        report.thumbLX = static_cast<int16_t>(random.Next());
+        report.thumbLY = static_cast<int16_t>(random.Next());
+        report.thumbRX = static_cast<int16_t>(random.Next());
+        report.thumbRY = static_cast<int16_t>(random.Next());
+        return report;
+    }
+
+    // Returns false if the three axis transform versions disagree on any report.
+    bool RunAxisCheck(size_t count, uint64_t seed) {
+        constexpr size_t ReportsPerSet = 64;
+        Random random(seed);
+        std::vector<GamepadReport> reports(ReportsPerSet);
+        uint64_t scalarNs = 0;
+        uint64_t simdNs = 0;
+
+        for (size_t checked = 0; checked < count; checked += ReportsPerSet) {
+            std::vector<AxisTransform> transforms(1 + random.Below(6));
+            for (auto& transform : transforms) {
+                transform = MakeRandomTransform(random);
+            }
+            const AxisTransformSet set(transforms);
+            for (auto& report : reports) {
+                report = MakeRandomReport(random);
+            }
+
+            std::vector<GamepadReport> scalar = reports;
+            std::vector<GamepadReport> simd = reports;
+            uint64_t start = MonotonicNanoseconds();
+            for (auto& report : scalar) {
+                set.ApplyScalar(report);
+            }
+            scalarNs += MonotonicNanoseconds() - start;
+            start = MonotonicNanoseconds();
+            for (auto& report : simd) {
+                set.ApplySimd(report);
+            }
+            simdNs += MonotonicNanoseconds() - start;
+
+            for (size_t i = 0; i < reports.size(); ++i) {
+                GamepadReport reference = reports[i];
+                AxisTransformSet::ApplyReference(transforms, reference);
+                if (scalar[i] != reference || simd[i] != reference) {
+                    std::cout << "Axis transform mismatch after " << checked + i << " reports:" << std::endl;
+                    PrintReport("input    ", reports[i]);
+                    PrintReport("reference", reference);
+                    PrintReport("scalar   ", scalar[i]);
+                    PrintReport("simd     ", simd[i]);
+                    return false;
+                }
+            }
+        }
+
+        const size_t total = (count + ReportsPerSet - 1) / ReportsPerSet * ReportsPerSet;
+        auto perReport = [total](uint64_t ns) { return static_cast<double>(ns) / static_cast<double>(total); };
+        std::cout << "Axis transforms: " << total << " reports identical, scalar " << perReport(scalarNs) << " ns, "
+                  << (AxisTransformSet::HasSimd() ? "SIMD " : "SIMD (scalar fallback) ") << perReport(simdNs)
+                  << " ns per report" << std::endl;
+        return true;
+    }
+
+    // Where a synthetic mouse is, in counts, sampled at MouseTraceHz. It sweeps around at up
+    // to about 6000 counts/s with the speed always changing, and rests for 200 ms of every
+    // second so the stick has to settle back to center.
+    constexpr uint32_t MouseTraceHz = 64000;
+
+    std::vector<std::pair<double, double>> MakeMouseTrace(double seconds) {
+        const size_t samples = static_cast<size_t>(seconds * MouseTraceHz);
+        std::vector<std::pair<double, double>> trace(samples + 1);
+        const double dt = 1.0 / MouseTraceHz;
+        double x = 0.0;
+        double y = 0.0;
+        for (size_t i = 1; i <= samples; ++i) {
+            const double t = static_cast<double>(i) * dt;
+            const double moving = std::fmod(t, 1.0) < 0.8 ? 1.0 : 0.0;
+            x += moving * (4000.0 * std::sin(2.0 * 3.14159265 * 0.7 * t) + 1500.0 * std::sin(2.0 * 3.14159265 * 5.3 * t)) * dt;
+            y += moving * (2500.0 * std::cos(2.0 * 3.14159265 * 0.45 * t) + 800.0 * std::sin(2.0 * 3.14159265 * 7.1 * t)) * dt;
+            trace[i] = { x, y };
+        }
+        return trace;
+    }
+
+    struct MouseTraceResult {
+        std::vector<MouseStickFilter::Output> outputs; // One per tick
+        uint64_t elapsedNs = 0;                        // In MouseStickFilter::Tick
+        uint64_t allocations = 0;
+    };
+
+    // Runs the trace through a filter as a mouse polled at `pollHz` would report it (whole
+    // counts, as of its latest report), with one output tick per millisecond.
+    MouseTraceResult RunMouseTrace(const std::vector<std::pair<double, double>>& trace, uint32_t pollHz,
+                                   const MouseStickSettings& settings) {
+        constexpr uint32_t TickHz = 1000;
+        const size_t samplesPerReport = MouseTraceHz / pollHz;
+        const size_t samplesPerTick = MouseTraceHz / TickHz;
+        MouseStickFilter filter(settings);
+        MouseTraceResult result;
+        result.outputs.reserve(trace.size() / samplesPerTick);
+
+        int64_t previousX = 0;
+        int64_t previousY = 0;
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        for (size_t sample = samplesPerTick; sample < trace.size(); sample += samplesPerTick) {
+            const size_t lastReport = sample / samplesPerReport * samplesPerReport;
+            const int64_t x = static_cast<int64_t>(std::floor(trace[lastReport].first));
+            const int64_t y = static_cast<int64_t>(std::floor(trace[lastReport].second));
+            const uint64_t start = MonotonicNanoseconds();
+            result.outputs.push_back(filter.Tick(static_cast<int32_t>(x - previousX), static_cast<int32_t>(y - previousY),
+                                                 1'000'000'000 / TickHz));
+            result.elapsedNs += MonotonicNanoseconds() - start;
+            previousX = x;
+            previousY = y;
+        }
+        result.allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        return result;
+    }
+
+    // Drives mouse-to-stick for one second through the worker and scheduler threads, the way
+    // the service runs it, with a mouse reporting at 8 kHz from this thread.
+    void RunThreadedMouse(MappingEngine& engine, RecordingGamepadSink& sink, const MouseStickSettings& settings) {
+        engine.LoadMappings({}, {}, {}, settings);
+        MappingWorker worker(engine);
+        MacroScheduler scheduler(worker, MonotonicNanoseconds());
+        engine.SetMacroScheduler(&scheduler);
+        sink.Clear();
+        sink.Reserve(4000); // Recording the output must not count as allocations
+        worker.Start();
+        scheduler.Start();
+        // Thread start-up allocates; let both threads get going before counting.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const uint64_t start = MonotonicNanoseconds();
+        uint64_t reports = 0;
+        for (uint64_t due = start; due < start + 1'000'000'000; due += 125'000) {
+            while (MonotonicNanoseconds() < due) {
+                std::this_thread::yield();
+            }
+            const double t = static_cast<double>(due - start) * 1e-9;
+            worker.PushMouseDelta(static_cast<int32_t>(std::lround(3.0 * std::sin(6.0 * t))), 1);
+            ++reports;
+        }
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+        scheduler.Stop();
+        worker.Stop();
+        engine.SetMacroScheduler(nullptr);
+        std::cout << "Mouse stick (threads): " << reports << " mouse reports, " << sink.GetReports().size()
+                  << " gamepad reports in 1 s, " << allocations << " allocations" << std::endl;
+    }
+
+    // Mean change of the stick from one tick to the next: how rough the output is.
+    double MeasureRoughness(const std::vector<MouseStickFilter::Output>& outputs) {
+        double sum = 0.0;
+        for (size_t i = 1; i < outputs.size(); ++i) {
+            sum += std::abs(outputs[i].x - outputs[i - 1].x) + std::abs(outputs[i].y - outputs[i - 1].y);
+        }
+        return outputs.size() > 1 ? sum / static_cast<double>(outputs.size() - 1) : 0.0;
+    }
+
+    void RunMouseBench(double seconds, MappingEngine& engine, RecordingGamepadSink& sink) {
+        MouseStickSettings settings;
+        settings.enabled = true;
+        settings.windowMs = 8.0f; // Covers a 125 Hz mouse
+        settings.smoothing = MouseStickSettings::Smoothing::OneEuro;
+        settings.decayMs = 20.0f;
+        const auto trace = MakeMouseTrace(seconds);
+
+        const MouseTraceResult reference = RunMouseTrace(trace, 8000, settings);
+        std::cout << "Mouse stick (8000 Hz mouse, 1000 Hz output): " << reference.outputs.size() << " ticks, "
+                  << static_cast<double>(reference.elapsedNs) / static_cast<double>(std::max<size_t>(reference.outputs.size(), 1))
+                  << " ns per tick, " << reference.allocations << " allocations, roughness "
+                  << MeasureRoughness(reference.outputs) << std::endl;
+
+        // The capture side's share: two atomic adds per mouse report.
+        {
+            MappingWorker worker(engine);
+            constexpr int Reports = 1'000'000;
+            const uint64_t start = MonotonicNanoseconds();
+            for (int i = 0; i < Reports; ++i) {
+                worker.PushMouseDelta(i & 7, -(i & 3));
+            }
+            std::cout << "  Per mouse report: " << static_cast<double>(MonotonicNanoseconds() - start) / Reports << " ns" << std::endl;
+        }
+
+        // The same movement polled more slowly should give nearly the same stick, lagging by
+        // at most one polling interval, and no rougher.
+        for (uint32_t pollHz : { 1000u, 500u, 250u, 125u }) {
+            const std::vector<MouseStickFilter::Output> outputs = RunMouseTrace(trace, pollHz, settings).outputs;
+            const size_t common = std::min(outputs.size(), reference.outputs.size());
+            double sum = 0.0;
+            int worst = 0;
+            for (size_t i = 0; i < common; ++i) {
+                const int diff = std::max(std::abs(outputs[i].x - reference.outputs[i].x), std::abs(outputs[i].y - reference.outputs[i].y));
+                sum += diff;
+                worst = std::max(worst, diff);
+            }
+            std::cout << "  " << pollHz << " Hz mouse: mean difference " << (common != 0 ? sum / static_cast<double>(common) : 0.0)
+                      << ", max " << worst << " (of 32767), roughness " << MeasureRoughness(outputs) << std::endl;
+        }
+
+        RunThreadedMouse(engine, sink, settings);
+    }
+
+    // Writes one record at `offset` the way GetRawInputBuffer packs them and returns where the
+    // next one goes.
+    size_t PackRecord(unsigned char* buffer, size_t offset, uint32_t type, PhysicalDeviceID device, const void* payload, size_t payloadBytes) {
+        const RawInputRecordHeader header{ type, static_cast<uint32_t>(sizeof(RawInputRecordHeader) + payloadBytes), device, 0 };
+        std::memcpy(buffer + offset, &header, sizeof(header));
+        std::memcpy(buffer + offset + sizeof(header), payload, payloadBytes);
+        return RawInputWalker::NextOffset(offset, header.size);
+    }
+
+    bool SameEvent(const InputEvent& a, const InputEvent& b) {
+        return a.type == b.type && a.device == b.device && a.timestamp == b.timestamp && a.id == b.id && a.value == b.value;
+    }
+
+    // Returns false if any synthetic buffer decodes differently from what its inputs describe.
+    // Reads a field the way the fixture's hand-written layout describes it.
+    uint32_t ReadFixtureBits(const std::vector<uint8_t>& report, uint32_t bitOffset, uint8_t bitSize) {
+        uint32_t value = 0;
+        for (uint8_t bit = 0; bit < bitSize; ++bit) {
+            const uint32_t at = bitOffset + bit;
+            value |= static_cast<uint32_t>((report[at / 8] >> (at % 8)) & 1) << bit;
+        }
+        return value;
+    }
+
+    bool RunHidCheck(size_t count, uint64_t seed) {
+        Random random(seed);
+        size_t decoded = 0;
+        uint64_t decodeNs = 0;
+        int64_t axisSum = 0; // Printed, so the timed decodes cannot be optimized away
+        for (const HidFixture& fixture : MakeHidFixtures()) {
+            auto fail = [&fixture](const std::string& what) {
+                std::cout << "HID: " << fixture.name << ": " << what << std::endl;
+                return false;
+            };
+            HidExtractionPlan plan;
+            if (!ParseHidReportDescriptor(fixture.descriptor.data(), fixture.descriptor.size(), plan)) {
+                return fail("the descriptor did not parse");
+            }
+            if (plan.HasReportIdPrefix() != (fixture.reportId != 0)) {
+                return fail("report ID prefix misdetected");
+            }
+            size_t controls = 0;
+            for (const auto& field : fixture.fields) {
+                controls += field.count;
+            }
+            if (plan.GetControls().size() != controls) {
+                return fail("found " + std::to_string(plan.GetControls().size()) + " controls, expected " + std::to_string(controls));
+            }
+
+            // What a report must decode to, from the fixture's layout alone. Controls the
+            // layout does not name must keep their initial values.
+            auto check = [&](const std::vector<uint8_t>& report, const InputSnapshot& state) {
+                InputSnapshot expected;
+                for (const auto& field : fixture.fields) {
+                    for (uint8_t c = 0; c < field.count; ++c) {
+                        const uint32_t raw = ReadFixtureBits(report, field.bitOffset + c * field.bitSize, field.bitSize);
+                        const uint16_t id = static_cast<uint16_t>(field.id + c);
+                        if (field.kind == HidFixtureField::Buttons) {
+                            expected.buttons[id / 64] |= uint64_t{ raw } << (id % 64);
+                        } else if (field.kind == HidFixtureField::Hat) {
+                            const int64_t direction = int64_t{ raw } - field.logicalMin;
+                            expected.hats[id] = direction >= 0 && direction <= field.logicalMax - field.logicalMin ? static_cast<int8_t>(direction) : int8_t{ -1 };
+                        } else {
+                            expected.axes[id] = static_cast<int32_t>(-32768 + (int64_t{ raw } - field.logicalMin) * 65535 / (field.logicalMax - field.logicalMin));
+                        }
+                    }
+                }
+                if (std::memcmp(expected.buttons, state.buttons, sizeof(expected.buttons)) != 0 ||
+                    std::memcmp(expected.hats, state.hats, sizeof(expected.hats)) != 0) {
+                    return false;
+                }
+                for (size_t a = 0; a < InputSnapshot::MaxAxes; ++a) {
+                    // The plan scales in 16.16 fixed point, rounded so the maximum lands exactly.
+                    if (std::abs(expected.axes[a] - state.axes[a]) > 1) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            // The recorded samples, with what they mean spelled out.
+            for (size_t s = 0; s < fixture.samples.size(); ++s) {
+                const HidFixtureSample& sample = fixture.samples[s];
+                std::vector<uint8_t> report = sample.report;
+                report.resize(fixture.reportBytes, 0);
+                InputSnapshot state;
+                if (!plan.Decode(report.data(), report.size(), state) || !check(report, state) || state.hats[0] != sample.hat) {
+                    return fail("sample " + std::to_string(s) + " decoded wrongly");
+                }
+                size_t pressed = 0;
+                for (size_t b = 0; b < InputSnapshot::MaxButtons; ++b) {
+                    pressed += state.IsButtonPressed(b) ? 1 : 0;
+                }
+                bool ok = pressed == sample.pressedButtons.size();
+                for (const uint16_t button : sample.pressedButtons) {
+                    ok = ok && state.IsButtonPressed(button);
+                }
+                for (const auto& axis : sample.axes) {
+                    ok = ok && state.axes[axis.first] == axis.second;
+                }
+                if (!ok) {
+                    return fail("sample " + std::to_string(s) + " does not show the recorded input");
+                }
+            }
+
+            // Random reports against the layout, then the reports the plan must turn away.
+            std::vector<uint8_t> report(fixture.reportBytes);
+            for (size_t i = 0; i < count; ++i) {
+                for (auto& byte : report) {
+                    byte = static_cast<uint8_t>(random.Next());
+                }
+                if (fixture.reportId != 0) {
+                    report[0] = fixture.reportId;
+                }
+                InputSnapshot state;
+                if (!plan.Decode(report.data(), report.size(), state) || !check(report, state)) {
+                    return fail("random report " + std::to_string(i) + " decoded wrongly");
+                }
+            }
+            InputSnapshot timed;
+            const uint64_t start = MonotonicNanoseconds();
+            for (size_t i = 0; i < count; ++i) {
+                report[report.size() / 2] = static_cast<uint8_t>(i);
+                plan.Decode(report.data(), report.size(), timed);
+                axisSum += timed.axes[0];
+            }
+            decodeNs += MonotonicNanoseconds() - start;
+            decoded += count;
+            InputSnapshot untouched;
+            InputSnapshot state;
+            if (plan.Decode(report.data(), report.size() - 1, state) || std::memcmp(&state, &untouched, sizeof(state)) != 0) {
+                return fail("a truncated report was decoded");
+            }
+            report[0] = static_cast<uint8_t>(fixture.reportId + 1);
+            if (fixture.reportId != 0 && plan.Decode(report.data(), report.size(), state)) {
+                return fail("a report with an unknown ID was decoded");
+            }
+        }
+        std::cout << "HID: Xbox 360, Xbox One, DualShock 4, DualSense and generic descriptors parsed to their layouts; samples and "
+                  << decoded << " random reports decoded as the layouts read them, "
+                  << (decoded != 0 ? static_cast<double>(decodeNs) / static_cast<double>(decoded) : 0.0) << " ns per report (axis sum "
+                  << axisSum << ")" << std::endl;
+        return true;
+    }
+
+    // Returns false if the SPSC ring loses, repeats or reorders an item between two threads,
+    // or if the mapping worker drops events when one batch is larger than its queue.
+    bool RunRingCheck(size_t count, uint64_t seed) {
+        constexpr size_t Capacity = 1024;
+        constexpr size_t MaxBatch = 64;
+        SpscRing<uint64_t, Capacity> ring;
+        size_t rejected = 0;
+        uint64_t waits = 0;
+
+        // Random batch sizes on both sides, so the indices wrap and the ring keeps running full
+        // and empty. The producer retries whatever did not fit.
+        const uint64_t start = MonotonicNanoseconds();
+        std::thread producer([&ring, &rejected, &waits, count, seed] {
+            Random random(seed);
+            uint64_t items[MaxBatch];
+            for (uint64_t next = 0; next < count;) {
+                if (random.Below(4) == 0) {
+                    if (ring.TryPush(next)) {
+                        ++next;
+                    } else {
+                        ++rejected;
+                        std::this_thread::yield();
+                    }
+                    continue;
+                }
+                const size_t size = std::min<size_t>(1 + random.Below(MaxBatch), count - next);
+                for (size_t i = 0; i < size; ++i) {
+                    items[i] = next + i;
+                }
+                for (size_t pushed = ring.PushBatch(items, size); pushed != size; pushed += ring.PushBatch(items + pushed, size - pushed)) {
+                    ++waits;
+                    std::this_thread::yield();
+                }
+                next += size;
+            }
+        });
+        Random random(seed + 1);
+        uint64_t items[MaxBatch];
+        uint64_t received = 0;
+        uint64_t misplaced = count; // The first item out of order, if any
+        while (received < count) {
+            const size_t popped = ring.PopBatch(items, 1 + random.Below(MaxBatch));
+            if (popped == 0) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < popped; ++i, ++received) {
+                if (items[i] != received && misplaced == count) {
+                    misplaced = received;
+                }
+            }
+        }
+        producer.join();
+        if (misplaced != count) {
+            std::cout << "Ring: item " << misplaced << " arrived out of order" << std::endl;
+            return false;
+        }
+        const uint64_t elapsedNs = MonotonicNanoseconds() - start;
+        if (!ring.IsEmpty() || ring.GetOverflowCount() != rejected) {
+            std::cout << "Ring: " << ring.GetSize() << " items left over, " << ring.GetOverflowCount() << " overflows counted for " << rejected
+                      << " rejected pushes" << std::endl;
+            return false;
+        }
+
+        // One batch of press/release frames four times the size of the worker's queue must
+        // reach the controller whole: every release, every frame end.
+        constexpr size_t Frames = 4 * MappingWorker::QueueCapacity / 2;
+        RecordingGamepadSink sink;
+        VirtualController controller(sink);
+        controller.Initialize();
+        MappingEngine engine(controller);
+        engine.LoadMappings({ MappingRule(InputCondition::OnButtonPress(0), { ButtonAction(VirtualButtonType::XBOX_A) }) });
+        sink.Clear(); // The neutral report Initialize sent
+        sink.Reserve(Frames);
+        std::vector<InputEvent> events;
+        for (size_t frame = 0; frame < Frames; ++frame) {
+            events.push_back(InputEvent::Button(0, InputType::Button, 0, frame % 2 == 0, frame));
+            events.push_back(InputEvent{});
+        }
+        uint64_t stalls = 0;
+        {
+            MappingWorker worker(engine);
+            worker.Start();
+            worker.PushBatch(events.data(), events.size());
+            worker.Stop();
+            stalls = worker.GetStallCount();
+            if (worker.GetDroppedCount() != 0) {
+                std::cout << "Ring: the mapping worker dropped " << worker.GetDroppedCount() << " events" << std::endl;
+                return false;
+            }
+        }
+        const auto& reports = sink.GetReports();
+        bool alternating = reports.size() == Frames;
+        for (size_t i = 0; i < reports.size() && alternating; ++i) {
+            alternating = ((reports[i].buttons & GamepadA) != 0) == (i % 2 == 0);
+        }
+        if (!alternating) {
+            std::cout << "Ring: " << Frames << " press/release frames pushed at once reached the controller as " << reports.size() << " reports"
+                      << std::endl;
+            return false;
+        }
+
+        std::cout << "Ring: " << count << " items crossed threads in order, "
+                  << (count != 0 ? static_cast<double>(elapsedNs) / static_cast<double>(count) : 0.0) << " ns per item, the producer waited "
+                  << waits << " times for room and " << rejected << " single pushes were turned away; " << Frames
+                  << " frames pushed to the mapping worker at once all arrived after " << stalls << " wait(s)" << std::endl;
+        return true;
+    }
+
+    // Returns false if the log rings of threads that logged and exited are not freed once the
+    // logger has drained them, or if their dropped records stop being counted.
+    bool RunLogThreadCheck(size_t count) {
+        constexpr size_t Wave = 8;
+        const size_t ringsBefore = Logger::GetRingCount();
+        const uint64_t droppedBefore = Logger::GetDroppedCount();
+        size_t peak = 0;
+        const uint64_t start = MonotonicNanoseconds();
+        for (size_t first = 0; first < count; first += Wave) {
+            std::vector<std::thread> threads;
+            for (size_t i = first; i < std::min(count, first + Wave); ++i) {
+                threads.emplace_back([i] { LOG_INFO("Bench: log thread {} exiting.", i); });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            peak = std::max(peak, Logger::GetRingCount());
+        }
+        // The writer drains every few milliseconds; give it a generous while.
+        size_t rings = Logger::GetRingCount();
+        for (int wait = 0; wait < 2000 && rings > ringsBefore; ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            rings = Logger::GetRingCount();
+        }
+        const uint64_t elapsedNs = MonotonicNanoseconds() - start;
+        if (rings > ringsBefore || Logger::GetDroppedCount() < droppedBefore) {
+            std::cout << "Log: " << rings - ringsBefore << " of " << count << " exited threads still have a ring registered" << std::endl;
+            return false;
+        }
+        std::cout << "Log: " << count << " threads logged and exited; every ring was drained and freed (at most " << peak - ringsBefore
+                  << " registered at once), " << static_cast<double>(elapsedNs) / 1e6 << " ms" << std::endl;
+        return true;
+    }
+
+    // Returns false if the events a device state store sends leave a mirror of it anywhere
+    // but where the reports put it, within the axis deadband.
+    bool RunStateCheck(size_t count, uint64_t seed) {
+        constexpr DeviceIndex Device = 3;
+        constexpr size_t Axes = 6;
+        constexpr int32_t Deadband = DeviceStateStore::DefaultAxisDeadband;
+        DeviceStateStore store;
+        DeviceStateStore mirror;
+        size_t events = 0;
+        auto mirrorEvent = [&mirror, &events](const InputEvent& event) {
+            mirror.Apply(event);
+            ++events;
+        };
+        auto axisOf = [&mirror](size_t axis) { return mirror.Get(Device).axes[axis]; };
+        auto moveAxis = [&](size_t axis, int32_t value) {
+            InputSnapshot next = store.Get(Device);
+            next.axes[axis] = value;
+            store.Commit(Device, next, 0, mirrorEvent);
+        };
+        auto fail = [](const std::string& what) {
+            std::cout << "States: " << what << std::endl;
+            return false;
+        };
+
+        // A stick let go from a reported 50 springs back to 0 in one report, as a pad that
+        // only reports changes would send it.
+        for (const int32_t value : { 120, 50, 0 }) {
+            moveAxis(0, value);
+        }
+        if (axisOf(0) != 0) {
+            return fail("a stick let go at 50 was left at " + std::to_string(axisOf(0)));
+        }
+        // Noise backing off a held position stays out; the next step onwards does not.
+        for (const int32_t value : { 5000, 4990, 4995 }) {
+            moveAxis(1, value);
+        }
+        if (axisOf(1) != 5000) {
+            return fail("a small reversal got through the deadband");
+        }
+        moveAxis(1, 5001);
+        if (axisOf(1) != 5001) {
+            return fail("a step on from a held position was filtered");
+        }
+        // A trigger barely pressed and let go again still reports its rest.
+        for (const int32_t value : { -32768, -32700, -32740, -32768 }) {
+            moveAxis(2, value);
+        }
+        if (axisOf(2) != -32768) {
+            return fail("a released trigger was left at " + std::to_string(axisOf(2)));
+        }
+        store.Release(Device, 0, mirrorEvent);
+        const InputSnapshot released;
+        if (std::memcmp(&mirror.Get(Device), &released, sizeof(released)) != 0 || store.Find(Device) != nullptr) {
+            return fail("a removed device was not released and centered");
+        }
+
+        // Random glides of the sticks to new positions, each followed by noise around where it
+        // stopped, with buttons and hats changing along the way.
+        Random random(seed);
+        InputSnapshot raw;
+        size_t reports = 0;
+        uint64_t commitNs = 0;
+        while (reports < count) {
+            const size_t axis = random.Below(Axes);
+            const int32_t target = static_cast<int32_t>(random.Below(65536)) - 32768;
+            if (std::abs(target - raw.axes[axis]) <= Deadband) {
+                continue;
+            }
+            const int32_t direction = target > raw.axes[axis] ? 1 : -1;
+            const size_t glide = reports;
+            const size_t noise = random.Below(64);
+            auto report = [&]() {
+                if (random.Below(8) == 0) {
+                    const uint32_t button = random.Below(InputSnapshot::MaxButtons);
+                    raw.buttons[button / 64] ^= uint64_t{ 1 } << (button % 64);
+                }
+                if (random.Below(16) == 0) {
+                    raw.hats[random.Below(InputSnapshot::MaxHats)] = static_cast<int8_t>(static_cast<int32_t>(random.Below(9)) - 1);
+                }
+                const size_t before = events;
+                const uint64_t start = MonotonicNanoseconds();
+                store.Commit(Device, raw, 0, mirrorEvent);
+                commitNs += MonotonicNanoseconds() - start;
+                ++reports;
+
+                const InputSnapshot& mirrored = mirror.Get(Device);
+                if (std::memcmp(mirrored.buttons, raw.buttons, sizeof(raw.buttons)) != 0 || std::memcmp(mirrored.hats, raw.hats, sizeof(raw.hats)) != 0) {
+                    return fail("buttons or hats differ after report " + std::to_string(reports));
+                }
+                for (size_t a = 0; a < InputSnapshot::MaxAxes; ++a) {
+                    if (std::abs(mirrored.axes[a] - raw.axes[a]) > Deadband) {
+                        return fail("axis " + std::to_string(a) + " is further than the deadband from report " + std::to_string(reports));
+                    }
+                }
+                if (events - before > 3) {
+                    return fail("one report sent " + std::to_string(events - before) + " events");
+                }
+                return true;
+            };
+            while (raw.axes[axis] != target) {
+                const int32_t remaining = std::abs(target - raw.axes[axis]);
+                raw.axes[axis] += direction * std::min<int32_t>(remaining, 1 + static_cast<int32_t>(random.Below(400)));
+                if (!report()) {
+                    return false;
+                }
+            }
+            if (axisOf(axis) != target) {
+                return fail("a stick that glided to " + std::to_string(target) + " in " + std::to_string(reports - glide) + " reports was left at " +
+                            std::to_string(axisOf(axis)));
+            }
+            for (size_t i = 0; i < noise; ++i) {
+                raw.axes[axis] = std::clamp(target + static_cast<int32_t>(random.Below(Deadband + 1)) - Deadband / 2, -32768, 32767);
+                if (!report()) {
+                    return false;
+                }
+            }
+        }
+
+        // Noise while holding still is what the deadband is for: it only gets through when it
+        // goes further the way the stick last moved, so at most once per step of its range.
+        const size_t before = events;
+        const int32_t held = std::clamp(raw.axes[0], -32768 + Deadband, 32767 - Deadband);
+        for (size_t i = 0; i < 10000; ++i) {
+            raw.axes[0] = held + static_cast<int32_t>(random.Below(Deadband / 2 + 1)) - Deadband / 4;
+            store.Commit(Device, raw, 0, mirrorEvent);
+        }
+        if (events - before > static_cast<size_t>(Deadband / 2 + 2)) {
+            return fail(std::to_string(events - before) + " events from a stick held still");
+        }
+
+        std::cout << "States: sticks let go, backed off and released report where they stopped; " << reports
+                  << " reports of random glides and noise kept the mirror within the deadband and every glide ended exact, "
+                  << (reports != 0 ? static_cast<double>(commitNs) / static_cast<double>(reports) : 0.0) << " ns per report, "
+                  << events - before << " events from 10000 noisy reports of a held stick" << std::endl;
+        return true;
+    }
+
+    bool RunRawInputCheck(size_t count, uint64_t seed) {
+        constexpr size_t MaxRecordBytes = 64;
+        const KeyCode keys[] = { KeyCodeFromName("W"), KeyCodeFromName("A"), KeyCodeFromName("Spacebar"),
+                                 KeyCodeFromName("RightControl"), KeyCodeFromName("Up"), KeyCodeFromName("Pause") };
+        const PhysicalDeviceID devices[] = { reinterpret_cast<PhysicalDeviceID>(1), reinterpret_cast<PhysicalDeviceID>(2) };
+
+        Random random(seed);
+        RawInputArena arena;
+        auto* buffer = static_cast<unsigned char*>(arena.GetData());
+        RawInputDecoder decoder;
+        DeviceRegistry registry;
+        std::vector<InputEvent> events;
+        std::vector<InputEvent> expected;
+        events.reserve(arena.GetCapacity());
+        expected.reserve(arena.GetCapacity());
+        bool keysDown[2][KeyCodeCount] = {};
+        int64_t expectedX = 0;
+        int64_t expectedY = 0;
+        int64_t decodedX = 0;
+        int64_t decodedY = 0;
+        uint64_t decodeNs = 0;
+        uint64_t decodeAllocations = 0;
+        size_t records = 0;
+        size_t batches = 0;
+
+        // Key state is per keyboard; decode a no-op release for each so that bookkeeping
+        // exists before anything is timed.
+        for (PhysicalDeviceID device : devices) {
+            const RawKeyboardData release{ 0x11, RawKeyBreak, 0, 0x57, 0, 0 };
+            const size_t size = PackRecord(buffer, 0, RawInputKeyboard, device, &release, sizeof(release));
+            RawInputWalker walker(buffer, size, 1);
+            const RawInputRecordHeader* record = walker.Next();
+            decoder.Decode(*record, registry.GetIndex(record->device), 0, events);
+        }
+
+        // The allocation count is process-wide; let the logger thread finish formatting
+        // what the replay logged before counting.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        // The registry numbered the handles in order above, so handle devices[i] is index i.
+        auto expectButton = [&expected](size_t device, InputType type, ButtonID id, bool pressed, uint64_t time) {
+            expected.push_back(InputEvent::Button(static_cast<DeviceIndex>(device), type, id, pressed, time));
+        };
+
+        while (records < count) {
+            // Fill one buffer with a mix of inputs, tracking what each should decode to.
+            const uint64_t time = ++batches;
+            size_t offset = 0;
+            size_t packed = 0;
+            events.clear();
+            expected.clear();
+            while (records + packed < count && offset + MaxRecordBytes <= arena.GetCapacity()) {
+                const size_t deviceIndex = random.Below(2);
+                const PhysicalDeviceID device = devices[deviceIndex];
+                const uint32_t kind = random.Below(8);
+                if (kind < 4) {
+                    const KeyCode code = keys[random.Below(6)];
+                    const bool pressed = random.Below(2) == 0;
+                    RawKeyboardData keyboard{ static_cast<uint16_t>(code & 0xFF), static_cast<uint16_t>(pressed ? 0 : RawKeyBreak), 0, 0x41, 0, 0 };
+                    if (code & KeyE0) {
+                        keyboard.flags |= RawKeyE0;
+                    } else if (code & KeyE1) {
+                        keyboard.makeCode = 0x1D;
+                        keyboard.flags |= RawKeyE1;
+                    }
+                    if (random.Below(8) == 0) {
+                        keyboard.virtualKey = 0xFF; // Escape sequence filler, never an event
+                    } else if (keysDown[deviceIndex][code] != pressed) {
+                        keysDown[deviceIndex][code] = pressed;
+                        expectButton(deviceIndex, InputType::Key, code, pressed, time);
+                        expected.emplace_back();
+                    }
+                    offset = PackRecord(buffer, offset, RawInputKeyboard, device, &keyboard, sizeof(keyboard));
+                } else if (kind < 7) {
+                    RawMouseData mouse{};
+                    mouse.lastX = static_cast<int32_t>(random.Below(41)) - 20;
+                    mouse.lastY = static_cast<int32_t>(random.Below(41)) - 20;
+                    expectedX += mouse.lastX;
+                    expectedY += mouse.lastY;
+                    if (random.Below(4) == 0) {
+                        const uint16_t button = static_cast<uint16_t>(random.Below(5));
+                        const bool pressed = random.Below(2) == 0;
+                        mouse.buttonFlags = static_cast<uint16_t>(1u << (button * 2 + (pressed ? 0 : 1)));
+                        expectButton(deviceIndex, InputType::MouseButton, button, pressed, time);
+                        expected.emplace_back();
+                    } else if (random.Below(4) == 0) {
+                        const bool up = random.Below(2) == 0;
+                        mouse.buttonFlags = RawMouseWheel;
+                        mouse.buttonData = static_cast<uint16_t>(up ? 120 : -120);
+                        const ButtonID wheel = static_cast<ButtonID>(up ? MouseButtonId::WheelUp : MouseButtonId::WheelDown);
+                        expectButton(deviceIndex, InputType::MouseButton, wheel, true, time);
+                        expected.emplace_back();
+                        expectButton(deviceIndex, InputType::MouseButton, wheel, false, time);
+                        expected.emplace_back();
+                    }
+                    offset = PackRecord(buffer, offset, RawInputMouse, device, &mouse, sizeof(mouse));
+                } else {
+                    // HID reports of odd sizes, which the decoder leaves to the caller; they
+                    // also make the records after them start on rounded-up offsets.
+                    unsigned char hid[8 + 13] = {};
+                    const uint32_t reportBytes = 1 + random.Below(13);
+                    const uint32_t reportCount = 1;
+                    std::memcpy(hid, &reportBytes, sizeof(reportBytes));
+                    std::memcpy(hid + 4, &reportCount, sizeof(reportCount));
+                    offset = PackRecord(buffer, offset, RawInputHid, device, hid, 8 + reportBytes);
+                }
+                ++packed;
+            }
+
+            const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            const uint64_t start = MonotonicNanoseconds();
+            RawInputWalker walker(buffer, offset, packed);
+            size_t walked = 0;
+            while (const RawInputRecordHeader* record = walker.Next()) {
+                decoder.Decode(*record, registry.GetIndex(record->device), time, events);
+                ++walked;
+            }
+            int32_t dx;
+            int32_t dy;
+            decoder.TakeMouseDelta(dx, dy);
+            decodeNs += MonotonicNanoseconds() - start;
+            decodeAllocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            decodedX += dx;
+            decodedY += dy;
+
+            if (walked != packed || events.size() != expected.size() ||
+                !std::equal(events.begin(), events.end(), expected.begin(), SameEvent)) {
+                std::cout << "Raw input mismatch in buffer " << batches << ": walked " << walked << " of " << packed << " records, "
+                          << events.size() << " events, expected " << expected.size() << std::endl;
+                return false;
+            }
+
+            // Cut the buffer short anywhere: the walk must stop at the last whole record.
+            const size_t cut = random.Below(static_cast<uint32_t>(offset));
+            size_t whole = 0;
+            for (size_t at = 0; at + sizeof(RawInputRecordHeader) <= cut; ++whole) {
+                const size_t size = reinterpret_cast<const RawInputRecordHeader*>(buffer + at)->size;
+                if (at + size > cut) {
+                    break;
+                }
+                at = RawInputWalker::NextOffset(at, size);
+            }
+            RawInputWalker truncated(buffer, cut, packed);
+            size_t truncatedWalked = 0;
+            while (truncated.Next() != nullptr) {
+                ++truncatedWalked;
+            }
+            if (truncatedWalked != whole) {
+                std::cout << "Raw input walk over a buffer cut at " << cut << " bytes read " << truncatedWalked << " records, expected "
+                          << whole << std::endl;
+                return false;
+            }
+            records += packed;
+        }
+
+        if (decodedX != expectedX || decodedY != expectedY) {
+            std::cout << "Raw input mouse movement mismatch: " << decodedX << "," << decodedY << ", expected " << expectedX << ","
+                      << expectedY << std::endl;
+            return false;
+        }
+        std::cout << "Raw input: " << records << " records in " << batches << " buffers decoded as expected, "
+                  << static_cast<double>(decodeNs) / static_cast<double>(records) << " ns per record, " << decodeAllocations
+                  << " allocations" << std::endl;
+        return true;
+    }
+
+    InputCondition OnKey(const char* name, Gesture gesture = Gesture::Press, const char* chordKey = nullptr) {
+        InputCondition condition = InputCondition::OnButtonPress(KeyCodeFromName(name));
+        condition.type = InputType::Key;
+        condition.gesture = gesture;
+        if (chordKey != nullptr) {
+            condition.chord[0] = { InputType::Key, KeyCodeFromName(chordKey) };
+        }
+        return condition;
+    }
+
+    // The gesture rules every scenario runs against, plus `combos` chords on keys the
+    // scenarios never press (at most 28672, so their IDs stay clear of real keys).
+    std::vector<MappingRule> MakeGestureRules(size_t combos) {
+        combos = std::min<size_t>(combos, 0x7000);
+        std::vector<MappingRule> rules = {
+            MappingRule(OnKey("Q", Gesture::Tap), { ButtonAction(VirtualButtonType::XBOX_A) }),
+            MappingRule(OnKey("Q", Gesture::LongPress), { ButtonAction(VirtualButtonType::XBOX_B) }),
+            MappingRule(OnKey("E", Gesture::DoubleTap), { ButtonAction(VirtualButtonType::XBOX_X) }),
+            MappingRule(OnKey("R", Gesture::Release), { ButtonAction(VirtualButtonType::XBOX_Y) }),
+            MappingRule(OnKey("F", Gesture::Press, "LeftControl"), { ButtonAction(VirtualButtonType::XBOX_RIGHT_SHOULDER) }),
+            MappingRule(OnKey("W"), { ButtonAction(VirtualButtonType::XBOX_DPAD_UP) }),
+        };
+        for (size_t i = 0; i < combos; ++i) {
+            InputCondition condition = InputCondition::OnButtonPress(static_cast<ButtonID>(0x400 + i));
+            condition.type = InputType::Key;
+            condition.gesture = static_cast<Gesture>(i % static_cast<size_t>(Gesture::Count));
+            condition.chord[0] = { InputType::Key, static_cast<ButtonID>(0x400 + combos + i) };
+            rules.emplace_back(condition, std::vector<OutputAction>{ ButtonAction(VirtualButtonType::XBOX_GUIDE) });
+        }
+        return rules;
+    }
+
+    // Returns false if any scripted scenario leaves the gamepad in the wrong state.
+    bool RunGestureCheck(size_t combos) {
+        constexpr uint64_t Ms = 1'000'000;
+        const DeviceIndex keyboard = 0;
+
+        RecordingGamepadSink sink;
+        VirtualController controller(sink);
+        controller.Initialize();
+        MappingEngine engine(controller);
+        engine.LoadMappings(MakeGestureRules(0));
+
+        // Virtual clock: input and timeouts both carry the time they happen at.
+        auto key = [&engine, keyboard](const char* name, bool pressed, uint64_t atMs) {
+            engine.ProcessInput(InputEvent::Button(keyboard, InputType::Key, KeyCodeFromName(name), pressed, atMs * Ms));
+            engine.EndFrame();
+        };
+        auto at = [&engine](uint64_t ms) { engine.AdvanceGestures(ms * Ms); };
+        bool ok = true;
+        auto expect = [&sink, &ok](const char* what, uint16_t buttons) {
+            const uint16_t actual = sink.GetReports().empty() ? 0 : sink.GetReports().back().buttons;
+            if (actual != buttons) {
+                std::cout << "Gesture mismatch: " << what << ": buttons " << std::hex << actual << ", expected " << buttons << std::dec << std::endl;
+                ok = false;
+            }
+        };
+
+        key("Q", true, 1000);
+        expect("tap pressed", 0);
+        key("Q", false, 1100);
+        expect("tap fires on release", GamepadA);
+        at(1139);
+        expect("tap pulse still held", GamepadA);
+        at(1141);
+        expect("tap pulse over", 0);
+
+        key("Q", true, 2000);
+        at(2499);
+        expect("long press before its time", 0);
+        at(2500);
+        expect("long press", GamepadB);
+        key("Q", false, 3000);
+        at(3100);
+        expect("long press let go, and no tap", 0);
+
+        key("E", true, 4000);
+        key("E", false, 4050);
+        expect("first tap of a double tap", 0);
+        key("E", true, 4200);
+        expect("double tap", GamepadX);
+        key("E", false, 4300);
+        expect("double tap let go", 0);
+        key("E", true, 5000);
+        key("E", false, 5050);
+        at(5300);
+        key("E", true, 5400);
+        expect("second tap too late", 0);
+        key("E", false, 5450);
+
+        key("R", true, 6000);
+        expect("release-only binding on press", 0);
+        key("R", false, 6500);
+        expect("release-only binding", GamepadY);
+        at(6600);
+
+        key("F", true, 7000);
+        expect("chord key alone", 0);
+        key("F", false, 7050);
+        key("LeftControl", true, 8000);
+        key("F", true, 8010);
+        expect("chord", GamepadRightShoulder);
+        key("F", false, 8100);
+        expect("chord let go", 0);
+        key("F", true, 8200);
+        key("LeftControl", false, 8300);
+        expect("chord broken by its other key", 0);
+        key("LeftControl", true, 8400);
+        expect("chord held in the other order", GamepadRightShoulder);
+        key("LeftControl", false, 8500);
+        key("F", false, 8500);
+        expect("everything let go", 0);
+        if (ok) {
+            std::cout << "Gestures: every scenario produced the expected output" << std::endl;
+        }
+
+        // What an event costs must not depend on how many combos the profile has.
+        constexpr size_t TimedEvents = 400'000;
+        sink.Reserve(TimedEvents);
+        for (const size_t extra : { size_t{ 0 }, combos }) {
+            engine.LoadMappings(MakeGestureRules(extra));
+            std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the logger settle
+            const char* const names[] = { "Q", "F", "LeftControl", "W" };
+            // The first event after a profile switch sets up the gesture state for it.
+            key("W", true, 9'000);
+            key("W", false, 9'000);
+            sink.Clear();
+            const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            const uint64_t start = MonotonicNanoseconds();
+            for (size_t i = 0; i < TimedEvents; ++i) {
+                key(names[(i / 2) % 4], (i & 1) == 0, 10'000 + i);
+            }
+            const uint64_t elapsed = MonotonicNanoseconds() - start;
+            const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            std::cout << "Gestures with " << std::min<size_t>(extra, 0x7000) << " extra combos: " << static_cast<double>(elapsed) / TimedEvents
+                      << " ns per event, " << allocations << " allocations" << std::endl;
+        }
+        controller.Shutdown();
+        return ok;
+    }
+
+    MappingRule OnLayer(uint8_t layer, ButtonID button, OutputAction action) {
+        InputCondition condition = InputCondition::OnButtonPress(button);
+        condition.layer = layer;
+        return MappingRule(condition, { action });
+    }
+
+    // Returns false if a scripted scenario maps wrongly or random input leaves a button stuck.
+    bool RunLayerCheck(size_t count, uint64_t seed) {
+        constexpr ButtonID HoldLayer1 = 0, ToggleLayer2 = 1, OneShotLayer3 = 2, Face = 10, Side = 11, Extra = 12;
+        const std::vector<MappingRule> rules = {
+            OnLayer(0, HoldLayer1, { LayerAction{ 1, LayerAction::Mode::Momentary } }),
+            OnLayer(0, ToggleLayer2, { LayerAction{ 2, LayerAction::Mode::Toggle } }),
+            OnLayer(0, OneShotLayer3, { LayerAction{ 3, LayerAction::Mode::OneShot } }),
+            OnLayer(0, Face, ButtonAction(VirtualButtonType::XBOX_A)),
+            OnLayer(0, Side, ButtonAction(VirtualButtonType::XBOX_B)),
+            OnLayer(1, Face, ButtonAction(VirtualButtonType::XBOX_DPAD_UP)),
+            OnLayer(1, Extra, ButtonAction(VirtualButtonType::XBOX_X)),
+            OnLayer(2, Face, ButtonAction(VirtualButtonType::XBOX_DPAD_LEFT)),
+            OnLayer(2, Side, ButtonAction(VirtualButtonType::XBOX_Y)),
+            OnLayer(3, Face, ButtonAction(VirtualButtonType::XBOX_DPAD_RIGHT)),
+            OnLayer(3, Side, ButtonAction(VirtualButtonType::XBOX_RIGHT_SHOULDER)),
+        };
+
+        RecordingGamepadSink sink;
+        VirtualController controller(sink);
+        controller.Initialize();
+        MappingEngine engine(controller);
+        engine.SetMatchPolicy(MatchPolicy::AllMatches);
+        engine.LoadMappings(rules);
+
+        const DeviceIndex pad = 0;
+        auto button = [&engine, pad](ButtonID id, bool pressed) {
+            engine.ProcessInput(InputEvent::Button(pad, InputType::Button, id, pressed));
+            engine.EndFrame();
+        };
+        auto click = [&button](ButtonID id) {
+            button(id, true);
+            button(id, false);
+        };
+        bool ok = true;
+        auto expect = [&sink, &ok](const char* what, uint16_t buttons) {
+            const uint16_t actual = sink.GetReports().empty() ? 0 : sink.GetReports().back().buttons;
+            if (actual != buttons) {
+                std::cout << "Layer mismatch: " << what << ": buttons " << std::hex << actual << ", expected " << buttons << std::dec << std::endl;
+                ok = false;
+            }
+        };
+
+        button(Face, true);
+        expect("base layer", GamepadA);
+        button(Face, false);
+
+        button(HoldLayer1, true);
+        button(Face, true);
+        expect("momentary layer", GamepadDpadUp);
+        button(Face, false);
+        button(Side, true);
+        expect("input the layer leaves alone", GamepadB);
+        button(Side, false);
+        button(Extra, true);
+        expect("input only the layer uses", GamepadX);
+        button(Extra, false);
+        button(HoldLayer1, false);
+        button(Extra, true);
+        expect("layer let go", 0);
+        button(Extra, false);
+
+        button(Face, true);
+        button(HoldLayer1, true);
+        button(Face, false);
+        expect("released after the layer came on", 0);
+        button(Face, true);
+        button(HoldLayer1, false);
+        button(Face, false);
+        expect("released after the layer went off", 0);
+
+        click(ToggleLayer2);
+        button(HoldLayer1, true);
+        button(Face, true);
+        expect("the higher of two layers", GamepadDpadLeft);
+        button(Extra, true);
+        expect("the lower layer below it", GamepadDpadLeft | GamepadX);
+        button(Face, false);
+        button(Extra, false);
+        button(HoldLayer1, false);
+        click(ToggleLayer2);
+        button(Side, true);
+        expect("toggled off", GamepadB);
+        button(Side, false);
+
+        click(OneShotLayer3);
+        button(Side, true);
+        expect("one-shot layer", GamepadRightShoulder);
+        button(Side, false);
+        button(Side, true);
+        expect("one-shot layer used up", GamepadB);
+        button(Side, false);
+        expect("everything let go", 0);
+
+        // Random presses, releases and layer switches in any order; once every button is let
+        // go, nothing may be left pressed.
+        Random random(seed);
+        const ButtonID inputs[] = { HoldLayer1, ToggleLayer2, OneShotLayer3, Face, Side, Extra };
+        bool down[std::size(inputs)] = {};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the logger settle
+        sink.Clear();
+        sink.Reserve(count + std::size(inputs));
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const uint64_t start = MonotonicNanoseconds();
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t pick = random.Below(static_cast<uint32_t>(std::size(inputs)));
+            down[pick] = !down[pick];
+            button(inputs[pick], down[pick]);
+        }
+        const uint64_t elapsed = MonotonicNanoseconds() - start;
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        for (size_t i = 0; i < std::size(inputs); ++i) {
+            if (down[i]) {
+                button(inputs[i], false);
+            }
+        }
+        expect("random input let go", 0);
+        controller.Shutdown();
+
+        if (ok) {
+            std::cout << "Layers: every scenario produced the expected output, " << count << " random events left nothing pressed, "
+                      << static_cast<double>(elapsed) / static_cast<double>(count) << " ns per event, " << allocations
+                      << " allocations" << std::endl;
+        }
+        return ok;
+    }
+
+    OutputAction ModeAction(VirtualButtonType button, VirtualButtonAction::Mode mode, uint16_t turboHz = 0) {
+        return OutputAction{ VirtualButtonAction{ button, true, mode, turboHz } };
+    }
+
+    // Returns false if a scripted scenario maps wrongly.
+    bool RunTurboCheck(size_t ticks) {
+        constexpr uint64_t Ms = 1'000'000;
+        constexpr ButtonID TurboA = 0, TurboX = 1, FastY = 2, ToggleB = 3, ReleaseB = 4, HoldB = 5, PushStick = 6;
+        using Mode = VirtualButtonAction::Mode;
+        std::vector<MappingRule> rules = {
+            MappingRule(InputCondition::OnButtonPress(TurboA), { ModeAction(VirtualButtonType::XBOX_A, Mode::Turbo) }),
+            MappingRule(InputCondition::OnButtonPress(TurboX), { ModeAction(VirtualButtonType::XBOX_X, Mode::Turbo) }),
+            MappingRule(InputCondition::OnButtonPress(FastY), { ModeAction(VirtualButtonType::XBOX_Y, Mode::Turbo, 25) }),
+            MappingRule(InputCondition::OnButtonPress(ToggleB), { ModeAction(VirtualButtonType::XBOX_B, Mode::Toggle) }),
+            MappingRule(InputCondition::OnButtonPress(ReleaseB), { OutputAction{ VirtualButtonAction{ VirtualButtonType::XBOX_B, false } } }),
+            MappingRule(InputCondition::OnButtonPress(HoldB), { ButtonAction(VirtualButtonType::XBOX_B) }),
+            MappingRule(InputCondition::OnButtonPress(PushStick), { OutputAction{ VirtualAxisAction{ VirtualAxisType::XBOX_LEFT_STICK_X, 32767 } } }),
+        };
+        // The same buttons doing something else.
+        const std::vector<MappingRule> otherRules = {
+            MappingRule(InputCondition::OnButtonPress(HoldB), { ButtonAction(VirtualButtonType::XBOX_Y) }),
+        };
+
+        RecordingGamepadSink sink;
+        VirtualController controller(sink);
+        controller.Initialize();
+        MappingEngine engine(controller);
+        engine.LoadMappings(rules);
+
+        // Virtual clock: input and ticks both carry the time they happen at.
+        const DeviceIndex pad = 0;
+        auto button = [&engine, pad](ButtonID id, bool pressed, uint64_t atMs) {
+            engine.ProcessInput(InputEvent::Button(pad, InputType::Button, id, pressed, atMs * Ms));
+            engine.EndFrame();
+        };
+        auto at = [&engine](uint64_t ms) { engine.Tick(ms * Ms, 0, 0); };
+        bool ok = true;
+        auto expect = [&sink, &ok](const char* what, uint16_t buttons) {
+            const uint16_t actual = sink.GetReports().empty() ? 0 : sink.GetReports().back().buttons;
+            if (actual != buttons) {
+                std::cout << "Turbo mismatch: " << what << ": buttons " << std::hex << actual << ", expected " << buttons << std::dec << std::endl;
+                ok = false;
+            }
+        };
+
+        // 10 Hz: down for 50 ms, up for 50 ms, from the press on.
+        button(TurboA, true, 1000);
+        expect("turbo presses at once", GamepadA);
+        at(1049);
+        expect("turbo first half", GamepadA);
+        at(1050);
+        expect("turbo second half", 0);
+        at(1100);
+        expect("turbo next period", GamepadA);
+        button(TurboX, true, 1120);
+        expect("second button joins in step", GamepadA | GamepadX);
+        button(FastY, true, 1130);
+        at(1140);
+        expect("two rates at once", GamepadA | GamepadX | GamepadY);
+        at(1150);
+        expect("both rates in their second half", 0);
+        at(1170);
+        expect("faster rate's second period", GamepadY);
+        button(TurboA, false, 1180);
+        button(TurboX, false, 1180);
+        button(FastY, false, 1180);
+        at(1200);
+        expect("turbo let go", 0);
+
+        button(ToggleB, true, 2000);
+        button(ToggleB, false, 2010);
+        expect("toggle latches", GamepadB);
+        button(ToggleB, true, 2100);
+        button(ToggleB, false, 2110);
+        expect("toggle lets go", 0);
+        button(ToggleB, true, 2200);
+        button(ToggleB, false, 2210);
+        button(ReleaseB, true, 2300);
+        expect("release binding ends the toggle", 0);
+        button(ReleaseB, false, 2310);
+        button(ToggleB, true, 2400);
+        expect("toggle starts over", GamepadB);
+        button(ToggleB, false, 2410);
+        button(HoldB, true, 2500);
+        button(HoldB, false, 2510);
+        expect("a hold on the same button lets go too", 0);
+
+        button(TurboA, true, 3000);
+        engine.LoadMappings(rules);
+        at(3010);
+        expect("a new profile lets go of turbo", 0);
+        button(TurboA, false, 3020);
+
+        // A held button's output goes up with a profile that maps it elsewhere, and its
+        // release then lets go of nothing; the same rules again keep it down until the release.
+        auto stickX = [&sink] { return sink.GetReports().empty() ? 0 : sink.GetReports().back().thumbLX; };
+        button(HoldB, true, 4000);
+        button(PushStick, true, 4000);
+        expect("hold before a switch", GamepadB);
+        engine.LoadMappings(otherRules);
+        at(4010);
+        expect("a new profile lets go of a hold", 0);
+        if (stickX() != 0) {
+            std::cout << "Turbo mismatch: a new profile left a button-pushed stick at " << stickX() << std::endl;
+            ok = false;
+        }
+        button(HoldB, false, 4020);
+        button(PushStick, false, 4020);
+        expect("the new profile's release", 0);
+        engine.LoadMappings(rules);
+        button(HoldB, true, 4100);
+        button(PushStick, true, 4100);
+        engine.LoadMappings(rules);
+        at(4110);
+        expect("the same rules keep a hold", GamepadB);
+        if (stickX() != 32767) {
+            std::cout << "Turbo mismatch: the same rules let go of a button-pushed stick" << std::endl;
+            ok = false;
+        }
+        button(HoldB, false, 4120);
+        button(PushStick, false, 4120);
+        expect("a kept hold lets go on release", 0);
+        if (ok) {
+            std::cout << "Turbo: every scenario produced the expected output" << std::endl;
+        }
+
+        // What a tick costs must not depend on how many buttons are in turbo.
+        std::vector<MappingRule> everyButton;
+        for (int target = static_cast<int>(VirtualButtonType::XBOX_DPAD_UP); target <= static_cast<int>(VirtualButtonType::XBOX_Y); ++target) {
+            everyButton.emplace_back(InputCondition::OnButtonPress(static_cast<ButtonID>(target)),
+                                     std::vector<OutputAction>{ ModeAction(static_cast<VirtualButtonType>(target), Mode::Turbo, 50) });
+        }
+        engine.LoadMappings(everyButton);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the logger settle
+        sink.Reserve(ticks);
+        uint64_t nowMs = 10'000;
+        for (const size_t held : { size_t{ 1 }, everyButton.size() }) {
+            for (size_t b = 0; b < held; ++b) {
+                button(static_cast<ButtonID>(b), true, nowMs);
+            }
+            sink.Clear();
+            const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            const uint64_t start = MonotonicNanoseconds();
+            for (size_t i = 0; i < ticks; ++i) {
+                at(++nowMs);
+            }
+            const uint64_t elapsed = MonotonicNanoseconds() - start;
+            const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            for (size_t b = 0; b < held; ++b) {
+                button(static_cast<ButtonID>(b), false, nowMs);
+            }
+            std::cout << "Turbo with " << held << " buttons held: " << static_cast<double>(elapsed) / static_cast<double>(ticks) << " ns per tick, "
+                      << allocations << " allocations" << std::endl;
+        }
+        controller.Shutdown();
+        return ok;
+    }
+
+    // Hands macro steps straight back to the engine, as the mapping worker does.
+    class EngineMacroOutput : public MacroOutput {
+    public:
+        explicit EngineMacroOutput(MappingEngine& engine) : engine(engine) {}
+        void PostStep(const MacroStep& step) override { engine.ApplyMacroStep(step); }
+        void EndSteps() override { engine.FlushMacroSteps(); }
+
+    private:
+        MappingEngine& engine;
+    };
+
+    // Returns false if output reaches the wrong controller.
+    bool RunPadsCheck(size_t count, uint64_t seed) {
+        constexpr size_t Pads = MaxVirtualControllers;
+        RecordingGamepadSink sinks[Pads];
+        std::vector<std::unique_ptr<VirtualController>> controllers;
+        VirtualControllerPool pool;
+        for (auto& sink : sinks) {
+            controllers.push_back(std::make_unique<VirtualController>(sink));
+            controllers.back()->Initialize();
+            pool.Add(*controllers.back());
+        }
+        MappingEngine engine(pool);
+        EngineMacroOutput macroOutput(engine);
+        MacroScheduler scheduler(macroOutput, 0);
+        engine.SetMacroScheduler(&scheduler);
+
+        constexpr ButtonID Jump = 0, Third = 1, Combo = 2, Rapid = 3;
+        MacroStep press{ MacroStep::Press, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_Y), 0 };
+        MacroStep wait{ MacroStep::Delay, 0, 0, 10'000 };
+        MacroStep release{ MacroStep::Release, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_Y), 0 };
+        OutputAction toThird = ButtonAction(VirtualButtonType::XBOX_X);
+        toThird.slot = 2;
+        InputCondition keyJump = InputCondition::OnButtonPress(Jump);
+        keyJump.type = InputType::Key;
+        const std::vector<MappingRule> rules = {
+            MappingRule(InputCondition::OnButtonPress(Jump), { ButtonAction(VirtualButtonType::XBOX_A) }),
+            MappingRule(InputCondition::OnButtonPress(Third), { toThird }),
+            MappingRule(InputCondition::OnButtonPress(Combo), { OutputAction{ MacroAction{ "combo" } } }),
+            MappingRule(InputCondition::OnButtonPress(Rapid), { ModeAction(VirtualButtonType::XBOX_B, VirtualButtonAction::Mode::Turbo) }),
+            MappingRule(InputCondition::OnAxisMove(0), { AxisAction(VirtualAxisType::XBOX_LEFT_STICK_X) }),
+            MappingRule(keyJump, { ButtonAction(VirtualButtonType::XBOX_LEFT_SHOULDER) }),
+        };
+        engine.LoadMappings(rules, { MacroDefinition{ "combo", { press, wait, release } } });
+
+        auto device = [](size_t index) { return static_cast<DeviceIndex>(index); };
+        auto button = [&engine, &device](size_t from, ButtonID id, bool pressed, uint64_t atNs = 0) {
+            engine.ProcessInput(InputEvent::Button(device(from), InputType::Button, id, pressed, atNs));
+            engine.EndFrame();
+        };
+        bool ok = true;
+        auto expect = [&sinks, &ok](const char* what, std::initializer_list<uint16_t> buttons) {
+            size_t pad = 0;
+            for (const uint16_t expected : buttons) {
+                const auto& reports = sinks[pad].GetReports();
+                const uint16_t actual = reports.empty() ? 0 : reports.back().buttons;
+                if (actual != expected) {
+                    std::cout << "Pad mismatch: " << what << ": pad " << pad + 1 << " has buttons " << std::hex << actual << ", expected "
+                              << expected << std::dec << std::endl;
+                    ok = false;
+                }
+                ++pad;
+            }
+        };
+
+        button(0, Jump, true);
+        expect("unrouted devices drive pad 1", { GamepadA, 0, 0, 0 });
+        button(0, Jump, false);
+        engine.SetDeviceSlot(device(1), 1);
+        engine.SetDeviceSlot(device(3), 3);
+        button(1, Jump, true);
+        button(3, Jump, true);
+        expect("routed by device", { 0, GamepadA, 0, GamepadA });
+        button(1, Third, true);
+        expect("routed by the action's slot", { 0, GamepadA, GamepadX, GamepadA });
+        button(1, Third, false);
+        button(1, Jump, false);
+        button(3, Jump, false);
+        expect("all let go", { 0, 0, 0, 0 });
+
+        button(3, Combo, true, 1'000'000);
+        scheduler.Poll(1'000'000);
+        expect("macro on its trigger's pad", { 0, 0, 0, GamepadY });
+        button(3, Combo, false, 2'000'000);
+        scheduler.Poll(12'000'000);
+        expect("macro finished", { 0, 0, 0, 0 });
+
+        button(0, Rapid, true, 20'000'000);
+        button(1, Rapid, true, 20'000'000);
+        expect("turbo on two pads", { GamepadB, GamepadB, 0, 0 });
+        engine.Tick(70'000'000, 0, 0);
+        expect("turbo on two pads, in step", { 0, 0, 0, 0 });
+        engine.Tick(120'000'000, 0, 0);
+        expect("turbo on two pads, next period", { GamepadB, GamepadB, 0, 0 });
+        button(0, Rapid, false);
+        button(1, Rapid, false);
+
+        // A second engine lets pads join: nothing until a button, then the lowest free slot.
+        MappingEngine joining(pool);
+        joining.SetAutoAssignSlots(true);
+        joining.LoadMappings(rules);
+        for (auto& sink : sinks) {
+            sink.Clear();
+        }
+        auto joinButton = [&joining, &device](size_t from, ButtonID id, bool pressed) {
+            joining.ProcessInput(InputEvent::Button(device(from), InputType::Button, id, pressed));
+            joining.EndFrame();
+        };
+        joining.ProcessInput(InputEvent::Axis(device(5), InputType::Axis, 0, 20000));
+        joining.EndFrame();
+        joinButton(6, Jump, true);
+        expect("first pad to press joins as player 1", { GamepadA, 0, 0, 0 });
+        joinButton(6, Jump, false);
+        joinButton(5, Jump, true);
+        expect("second pad joins as player 2, its stick ignored until then", { 0, GamepadA, 0, 0 });
+        joining.ProcessInput(InputEvent::Axis(device(5), InputType::Axis, 0, 20000));
+        joining.EndFrame();
+        if (sinks[1].GetReports().empty() || sinks[1].GetReports().back().thumbLX != 20000 || sinks[0].GetReports().back().thumbLX != 0) {
+            std::cout << "Pad mismatch: a joined pad's stick" << std::endl;
+            ok = false;
+        }
+        joinButton(5, Jump, false);
+        joining.ProcessInput(InputEvent::Axis(device(5), InputType::Axis, 0, 0));
+        joining.EndFrame();
+        joining.ProcessInput(InputEvent::Button(device(9), InputType::Key, Jump, true));
+        joining.EndFrame();
+        expect("keyboards stay on player 1", { GamepadLeftShoulder, 0, 0, 0 });
+        joining.ProcessInput(InputEvent::Button(device(9), InputType::Key, Jump, false));
+        joining.EndFrame();
+        if (ok) {
+            std::cout << "Pads: every scenario reached the expected controller" << std::endl;
+        }
+
+        // Four devices, each on its own pad.
+        Random random(seed);
+        for (size_t pad = 0; pad < Pads; ++pad) {
+            engine.SetDeviceSlot(device(pad), static_cast<uint8_t>(pad));
+            sinks[pad].Clear();
+            sinks[pad].Reserve(count);
+        }
+        bool down[Pads] = {};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the logger settle
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const uint64_t start = MonotonicNanoseconds();
+        for (size_t i = 0; i < count; ++i) {
+            const size_t pad = random.Below(Pads);
+            down[pad] = !down[pad];
+            button(pad, Jump, down[pad]);
+        }
+        const uint64_t elapsed = MonotonicNanoseconds() - start;
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        size_t reports = 0;
+        for (size_t pad = 0; pad < Pads; ++pad) {
+            reports += sinks[pad].GetReports().size();
+            button(pad, Jump, false);
+        }
+        std::cout << "Pads: " << count << " events to " << Pads << " controllers, " << reports << " reports, "
+                  << static_cast<double>(elapsed) / static_cast<double>(count) << " ns per event, " << allocations << " allocations" << std::endl;
+        for (auto& controller : controllers) {
+            controller->Shutdown();
+        }
+        return ok && reports == count;
+    }
+
+    // Returns false if a target lands anywhere but where it should.
+    bool RunOutputsCheck(size_t count, uint64_t seed) {
+        RecordingGamepadSink sink;
+        VirtualController controller(sink);
+        controller.Initialize();
+        RecordingKeyboardMouseSink keyboardMouseSink;
+        VirtualKeyboardMouse keyboardMouse(keyboardMouseSink);
+        MappingEngine engine(controller);
+        engine.SetKeyboardMouse(&keyboardMouse);
+
+        // The reference the tables must agree with, written out the long way.
+        const std::pair<VirtualButtonType, uint16_t> gamepadButtons[] = {
+            { VirtualButtonType::XBOX_DPAD_UP, GamepadDpadUp }, { VirtualButtonType::XBOX_DPAD_DOWN, GamepadDpadDown },
+            { VirtualButtonType::XBOX_DPAD_LEFT, GamepadDpadLeft }, { VirtualButtonType::XBOX_DPAD_RIGHT, GamepadDpadRight },
+            { VirtualButtonType::XBOX_START, GamepadStart }, { VirtualButtonType::XBOX_BACK, GamepadBack },
+            { VirtualButtonType::XBOX_LEFT_THUMB, GamepadLeftThumb }, { VirtualButtonType::XBOX_RIGHT_THUMB, GamepadRightThumb },
+            { VirtualButtonType::XBOX_LEFT_SHOULDER, GamepadLeftShoulder }, { VirtualButtonType::XBOX_RIGHT_SHOULDER, GamepadRightShoulder },
+            { VirtualButtonType::XBOX_GUIDE, GamepadGuide }, { VirtualButtonType::XBOX_A, GamepadA }, { VirtualButtonType::XBOX_B, GamepadB },
+            { VirtualButtonType::XBOX_X, GamepadX }, { VirtualButtonType::XBOX_Y, GamepadY },
+        };
+        auto axisField = [](const GamepadReport& report, VirtualAxisType axis) {
+            switch (axis) {
+                case VirtualAxisType::XBOX_LEFT_STICK_X: return static_cast<int>(report.thumbLX);
+                case VirtualAxisType::XBOX_LEFT_STICK_Y: return static_cast<int>(report.thumbLY);
+                case VirtualAxisType::XBOX_RIGHT_STICK_X: return static_cast<int>(report.thumbRX);
+                case VirtualAxisType::XBOX_RIGHT_STICK_Y: return static_cast<int>(report.thumbRY);
+                case VirtualAxisType::XBOX_LEFT_TRIGGER: return static_cast<int>(report.leftTrigger);
+                case VirtualAxisType::XBOX_RIGHT_TRIGGER: return static_cast<int>(report.rightTrigger);
+                default: return 0;
+            }
+        };
+        const VirtualAxisType gamepadAxes[] = {
+            VirtualAxisType::XBOX_LEFT_STICK_X, VirtualAxisType::XBOX_LEFT_STICK_Y, VirtualAxisType::XBOX_RIGHT_STICK_X,
+            VirtualAxisType::XBOX_RIGHT_STICK_Y, VirtualAxisType::XBOX_LEFT_TRIGGER, VirtualAxisType::XBOX_RIGHT_TRIGGER,
+        };
+
+        // One input per target: buttons first, then each axis driven to a value out of range.
+        std::vector<MappingRule> rules;
+        for (const auto& [button, bit] : gamepadButtons) {
+            rules.emplace_back(InputCondition::OnButtonPress(static_cast<ButtonID>(rules.size())), std::vector<OutputAction>{ ButtonAction(button) });
+        }
+        const ButtonID firstAxis = static_cast<ButtonID>(rules.size());
+        for (const VirtualAxisType axis : gamepadAxes) {
+            rules.emplace_back(InputCondition::OnButtonPress(static_cast<ButtonID>(rules.size())),
+                               std::vector<OutputAction>{ OutputAction{ VirtualAxisAction{ axis, -40000 } } });
+        }
+        constexpr ButtonID Walk = 100, Jump = 101, Fire = 102, Nudge = 103, Scroll = 104, Unknown = 105;
+        rules.emplace_back(InputCondition::OnButtonPress(Walk), std::vector<OutputAction>{ ButtonAction(VirtualButtonType::KEY_W) });
+        rules.emplace_back(InputCondition::OnButtonPress(Jump), std::vector<OutputAction>{ ButtonAction(VirtualButtonType::KEY_SPACE) });
+        rules.emplace_back(InputCondition::OnButtonPress(Fire), std::vector<OutputAction>{ ButtonAction(VirtualButtonType::MOUSE_LEFT_BUTTON) });
+        rules.emplace_back(InputCondition::OnButtonPress(Nudge), std::vector<OutputAction>{ OutputAction{ VirtualAxisAction{ VirtualAxisType::MOUSE_X, 5 } },
+                                                                                          OutputAction{ VirtualAxisAction{ VirtualAxisType::MOUSE_Y, -3 } } });
+        rules.emplace_back(InputCondition::OnButtonPress(Scroll), std::vector<OutputAction>{ OutputAction{ VirtualAxisAction{ VirtualAxisType::MOUSE_SCROLL_WHEEL, 120 } } });
+        rules.emplace_back(InputCondition::OnButtonPress(Unknown), std::vector<OutputAction>{ ButtonAction(static_cast<VirtualButtonType>(999)) });
+        engine.LoadMappings(rules);
+
+        const DeviceIndex pad = 0;
+        auto press = [&engine, pad](ButtonID id, bool pressed) {
+            engine.ProcessInput(InputEvent::Button(pad, InputType::Button, id, pressed, 0));
+        };
+        bool ok = true;
+        auto check = [&ok](bool good, const char* what) {
+            if (!good) {
+                std::cout << "Output mismatch: " << what << std::endl;
+                ok = false;
+            }
+        };
+
+        for (size_t i = 0; i < std::size(gamepadButtons); ++i) {
+            press(static_cast<ButtonID>(i), true);
+            engine.EndFrame();
+            check(sink.GetReports().back().buttons == gamepadButtons[i].second, "gamepad button bit");
+            press(static_cast<ButtonID>(i), false);
+            engine.EndFrame();
+            check(sink.GetReports().back().buttons == 0, "gamepad button release");
+        }
+        for (size_t i = 0; i < std::size(gamepadAxes); ++i) {
+            const bool trigger = gamepadAxes[i] == VirtualAxisType::XBOX_LEFT_TRIGGER || gamepadAxes[i] == VirtualAxisType::XBOX_RIGHT_TRIGGER;
+            press(static_cast<ButtonID>(firstAxis + i), true);
+            engine.EndFrame();
+            GamepadReport expected{};
+            check(axisField(sink.GetReports().back(), gamepadAxes[i]) == (trigger ? 0 : -32768), "gamepad axis clamped into its field");
+            for (const VirtualAxisType other : gamepadAxes) {
+                if (other != gamepadAxes[i]) {
+                    check(axisField(sink.GetReports().back(), other) == axisField(expected, other), "gamepad axis store stays in its field");
+                }
+            }
+            press(static_cast<ButtonID>(firstAxis + i), false);
+            engine.EndFrame();
+        }
+        controller.SetAxis(VirtualAxisType::XBOX_RIGHT_TRIGGER, 300);
+        check(controller.GetReport().rightTrigger == 255 && controller.GetReport().buttons == 0, "trigger clamps high");
+        controller.SetAxis(VirtualAxisType::XBOX_RIGHT_TRIGGER, 0);
+        engine.EndFrame();
+
+        // A frame of keyboard and mouse output goes out as one batch, with the moves summed.
+        const size_t reportsBefore = sink.GetReports().size();
+        press(Walk, true);
+        press(Jump, true);
+        press(Fire, true);
+        press(Nudge, true);
+        press(Nudge, false);
+        press(Nudge, true);
+        press(Unknown, true);
+        engine.EndFrame();
+        const std::vector<InjectedInput> frame = {
+            { InjectedInput::Key, true, 0x11 },
+            { InjectedInput::Key, true, 0x39 },
+            { InjectedInput::MouseButton, true, static_cast<uint16_t>(MouseButtonId::Left) },
+            { InjectedInput::MouseMove, false, 0, 10, -6 },
+        };
+        check(keyboardMouseSink.GetBatchCount() == 1 && keyboardMouseSink.GetInputs() == frame, "keyboard and mouse frame batched");
+        check(sink.GetReports().size() == reportsBefore, "keyboard and mouse output leaves the gamepad alone");
+        press(Walk, true); // Already down: nothing to inject
+        press(Scroll, true);
+        press(Walk, false);
+        press(Jump, false);
+        press(Fire, false);
+        engine.EndFrame();
+        check(keyboardMouseSink.GetBatchCount() == 2 && keyboardMouseSink.GetInputs().size() == frame.size() + 4 &&
+              keyboardMouseSink.GetInputs()[frame.size()] == InjectedInput{ InjectedInput::MouseWheel, false, 0, 0, 120 },
+              "repeat press dropped, wheel and releases batched");
+
+        // Macro steps reach the keyboard too, and ReleaseAll lets go of what they left down.
+        engine.ApplyMacroStep({ MacroStep::Press, 0, static_cast<uint16_t>(VirtualButtonType::KEY_D), 0 });
+        engine.ApplyMacroStep({ MacroStep::Press, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_A), 0 });
+        engine.FlushMacroSteps();
+        check(keyboardMouseSink.GetInputs().back() == InjectedInput{ InjectedInput::Key, true, 0x20 } && sink.GetReports().back().buttons == GamepadA,
+              "macro steps on both outputs");
+        keyboardMouse.ReleaseAll();
+        check(keyboardMouseSink.GetInputs().back() == InjectedInput{ InjectedInput::Key, false, 0x20 }, "ReleaseAll lets go");
+        engine.ApplyMacroStep({ MacroStep::Release, 0, static_cast<uint16_t>(VirtualButtonType::XBOX_A), 0 });
+        engine.FlushMacroSteps();
+        if (ok) {
+            std::cout << "Outputs: every button and axis target landed where the table says" << std::endl;
+        }
+
+        // Random presses and releases across gamepad, keyboard and mouse targets.
+        const ButtonID inputs[] = { 0, 5, 11, 14, static_cast<ButtonID>(firstAxis), static_cast<ButtonID>(firstAxis + 4), Walk, Jump, Fire };
+        bool down[std::size(inputs)] = {};
+        Random random(seed);
+        sink.Reserve(count + sink.GetReports().size());
+        keyboardMouseSink.Reserve(count + keyboardMouseSink.GetInputs().size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // Let the logger settle
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const uint64_t start = MonotonicNanoseconds();
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t pick = random.Below(static_cast<uint32_t>(std::size(inputs)));
+            down[pick] = !down[pick];
+            press(inputs[pick], down[pick]);
+            engine.EndFrame();
+        }
+        const uint64_t elapsed = MonotonicNanoseconds() - start;
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        std::cout << "Outputs: " << count << " events to gamepad, keyboard and mouse targets, " << keyboardMouseSink.GetBatchCount()
+                  << " SendInput batches, " << static_cast<double>(elapsed) / static_cast<double>(count) << " ns per event, "
+                  << allocations << " allocations" << std::endl;
+        keyboardMouse.ReleaseAll();
+        controller.Shutdown();
+        return ok;
+    }
+
+    // Returns false if a batch's scans disagree with a plain loop over the events, or if
+    // mapping through batches sends anything other than mapping event by event.
+    bool RunBatchCheck(size_t count, uint64_t seed) {
+        const std::vector<InputEvent> events = MakeSyntheticStream(count, seed);
+        Random random(seed);
+        InputEventBatch batch;
+        uint16_t selected[InputEventBatch::Capacity];
+        auto fail = [](const char* what, size_t at) {
+            std::cout << "Batches: " << what << " disagrees at event " << at << std::endl;
+            return false;
+        };
+
+        // Batches of every size cut anywhere in the stream, frames split across them included.
+        for (size_t begin = 0; begin < events.size();) {
+            const size_t size = std::min<size_t>(1 + random.Below(InputEventBatch::Capacity), events.size() - begin);
+            const InputEvent* chunk = events.data() + begin;
+            batch.Clear();
+            if (batch.Append(chunk, size) != size) {
+                return fail("Append", begin);
+            }
+            const InputEventBatch::Mask markers = batch.Match(InputType::Unknown);
+            const ButtonID button = static_cast<ButtonID>(random.Below(SyntheticButtons));
+            const size_t buttons = batch.Select(InputType::Button, button, selected);
+            size_t expectedButtons = 0;
+            for (size_t i = 0; i < size; ++i) {
+                const InputEvent event = batch.Get(i);
+                if (std::memcmp(&event, &chunk[i], sizeof(InputEvent)) != 0) {
+                    return fail("Get", begin + i);
+                }
+                if (((markers[i / 64] >> (i % 64)) & 1) != (chunk[i].type == InputType::Unknown)) {
+                    return fail("Match", begin + i);
+                }
+                if (chunk[i].type == InputType::Button && chunk[i].id == button &&
+                    (expectedButtons >= buttons || selected[expectedButtons++] != i)) {
+                    return fail("Select", begin + i);
+                }
+            }
+            if (expectedButtons != buttons) {
+                return fail("Select", begin + size);
+            }
+            begin += size;
+        }
+
+        // The same stream through ProcessBatch, in random pieces, and through ProcessInput.
+        const Profile profile = MakeBuiltInProfile(0);
+        RecordingGamepadSink batchSink;
+        RecordingGamepadSink eventSink;
+        batchSink.Reserve(events.size());
+        eventSink.Reserve(events.size());
+        VirtualController batchController(batchSink);
+        VirtualController eventController(eventSink);
+        batchController.Initialize();
+        eventController.Initialize();
+        MappingEngine batchEngine(batchController);
+        MappingEngine eventEngine(eventController);
+        batchEngine.LoadMappings(profile.GetMappings());
+        eventEngine.LoadMappings(profile.GetMappings());
+        for (const auto& event : events) {
+            if (event.type == InputType::Unknown) {
+                eventEngine.EndFrame();
+            } else {
+                eventEngine.ProcessInput(event);
+            }
+        }
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        for (size_t begin = 0; begin < events.size();) {
+            const size_t size = std::min<size_t>(1 + random.Below(InputEventBatch::Capacity), events.size() - begin);
+            batch.Clear();
+            batch.Append(events.data() + begin, size);
+            batchEngine.ProcessBatch(batch);
+            begin += size;
+        }
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        batchController.Shutdown();
+        eventController.Shutdown();
+        if (batchSink.GetReports() != eventSink.GetReports()) {
+            std::cout << "Batches: ProcessBatch sent " << batchSink.GetReports().size() << " reports, ProcessInput "
+                      << eventSink.GetReports().size() << ", or different ones" << std::endl;
+            return false;
+        }
+
+        // Finding one control's events: a column scan against a loop over whole events.
+        constexpr int Rounds = 20;
+        const size_t batchCount = (events.size() + InputEventBatch::Capacity - 1) / InputEventBatch::Capacity;
+        std::vector<InputEventBatch> batches(batchCount);
+        for (size_t i = 0; i < batchCount; ++i) {
+            const size_t begin = i * InputEventBatch::Capacity;
+            batches[i].Append(events.data() + begin, std::min(InputEventBatch::Capacity, events.size() - begin));
+        }
+        size_t columnFound = 0;
+        uint64_t start = MonotonicNanoseconds();
+        for (int round = 0; round < Rounds; ++round) {
+            for (const auto& each : batches) {
+                columnFound += each.Select(InputType::Button, static_cast<ButtonID>(round % SyntheticButtons), selected);
+            }
+        }
+        const uint64_t columnNs = MonotonicNanoseconds() - start;
+        size_t eventFound = 0;
+        start = MonotonicNanoseconds();
+        for (int round = 0; round < Rounds; ++round) {
+            const ButtonID button = static_cast<ButtonID>(round % SyntheticButtons);
+            for (size_t begin = 0; begin < events.size(); begin += InputEventBatch::Capacity) {
+                const size_t end = std::min(begin + InputEventBatch::Capacity, events.size());
+                size_t found = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    if (events[i].type == InputType::Button && events[i].id == button) {
+                        selected[found++] = static_cast<uint16_t>(i - begin);
+                    }
+                }
+                eventFound += found;
+            }
+        }
+        const uint64_t eventNs = MonotonicNanoseconds() - start;
+        if (columnFound != eventFound) {
+            std::cout << "Batches: column scan found " << columnFound << " events, event loop " << eventFound << std::endl;
+            return false;
+        }
+        const double scanned = static_cast<double>(events.size()) * Rounds;
+        std::cout << "Batches: " << events.size() << " events in batches of every size matched event-by-event mapping, "
+                  << allocations << " allocations; finding one button: " << static_cast<double>(columnNs) / scanned
+                  << " ns per event by column, " << static_cast<double>(eventNs) / scanned << " ns by event" << std::endl;
+        return true;
+    }
+    bool RunDeviceCheck(size_t count, uint64_t seed) {
+        Random random(seed);
+        DeviceRegistry registry;
+        std::unordered_map<PhysicalDeviceID, DeviceIndex> reference;
+        std::array<PhysicalDeviceID, MaxDevices> owners{};
+        auto fail = [](const char* what, size_t at) {
+            std::cout << "Devices: " << what << " is wrong at step " << at << std::endl;
+            return false;
+        };
+
+        // Random arrivals, lookups and removals from a pool of handles over three times what
+        // the registry holds, so it runs full and indices are recycled all the time. Handles
+        // are small numbers and pointer-like values, both multiples of 4 as real ones are.
+        constexpr uint32_t HandlePool = 3 * MaxDevices;
+        auto handle = [](uint32_t n) {
+            const uintptr_t base = n % 2 == 0 ? uintptr_t{ 0x10 } : uintptr_t{ 0x7FF6A0000000 };
+            return reinterpret_cast<PhysicalDeviceID>(base + uintptr_t{ n } * 4);
+        };
+        for (size_t step = 0; step < count; ++step) {
+            const PhysicalDeviceID device = handle(random.Below(HandlePool));
+            const auto known = reference.find(device);
+            const uint32_t op = random.Below(10);
+            if (op < 6) {
+                // The lowest index nobody holds, or none while all are taken.
+                DeviceIndex expected = NoDeviceIndex;
+                if (known != reference.end()) {
+                    expected = known->second;
+                } else {
+                    for (DeviceIndex index = 0; index < MaxDevices; ++index) {
+                        if (owners[index] == nullptr) {
+                            expected = index;
+                            break;
+                        }
+                    }
+                }
+                // Twice; the second time it is already registered.
+                if (registry.GetIndex(device) != expected || registry.GetIndex(device) != expected) {
+                    return fail("GetIndex", step);
+                }
+                if (known == reference.end() && expected != NoDeviceIndex) {
+                    reference.emplace(device, expected);
+                    owners[expected] = device;
+                }
+            } else if (op < 8) {
+                const DeviceIndex expected = known != reference.end() ? known->second : NoDeviceIndex;
+                if (registry.Remove(device) != expected) {
+                    return fail("Remove", step);
+                }
+                if (expected != NoDeviceIndex) {
+                    owners[expected] = nullptr;
+                    reference.erase(known);
+                }
+            } else {
+                if (registry.Find(device) != (known != reference.end() ? known->second : NoDeviceIndex)) {
+                    return fail("Find", step);
+                }
+            }
+            if (registry.GetCount() != reference.size()) {
+                return fail("GetCount", step);
+            }
+        }
+        for (DeviceIndex index = 0; index < MaxDevices; ++index) {
+            if (registry.GetHandle(index) != owners[index]) {
+                return fail("GetHandle", count);
+            }
+        }
+        if (registry.GetIndex(nullptr) != NoDeviceIndex) {
+            return fail("GetIndex(nullptr)", count);
+        }
+
+        // Models, read from hardware IDs and interface names alike.
+        struct ModelCase {
+            const wchar_t* text;
+            DeviceModel expected;
+        };
+        const ModelCase modelCases[] = {
+            { L"HID\\VID_045E&PID_028E&REV_0110", { 0x045E, 0x028E } },
+            { L"\\\\?\\HID#VID_046D&PID_C52B&MI_01#7&1234&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", { 0x046D, 0xC52B } },
+            { L"hid\\vid_054c&pid_0ce6", { 0x054C, 0x0CE6 } },
+            { L"HID\\VID_045E", { 0x045E, 0 } },
+            { L"HID\\VID_04G5&PID_028E", { 0, 0x028E } },
+            { L"HID\\PID_12", { 0, 0 } },
+            { L"", { 0, 0 } },
+        };
+        for (const auto& modelCase : modelCases) {
+            if (DeviceRegistry::ParseModel(modelCase.text, std::wcslen(modelCase.text)) != modelCase.expected) {
+                std::wcout << L"Devices: ParseModel read " << modelCase.text << L" wrong" << std::endl;
+                return false;
+            }
+        }
+
+        // A rule bound to a model follows the pad from index to index, and a removed pad gives
+        // up its seat for the next one to join.
+        DeviceRegistry pads;
+        RecordingGamepadSink sinks[2];
+        VirtualController first(sinks[0]);
+        VirtualController second(sinks[1]);
+        first.Initialize();
+        second.Initialize();
+        VirtualControllerPool pool;
+        pool.Add(first);
+        pool.Add(second);
+        MappingEngine engine(pool);
+        engine.SetDeviceRegistry(&pads);
+        engine.SetAutoAssignSlots(true);
+        constexpr DeviceModel Xbox{ 0x045E, 0x028E };
+        constexpr DeviceModel DualSense{ 0x054C, 0x0CE6 };
+        InputCondition xboxOnly = InputCondition::OnButtonPress(0);
+        xboxOnly.model = Xbox;
+        engine.LoadMappings({
+            MappingRule(xboxOnly, { ButtonAction(VirtualButtonType::XBOX_A) }),
+            MappingRule(InputCondition::OnButtonPress(0), { ButtonAction(VirtualButtonType::XBOX_B) }),
+        });
+        auto press = [&engine](DeviceIndex device, bool pressed) {
+            engine.ProcessInput(InputEvent::Button(device, InputType::Button, 0, pressed));
+            engine.EndFrame();
+        };
+        auto buttonsOf = [&sinks](size_t pad) {
+            const auto& reports = sinks[pad].GetReports();
+            return reports.empty() ? uint16_t{ 0 } : reports.back().buttons;
+        };
+        bool ok = true;
+        auto expect = [&ok](const char* what, uint16_t actual, uint16_t expected) {
+            if (actual != expected) {
+                std::cout << "Devices: " << what << ": buttons " << std::hex << actual << ", expected " << expected << std::dec << std::endl;
+                ok = false;
+            }
+        };
+        const auto padA = reinterpret_cast<PhysicalDeviceID>(uintptr_t{ 0x100 });
+        const auto padB = reinterpret_cast<PhysicalDeviceID>(uintptr_t{ 0x200 });
+        const auto padC = reinterpret_cast<PhysicalDeviceID>(uintptr_t{ 0x300 });
+        const DeviceIndex a = pads.GetIndex(padA);
+        const DeviceIndex b = pads.GetIndex(padB);
+        pads.SetModel(a, DualSense);
+        pads.SetModel(b, Xbox);
+        press(a, true);
+        expect("other model takes the generic rule", buttonsOf(0), GamepadB);
+        press(b, true);
+        expect("bound model takes its rule", buttonsOf(1), GamepadA);
+        press(a, false);
+        press(b, false);
+
+        // Pad A goes: the engine hears of it in order, and pad C gets its index and seat.
+        engine.ProcessInput(InputEvent{ 0, InputType::DeviceRemoved, a, 0, 0 });
+        engine.EndFrame();
+        pads.Remove(padA);
+        const DeviceIndex c = pads.GetIndex(padC);
+        if (c != a || pads.IsIdentified(c) || pads.GetModel(c).IsKnown()) {
+            std::cout << "Devices: a recycled index kept the old device's model" << std::endl;
+            ok = false;
+        }
+        pads.SetModel(c, Xbox);
+        press(c, true);
+        expect("new pad of the bound model on the freed seat", buttonsOf(0), GamepadA);
+        press(c, false);
+        first.Shutdown();
+        second.Shutdown();
+        if (!ok) {
+            return false;
+        }
+
+        // Lookups alternating between devices at random, against a hash map; then runs from
+        // one device, as reports from a single pad come.
+        constexpr size_t Present = 8;
+        constexpr size_t Lookups = 1 << 20;
+        DeviceRegistry timed;
+        std::unordered_map<PhysicalDeviceID, DeviceIndex> map;
+        PhysicalDeviceID handles[Present];
+        for (size_t i = 0; i < Present; ++i) {
+            handles[i] = handle(static_cast<uint32_t>(i * 7 + 1));
+            map.emplace(handles[i], timed.GetIndex(handles[i]));
+        }
+        std::vector<uint8_t> order(Lookups);
+        for (auto& next : order) {
+            next = static_cast<uint8_t>(random.Below(Present));
+        }
+        auto time = [&order, &handles](auto&& lookup) {
+            size_t sum = 0;
+            const uint64_t start = MonotonicNanoseconds();
+            for (const uint8_t next : order) {
+                sum += lookup(handles[next]);
+            }
+            const uint64_t elapsed = MonotonicNanoseconds() - start;
+            return std::make_pair(static_cast<double>(elapsed) / static_cast<double>(order.size()), sum);
+        };
+        const uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const auto registryMixed = time([&timed](PhysicalDeviceID device) { return timed.GetIndex(device); });
+        const auto mapMixed = time([&map](PhysicalDeviceID device) { return map.find(device)->second; });
+        std::sort(order.begin(), order.end());
+        const auto registryRuns = time([&timed](PhysicalDeviceID device) { return timed.GetIndex(device); });
+        const uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        if (registryMixed.second != mapMixed.second || registryRuns.second != mapMixed.second) {
+            std::cout << "Devices: the timed lookups disagree" << std::endl;
+            return false;
+        }
+        std::cout << "Devices: " << count << " random arrivals, lookups and removals matched a hash map, models and removal "
+                  << "reached the engine, " << allocations << " allocations; lookup among " << Present << " devices: "
+                  << registryMixed.first << " ns (mixed), " << registryRuns.first << " ns (runs), hash map "
+                  << mapMixed.first << " ns" << std::endl;
+        return true;
+    }
+    bool RunDeviceListCheck(size_t count, uint64_t seed) {
+        Random random(seed);
+        auto fail = [](const char* what, size_t at) {
+            std::cout << "Device list: " << what << " is wrong at step " << at << std::endl;
+            return false;
+        };
+
+        // Instance IDs out of interface paths, as device notifications name devices.
+        struct PathCase {
+            const wchar_t* path;
+            const wchar_t* expected;
+        };
+        const PathCase pathCases[] = {
+            { L"\\\\?\\HID#VID_045E&PID_028E#7&1a2b3c4d&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", L"HID\\VID_045E&PID_028E\\7&1A2B3C4D&0&0000" },
+            { L"\\\\?\\hid#vid_046d&pid_c52b&mi_01&col02#8&2f1e&0&0001#{378de44c-56ef-11d1-bc8c-00a0c91405dd}", L"HID\\VID_046D&PID_C52B&MI_01&COL02\\8&2F1E&0&0001" },
+            { L"HID\\VID_045E&PID_028E\\7&1A2B", L"" },
+            { L"\\\\?\\HID#VID_045E&PID_028E#7&1a2b", L"" },
+            { L"", L"" },
+        };
+        for (const auto& pathCase : pathCases) {
+            if (DeviceTable::InstanceIdFromInterface(pathCase.path, std::wcslen(pathCase.path)) != pathCase.expected) {
+                std::wcout << L"Device list: InstanceIdFromInterface read " << pathCase.path << L" wrong" << std::endl;
+                return false;
+            }
+        }
+
+        // A world of devices coming, going and being renamed. Odd-numbered ones are raw input
+        // devices, whose changes are also notified; every so often a sweep lists the world,
+        // and more changes happen between the listing and its Sync, as on a background thread.
+        constexpr uint32_t DevicePool = 96;
+        auto instanceId = [](uint32_t n, bool lowerCase) {
+            std::wstring id = L"HID\\VID_" + std::to_wstring(1000 + n) + L"&PID_00" + std::to_wstring(10 + n % 90) + L"\\7&ABCDEF&0&" + std::to_wstring(n);
+            if (lowerCase) {
+                for (auto& c : id) {
+                    c = static_cast<wchar_t>(std::towlower(c));
+                }
+            }
+            return id;
+        };
+        std::map<std::wstring, InputDevice> world;
+        DeviceTable table;
+        size_t sweeps = 0;
+        auto change = [&](size_t step, bool notifiedOnly) {
+            const uint32_t n = notifiedOnly ? random.Below(DevicePool / 2) * 2 + 1 : random.Below(DevicePool);
+            const std::wstring key = instanceId(n, false);
+            const bool notified = n % 2 == 1;
+            const auto present = world.find(key);
+            if (present != world.end() && random.Below(3) != 0) {
+                world.erase(present);
+                if (notified && !table.Remove(instanceId(n, true))) {
+                    return fail("Remove", step);
+                }
+            } else {
+                InputDevice device{ L"Pad " + std::to_wstring(n) + L" rev " + std::to_wstring(random.Below(3)), key,
+                                    { static_cast<uint16_t>(0x0400 + n), static_cast<uint16_t>(n) } };
+                const bool differs = present == world.end() || present->second.name != device.name;
+                world[key] = device;
+                if (notified && table.Add(device) != differs) {
+                    return fail("Add", step);
+                }
+            }
+            return true;
+        };
+        for (size_t step = 0; step < count; ++step) {
+            if (!change(step, false)) {
+                return false;
+            }
+            if (random.Below(64) != 0) {
+                continue;
+            }
+
+            table.BeginSync();
+            std::vector<InputDevice> sweep;
+            for (const auto& [key, device] : world) {
+                sweep.push_back(device);
+                if (random.Below(2) == 0) {
+                    sweep.back().instanceId = instanceId(static_cast<uint32_t>(device.model.productId), true);
+                }
+            }
+            std::shuffle(sweep.begin(), sweep.end(), std::mt19937_64(random.Next()));
+            // Only notified changes can reach the table before the next sweep.
+            for (uint32_t late = random.Below(4); late != 0; --late) {
+                if (!change(step, true)) {
+                    return false;
+                }
+            }
+            const std::vector<InputDevice> before = table.GetDevices();
+            const std::vector<DeviceTable::Change> changes = table.Sync(std::move(sweep));
+            ++sweeps;
+
+            // Notifications still count on top of the older sweep, so the table is the world.
+            const std::vector<InputDevice> after = table.GetDevices();
+            if (after.size() != world.size() || !table.IsSynced()) {
+                return fail("Sync", step);
+            }
+            size_t i = 0;
+            for (const auto& [key, device] : world) {
+                if (after[i].instanceId != key || after[i].name != device.name || after[i].model != device.model) {
+                    return fail("Sync", step);
+                }
+                ++i;
+            }
+
+            // The changes are exactly the difference from before, in order.
+            std::vector<DeviceTable::Change> expected;
+            std::map<std::wstring, const InputDevice*> old;
+            for (const auto& device : before) {
+                old[device.instanceId] = &device;
+            }
+            std::set<std::wstring> keys;
+            for (const auto& device : before) {
+                keys.insert(device.instanceId);
+            }
+            for (const auto& [key, device] : world) {
+                keys.insert(key);
+            }
+            for (const auto& key : keys) {
+                const auto was = old.find(key);
+                const auto now = world.find(key);
+                if (now == world.end()) {
+                    expected.push_back({ DeviceTable::Change::Removed, *was->second });
+                } else if (was == old.end()) {
+                    expected.push_back({ DeviceTable::Change::Added, now->second });
+                } else if (was->second->name != now->second.name) {
+                    expected.push_back({ DeviceTable::Change::Updated, now->second });
+                }
+            }
+            if (changes.size() != expected.size()) {
+                return fail("the changes from Sync", step);
+            }
+            for (size_t c = 0; c < changes.size(); ++c) {
+                if (changes[c].kind != expected[c].kind || changes[c].device.instanceId != expected[c].device.instanceId ||
+                    changes[c].device.name != expected[c].device.name) {
+                    return fail("the changes from Sync", step);
+                }
+            }
+        }
+
+        // Devices without notifications that came after the last sweep only reach the table
+        // with the next one, so a final sweep first; then every device is found under its
+        // ID in either case.
+        table.BeginSync();
+        std::vector<InputDevice> last;
+        for (const auto& [key, device] : world) {
+            last.push_back(device);
+        }
+        table.Sync(std::move(last));
+        for (const auto& [key, device] : world) {
+            InputDevice found;
+            if (!table.Find(instanceId(static_cast<uint32_t>(device.model.productId), true), found) || found.name != device.name) {
+                return fail("Find", count);
+            }
+        }
+
+        // What a sweep costs to apply when nothing changed, which is the usual case.
+        std::vector<InputDevice> full;
+        for (uint32_t n = 0; n < 256; ++n) {
+            full.push_back({ L"Device " + std::to_wstring(n), instanceId(n, false), { static_cast<uint16_t>(n), 1 } });
+        }
+        DeviceTable timed;
+        timed.Sync(full);
+        constexpr int Rounds = 50;
+        const uint64_t start = MonotonicNanoseconds();
+        size_t changed = 0;
+        for (int round = 0; round < Rounds; ++round) {
+            changed += timed.Sync(full).size();
+        }
+        const double syncUs = static_cast<double>(MonotonicNanoseconds() - start) / 1000.0 / Rounds;
+        if (changed != 0) {
+            return fail("an unchanged Sync", count);
+        }
+        std::cout << "Device list: " << count << " arrivals, removals and renames with " << sweeps
+                  << " overlapping sweeps kept the table exact; applying an unchanged sweep of " << full.size()
+                  << " devices: " << syncUs << " us" << std::endl;
+        return true;
+    }
+    bool RunStartupCheck(size_t count, uint64_t seed) {
+        Random random(seed);
+        const std::thread::id caller = std::this_thread::get_id();
+
+        // A random graph of stages that sleep for up to 2 ms, a few of which fail and a few of
+        // which must run on this thread. Each depends on up to three earlier ones.
+        struct Plan {
+            std::vector<StartupOrchestrator::StageId> after;
+            uint64_t sleepUs;
+            bool fails;
+            StartupOrchestrator::Runs runs;
+            bool expectRun;
+            bool expectSuccess;
+        };
+        std::vector<Plan> plans(count);
+        for (size_t i = 0; i < count; ++i) {
+            Plan& plan = plans[i];
+            for (uint32_t d = i != 0 ? random.Below(4) : 0; d != 0; --d) {
+                plan.after.push_back(static_cast<StartupOrchestrator::StageId>(random.Below(static_cast<uint32_t>(i))));
+            }
+            plan.sleepUs = random.Below(2000);
+            plan.fails = random.Below(20) == 0;
+            plan.runs = random.Below(8) == 0 ? StartupOrchestrator::Runs::OnCaller : StartupOrchestrator::Runs::OnPool;
+            plan.expectRun = std::all_of(plan.after.begin(), plan.after.end(), [&plans](auto d) { return plans[d].expectSuccess; });
+            plan.expectSuccess = plan.expectRun && !plan.fails;
+        }
+
+        std::vector<std::atomic<int>> runs(count);
+        std::atomic<bool> wrongThread{ false };
+        bool ok = true;
+        std::vector<StartupOrchestrator::Timing> timings;
+        const uint64_t wallStart = MonotonicNanoseconds();
+        {
+            StartupOrchestrator startup;
+            for (size_t i = 0; i < count; ++i) {
+                const Plan& plan = plans[i];
+                startup.Add("stage", [&plan, &runs, &wrongThread, caller, i] {
+                    runs[i].fetch_add(1);
+                    if ((std::this_thread::get_id() == caller) != (plan.runs == StartupOrchestrator::Runs::OnCaller)) {
+                        wrongThread = true;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(plan.sleepUs));
+                    return !plan.fails;
+                }, plan.after, plan.runs);
+            }
+            startup.Start();
+            for (size_t i = 0; i < count; ++i) {
+                if (plans[i].runs == StartupOrchestrator::Runs::OnCaller &&
+                    startup.RunHere(static_cast<StartupOrchestrator::StageId>(i)) != plans[i].expectSuccess) {
+                    std::cout << "Startup: RunHere of stage " << i << " returned the wrong result" << std::endl;
+                    ok = false;
+                }
+            }
+            startup.WaitAll();
+            timings = startup.GetTimings();
+        }
+        const uint64_t wallNs = MonotonicNanoseconds() - wallStart;
+
+        // Each stage ran once if and only if everything before it succeeded, on the right
+        // thread, and only after its dependencies had ended.
+        std::vector<uint64_t> finishUs(count, 0);
+        uint64_t totalUs = 0;
+        uint64_t criticalUs = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const Plan& plan = plans[i];
+            const auto expectedState = !plan.expectRun ? StartupOrchestrator::State::Skipped
+                                       : plan.fails    ? StartupOrchestrator::State::Failed
+                                                       : StartupOrchestrator::State::Succeeded;
+            if (runs[i].load() != (plan.expectRun ? 1 : 0) || timings[i].state != expectedState) {
+                std::cout << "Startup: stage " << i << " ran " << runs[i].load() << " times" << std::endl;
+                ok = false;
+            }
+            uint64_t readyUs = 0;
+            for (const auto d : plan.after) {
+                if (plan.expectRun && timings[i].startNs < timings[d].endNs) {
+                    std::cout << "Startup: stage " << i << " started before stage " << d << " ended" << std::endl;
+                    ok = false;
+                }
+                readyUs = std::max(readyUs, finishUs[d]);
+            }
+            if (plan.expectRun) {
+                finishUs[i] = readyUs + plan.sleepUs;
+                totalUs += plan.sleepUs;
+                criticalUs = std::max(criticalUs, finishUs[i]);
+            }
+        }
+        if (wrongThread) {
+            std::cout << "Startup: a stage ran on the wrong thread" << std::endl;
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+        std::cout << "Startup: " << count << " stages ran in dependency order on the right threads, failures skipped their "
+                  << "dependents; " << static_cast<double>(wallNs) / 1e6 << " ms for " << static_cast<double>(totalUs) / 1e3
+                  << " ms of stages with a " << static_cast<double>(criticalUs) / 1e3 << " ms critical path" << std::endl;
+        return true;
+    }
+    bool RunLibraryCheck(size_t count, uint64_t seed) {
+        namespace fs = std::filesystem;
+        Random random(seed);
+        const fs::path directory = fs::temp_directory_path() / ("CoreServiceBench-library-" + std::to_string(seed));
+        std::error_code error;
+        fs::remove_all(directory, error);
+        fs::create_directories(directory, error);
+        if (error) {
+            std::cout << "Library: could not create " << directory.string() << std::endl;
+            return false;
+        }
+
+        // Profiles as SaveProfile writes them, with the name first, so the scan stops reading
+        // there. Every eighth has its keys sorted instead, as a hand-written or older one may,
+        // and the scan has to stream past its rules.
+        std::map<std::string, std::pair<std::string, size_t>> expected; // Path -> name, rule count
+        auto writeProfile = [&](const std::string& path, const std::string& name, size_t rules, bool nameFirst) {
+            nlohmann::json j;
+            j["mappings"] = nlohmann::json::array();
+            for (size_t r = 0; r < rules; ++r) {
+                j["mappings"].push_back(MappingRule(InputCondition::OnButtonPress(static_cast<ButtonID>(r % 256)),
+                                                    { ButtonAction(VirtualButtonType::XBOX_A) }));
+            }
+            if (nameFirst) {
+                nlohmann::ordered_json ordered{ { "profileName", name }, { "mappings", j["mappings"] } };
+                std::ofstream(path) << ordered.dump(4);
+            } else {
+                j["profileName"] = name;
+                std::ofstream(path) << j.dump(4);
+            }
+            expected[path] = { name, rules };
+        };
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < count; ++i) {
+            paths.push_back((directory / ("profile" + std::to_string(i) + ".json")).string());
+            writeProfile(paths.back(), "Library profile " + std::to_string(i), 20 + random.Below(400), i % 8 != 0);
+        }
+        // Two that cannot be indexed: no name, and not JSON.
+        std::ofstream((directory / "unnamed.json").string()) << "{ \"mappings\": [] }";
+        std::ofstream((directory / "broken.json").string()) << "{ \"profileName\": ";
+        auto& log = std::cout;
+        auto matches = [&](const ProfileLibrary& library, const char* when) {
+            bool ok = library.GetEntries().size() == expected.size();
+            for (const auto& entry : library.GetEntries()) {
+                const auto it = expected.find(entry.path);
+                ok = ok && it != expected.end() && it->second.first == entry.name && library.Find(entry.name) == &entry;
+            }
+            if (!ok) {
+                log << "Library: the index " << when << " does not match the files" << std::endl;
+            }
+            return ok;
+        };
+        auto counts = [&](const ProfileLibrary::ScanResult& result, size_t read, size_t added, size_t updated, size_t removed, const char* when) {
+            if (result.read == read && result.added == added && result.updated == updated && result.removed == removed && result.failed == 2) {
+                return true;
+            }
+            log << "Library: " << when << " read " << result.read << ", added " << result.added << ", updated " << result.updated << ", removed "
+                << result.removed << ", failed " << result.failed << "; expected " << read << ", " << added << ", " << updated << ", " << removed
+                << ", 2" << std::endl;
+            return false;
+        };
+
+        // A first scan reads everything; a restart with the saved index reads only what it
+        // could not index.
+        ProfileLibrary first;
+        uint64_t start = MonotonicNanoseconds();
+        const auto fresh = first.Scan(directory.string());
+        const uint64_t freshNs = MonotonicNanoseconds() - start;
+        bool ok = counts(fresh, count + 2, count, 0, 0, "the first scan") && matches(first, "after the first scan");
+        ok = ok && first.SaveIndex(ProfileLibrary::GetIndexPath(directory.string()));
+        ProfileLibrary library;
+        ok = ok && library.LoadIndex(ProfileLibrary::GetIndexPath(directory.string()));
+        start = MonotonicNanoseconds();
+        const auto restart = library.Scan(directory.string());
+        const uint64_t unchangedNs = MonotonicNanoseconds() - start;
+        ok = ok && counts(restart, 2, 0, 0, 0, "a scan from the saved index") && matches(library, "loaded");
+
+        // Activation through the cache, against a reference LRU list: a hit returns the
+        // profile already built, a miss builds it from its file with all its rules.
+        const size_t used = std::min<size_t>(count, 3 * ProfileLibrary::DefaultCacheCapacity);
+        std::vector<std::string> recent; // Most recent last
+        std::map<std::string, std::shared_ptr<const Profile>> built;
+        for (size_t step = 0; ok && step < 50 * used; ++step) {
+            const ProfileLibrary::Entry entry = library.GetEntries()[random.Below(static_cast<uint32_t>(used))];
+            const auto cached = std::find(recent.begin(), recent.end(), entry.path);
+            const bool hit = cached != recent.end();
+            if (hit) {
+                recent.erase(cached);
+            } else if (recent.size() == ProfileLibrary::DefaultCacheCapacity) {
+                recent.erase(recent.begin());
+            }
+            recent.push_back(entry.path);
+            const auto profile = library.Materialize(entry);
+            if (!profile || profile->GetName() != entry.name || profile->GetMappings().size() != expected[entry.path].second ||
+                (profile == built[entry.path]) != hit || library.GetCachedCount() != recent.size()) {
+                log << "Library: activation " << step << " of " << entry.name << " was not a cache " << (hit ? "hit" : "miss") << std::endl;
+                ok = false;
+            }
+            built[entry.path] = profile;
+        }
+
+        // Changed, touched, deleted and new files; a changed profile that was cached is built
+        // again from its new contents.
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; ++i) {
+            order[i] = i;
+        }
+        for (size_t i = count; i > 1; --i) {
+            std::swap(order[i - 1], order[random.Below(static_cast<uint32_t>(i))]);
+        }
+        const size_t changes = std::max<size_t>(1, count / 10);
+        const std::string cachedPath = recent.back();
+        for (size_t i = 0; ok && i < std::min(count, 2 * changes + 1); ++i) {
+            const std::string& path = paths[order[i]];
+            if (i < changes) {
+                // One rule more changes the size, whatever the clock's resolution.
+                writeProfile(path, expected[path].first + " v2", expected[path].second + 1, i % 8 != 0);
+            } else if (i < 2 * changes) {
+                fs::last_write_time(path, fs::last_write_time(path) + std::chrono::hours(1));
+            } else {
+                fs::remove(path);
+                expected.erase(path);
+            }
+        }
+        // The new one through SaveProfile itself, which has to put the name first too.
+        {
+            RecordingGamepadSink sink;
+            VirtualController controller(sink);
+            MappingEngine engine(controller);
+            ProfileManager manager(engine);
+            Profile added("Added profile");
+            for (size_t r = 0; r < 10; ++r) {
+                added.AddMapping(MappingRule(InputCondition::OnButtonPress(static_cast<ButtonID>(r)), { ButtonAction(VirtualButtonType::XBOX_B) }));
+            }
+            const std::string path = (directory / "added.json").string();
+            const bool saved = manager.SaveProfile(added, path);
+            std::ifstream file(path);
+            std::string line; // The line after the opening brace
+            if (saved && std::getline(file, line) && std::getline(file, line) && line.find("\"profileName\"") != std::string::npos) {
+                expected[path] = { added.GetName(), 10 };
+            } else {
+                log << "Library: SaveProfile did not write the name first" << std::endl;
+                ok = false;
+            }
+        }
+        const bool cachedChanged = expected.count(cachedPath) && expected[cachedPath].first.size() > 3 &&
+                                   expected[cachedPath].first.compare(expected[cachedPath].first.size() - 3, 3, " v2") == 0;
+        const size_t removedCount = count > 2 * changes ? 1 : 0;
+        start = MonotonicNanoseconds();
+        const auto rescan = library.Scan(directory.string());
+        const uint64_t rescanNs = MonotonicNanoseconds() - start;
+        // A touched file counts as changed: its contents are not compared, only its stamp.
+        ok = ok && counts(rescan, std::min(count, 2 * changes) + 3, 1, std::min(count, 2 * changes), removedCount, "a rescan") &&
+             matches(library, "rescanned");
+        if (ok && expected.count(cachedPath)) {
+            const auto profile = library.Materialize(*library.Find(expected[cachedPath].first));
+            if (!profile || profile->GetMappings().size() != expected[cachedPath].second || (profile == built[cachedPath]) == cachedChanged) {
+                log << "Library: the cached " << expected[cachedPath].first << " was not rebuilt after a rescan" << std::endl;
+                ok = false;
+            }
+        }
+
+        // An edit that keeps the size, with the write time put back as a clock too coarse to
+        // see it would leave it: the stamp still matches, so only the content hash can tell
+        // the cached profile, and the compiled image next to the file, are stale.
+        if (ok && !expected.empty()) {
+            const std::string path = expected.count(cachedPath) ? cachedPath : expected.begin()->first;
+            const ProfileLibrary::Entry entry = *library.Find(expected[path].first);
+            const auto before = library.Materialize(entry);
+            std::string text;
+            {
+                std::ifstream file(path, std::ios::binary);
+                text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+            std::string& name = expected[path].first;
+            const size_t at = text.find("\"" + name + "\"");
+            const auto writeTime = fs::last_write_time(path);
+            if (at != std::string::npos) {
+                name.back() = name.back() == 'X' ? 'Y' : 'X';
+                text.replace(at + 1, name.size(), name);
+                std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+                fs::last_write_time(path, writeTime);
+            }
+            const auto after = library.Materialize(entry);
+            uint64_t size = 0;
+            int64_t time = 0;
+            if (at == std::string::npos || !before || !after || after == before || after->GetName() != name ||
+                !ProfileManager::GetSourceStamp(path, size, time) || size != entry.size || time != entry.modifiedTime) {
+                log << "Library: a same-size edit with the old write time served the stale " << entry.name << std::endl;
+                ok = false;
+            }
+        }
+
+        // What the library replaces: every profile loaded in full, from its compiled image
+        // (made by the first pass).
+        for (const auto& file : expected) {
+            ProfileManager::ReadProfile(file.first);
+        }
+        start = MonotonicNanoseconds();
+        for (const auto& file : expected) {
+            ok = ok && ProfileManager::ReadProfile(file.first)->GetMappings().size() == file.second.second;
+        }
+        const uint64_t loadAllNs = MonotonicNanoseconds() - start;
+
+        // A cold scan now that every profile has a current compiled image: the names come from
+        // the image headers.
+        ProfileLibrary cold;
+        start = MonotonicNanoseconds();
+        const auto coldScan = cold.Scan(directory.string());
+        const uint64_t coldNs = MonotonicNanoseconds() - start;
+        ok = ok && counts(coldScan, expected.size() + 2, expected.size(), 0, 0, "a cold scan with images") && matches(cold, "from the images");
+
+        uint64_t sharedActivationNs = 0;
+        uint64_t copiedActivationNs = 0;
+        // A compiled profile builds its rules on first use, which may come from two startup
+        // threads at once; both must get the one set.
+        if (ok && !expected.empty()) {
+            const auto profile = ProfileManager::ReadProfile(expected.begin()->first);
+            const std::vector<MappingRule>* seen[2] = {};
+            std::thread other([&profile, &seen] { seen[1] = &profile->GetMappings(); });
+            seen[0] = &profile->GetMappings();
+            other.join();
+            if (!profile->GetImage() || seen[0] != seen[1] || seen[0]->size() != expected.begin()->second.second) {
+                log << "Library: a compiled profile's rules were built twice or wrongly" << std::endl;
+                ok = false;
+            }
+
+            // Activating it hands the engine those same rules, so activating it again costs only
+            // the index, not a fresh copy of every rule and action.
+            RecordingGamepadSink activationSink;
+            VirtualController activationController(activationSink);
+            activationController.Initialize();
+            MappingEngine activationEngine(activationController);
+            ProfileManager activationManager(activationEngine);
+            const auto shared = profile->GetSharedMappings();
+            const long users = shared.use_count();
+            activationManager.ActivateProfile(*profile);
+            if (shared.get() != seen[0] || shared.use_count() != users + 1) {
+                log << "Library: activating a compiled profile did not share its rules" << std::endl;
+                ok = false;
+            }
+            constexpr int Activations = 50;
+            start = MonotonicNanoseconds();
+            for (int i = 0; i < Activations; ++i) {
+                activationEngine.LoadSharedMappings(profile->GetSharedMappings());
+            }
+            sharedActivationNs = (MonotonicNanoseconds() - start) / Activations;
+            start = MonotonicNanoseconds();
+            for (int i = 0; i < Activations; ++i) {
+                activationEngine.LoadMappings(profile->GetImage()->ToRules());
+            }
+            copiedActivationNs = (MonotonicNanoseconds() - start) / Activations;
+        }
+        fs::remove_all(directory, error);
+        if (!ok) {
+            return false;
+        }
+        auto millis = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+        std::cout << "Library: " << count << " profiles indexed by name, rescans read only changed files, activations hit "
+                  << "the LRU as expected; first scan " << millis(freshNs) << " ms, unchanged " << millis(unchangedNs) << " ms, with "
+                  << changes << " changed and " << changes << " touched " << millis(rescanNs) << " ms, cold with compiled images "
+                  << millis(coldNs) << " ms; loading all in full " << millis(loadAllNs) << " ms; activating a compiled profile "
+                  << sharedActivationNs / 1000.0 << " us with shared rules, " << copiedActivationNs / 1000.0
+                  << " us rebuilding them" << std::endl;
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return 2;
+    }
+    Logger::Start();
+
+    std::vector<InputEvent> events;
+    if (!options.capturePath.empty()) {
+        if (!LoadInputCapture(options.capturePath, events)) {
+            return 2;
+        }
+        std::cout << "Loaded " << events.size() << " records from " << options.capturePath << std::endl;
+    } else {
+        events = MakeSyntheticStream(options.syntheticFrames, options.seed);
+        std::cout << "Generated " << events.size() << " records (" << options.syntheticFrames << " frames, seed " << options.seed << ")" << std::endl;
+    }
+    if (!options.saveCapturePath.empty() && !SaveInputCapture(options.saveCapturePath, events)) {
+        return 2;
+    }
+
+    size_t inputEvents = 0;
+    for (const auto& event : events) {
+        inputEvents += event.type != InputType::Unknown;
+    }
+
+    RecordingGamepadSink sink;
+    VirtualController controller(sink);
+    controller.Initialize();
+    MappingEngine engine(controller);
+    engine.SetMatchPolicy(options.allMatches ? MatchPolicy::AllMatches : MatchPolicy::FirstMatch);
+
+    ProfileManager profileManager(engine);
+    if (!options.profilePath.empty()) {
+        const uint64_t loadStart = MonotonicNanoseconds();
+        if (!profileManager.LoadProfile(options.profilePath)) {
+            return 2;
+        }
+        const uint64_t activateStart = MonotonicNanoseconds();
+        profileManager.ActivateProfile(profileManager.GetProfiles().back());
+        const uint64_t activateEnd = MonotonicNanoseconds();
+        std::cout << "Profile load: " << static_cast<double>(activateStart - loadStart) / 1000.0 << " us, activation: "
+                  << static_cast<double>(activateEnd - activateStart) / 1000.0 << " us" << std::endl;
+    } else {
+        profileManager.ActivateProfile(MakeBuiltInProfile(options.extraRules));
+    }
+
+    // The first run is the reference for the golden comparison. Later runs start from
+    // whatever state the previous one left, so only their timing is used.
+    // Room for one report per frame, so recording the output does not count as allocations.
+    sink.Reserve(events.size());
+    RunResult best;
+    std::vector<GamepadReport> firstRunReports;
+    for (int run = 0; run < options.repeat; ++run) {
+        sink.Clear();
+
+        // Swapping in an identical rule set must never change what comes out.
+        std::atomic<bool> swapping{ run == 0 && options.swapProfile };
+        uint64_t swaps = 0;
+        std::thread swapper;
+        if (swapping) {
+            const std::vector<MappingRule> rules = profileManager.GetProfiles().empty()
+                ? MakeBuiltInProfile(options.extraRules).GetMappings()
+                : profileManager.GetProfiles().back().GetMappings();
+            swapper = std::thread([&engine, &swapping, &swaps, rules] {
+                while (swapping.load()) {
+                    engine.LoadMappings(rules);
+                    ++swaps;
+                }
+            });
+        }
+
+        const RunResult result = Replay(engine, events, options.realtime);
+        if (swapper.joinable()) {
+            swapping = false;
+            swapper.join();
+            std::cout << "Profile swaps: " << swaps << " during the first run" << std::endl;
+        }
+        if (run == 0) {
+            firstRunReports = sink.GetReports();
+            best = result;
+        } else if (result.elapsedNs < best.elapsedNs) {
+            best = result;
+        }
+        if (options.realtime) {
+            break; // Pacing dominates; repeating only makes the run longer
+        }
+    }
+
+    const double seconds = static_cast<double>(best.elapsedNs) / 1e9;
+    std::cout << "Events:       " << inputEvents << " in " << (events.size() - inputEvents) << " frames" << std::endl;
+    std::cout << "Reports sent: " << firstRunReports.size() << std::endl;
+    std::cout << "Best run:     " << seconds * 1000.0 << " ms" << std::endl;
+    if (inputEvents != 0 && best.elapsedNs != 0) {
+        std::cout << "Throughput:   " << static_cast<uint64_t>(static_cast<double>(inputEvents) / seconds) << " events/s" << std::endl;
+        std::cout << "Per event:    " << static_cast<double>(best.elapsedNs) / static_cast<double>(inputEvents) << " ns" << std::endl;
+    }
+    std::cout << "Allocations:  " << best.allocations << " during the run" << std::endl;
+
+    int exitCode = 0;
+    if (!options.writeGoldenPath.empty()) {
+        if (WriteGolden(options.writeGoldenPath, firstRunReports)) {
+            std::cout << "Wrote " << firstRunReports.size() << " reports to " << options.writeGoldenPath << std::endl;
+        } else {
+            exitCode = 2;
+        }
+    }
+    if (!options.goldenPath.empty()) {
+        std::vector<GamepadReport> golden;
+        if (!ReadGolden(options.goldenPath, golden)) {
+            exitCode = 2;
+        } else if (!CompareWithGolden(firstRunReports, golden)) {
+            exitCode = 1;
+        }
+    }
+
+    if (options.macros != 0 && !RunMacroBench(options.macros)) {
+        exitCode = 1;
+    }
+    if (options.axisChecks != 0 && !RunAxisCheck(options.axisChecks, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.mouseSeconds > 0.0) {
+        RunMouseBench(options.mouseSeconds, engine, sink);
+    }
+    if (options.rawInputs != 0 && !RunRawInputCheck(options.rawInputs, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.hidReports != 0 && !RunHidCheck(options.hidReports, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.stateReports != 0 && !RunStateCheck(options.stateReports, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.ringItems != 0 && !RunRingCheck(options.ringItems, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.logThreads != 0 && !RunLogThreadCheck(options.logThreads)) {
+        exitCode = 1;
+    }
+    if (options.gestureCombos != 0 && !RunGestureCheck(options.gestureCombos)) {
+        exitCode = 1;
+    }
+    if (options.layerEvents != 0 && !RunLayerCheck(options.layerEvents, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.turboTicks != 0 && !RunTurboCheck(options.turboTicks)) {
+        exitCode = 1;
+    }
+    if (options.padEvents != 0 && !RunPadsCheck(options.padEvents, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.outputEvents != 0 && !RunOutputsCheck(options.outputEvents, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.batchFrames != 0 && !RunBatchCheck(options.batchFrames, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.deviceSteps != 0 && !RunDeviceCheck(options.deviceSteps, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.deviceListSteps != 0 && !RunDeviceListCheck(options.deviceListSteps, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.startupStages != 0 && !RunStartupCheck(options.startupStages, options.seed)) {
+        exitCode = 1;
+    }
+    if (options.libraryProfiles != 0 && !RunLibraryCheck(options.libraryProfiles, options.seed)) {
+        exitCode = 1;
+    }
+
+    controller.Shutdown();
+    Logger::Stop();
+    return exitCode;
+}
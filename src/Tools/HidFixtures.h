@@ -0,0 +1,179 @@
+#pragma once
+
+// Report descriptors and reports of the controller families the service has to decode, for
+// CoreServiceBench --hid. Each descriptor is the one the pad reports (trimmed of feature
+// reports the parser only has to skip), with its input layout written out by hand from the
+// descriptor, so the parser's plan can be checked against something it did not produce.
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+struct HidFixtureField {
+    enum Kind : uint8_t { Buttons, Axis, Hat };
+
+    Kind kind;
+    uint16_t id;        // First ButtonID, AxisID or hat index
+    uint32_t bitOffset; // From the start of the report, report ID byte included
+    uint8_t bitSize;    // Per control
+    uint8_t count;      // Consecutive 1-bit buttons; 1 otherwise
+    int32_t logicalMin;
+    int32_t logicalMax;
+};
+
+// One report with what it should decode to. Controls not listed are released, centered
+// (hats) or ignored (axes).
+struct HidFixtureSample {
+    std::vector<uint8_t> report;
+    std::vector<uint16_t> pressedButtons;
+    int8_t hat;
+    std::vector<std::pair<uint16_t, int32_t>> axes;
+};
+
+struct HidFixture {
+    const char* name;
+    std::vector<uint8_t> descriptor;
+    uint8_t reportId; // 0 = the reports carry no ID byte
+    size_t reportBytes;
+    std::vector<HidFixtureField> fields;
+    std::vector<HidFixtureSample> samples;
+};
+
+inline std::vector<HidFixture> MakeHidFixtures() {
+    using F = HidFixtureField;
+    std::vector<HidFixture> fixtures;
+
+    // Xbox 360 and Xbox One pads on USB, as Windows presents them to HID readers (XInput
+    // compatibility collection): 16-bit sticks, both triggers on one Z axis, no report ID.
+    fixtures.push_back({ "Xbox 360 (XInput HID)",
+                         { 0x05, 0x01, 0x09, 0x05, 0xA1, 0x01,
+                           0xA1, 0x00, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x35, 0x00, 0x47, 0xFF, 0xFF, 0x00, 0x00,
+                           0x95, 0x02, 0x75, 0x10, 0x81, 0x02, 0xC0,
+                           0xA1, 0x00, 0x09, 0x33, 0x09, 0x34, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x35, 0x00, 0x47, 0xFF, 0xFF, 0x00, 0x00,
+                           0x95, 0x02, 0x75, 0x10, 0x81, 0x02, 0xC0,
+                           0xA1, 0x00, 0x09, 0x32, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x35, 0x00, 0x47, 0xFF, 0xFF, 0x00, 0x00,
+                           0x95, 0x01, 0x75, 0x10, 0x81, 0x02, 0xC0,
+                           0x05, 0x09, 0x19, 0x01, 0x29, 0x0A, 0x95, 0x0A, 0x75, 0x01, 0x81, 0x02,
+                           0x05, 0x01, 0x09, 0x39, 0x15, 0x01, 0x25, 0x08, 0x35, 0x00, 0x46, 0x3B, 0x10, 0x66, 0x0E, 0x00,
+                           0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+                           0x75, 0x02, 0x95, 0x01, 0x81, 0x03,
+                           0x75, 0x08, 0x95, 0x02, 0x81, 0x03,
+                           0xC0 },
+                         0, 14,
+                         { F{ F::Axis, 0, 0, 16, 1, 0, 65535 }, F{ F::Axis, 1, 16, 16, 1, 0, 65535 },
+                           F{ F::Axis, 3, 32, 16, 1, 0, 65535 }, F{ F::Axis, 4, 48, 16, 1, 0, 65535 },
+                           F{ F::Axis, 2, 64, 16, 1, 0, 65535 },
+                           F{ F::Buttons, 0, 80, 1, 10, 0, 65535 },
+                           F{ F::Hat, 0, 90, 4, 1, 1, 8 } },
+                         // B held, d-pad down, right trigger fully in (Z at its maximum)
+                         { { { 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0xFF, 0xFF, 0x02, 0x14, 0x00, 0x00 },
+                             { 1 }, 4, { { 0, 0 }, { 2, 32767 } } } } });
+
+    // Xbox One S / Series pad over Bluetooth: report 1, 16-bit sticks, 10-bit triggers on
+    // the Simulation page (brake, then accelerator: AxisIDs 9 and 10), a 1-8 hat and a
+    // rumble output report the parser has to step over.
+    fixtures.push_back({ "Xbox One (Bluetooth)",
+                         { 0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,
+                           0x09, 0x01, 0xA1, 0x00, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x95, 0x02, 0x75, 0x10, 0x81, 0x02, 0xC0,
+                           0x09, 0x01, 0xA1, 0x00, 0x09, 0x32, 0x09, 0x35, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x95, 0x02, 0x75, 0x10, 0x81, 0x02, 0xC0,
+                           0x05, 0x02, 0x09, 0xC5, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x95, 0x01, 0x75, 0x0A, 0x81, 0x02,
+                           0x15, 0x00, 0x25, 0x00, 0x75, 0x06, 0x95, 0x01, 0x81, 0x03,
+                           0x05, 0x02, 0x09, 0xC4, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x95, 0x01, 0x75, 0x0A, 0x81, 0x02,
+                           0x15, 0x00, 0x25, 0x00, 0x75, 0x06, 0x95, 0x01, 0x81, 0x03,
+                           0x05, 0x01, 0x09, 0x39, 0x15, 0x01, 0x25, 0x08, 0x35, 0x00, 0x46, 0x3B, 0x01, 0x66, 0x14, 0x00,
+                           0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+                           0x75, 0x04, 0x95, 0x01, 0x15, 0x00, 0x25, 0x00, 0x35, 0x00, 0x45, 0x00, 0x65, 0x00, 0x81, 0x03,
+                           0x05, 0x09, 0x19, 0x01, 0x29, 0x0F, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0F, 0x81, 0x02,
+                           0x15, 0x00, 0x25, 0x00, 0x75, 0x01, 0x95, 0x01, 0x81, 0x03,
+                           0x05, 0x0C, 0x0A, 0xB2, 0x00, 0x15, 0x00, 0x25, 0x01, 0x95, 0x01, 0x75, 0x01, 0x81, 0x02,
+                           0x15, 0x00, 0x25, 0x00, 0x75, 0x07, 0x95, 0x01, 0x81, 0x03,
+                           0x05, 0x0F, 0x09, 0x21, 0x85, 0x03, 0xA1, 0x02,
+                           0x09, 0x97, 0x15, 0x00, 0x25, 0x01, 0x75, 0x04, 0x95, 0x01, 0x91, 0x02,
+                           0x15, 0x00, 0x25, 0x00, 0x75, 0x04, 0x95, 0x01, 0x91, 0x03,
+                           0x09, 0x70, 0x15, 0x00, 0x25, 0x64, 0x75, 0x08, 0x95, 0x04, 0x91, 0x02,
+                           0x09, 0x50, 0x66, 0x01, 0x10, 0x55, 0x0E, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x91, 0x02,
+                           0x09, 0xA7, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x91, 0x02,
+                           0x65, 0x00, 0x55, 0x00, 0x09, 0x7C, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x01, 0x91, 0x02,
+                           0xC0,
+                           0xC0 },
+                         1, 17,
+                         { F{ F::Axis, 0, 8, 16, 1, 0, 65535 }, F{ F::Axis, 1, 24, 16, 1, 0, 65535 },
+                           F{ F::Axis, 2, 40, 16, 1, 0, 65535 }, F{ F::Axis, 5, 56, 16, 1, 0, 65535 },
+                           F{ F::Axis, 9, 72, 10, 1, 0, 1023 }, F{ F::Axis, 10, 88, 10, 1, 0, 1023 },
+                           F{ F::Hat, 0, 104, 4, 1, 1, 8 },
+                           F{ F::Buttons, 0, 112, 1, 15, 0, 1 } },
+                         // A held, d-pad right, left stick hard right and up, left trigger (brake) fully in
+                         { { { 0x01, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x80, 0x00, 0x80, 0xFF, 0x03, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00 },
+                             { 0 }, 2, { { 0, 32767 }, { 1, -32768 }, { 9, 32767 }, { 10, -32768 } } } } });
+
+    // DualShock 4 on USB: report 1 of 64 bytes, 8-bit sticks and triggers (Rx, Ry), hat and
+    // 14 buttons sharing a byte, vendor data (counter, IMU, touchpad) the parser skips.
+    fixtures.push_back({ "DualShock 4 (USB)",
+                         { 0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,
+                           0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x04, 0x81, 0x02,
+                           0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3B, 0x01, 0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+                           0x65, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0E, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0E, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x09, 0x20, 0x75, 0x06, 0x95, 0x01, 0x15, 0x00, 0x25, 0x7F, 0x81, 0x02,
+                           0x05, 0x01, 0x09, 0x33, 0x09, 0x34, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x09, 0x21, 0x95, 0x36, 0x81, 0x02,
+                           0x85, 0x05, 0x09, 0x22, 0x95, 0x1F, 0x91, 0x02,
+                           0x85, 0x04, 0x09, 0x23, 0x95, 0x24, 0xB1, 0x02,
+                           0xC0 },
+                         1, 64,
+                         { F{ F::Axis, 0, 8, 8, 1, 0, 255 }, F{ F::Axis, 1, 16, 8, 1, 0, 255 },
+                           F{ F::Axis, 2, 24, 8, 1, 0, 255 }, F{ F::Axis, 5, 32, 8, 1, 0, 255 },
+                           F{ F::Hat, 0, 40, 4, 1, 0, 7 },
+                           F{ F::Buttons, 0, 44, 1, 14, 0, 1 },
+                           F{ F::Axis, 3, 64, 8, 1, 0, 255 }, F{ F::Axis, 4, 72, 8, 1, 0, 255 } },
+                         // Idle, then cross held with d-pad right, left stick hard left and down, L2 fully in
+                         { { { 0x01, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x00, 0x00, 0x00 }, {}, -1, { { 0, 128 }, { 3, -32768 } } },
+                           { { 0x01, 0x00, 0xFF, 0x80, 0x80, 0x22, 0x00, 0x00, 0xFF, 0x00 },
+                             { 1 }, 2, { { 0, -32768 }, { 1, 32767 }, { 3, 32767 } } } } });
+
+    // DualSense on USB: report 1 of 64 bytes, six 8-bit axes up front, then a counter, the
+    // hat and 15 buttons, and vendor bits in and after the button bytes.
+    fixtures.push_back({ "DualSense (USB)",
+                         { 0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,
+                           0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35, 0x09, 0x33, 0x09, 0x34, 0x15, 0x00, 0x26, 0xFF, 0x00,
+                           0x75, 0x08, 0x95, 0x06, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x09, 0x20, 0x95, 0x01, 0x81, 0x02,
+                           0x05, 0x01, 0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3B, 0x01, 0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+                           0x65, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0F, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0F, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x09, 0x21, 0x95, 0x0D, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x09, 0x22, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x34, 0x81, 0x02,
+                           0x85, 0x02, 0x09, 0x23, 0x95, 0x2F, 0x91, 0x02,
+                           0xC0 },
+                         1, 64,
+                         { F{ F::Axis, 0, 8, 8, 1, 0, 255 }, F{ F::Axis, 1, 16, 8, 1, 0, 255 },
+                           F{ F::Axis, 2, 24, 8, 1, 0, 255 }, F{ F::Axis, 5, 32, 8, 1, 0, 255 },
+                           F{ F::Axis, 3, 40, 8, 1, 0, 255 }, F{ F::Axis, 4, 48, 8, 1, 0, 255 },
+                           F{ F::Hat, 0, 64, 4, 1, 0, 7 },
+                           F{ F::Buttons, 0, 68, 1, 15, 0, 1 } },
+                         // Triangle, L1 and PS held, d-pad left, L2 fully in, R2 released
+                         { { { 0x01, 0x80, 0x80, 0x80, 0x80, 0xFF, 0x00, 0x00, 0x86, 0x01, 0x01 },
+                             { 3, 4, 12 }, 6, { { 3, 32767 }, { 4, -32768 } } } } });
+
+    // A generic DirectInput pad (Logitech Dual Action layout): no report ID, four 8-bit
+    // axes, a 0-7 hat and 12 buttons, then vendor bits.
+    fixtures.push_back({ "Generic DirectInput pad",
+                         { 0x05, 0x01, 0x09, 0x04, 0xA1, 0x01, 0xA1, 0x02,
+                           0x15, 0x00, 0x26, 0xFF, 0x00, 0x35, 0x00, 0x46, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x04,
+                           0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35, 0x81, 0x02,
+                           0x25, 0x07, 0x46, 0x3B, 0x01, 0x75, 0x04, 0x95, 0x01, 0x65, 0x14, 0x09, 0x39, 0x81, 0x42,
+                           0x65, 0x00, 0x25, 0x01, 0x45, 0x01, 0x75, 0x01, 0x95, 0x0C, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0C, 0x81, 0x02,
+                           0x06, 0x00, 0xFF, 0x75, 0x01, 0x95, 0x10, 0x25, 0x01, 0x45, 0x01, 0x09, 0x01, 0x81, 0x02,
+                           0xC0,
+                           0xA1, 0x02, 0x26, 0xFF, 0x00, 0x46, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x07, 0x09, 0x02, 0x91, 0x02, 0xC0,
+                           0xC0 },
+                         0, 8,
+                         { F{ F::Axis, 0, 0, 8, 1, 0, 255 }, F{ F::Axis, 1, 8, 8, 1, 0, 255 },
+                           F{ F::Axis, 2, 16, 8, 1, 0, 255 }, F{ F::Axis, 5, 24, 8, 1, 0, 255 },
+                           F{ F::Hat, 0, 32, 4, 1, 0, 7 },
+                           F{ F::Buttons, 0, 36, 1, 12, 0, 1 } },
+                         // Buttons 1 and 12 held, hat released (8 is out of range)
+                         { { { 0x80, 0x80, 0x80, 0x80, 0x18, 0x80, 0x00, 0x00 }, { 0, 11 }, -1, { { 0, 128 } } } } });
+
+    return fixtures;
+}
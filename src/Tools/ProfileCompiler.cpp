@@ -0,0 +1,40 @@
+// Compiles JSON profiles into the binary images the service maps at startup
+// (see include/CoreService/BinaryProfile.h).
+//
+// Usage: ProfileCompiler <profile.json>... [-o <output>]
+//   Each profile is written next to its JSON as <profile.json>.bin, which is where
+//   ProfileManager looks for it. -o names the output instead (one input only).
+
+#include "CoreService/ProfileManager.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs;
+    std::string outputPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty() || (!outputPath.empty() && inputs.size() != 1)) {
+        std::cerr << "Usage: ProfileCompiler <profile.json>... [-o <output>]" << std::endl;
+        return 2;
+    }
+
+    int failures = 0;
+    for (const auto& input : inputs) {
+        const std::string output = outputPath.empty() ? ProfileManager::GetCompiledPath(input) : outputPath;
+        if (ProfileManager::CompileProfile(input, output)) {
+            std::cout << input << " -> " << output << std::endl;
+        } else {
+            std::cerr << "Failed to compile " << input << std::endl;
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}